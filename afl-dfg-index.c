@@ -0,0 +1,448 @@
+/*
+   DAFL - DFG index compiler
+   -------------------------
+
+   Compiles the DFG node lists and the list of functions to instrument into
+   a binary index (see dfgindex.h), so that the compiler pass and afl-fuzz
+   map it instead of parsing the text files on every run.
+
+   Usage: afl-dfg-index [ -c selective_cov ] -o index dfg_file[:dfg_file...]
+
+   The DFG files are the ones given to DAFL_DFG_SCORE, in the same order
+   (several arguments or a colon-separated list); selective_cov is the file
+   given to DAFL_SELECTIVE_COV. Then build with DAFL_DFG_INDEX=index
+   instead of those two, and fuzz with -p index.
+*/
+
+#define AFL_MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "config.h"
+#include "types.h"
+#include "debug.h"
+#include "alloc-inl.h"
+#include "dfgindex.h"
+
+static struct dfgi_source* srcs;      /* Sources                          */
+static struct dfgi_target* targets;   /* One per DFG                      */
+static struct dfgi_node*   nodes;     /* DFG nodes, by map index          */
+static struct dfgi_func*   funcs;     /* Functions to instrument          */
+static u32* files;                    /* File names (string offsets)      */
+static u32* file_tab;                 /* File name -> file ID             */
+
+static u32 src_cnt, target_cnt, node_cnt, func_cnt, file_cnt, file_slots;
+
+static u8* strings;                   /* String pool                      */
+static u32 strings_len, strings_size;
+
+
+static u32 add_string(const u8* s, u32 len) {
+
+  u32 off = strings_len;
+
+  while (strings_len + len + 1 > strings_size) {
+    strings_size = strings_size ? strings_size * 2 : 65536;
+    strings = ck_realloc(strings, strings_size);
+  }
+
+  memcpy(strings + off, s, len);
+  strings[off + len] = 0;
+  strings_len += len + 1;
+
+  return off;
+
+}
+
+
+/* Smallest power of two at least twice n. */
+
+static u32 table_size(u32 n) {
+
+  u32 slots = 16;
+
+  while (slots < n * 2) slots *= 2;
+  return slots;
+
+}
+
+
+static u32* new_table(u32 slots) {
+
+  u32* tab = ck_alloc(slots * 4);
+
+  memset(tab, 0xff, slots * 4);
+  return tab;
+
+}
+
+
+/* File ID of a file name (len bytes at s), added if new. */
+
+static u32 intern_file(const u8* s, u32 len) {
+
+  u8* name = ck_alloc(len + 1);
+  u32 mask, i, id;
+
+  memcpy(name, s, len);
+
+  if (file_cnt * 2 >= file_slots) {
+
+    /* Grow and rehash. */
+
+    ck_free(file_tab);
+    file_slots = table_size(file_cnt + 1) * 2;
+    file_tab   = new_table(file_slots);
+
+    for (id = 0; id < file_cnt; id++) {
+      for (i = dfgi_str_hash(strings + files[id]) & (file_slots - 1);
+           file_tab[i] != DFGI_NONE; i = (i + 1) & (file_slots - 1));
+      file_tab[i] = id;
+    }
+
+  }
+
+  mask = file_slots - 1;
+
+  for (i = dfgi_str_hash(name) & mask; file_tab[i] != DFGI_NONE;
+       i = (i + 1) & mask)
+    if (!strcmp(strings + files[file_tab[i]], name)) {
+      ck_free(name);
+      return file_tab[i];
+    }
+
+  files = ck_realloc(files, (file_cnt + 1) * 4);
+  files[file_cnt] = add_string(name, len);
+  file_tab[i] = file_cnt;
+
+  ck_free(name);
+  return file_cnt++;
+
+}
+
+
+/* Record a source file: where it is and what it holds. */
+
+static void add_source(u8* path, u32 kind) {
+
+  u8 abs_path[PATH_MAX];
+  struct stat st;
+  struct dfgi_source* src;
+
+  if (!realpath(path, abs_path)) PFATAL("Unable to open '%s'", path);
+  if (stat(abs_path, &st)) PFATAL("Unable to stat '%s'", path);
+
+  srcs = ck_realloc(srcs, (src_cnt + 1) * sizeof(struct dfgi_source));
+  src  = &srcs[src_cnt++];
+
+  src->path     = add_string(abs_path, strlen(abs_path));
+  src->kind     = kind;
+  src->mtime_ns = (u64)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+
+  if (!dfgi_hash_file(abs_path, &src->hash, &src->size))
+    PFATAL("Unable to read '%s'", path);
+
+}
+
+
+/* Read one DFG: "score max_paths file:line" per node, the way init_dfg()
+   and the pass read it. */
+
+static void read_dfg(u8* fn) {
+
+  FILE* f = fopen(fn, "r");
+  u8 node_name[4096];
+  s32 score;
+  unsigned long long max_paths;
+
+  if (!f) PFATAL("Unable to open '%s'", fn);
+
+  add_source(fn, DFGI_SRC_DFG);
+
+  targets = ck_realloc(targets, (target_cnt + 1) * sizeof(struct dfgi_target));
+  targets[target_cnt].base = node_cnt;
+
+  while (fscanf(f, "%d %llu %4095s", &score, &max_paths, node_name) == 3) {
+
+    struct dfgi_node* n;
+    u8 *colon = strrchr(node_name, ':'), *end = NULL;
+    unsigned long line = colon ? strtoul(colon + 1, (char**)&end, 10) : 0;
+
+    if (node_cnt >= DFG_MAP_SIZE - 1)
+      FATAL("Input DFG is too large (check DFG_MAP_SIZE)");
+
+    nodes = ck_realloc(nodes, (node_cnt + 1) * sizeof(struct dfgi_node));
+    n = &nodes[node_cnt++];
+
+    n->score     = score;
+    n->max_paths = max_paths;
+    n->next      = DFGI_NONE;
+
+    /* Not a file:line node: it keeps its index, but no block maps to it. */
+
+    if (line && !*end && line < DFGI_NONE) {
+      n->file = intern_file(node_name, colon - node_name);
+      n->line = line;
+    } else {
+      n->file = DFGI_NONE;
+      n->line = 0;
+    }
+
+  }
+
+  fclose(f);
+
+  targets[target_cnt].nodes = node_cnt - targets[target_cnt].base;
+  target_cnt++;
+
+}
+
+
+/* Read the list of functions to instrument: "file:func" per line. */
+
+static void read_cov(u8* fn) {
+
+  FILE* f = fopen(fn, "r");
+  u8 line[4096];
+
+  if (!f) PFATAL("Unable to open '%s'", fn);
+
+  add_source(fn, DFGI_SRC_COV);
+
+  while (fgets(line, sizeof(line), f)) {
+
+    struct dfgi_func* fu;
+    u8* colon;
+    u32 len = strlen(line);
+
+    while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      line[--len] = 0;
+
+    if (!len) continue;
+
+    /* Like the pass, take everything before the first ':' as the file. */
+
+    colon = strchr(line, ':');
+
+    funcs = ck_realloc(funcs, (func_cnt + 1) * sizeof(struct dfgi_func));
+    fu = &funcs[func_cnt++];
+
+    fu->file  = intern_file(line, colon ? colon - line : len);
+    fu->name  = colon ? add_string(colon + 1, strlen(colon + 1))
+                      : add_string(line, len);
+    fu->entry = add_string(line, len);
+    fu->next  = DFGI_NONE;
+
+  }
+
+  fclose(f);
+
+}
+
+
+/* Hash (file, line) to nodes, chaining nodes at the same line in order. */
+
+static u32* build_line_tab(u32 slots) {
+
+  u32* tab = new_table(slots);
+  u32 mask = slots - 1, n, i;
+
+  for (n = 0; n < node_cnt; n++) {
+
+    if (nodes[n].file == DFGI_NONE) continue;
+
+    for (i = dfgi_line_hash(nodes[n].file, nodes[n].line) & mask;
+         tab[i] != DFGI_NONE; i = (i + 1) & mask) {
+
+      struct dfgi_node* first = &nodes[tab[i]];
+
+      if (first->file == nodes[n].file && first->line == nodes[n].line) {
+        while (first->next != DFGI_NONE) first = &nodes[first->next];
+        first->next = n;
+        break;
+      }
+
+    }
+
+    if (tab[i] == DFGI_NONE) tab[i] = n;
+
+  }
+
+  return tab;
+
+}
+
+
+/* Hash function names to entries, chaining entries of the same name. */
+
+static u32* build_func_tab(u32 slots) {
+
+  u32* tab = new_table(slots);
+  u32 mask = slots - 1, n, i;
+
+  for (n = 0; n < func_cnt; n++) {
+
+    for (i = dfgi_str_hash(strings + funcs[n].name) & mask;
+         tab[i] != DFGI_NONE; i = (i + 1) & mask) {
+
+      struct dfgi_func* first = &funcs[tab[i]];
+
+      if (!strcmp(strings + first->name, strings + funcs[n].name)) {
+        while (first->next != DFGI_NONE) first = &funcs[first->next];
+        first->next = n;
+        break;
+      }
+
+    }
+
+    if (tab[i] == DFGI_NONE) tab[i] = n;
+
+  }
+
+  return tab;
+
+}
+
+
+/* Append len bytes to the index being written, 8-byte aligned. */
+
+static u64 put_section(FILE* f, const void* data, u64 len) {
+
+  static const u8 zero[8];
+  u64 off = ftell(f);
+
+  if (off & 7) {
+    fwrite(zero, 1, 8 - (off & 7), f);
+    off += 8 - (off & 7);
+  }
+
+  if (len && fwrite(data, 1, len, f) != len) PFATAL("Short write to index");
+  return off;
+
+}
+
+
+static void write_index(u8* fn) {
+
+  struct dfgi_header h;
+  u8* tmp = alloc_printf("%s.tmp", fn);
+  FILE* f;
+  u32 *line_tab, *func_tab;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, DFGI_MAGIC, sizeof(h.magic));
+  h.version = DFGI_VERSION;
+
+  h.src_cnt     = src_cnt;
+  h.target_cnt  = target_cnt;
+  h.node_cnt    = node_cnt;
+  h.file_cnt    = file_cnt;
+  h.func_cnt    = func_cnt;
+  h.line_slots  = table_size(node_cnt);
+  h.file_slots  = table_size(file_cnt);
+  h.func_slots  = table_size(func_cnt);
+
+  /* Leave the string pool non-empty, so an index can always be checked. */
+
+  if (!strings_len) add_string("", 0);
+  h.strings_len = strings_len;
+
+  line_tab = build_line_tab(h.line_slots);
+  func_tab = build_func_tab(h.func_slots);
+
+  /* The table built while interning may be larger than needed. */
+
+  ck_free(file_tab);
+  file_slots = h.file_slots;
+  file_tab   = new_table(file_slots);
+
+  {
+    u32 id, i, mask = file_slots - 1;
+    for (id = 0; id < file_cnt; id++) {
+      for (i = dfgi_str_hash(strings + files[id]) & mask;
+           file_tab[i] != DFGI_NONE; i = (i + 1) & mask);
+      file_tab[i] = id;
+    }
+  }
+
+  f = fopen(tmp, "w");
+  if (!f) PFATAL("Unable to create '%s'", tmp);
+
+  fwrite(&h, sizeof(h), 1, f);
+
+  h.src_off      = put_section(f, srcs, (u64)src_cnt * sizeof(struct dfgi_source));
+  h.target_off   = put_section(f, targets, (u64)target_cnt * sizeof(struct dfgi_target));
+  h.node_off     = put_section(f, nodes, (u64)node_cnt * sizeof(struct dfgi_node));
+  h.line_off     = put_section(f, line_tab, (u64)h.line_slots * 4);
+  h.file_off     = put_section(f, files, (u64)file_cnt * 4);
+  h.file_tab_off = put_section(f, file_tab, (u64)h.file_slots * 4);
+  h.func_off     = put_section(f, funcs, (u64)func_cnt * sizeof(struct dfgi_func));
+  h.func_tab_off = put_section(f, func_tab, (u64)h.func_slots * 4);
+  h.str_off      = put_section(f, strings, strings_len);
+  h.size         = ftell(f);
+
+  rewind(f);
+  fwrite(&h, sizeof(h), 1, f);
+
+  if (fclose(f)) PFATAL("Unable to write '%s'", tmp);
+  if (rename(tmp, fn)) PFATAL("Unable to rename '%s'", tmp);
+
+  OKF("Wrote '%s': %u DFG%s, %u nodes, %u functions, %u files, %llu bytes.",
+      fn, target_cnt, target_cnt == 1 ? "" : "s", node_cnt, func_cnt,
+      file_cnt, h.size);
+
+  ck_free(line_tab);
+  ck_free(func_tab);
+  ck_free(tmp);
+
+}
+
+
+int main(int argc, char** argv) {
+
+  u8 *out = NULL, *cov = NULL;
+  s32 opt, i;
+
+  SAYF(cCYA "afl-dfg-index " cBRI VERSION cRST "\n");
+
+  while ((opt = getopt(argc, argv, "+o:c:")) > 0)
+
+    switch (opt) {
+
+      case 'o': out = optarg; break;
+      case 'c': cov = optarg; break;
+
+      default:
+        FATAL("Usage: %s [ -c selective_cov ] -o index dfg_file[:dfg_file...]",
+              argv[0]);
+
+    }
+
+  if (!out || (optind == argc && !cov))
+    FATAL("Usage: %s [ -c selective_cov ] -o index dfg_file[:dfg_file...]",
+          argv[0]);
+
+  if (cov) read_cov(cov);
+
+  for (i = optind; i < argc; i++) {
+
+    u8 *list = ck_strdup(argv[i]), *fn, *save = NULL;
+
+    for (fn = strtok_r(list, ":", (char**)&save); fn;
+         fn = strtok_r(NULL, ":", (char**)&save))
+      read_dfg(fn);
+
+    ck_free(list);
+
+  }
+
+  write_index(out);
+
+  return 0;
+
+}
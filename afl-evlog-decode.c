@@ -0,0 +1,187 @@
+/*
+   DAFL - event log decoder
+   ------------------------
+
+   Converts the binary event log written by afl-fuzz
+   (<out_dir>/unique_dafl.evlog) back into the text of the old
+   unique_dafl.log, one line per event.
+
+   Usage: afl-evlog-decode [ -l level ] [ unique_dafl.evlog [ output.log ] ]
+
+   Reads stdin and writes stdout when the file names are omitted. With -l,
+   events below the given level (debug, info, warn, error) are skipped.
+*/
+
+#define AFL_MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "types.h"
+#include "debug.h"
+#include "evlog.h"
+
+/* Prints one record using the event's format, one conversion at a time.
+   Returns 0 if the payload does not match the format. */
+
+static u8 print_record(FILE* out, u16 id, u8* p, u16 len) {
+
+  static char str[EVLOG_MAX_STR + 1];
+
+  const char* f = evlog_desc[id].fmt;
+  u8* end = p + len;
+
+  while (*f) {
+
+    const char* lit = strchr(f, '%');
+    char spec[32];
+    u32 slen;
+    u8  cls;
+    u64 v;
+
+    if (!lit) {
+      fputs(f, out);
+      break;
+    }
+
+    fwrite(f, 1, lit - f, out);
+
+    cls = evlog_spec(lit, &slen);
+    f = lit + slen;
+
+    if (slen >= sizeof(spec)) return 0;
+
+    memcpy(spec, lit, slen);
+    spec[slen] = 0;
+
+    if (cls == EVA_NONE) {
+      fputs(slen == 2 && lit[1] == '%' ? "%" : spec, out);
+      continue;
+    }
+
+    if (cls == EVA_STR) {
+
+      u16 n;
+
+      if (p + 2 > end) return 0;
+      memcpy(&n, p, 2);
+      if (p + 2 + n > end || n > EVLOG_MAX_STR) return 0;
+
+      memcpy(str, p + 2, n);
+      str[n] = 0;
+      p += 2 + n;
+
+      fprintf(out, spec, str);
+      continue;
+
+    }
+
+    if (p + 8 > end) return 0;
+    memcpy(&v, p, 8);
+    p += 8;
+
+    switch (cls) {
+
+      case EVA_INT:  fprintf(out, spec, (u32)v); break;
+      case EVA_SINT: fprintf(out, spec, (s32)v); break;
+      case EVA_LONG: fprintf(out, spec, (unsigned long long)v); break;
+
+      case EVA_DOUBLE: {
+          double d;
+          memcpy(&d, &v, sizeof(d));
+          fprintf(out, spec, d);
+          break;
+        }
+
+    }
+
+  }
+
+  return p == end;
+
+}
+
+
+int main(int argc, char** argv) {
+
+  static u8 payload[65536];
+
+  struct evlog_header hdr;
+  FILE *in = stdin, *out = stdout;
+  s32 min_level = EV_DEBUG, opt;
+  u64 total = 0, skipped = 0;
+  u16 rec[2];
+
+  while ((opt = getopt(argc, argv, "+l:h")) > 0)
+
+    switch (opt) {
+
+      case 'l':
+        min_level = evlog_parse_level(optarg);
+        if (min_level < 0) FATAL("Unknown level '%s'", optarg);
+        break;
+
+      default:
+        SAYF("Usage: %s [ -l level ] [ unique_dafl.evlog [ output.log ] ]\n\n"
+             "Decodes a DAFL binary event log into text. Uses stdin / stdout\n"
+             "when file names are omitted. -l skips events below the given\n"
+             "level (debug, info, warn, error).\n", argv[0]);
+        exit(1);
+
+    }
+
+  if (argc - optind > 2) FATAL("Too many arguments (try -h)");
+
+  if (optind < argc && strcmp(argv[optind], "-")) {
+    in = fopen(argv[optind], "rb");
+    if (!in) PFATAL("Unable to open '%s'", argv[optind]);
+  }
+
+  if (optind + 1 < argc) {
+    out = fopen(argv[optind + 1], "w");
+    if (!out) PFATAL("Unable to create '%s'", argv[optind + 1]);
+  }
+
+  if (fread(&hdr, sizeof(hdr), 1, in) != 1)
+    FATAL("Input is too short to be an event log");
+
+  if (memcmp(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic)))
+    FATAL("Not an event log (bad magic)");
+
+  if (hdr.version != EVLOG_VERSION || hdr.event_count > EV_COUNT)
+    FATAL("Unsupported event log version %u (%u events)", hdr.version,
+          hdr.event_count);
+
+  while (fread(rec, sizeof(rec), 1, in) == 1) {
+
+    if (rec[1] && fread(payload, rec[1], 1, in) != 1)
+      FATAL("Truncated record at event %llu", total);
+
+    if (rec[0] >= EV_COUNT) FATAL("Bad event id %u", rec[0]);
+
+    total++;
+
+    if (evlog_desc[rec[0]].level < min_level) {
+      skipped++;
+      continue;
+    }
+
+    if (!print_record(out, rec[0], payload, rec[1]))
+      FATAL("Malformed %s record at event %llu", evlog_desc[rec[0]].name,
+            total);
+
+  }
+
+  if (ferror(in)) PFATAL("Read error");
+
+  if (fclose(out)) PFATAL("Write error");
+
+  if (optind + 1 < argc)
+    OKF("Decoded %llu events (%llu skipped).", total, skipped);
+
+  return 0;
+
+}
@@ -42,6 +42,15 @@
 #include "debug.h"
 #include "alloc-inl.h"
 #include "hash.h"
+#include "bitmap-inl.h"
+#include "vlog.h"
+#include "evlog.h"
+#include "ckpt.h"
+#include "calcache.h"
+#include "pack.h"
+#include "dfgshm.h"
+#include "syncd.h"
+#include "dfgindex.h"
 #include "afl-fuzz.h"
 
 #include <stdio.h>
@@ -57,6 +66,8 @@
 #include <termios.h>
 #include <dlfcn.h>
 #include <sched.h>
+#include <pthread.h>
+#include <stdarg.h>
 
 #include <sys/wait.h>
 #include <sys/time.h>
@@ -65,6 +76,8 @@
 #include <sys/types.h>
 #include <sys/resource.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/file.h>
 
@@ -79,6 +92,10 @@
 
 #ifdef __linux__
 #  define HAVE_AFFINITY 1
+#  define HAVE_INOTIFY 1
+#  include <sys/inotify.h>
+#  include <sys/syscall.h>
+#  include <linux/mempolicy.h>
 #endif /* __linux__ */
 
 /* A toggle to export some variables when building as a library. Not very
@@ -99,7 +116,19 @@
 static u64 moo_operator_persistent[OPERATOR_NUM],
     moo_operator_total[OPERATOR_NUM],
     moo_operator_val[OPERATOR_NUM];
-static FILE *moo_vertical_log_file;
+
+/* Mutation log: afl-fuzz pushes vlog_records into a single-producer,
+   single-consumer ring; a writer thread drains it into vertical.bin. */
+
+static struct vlog_record vlog_ring[VLOG_RING_SIZE];
+static u64 vlog_head,                 /* Next slot to fill (fuzzer)       */
+           vlog_tail,                 /* Next slot to write (writer)      */
+           vlog_stalls;               /* Times the ring was full          */
+static u8  vlog_stop;                 /* Writer should drain and exit     */
+static s32 vlog_errno;                /* Writer failed with this errno    */
+static s32 vlog_fd = -1;              /* Descriptor of vertical.bin       */
+static pid_t vlog_owner;              /* PID that started the writer      */
+static pthread_t vlog_thread;
 static u8 use_vertical_navigation = 0; // Option given by -v
 
 static u8 vertical_is_persistent = 0;
@@ -117,6 +146,12 @@ static enum AddQueueMode add_queue_mode = ADD_QUEUE_DEFAULT;
 
 static struct vertical_manager *vertical_manager = NULL;
 static struct pareto_scheduler *pareto_scheduler = NULL;
+
+static struct dafl_target *dafl_targets;  /* Targets, with several (-p a:b) */
+static u32 dafl_target_cnt,               /* Number of dafl_targets[]       */
+           dafl_target_cur,               /* Target in focus                */
+           dafl_target_seen;              /* dafl_target_log[] handed out   */
+static struct vector *dafl_target_log;    /* Entries in order of addition   */
 // End vertical navigation
 
 EXP_ST u8 *in_dir,                    /* Input directory with test cases  */
@@ -158,6 +193,8 @@ EXP_ST u8  skip_deterministic,        /* Skip deterministic stages?       */
            bitmap_changed = 1,        /* Time to update bitmap?           */
            qemu_mode,                 /* Running in QEMU mode?            */
            skip_requested,            /* Skip request, via SIGUSR1        */
+           dump_requested,            /* Scheduler dump, via SIGUSR2      */
+           debug_stats,               /* Extra scheduler fuzzer_stats     */
            run_over10m,               /* Run time over 10 minutes?        */
            persistent_mode,           /* Running in persistent mode?      */
            deferred_mode,             /* Deferred forkserver mode?        */
@@ -173,7 +210,15 @@ static s32 forksrv_pid,               /* PID of the fork server           */
            child_pid = -1,            /* PID of the fuzzed program        */
            out_dir_fd = -1;           /* FD of the lock file              */
 
+static u32 prev_timed_out;            /* Last child of the fork server    */
+                                      /* was killed on a timeout?         */
+
 EXP_ST u8* trace_bits;                /* SHM with code coverage bitmap    */
+
+static u8 defer_classify,             /* Leave counts raw in run_target() */
+          trace_raw;                  /* trace_bits[] not bucketed yet    */
+
+static fused_scan_fn fused_trace_scan; /* Best fused scan for this CPU    */
 EXP_ST u32* dfg_bits;                 /* SHM with DFG coverage bitmap     */
 EXP_ST u32 *dfg_count_map;            /* DFG count bitmap                 */
 EXP_ST u32* last_location;         /* Last location of the target      */
@@ -191,6 +236,8 @@ EXP_ST u8  virgin_bits[MAP_SIZE],     /* Regions yet untouched by fuzzing */
 
 static u8  var_bytes[MAP_SIZE];       /* Bytes that appear to be variable */
 
+static u32 map_size = MAP_SIZE;       /* Bytes of trace_bits[] in use     */
+
 static s32 shm_id;                    /* ID of the SHM for code coverage  */
 static s32 shm_id_dfg;                /* ID of the SHM for DFG coverage   */
 static s32 shm_id_dfg_count;          /* ID of the SHM for DFG path count      */
@@ -254,6 +301,20 @@ static u32 master_id, master_max;     /* Master instance job splitting    */
 
 static u32 syncing_case;              /* Syncing with case #...           */
 
+static u64 sync_execs_saved;          /* Synced cases known, not executed */
+
+static s32 syncd_fd = -1;             /* Connection to afl-syncd, if any  */
+static u8* syncd_addr;                /* Its address (AFL_SYNCD)          */
+static u8* syncd_in;                  /* Message being received from it   */
+static u32 syncd_in_have;             /* Bytes of it received so far      */
+static u8* syncd_out;                 /* Messages waiting to be sent      */
+static u32 syncd_out_len,             /* Bytes in syncd_out               */
+           syncd_out_off;             /* Bytes of them sent so far        */
+static u64 syncd_pushed,              /* Entries pushed to afl-syncd      */
+           syncd_pulled;              /* Cases received from it           */
+
+static void syncd_push(struct queue_entry* q, u8* mem);
+
 static s32 stage_cur_byte,            /* Byte offset of current stage op  */
            stage_cur_val;             /* Value used for stage op          */
 
@@ -275,9 +336,14 @@ static s32 cpu_core_count;            /* CPU core count                   */
 #ifdef HAVE_AFFINITY
 
 static s32 cpu_aff = -1;       	      /* Selected CPU core                */
+static s32 cpu_node = -1;             /* NUMA node of cpu_aff, if known   */
+static s32* cpu_list;                 /* CPUs given in AFL_CPU_LIST       */
+static u32 cpu_list_len;              /* Number of cpu_list[] entries     */
 
 #endif /* HAVE_AFFINITY */
 
+static u32 pool_size;                 /* Executors (AFL_EXEC_POOL)        */
+
 static FILE* plot_file;               /* Gnuplot output file              */
 
 static double *proximity_score_cache = NULL; /* Cache for proximity scores */
@@ -285,21 +351,156 @@ static double proximity_score_reduction = 0.1; /* Reduction factor for proximity
 static s32 proximity_score_allowance = -1;  /* Node will be treated as new coverage up to this count */
 static u32 max_queue_size = 4096;          /* Maximum input in queue            */
 static u32 unique_dafl_input = 0;     /* Number of unique input with new coverage on def-use graph */
-static FILE* unique_dafl_log_file = NULL; /* File to record unique input with new coverage on def-use graph */
 static u8 ignore_crash_loc = 0;         /* Ignore crash location in unique input */
 static u8 use_adaptive_scheduler_selection = 0;    /* Scheduler selection mode */
 static double scheduler_select_ratio = 0.5; /* Ratio for vertical scheduler selection */
 static struct stride_scheduler *stride_scheduler = NULL; /* Stride scheduler */
 
-#define LOGF(x...) do { \
-    if (not_on_tty) \
-      ACTF_NNL(x); \
-    if (unique_dafl_log_file) { \
-      fprintf(unique_dafl_log_file, x); \
-    } \
+/* Event log, see evlog.h. Events below the active level never get their
+   arguments evaluated. The dead printf() only has the compiler check the
+   arguments against the event's format. */
+
+static s32 evlog_fd = -1;             /* unique_dafl.evlog                */
+static u8  evlog_level = EV_DEBUG,    /* Lowest level written to the file */
+           evlog_console = EV_DEBUG,  /* Lowest level echoed w/o the UI   */
+           evlog_active = EV_DEBUG;   /* min() of the two above           */
+static pid_t evlog_owner;             /* PID that owns the buffer         */
+static u32 evlog_fill;                /* Bytes pending in evlog_buf       */
+static u8  evlog_buf[EVLOG_BUF_SIZE]; /* Records not yet written          */
+
+#define EVLOG(id, ...) do { \
+    if (0) printf(id##_FMT, __VA_ARGS__); \
+    if (id##_LEVEL >= EVLOG_MIN_LEVEL && id##_LEVEL >= evlog_active) \
+      evlog_write(id, __VA_ARGS__); \
   } while (0)
 
-// fflush(unique_dafl_log_file);     \
+static void evlog_flush(void) {
+
+  if (evlog_fd < 0 || !evlog_fill) return;
+
+  ck_write(evlog_fd, evlog_buf, evlog_fill, "unique_dafl.evlog");
+  evlog_fill = 0;
+
+}
+
+static void evlog_write(u32 id, ...) {
+
+  static u8 rec[65536];
+
+  const struct evlog_desc* d = &evlog_desc[id];
+  const char* f;
+  va_list args;
+  u8* out;
+
+  if (not_on_tty && d->level >= evlog_console) {
+    va_start(args, id);
+    SAYF(cLBL "[*] " cRST);
+    vprintf(d->fmt, args);
+    va_end(args);
+  }
+
+  if (evlog_fd < 0 || d->level < evlog_level) return;
+
+  /* The record is built in rec[] first, as its size is only known once
+     the string arguments have been measured. */
+
+  out = rec + 4;
+
+  va_start(args, id);
+
+  for (f = d->fmt; *f; f++) {
+
+    u32 len;
+    u64 v;
+
+    if (*f != '%') continue;
+
+    switch (evlog_spec(f, &len)) {
+
+      case EVA_INT:    v = va_arg(args, u32); break;
+      case EVA_SINT:   v = (s64)va_arg(args, s32); break;
+      case EVA_LONG:   v = va_arg(args, u64); break;
+
+      case EVA_DOUBLE: {
+          double dv = va_arg(args, double);
+          memcpy(&v, &dv, sizeof(v));
+          break;
+        }
+
+      case EVA_STR: {
+          const char* str = va_arg(args, const char*);
+          u16 slen;
+          if (!str) str = "(null)";
+          slen = MIN(strlen(str), EVLOG_MAX_STR);
+          if (out + 2 + slen > rec + sizeof(rec)) slen = 0;
+          memcpy(out, &slen, 2);
+          memcpy(out + 2, str, slen);
+          out += 2 + slen;
+          f += len - 1;
+          continue;
+        }
+
+      default: f += len - 1; continue;
+
+    }
+
+    if (out + 8 > rec + sizeof(rec)) break;
+
+    memcpy(out, &v, 8);
+    out += 8;
+    f += len - 1;
+
+  }
+
+  va_end(args);
+
+  {
+    u16 hdr[2] = { id, out - rec - 4 };
+    memcpy(rec, hdr, 4);
+  }
+
+  if (evlog_fill + (out - rec) > EVLOG_BUF_SIZE) evlog_flush();
+
+  if (out - rec > EVLOG_BUF_SIZE)
+    ck_write(evlog_fd, rec, out - rec, "unique_dafl.evlog");
+  else {
+    memcpy(evlog_buf + evlog_fill, rec, out - rec);
+    evlog_fill += out - rec;
+  }
+
+}
+
+/* Flush on the way out (atexit handler). Forked children inherit the
+   buffer, so only the process that opened the log writes it. */
+
+static void evlog_close(void) {
+
+  if (evlog_fd < 0 || getpid() != evlog_owner) return;
+
+  evlog_flush();
+  close(evlog_fd);
+  evlog_fd = -1;
+
+}
+
+static void evlog_open(u8* fn) {
+
+  struct evlog_header hdr;
+
+  evlog_fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (evlog_fd < 0) PFATAL("Unable to create '%s'", fn);
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic));
+  hdr.version     = EVLOG_VERSION;
+  hdr.event_count = EV_COUNT;
+
+  ck_write(evlog_fd, &hdr, sizeof(hdr), fn);
+
+  evlog_owner = getpid();
+  atexit(evlog_close);
+
+}
 
 static struct queue_entry *queue,     /* Fuzzing queue (linked list)      */
                           *queue_cur, /* Current offset within the queue  */
@@ -343,11 +544,17 @@ u8 use_old_dafl_coverage = 0;
 
 static struct hashmap *dfg_hashmap;     /* Hashmap for DFG coverage         */
 
+static struct arena queue_arena;        /* Queue entries, packed DFG maps   */
+
 static struct hashmap *unique_mem_hashmap; /* Hashmap for unique memory valuation */
 
 static u32 no_dfg_schedule = 0;      /* No DFG-based seed scheduling     */
 static u32 t_x = 0;                   /* To test AFLGo's scheduling       */
 
+static double last_factor_prox,       /* Last input to calculate_factor() */
+              last_factor;            /* ...and what it returned          */
+static u64 factor_calls;              /* Number of calculate_factor()s    */
+
 static u8* (*post_handler)(u8* buf, u32* len);
 
 /* Interesting values, as per config.h */
@@ -469,6 +676,107 @@ static void shuffle_ptrs(void** ptrs, u32 cnt) {
 
 #ifdef HAVE_AFFINITY
 
+
+/* Read AFL_CPU_LIST: CPU numbers and ranges separated by commas, in the
+   order they are to be used ("4,5" or "0-3"). */
+
+static void read_cpu_list(u8* str) {
+
+  u8* p = str;
+  u32 a, b;
+  s32 n;
+
+  while (*p) {
+
+    if (sscanf(p, "%u%n", &a, &n) != 1) break;
+    p += n;
+    b = a;
+
+    if (*p == '-') {
+      if (sscanf(++p, "%u%n", &b, &n) != 1 || b < a) break;
+      p += n;
+    }
+
+    if (b >= CPU_SETSIZE) break;
+
+    cpu_list = ck_realloc(cpu_list, (cpu_list_len + b - a + 1) * sizeof(s32));
+    while (a <= b) cpu_list[cpu_list_len++] = a++;
+
+    if (*p == ',') p++; else if (*p) break;
+
+  }
+
+  if (*p || !cpu_list_len) FATAL("Invalid value of AFL_CPU_LIST");
+
+}
+
+
+/* NUMA node of a CPU, from sysfs. Returns -1 if unknown. */
+
+static s32 get_cpu_node(u32 cpu) {
+
+  u8* fn = alloc_printf("/sys/devices/system/cpu/cpu%u", cpu);
+  DIR* d = opendir(fn);
+  struct dirent* de;
+  s32 node = -1;
+
+  ck_free(fn);
+  if (!d) return -1;
+
+  while ((de = readdir(d)))
+    if (!strncmp(de->d_name, "node", 4) && isdigit(de->d_name[4])) {
+      node = atoi(de->d_name + 4);
+      break;
+    }
+
+  closedir(d);
+  return node;
+
+}
+
+
+/* Bind the calling thread to cpu_list[slot], or to the CPUs of the whole
+   instance if slot is negative: the first one, or one per executor with
+   AFL_EXEC_POOL. */
+
+static void bind_cpu_slot(s32 slot) {
+
+  cpu_set_t c;
+  u32 i;
+
+  CPU_ZERO(&c);
+
+  if (slot >= 0) CPU_SET(cpu_list[slot % cpu_list_len], &c);
+  else for (i = 0; i < (pool_size ? MIN(pool_size, cpu_list_len) : 1); i++)
+    CPU_SET(cpu_list[i], &c);
+
+  if (sched_setaffinity(0, sizeof(c), &c))
+    PFATAL("sched_setaffinity failed");
+
+}
+
+
+/* Take the placement given in AFL_CPU_LIST (normally by afl-fuzz launch)
+   instead of looking for a free core. */
+
+static void bind_to_cpu_list(u8* str) {
+
+  read_cpu_list(str);
+
+  if (pool_size > cpu_list_len)
+    WARNF("AFL_CPU_LIST has fewer CPUs than there are executors.");
+
+  bind_cpu_slot(-1);
+
+  cpu_aff  = cpu_list[0];
+  cpu_node = get_cpu_node(cpu_aff);
+
+  OKF("Bound to CPU #%u (NUMA node %d) as given in AFL_CPU_LIST.",
+      cpu_aff, cpu_node);
+
+}
+
+
 /* Build a list of processes bound to specific cores. Returns -1 if nothing
    can be found. Assumes an upper bound of 4k CPUs. */
 
@@ -481,7 +789,14 @@ static void bind_to_free_cpu(void) {
   u8 cpu_used[4096] = { 0 };
   u32 i;
 
-  if (cpu_core_count < 2) return;
+  if (getenv("AFL_CPU_LIST")) {
+    bind_to_cpu_list(getenv("AFL_CPU_LIST"));
+    return;
+  }
+
+  /* Executors are spread over cores by the scheduler. */
+
+  if (pool_size || cpu_core_count < 2) return;
 
   if (getenv("AFL_NO_AFFINITY")) {
 
@@ -579,10 +894,32 @@ static void bind_to_free_cpu(void) {
   if (sched_setaffinity(0, sizeof(c), &c))
     PFATAL("sched_setaffinity failed");
 
+  cpu_node = get_cpu_node(i);
+
 }
 
 #endif /* HAVE_AFFINITY */
 
+
+/* Ask for the pages of a freshly attached segment to come from our NUMA
+   node, so that the maps we share with the target stay local to both of
+   us. Best effort: nothing happens if the node is unknown. */
+
+static void shm_prefer_node(void* addr, u32 len, s32 node) {
+
+#if defined(HAVE_AFFINITY) && defined(SYS_mbind)
+
+  unsigned long mask;
+
+  if (node < 0 || node >= sizeof(mask) * 8) return;
+
+  mask = 1UL << node;
+  syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0);
+
+#endif /* HAVE_AFFINITY && SYS_mbind */
+
+}
+
 #ifndef IGNORE_FINDS
 
 /* Helper function to compare buffers; returns first and last differing offset. We
@@ -953,7 +1290,7 @@ enum VerticalMode stride_scheduler_get_mode_adaptive(struct stride_scheduler *st
     }
     stride->previous = initial_mode;
     stride->current = mode;
-    LOGF("[adaptive] [cur %d] [new %d] [h %u] [v %u] [h3 %f] [h12 %f] [v3 %f] [v12 %f] [rst %d]\n", initial_mode, mode, h_count, v_count, h3, h12, v3, v12, reset);
+    EVLOG(EV_ADAPTIVE, initial_mode, mode, h_count, v_count, h3, h12, v3, v12, reset);
     return mode;
   }
   // Fallback
@@ -1118,7 +1455,7 @@ void vertical_entry_sorted_insert(struct vertical_manager *manager, struct verti
   if (entry == NULL)
     return;
   if (update)
-    LOGF("[vert-entry] [insert] [entry %u] [vals %u] [entries %u]\n", entry->hash, hashmap_size(entry->value_map), vector_size(entry->entries) + vector_size(entry->old_entries));
+    EVLOG(EV_VERT_ENTRY_INSERT, entry->hash, hashmap_size(entry->value_map), vector_size(entry->entries) + vector_size(entry->old_entries));
   struct vertical_entry *cur = manager->head;
   if (!cur) {
     manager->head = entry;
@@ -1163,7 +1500,7 @@ void vertical_entry_sorted_insert(struct vertical_manager *manager, struct verti
       cur->next = entry;
       entry->next = NULL;
       if (hashmap_size(entry->value_map) < hashmap_size(cur->value_map)) {
-        LOGF("[error] [vert-entry] [insert] [error] [entry %u] [vals %u] [entries %u] [cur %u] [cur-vals %u] [cur-entries %u]\n", entry->hash, hashmap_size(entry->value_map), vector_size(entry->entries) + vector_size(entry->old_entries), cur->hash, hashmap_size(cur->value_map), vector_size(cur->entries) + vector_size(cur->old_entries));
+        EVLOG(EV_ERR_VERT_ENTRY_INSERT, entry->hash, hashmap_size(entry->value_map), vector_size(entry->entries) + vector_size(entry->old_entries), cur->hash, hashmap_size(cur->value_map), vector_size(cur->entries) + vector_size(cur->old_entries));
       }
       break;
     } else if (hashmap_size(entry->value_map) < hashmap_size(cur->next->value_map)) {
@@ -1348,8 +1685,7 @@ struct queue_entry *pareto_scheduler_moo_pop(struct pareto_scheduler *scheduler)
   if (selected) {
     push_back(scheduler->moo_recycled, selected);
     pareto_info_set(&selected->moo_info, PARETO_RECYCLED, vector_size(scheduler->moo_recycled) - 1);
-    LOGF("[sel] [moo] [id %d] [dfg-path %u] [dfg-path-count %llu] [time %llu]\n", 
-      selected->entry_id, selected->dfg_cksum, 
+    EVLOG(EV_SEL_MOO, selected->entry_id, selected->dfg_cksum, 
       pareto_scheduler_get_dfg_count(scheduler, selected->dfg_cksum), get_cur_time() - start_time);
   }
   return selected;
@@ -1385,8 +1721,7 @@ void pareto_scheduler_moo_remove(struct pareto_scheduler *scheduler, struct queu
   }
   struct queue_entry *removed = vector_pop(vec, index);
   if (removed != entry) {
-    LOGF("[error] [moo] [remove] [id %d] [status %d] [index %d] [removed %d] [time %llu]\n", 
-      entry->entry_id, entry->moo_info.status, entry->moo_info.index, removed ? removed->entry_id : -1, get_cur_time() - start_time);
+    EVLOG(EV_ERR_MOO_REMOVE, entry->entry_id, entry->moo_info.status, entry->moo_info.index, removed ? removed->entry_id : -1, get_cur_time() - start_time);
   }
   push_back(scheduler->moo_recycled, entry);
   pareto_info_set(&entry->moo_info, PARETO_RECYCLED, vector_size(scheduler->moo_recycled) - 1);
@@ -1467,8 +1802,7 @@ struct queue_entry *pareto_scheduler_explore_pop(struct pareto_scheduler *schedu
   if (selected) {
     push_back(scheduler->explore_recycled, selected);
     pareto_info_set(&selected->explore_info, PARETO_RECYCLED, vector_size(scheduler->explore_recycled) - 1);
-    LOGF("[sel] [explore] [id %d] [dfg-path %u] [dfg-path-count %llu] [time %llu]\n", 
-      selected->entry_id, selected->dfg_cksum, 
+    EVLOG(EV_SEL_EXPLORE, selected->entry_id, selected->dfg_cksum, 
       pareto_scheduler_get_dfg_count(scheduler, selected->dfg_cksum), get_cur_time() - start_time);
   }
   return selected;
@@ -1504,8 +1838,7 @@ void pareto_scheduler_explore_remove(struct pareto_scheduler *scheduler, struct
   }
   struct queue_entry *removed = vector_pop(vec, index);
   if (removed != entry) {
-    LOGF("[error] [explore] [remove] [id %d] [status %d] [index %d] [removed %d] [time %llu]\n", 
-      entry->entry_id, entry->explore_info.status, entry->explore_info.index, removed ? removed->entry_id : -1, get_cur_time() - start_time);
+    EVLOG(EV_ERR_EXPLORE_REMOVE, entry->entry_id, entry->explore_info.status, entry->explore_info.index, removed ? removed->entry_id : -1, get_cur_time() - start_time);
   }
   vector_pop(vec, index);
   push_back(scheduler->explore_recycled, entry);
@@ -1566,21 +1899,27 @@ static void sorted_insert_to_queue(struct queue_entry* q) {
 
 static void add_to_queue(u8* fname, u32 len, u8 passed_det, struct proximity_score *prox_score) {
 
-  struct queue_entry* q = ck_alloc(sizeof(struct queue_entry));
+  struct queue_entry* q = arena_alloc(&queue_arena, sizeof(struct queue_entry));
 
   q->fname        = fname;
   q->len          = len;
   q->depth        = cur_depth + 1;
   q->passed_det   = passed_det;
   q->prox_score   = *prox_score;
-  q->prox_score.dfg_dense_map = NULL;
-  q->prox_score.dfg_count_map = NULL;
+  q->prox_score.dfg_packed_map = NULL;
+  q->prox_score.dfg_packed_len = 0;
   q->entry_id     = queued_paths;
   q->next = NULL;
 
   if (q->depth > max_depth) max_depth = q->depth;
 
-  pareto_scheduler_push(pareto_scheduler, q);
+  /* With several targets, the entry is handed out once calibrated, see
+     targets_take_new(). */
+
+  if (dafl_target_cnt > 1) {
+    q->target_found = dafl_target_cur;
+    push_back(dafl_target_log, q);
+  } else pareto_scheduler_push(pareto_scheduler, q);
 
   sorted_insert_to_queue(q);
 
@@ -1622,11 +1961,11 @@ EXP_ST void destroy_queue_entry(struct queue_entry* q, u8 only_prox_score) {
 
   q->removed = 1;
 
-  ck_free(q->prox_score.dfg_count_map);
-  q->prox_score.dfg_count_map = NULL;
+  /* The entry itself and its packed DFG map live in queue_arena and are
+     released along with it. */
 
-  ck_free(q->prox_score.dfg_dense_map);
-  q->prox_score.dfg_dense_map = NULL;
+  q->prox_score.dfg_packed_map = NULL;
+  q->prox_score.dfg_packed_len = 0;
 
   ck_free(q->trace_mini);
   q->trace_mini = NULL;
@@ -1636,8 +1975,6 @@ EXP_ST void destroy_queue_entry(struct queue_entry* q, u8 only_prox_score) {
   ck_free(q->fname);
   q->fname = NULL;
 
-  ck_free(q);
-
 }
 
 
@@ -1655,6 +1992,8 @@ EXP_ST void destroy_queue(void) {
 
   }
 
+  arena_free(&queue_arena);
+
 }
 
 
@@ -1713,14 +2052,14 @@ static inline u8 has_new_bits(u8* virgin_map) {
   u64* current = (u64*)trace_bits;
   u64* virgin  = (u64*)virgin_map;
 
-  u32  i = (MAP_SIZE >> 3);
+  u32  i = (map_size >> 3);
 
 #else
 
   u32* current = (u32*)trace_bits;
   u32* virgin  = (u32*)virgin_map;
 
-  u32  i = (MAP_SIZE >> 2);
+  u32  i = (map_size >> 2);
 
 #endif /* ^WORD_SIZE_64 */
 
@@ -1776,13 +2115,83 @@ static inline u8 has_new_bits(u8* virgin_map) {
 }
 
 
+/* List of nonzero tuple indices in trace_bits[] for the last exec. Built
+   lazily by collect_trace_idx() and shared by count_trace_bytes(),
+   minimize_bits() and update_bitmap_score(), so that calibration does not
+   rescan the whole map for each of them. Anything that rewrites trace_bits[]
+   must call invalidate_trace_idx(). */
+
+static u32 trace_idx[MAP_SIZE];         /* Nonzero tuple indices            */
+static u32 trace_idx_cnt;               /* Number of valid trace_idx[] slots */
+static u8  trace_idx_valid;             /* trace_idx[] matches trace_bits[] */
+
+static inline void invalidate_trace_idx(void) {
+
+  trace_idx_valid = 0;
+
+}
+
+static void collect_trace_idx(void) {
+
+#ifdef WORD_SIZE_64
+
+  u64* current = (u64*)trace_bits;
+  u32  i = (map_size >> 3);
+
+#else
+
+  u32* current = (u32*)trace_bits;
+  u32  i = (map_size >> 2);
+
+#endif /* ^WORD_SIZE_64 */
+
+  u32  base = 0, cnt = 0;
+
+  if (trace_idx_valid) return;
+
+  while (i--) {
+
+    /* The map is overwhelmingly sparse, so only look at individual bytes
+       when the whole word is nonzero. */
+
+    if (unlikely(*current)) {
+
+      u8* cur = (u8*)current;
+      u32 j;
+
+      for (j = 0; j < sizeof(*current); j++)
+        if (cur[j]) trace_idx[cnt++] = base + j;
+
+    }
+
+    current++;
+    base += sizeof(*current);
+
+  }
+
+  trace_idx_cnt   = cnt;
+  trace_idx_valid = 1;
+
+}
+
+
+/* Same as count_bytes(trace_bits), but served from the index list. */
+
+static u32 count_trace_bytes(void) {
+
+  collect_trace_idx();
+  return trace_idx_cnt;
+
+}
+
+
 /* Count the number of bits set in the provided bitmap. Used for the status
    screen several times every second, does not have to be fast. */
 
 static u32 count_bits(u8* mem) {
 
   u32* ptr = (u32*)mem;
-  u32  i   = (MAP_SIZE >> 2);
+  u32  i   = (map_size >> 2);
   u32  ret = 0;
 
   while (i--) {
@@ -1817,7 +2226,7 @@ static u32 count_bits(u8* mem) {
 static u32 count_bytes(u8* mem) {
 
   u32* ptr = (u32*)mem;
-  u32  i   = (MAP_SIZE >> 2);
+  u32  i   = (map_size >> 2);
   u32  ret = 0;
 
   while (i--) {
@@ -1843,7 +2252,7 @@ static u32 count_bytes(u8* mem) {
 static u32 count_non_255_bytes(u8* mem) {
 
   u32* ptr = (u32*)mem;
-  u32  i   = (MAP_SIZE >> 2);
+  u32  i   = (map_size >> 2);
   u32  ret = 0;
 
   while (i--) {
@@ -1876,6 +2285,142 @@ static u32 get_dfg_checksum() {
   return checksum;
 }
 
+/* Shared DFG state (AFL_SHARED_DFG), see dfgshm.h. */
+
+static struct dfgshm* dfg_shm;        /* Segment shared with siblings     */
+static s32 dfg_shm_id = -1;           /* Its SysV id                      */
+
+static u8  dfg_shm_recount,           /* Our queue not in counts[] yet?   */
+           dfg_shm_creator,           /* Did we create the segment?       */
+           dfg_shm_in_dry_run;        /* Inside perform_dry_run()?        */
+
+static u32 dfg_shm_val_skips;         /* Valuation runs saved by the memo */
+
+static void get_target_id(u64* size, u32* hash);
+static u32 cal_content_hash(u8* mem, u32 len);
+
+/* Detach the segment; the last instance to go removes it. */
+
+static void detach_dfg_shm(void) {
+
+  struct shmid_ds ds;
+
+  shmdt(dfg_shm);
+
+  if (!shmctl(dfg_shm_id, IPC_STAT, &ds) && !ds.shm_nattch)
+    shmctl(dfg_shm_id, IPC_RMID, NULL);
+
+}
+
+/* Create or attach the segment of the sync dir and move dfg_count_map into
+   it. Must be called before anything is counted. */
+
+static void setup_dfg_shm(void) {
+
+  struct dfgshm_header* hdr;
+  u64 target_size;
+  u32 target_hash, tries = 0;
+  u8  created = 0;
+  key_t key;
+
+  if (!sync_id) FATAL("AFL_SHARED_DFG requires -M or -S");
+
+  key = ftok(sync_dir, 'D');
+  if (key == -1) PFATAL("ftok() failed for '%s'", sync_dir);
+
+  dfg_shm_id = shmget(key, sizeof(struct dfgshm), IPC_CREAT | IPC_EXCL | 0600);
+
+  if (dfg_shm_id >= 0) {
+
+    created = dfg_shm_creator = 1;
+
+  } else {
+
+    if (errno != EEXIST) PFATAL("shmget() failed");
+
+    dfg_shm_id = shmget(key, sizeof(struct dfgshm), 0600);
+
+    if (dfg_shm_id < 0)
+      PFATAL("Unable to attach the shared DFG state of '%s' (a stale segment "
+             "from another build? see ipcs -m)", sync_dir);
+
+  }
+
+  dfg_shm = shmat(dfg_shm_id, NULL, 0);
+  if (dfg_shm == (void*)-1) PFATAL("shmat() failed");
+
+  atexit(detach_dfg_shm);
+
+  get_target_id(&target_size, &target_hash);
+
+  hdr = &dfg_shm->hdr;
+
+  if (created) {
+
+    memcpy(hdr->magic, DFGSHM_MAGIC, sizeof(hdr->magic));
+    hdr->version      = DFGSHM_VERSION;
+    hdr->dfg_map_size = DFG_MAP_SIZE;
+    hdr->set_size     = DFGSHM_SET_SIZE;
+    hdr->target_size  = target_size;
+    hdr->target_hash  = target_hash;
+
+    __atomic_store_n(&hdr->ready, 1, __ATOMIC_RELEASE);
+
+  } else {
+
+    while (!__atomic_load_n(&hdr->ready, __ATOMIC_ACQUIRE)) {
+
+      if (++tries > 5000)
+        FATAL("Shared DFG state was never initialized (remove it with "
+              "'ipcrm -m %d')", dfg_shm_id);
+
+      usleep(1000);
+
+    }
+
+    if (memcmp(hdr->magic, DFGSHM_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != DFGSHM_VERSION || hdr->dfg_map_size != DFG_MAP_SIZE ||
+        hdr->set_size != DFGSHM_SET_SIZE)
+      FATAL("Shared DFG state has an incompatible layout (remove it with "
+            "'ipcrm -m %d')", dfg_shm_id);
+
+    if (hdr->target_size != target_size || hdr->target_hash != target_hash)
+      FATAL("Instances sharing DFG state must fuzz the same target binary");
+
+  }
+
+  /* If we have been here before, our queue is already in counts[]. */
+
+  dfg_shm_recount = dfgshm_set_add(dfg_shm->instances, DFG_SHM_INSTANCES,
+                                   cal_content_hash(sync_id, strlen(sync_id)));
+
+  ck_free(dfg_count_map);
+  dfg_count_map = dfg_shm->counts;
+
+  OKF("%s the shared DFG state of the sync dir (segment %d).",
+      created ? "Created" : "Attached to", dfg_shm_id);
+
+}
+
+/* Whether the shared counts already include q: entries imported from a
+   sibling were counted by it, and so was our own queue if we are
+   rejoining a segment that outlived us. The -i seeds (depth 1), which
+   every instance has, are left to the one that created the segment. */
+
+static u8 dfg_shm_counted(struct queue_entry* q) {
+
+  if (!q) return 0;
+
+  if (syncing_party || strstr(q->fname, ",sync:")) return 1;
+
+  if (!dfg_shm_in_dry_run) return 0;
+
+  if (q->depth <= 1 && !dfg_shm_creator) return 1;
+
+  return !dfg_shm_recount;
+
+}
+
 static void update_dfg_count_map(struct queue_entry *q) {
 
   if (use_moo_scheduler && q && check_covered_target()) {
@@ -1898,13 +2443,17 @@ static void update_dfg_count_map(struct queue_entry *q) {
 
   u32 i = DFG_MAP_SIZE;
   u8 is_unique = 0;
+  u8 counted = dfg_shm && dfg_shm_counted(q);
 
   while (i--) {
   
-    if (dfg_bits[i]) {
-      u32 count = dfg_count_map[i];
+    if (dfg_bits[i] && !counted) {
+      u32 count;
+      if (dfg_shm)
+        count = __atomic_fetch_add(dfg_count_map + i, 1, __ATOMIC_RELAXED);
+      else
+        count = dfg_count_map[i]++;
       if (count == 0) is_unique = 1;
-      dfg_count_map[i] = count + 1;
     }
   
   }
@@ -1913,42 +2462,241 @@ static void update_dfg_count_map(struct queue_entry *q) {
 
   if (is_unique) {
     unique_dafl_input++;
-    LOGF("[q] [uniq] [seed %d] [id %u] [orig %llu] [adj %.4f] [cov %u] [cnt %u]\n",
-         queue_cur ? queue_cur->entry_id : -1, q->entry_id, q->prox_score.original, q->prox_score.adjusted, q->prox_score.covered, unique_dafl_input);
+    EVLOG(EV_Q_UNIQ, queue_cur ? queue_cur->entry_id : -1, q->entry_id, q->prox_score.original, q->prox_score.adjusted, q->prox_score.covered, unique_dafl_input);
   } else {
-    LOGF("[q] [non-uniq] [seed %d] [id %u] [orig %llu] [adj %.4f] [cov %u]\n",
-         queue_cur ? queue_cur->entry_id : -1, q->entry_id, q->prox_score.original, q->prox_score.adjusted, q->prox_score.covered);
+    EVLOG(EV_Q_NON_UNIQ, queue_cur ? queue_cur->entry_id : -1, q->entry_id, q->prox_score.original, q->prox_score.adjusted, q->prox_score.covered);
   }
 
 }
 
-static u8 save_proximity_map(struct proximity_score *prox_score, u32* dfg_map) {
-  
-  u32 covered = prox_score->covered;
-  if (covered > DFG_MAP_SIZE / 2) {
-    prox_score->dfg_dense_map = NULL;
-    prox_score->dfg_count_map = ck_alloc(DFG_MAP_SIZE * sizeof(u32));
-    memcpy(prox_score->dfg_count_map, dfg_map, DFG_MAP_SIZE * sizeof(u32));
-    return 1;
-  }
-  prox_score->dfg_count_map = NULL;
-  prox_score->dfg_dense_map = ck_alloc(2 * (covered + 1) * sizeof(u32));
-  u32 index = 0;
-  for (u32 i = 0; i < DFG_MAP_SIZE; i++) {
-    if (dfg_map[i]) {
-      prox_score->dfg_dense_map[index] = i;
-      prox_score->dfg_dense_map[index + 1] = dfg_map[i];
-      index += 2;
-    }
+/* LEB128-style varints for the packed DFG maps. */
+
+static inline u8* varint_put(u8* p, u32 v) {
+
+  while (v >= 0x80) {
+    *p++ = (v & 0x7f) | 0x80;
+    v >>= 7;
   }
-  prox_score->dfg_dense_map[covered] = 0;
-  return 0;
+  *p++ = v;
+  return p;
 
 }
 
-static double compute_reduced_score(u32 score, u32 count) {
+static inline u32 varint_get(u8** pp) {
 
-  /** Calculate the reduced score: score * (1 - proximity_score_reduction) ^ count
+  u8* p = *pp;
+  u32 v = 0, shift = 0;
+
+  while (*p & 0x80) {
+    v |= (u32)(*p++ & 0x7f) << shift;
+    shift += 7;
+  }
+  v |= (u32)*p++ << shift;
+
+  *pp = p;
+  return v;
+
+}
+
+/* The same, for maps read from disk: fails instead of reading past end. */
+
+static inline u8 varint_get_checked(u8** pp, u8* end, u32* v) {
+
+  u8* p = *pp;
+  u32 shift;
+
+  for (*v = 0, shift = 0; p < end && (*p & 0x80) && shift < 28; shift += 7)
+    *v |= (u32)(*p++ & 0x7f) << shift;
+
+  if (p >= end) return 0;
+
+  *v |= (u32)*p++ << shift;
+
+  *pp = p;
+  return 1;
+
+}
+
+/* Add an entry restored from the checkpoint to the shared counts, from its
+   packed DFG map, the way update_dfg_count_map() would have. */
+
+static void dfg_shm_count_packed(struct queue_entry* q) {
+
+  u8* p   = q->prox_score.dfg_packed_map;
+  u8* end = p + q->prox_score.dfg_packed_len;
+  u32 index = 0;
+
+  if (!p || dfg_shm_counted(q)) return;
+
+  if (use_moo_scheduler) {
+
+    while (p < end) {
+      index += varint_get(&p);
+      varint_get(&p);
+      if (index == dfg_target_idx) return;
+    }
+
+    p = q->prox_score.dfg_packed_map;
+    index = 0;
+
+  }
+
+  while (p < end) {
+    index += varint_get(&p);
+    varint_get(&p);
+    __atomic_fetch_add(dfg_count_map + index, 1, __ATOMIC_RELAXED);
+  }
+
+}
+
+/* DFG path partitioning (AFL_DFG_PARTITION). The instances of a sync dir
+   split the DFG path hashes among themselves by rendezvous hashing: a
+   path belongs to the live instance whose sync ID hash, mixed with the
+   path hash, scores highest. Vertical mode only picks the paths this
+   instance owns; everything else (queueing, imports, the other modes)
+   is unaffected. When an instance joins or leaves, only the paths it
+   gains or loses change hands.
+
+   An instance counts as live while it keeps the mtime of its heartbeat
+   file (queue/.state/partition in its output dir) fresh; it does so when it
+   writes its stats, and removes the file on a clean exit. */
+
+static u8  partition_on;              /* AFL_DFG_PARTITION set?           */
+static u32 *partition_members,        /* Sync ID hashes of live instances */
+           partition_member_cnt;      /* Number of partition_members[]    */
+
+static u8 partition_owns(u32 path_hash) {
+
+  u32 i, best = 0, best_score = 0;
+
+  if (partition_member_cnt < 2) return 1;
+
+  for (i = 0; i < partition_member_cnt; i++) {
+
+    u32 key[2] = { path_hash, partition_members[i] };
+    u32 score  = hash32(key, sizeof(key), HASH_CONST);
+
+    if (!i || score > best_score) {
+      best       = i;
+      best_score = score;
+    }
+
+  }
+
+  return partition_members[best] == cal_content_hash(sync_id, strlen(sync_id));
+
+}
+
+/* Refresh our heartbeat and rebuild the member list from the heartbeats
+   in the sync dir. */
+
+static void partition_refresh(void) {
+
+  u64 now = get_cur_time() / 1000;
+  struct dirent* de;
+  struct stat st;
+  DIR* sd;
+  u8* fn;
+  s32 fd;
+
+  fn = alloc_printf("%s/queue/.state/partition", out_dir);
+  fd = open(fn, O_WRONLY | O_CREAT, 0600);
+  if (fd < 0 || futimens(fd, NULL)) PFATAL("Unable to update '%s'", fn);
+  close(fd);
+  ck_free(fn);
+
+  sd = opendir(sync_dir);
+  if (!sd) PFATAL("Unable to open '%s'", sync_dir);
+
+  partition_member_cnt = 0;
+
+  while ((de = readdir(sd))) {
+
+    if (de->d_name[0] == '.') continue;
+
+    fn = alloc_printf("%s/%s/queue/.state/partition", sync_dir, de->d_name);
+
+    if (!stat(fn, &st) && (strcmp(de->d_name, sync_id) ?
+                           st.st_mtime + PARTITION_TIMEOUT >= now : 1)) {
+
+      partition_members = ck_realloc_block(partition_members,
+                                           (partition_member_cnt + 1) *
+                                           sizeof(u32));
+
+      partition_members[partition_member_cnt++] =
+        cal_content_hash(de->d_name, strlen(de->d_name));
+
+    }
+
+    ck_free(fn);
+
+  }
+
+  closedir(sd);
+
+}
+
+static void partition_init(void) {
+
+  if (!sync_id) FATAL("AFL_DFG_PARTITION requires -M or -S");
+
+  partition_on = 1;
+  partition_refresh();
+
+  OKF("DFG paths partitioned among %u live instance%s.", partition_member_cnt,
+      partition_member_cnt == 1 ? "" : "s");
+
+}
+
+/* Clean exit: hand our paths over to the others right away. */
+
+static void partition_leave(void) {
+
+  u8* fn;
+
+  if (!partition_on) return;
+
+  fn = alloc_printf("%s/queue/.state/partition", out_dir);
+  unlink(fn); /* ignore errors */
+  ck_free(fn);
+
+}
+
+
+/* Store the covered DFG nodes of an entry as (index delta, score) varint
+   pairs in queue_arena. Neighbouring nodes cost two or three bytes, so
+   even a fully covered map stays far below the 130 kB of a raw copy. */
+
+static void save_proximity_map(struct proximity_score *prox_score, u32* dfg_map) {
+
+  static u8 scratch[DFG_MAP_SIZE * 10];
+  u8* p = scratch;
+  u32 i, prev = 0;
+
+  for (i = 0; i < DFG_MAP_SIZE; i++) {
+    if (dfg_map[i]) {
+      p = varint_put(p, i - prev);
+      p = varint_put(p, dfg_map[i]);
+      prev = i;
+    }
+  }
+
+  u32 len = p - scratch;
+
+  /* Recalibration may store a new map for the same entry; reuse the old
+     buffer when it is large enough, since arena memory is not reclaimed. */
+
+  if (!prox_score->dfg_packed_map || prox_score->dfg_packed_len < len)
+    prox_score->dfg_packed_map = arena_alloc(&queue_arena, len ? len : 1);
+
+  memcpy(prox_score->dfg_packed_map, scratch, len);
+  prox_score->dfg_packed_len = len;
+
+}
+
+static double compute_reduced_score(u32 score, u32 count) {
+
+  /** Calculate the reduced score: score * (1 - proximity_score_reduction) ^ count
    *  Use cache to avoid computing the same value multiple times */
   if (proximity_score_cache == NULL) {
     proximity_score_cache = ck_alloc(max_queue_size * sizeof(double));
@@ -2026,11 +2774,14 @@ static u8 recompute_proximity_score(struct queue_entry* q) {
   /**
    * Recalculate the proximity score of the input entry
   */
-  if (q->prox_score.dfg_dense_map) {
+  if (q->prox_score.dfg_packed_map) {
     double adjusted_score = .0;
-    for (u32 i = 0; i < q->prox_score.covered; i++) {
-      u32 index = q->prox_score.dfg_dense_map[i * 2];
-      u32 score = q->prox_score.dfg_dense_map[i * 2 + 1];
+    u8 *p = q->prox_score.dfg_packed_map;
+    u8 *end = p + q->prox_score.dfg_packed_len;
+    u32 index = 0;
+    while (p < end) {
+      index += varint_get(&p);
+      u32 score = varint_get(&p);
       u32 count = dfg_count_map[index];
       if (use_moo_scheduler && proximity_score_allowance < 0) {
         u32 max_paths = dfg_node_info_map[index].max_paths;
@@ -2045,10 +2796,6 @@ static u8 recompute_proximity_score(struct queue_entry* q) {
     q->prox_score.adjusted = adjusted_score;
     return 0;
   }
-  if (q->prox_score.dfg_count_map) {
-    compute_proximity_score(&q->prox_score, q->prox_score.dfg_count_map, 0);
-    return 1;
-  }
   // This should not happen
   WARNF("Invalid proximity_score for recomputation: testcase %u", q->entry_id);
   return 2;
@@ -2065,6 +2812,118 @@ static void init_global_prox_score() {
   avg_prox_score.adjusted = .0;
 }
 
+/* Start the next target of -p, its nodes numbered from base on. */
+
+static struct dafl_target* dfg_add_target(u32 base) {
+
+  struct dafl_target *t;
+
+  if (dafl_target_cnt == MULTI_TARGET_MAX)
+    FATAL("Too many targets (limit is %u)", MULTI_TARGET_MAX);
+
+  dafl_targets = ck_realloc(dafl_targets, (dafl_target_cnt + 1) * sizeof(struct dafl_target));
+  t = &dafl_targets[dafl_target_cnt++];
+  t->base = base;
+  t->idx = DFG_MAP_SIZE + 1;
+
+  if (!dfg_node_info_map)
+    dfg_node_info_map = ck_alloc(DFG_MAP_SIZE * sizeof(struct dfg_node_info));
+
+  return t;
+
+}
+
+/* Add node idx to target t; the node with the highest score is the target. */
+
+static void dfg_add_node(struct dafl_target *t, u32 idx, u32 score, u32 max_paths) {
+
+  if (idx >= DFG_MAP_SIZE - 1)
+    FATAL("Input DFG is too large (check DFG_MAP_SIZE)");
+  // Insert to dfg_node_info_map
+  struct dfg_node_info *node_info = &dfg_node_info_map[idx];
+  node_info->idx = idx;
+  node_info->score = score;
+  node_info->max_paths = max_paths;
+  if (score > (t->idx < DFG_MAP_SIZE ? dfg_node_info_map[t->idx].score : 0))
+    t->idx = idx;
+  t->nodes = idx + 1 - t->base;
+
+}
+
+/* Several targets: a list of node files, in the order given to the pass. */
+
+static void init_dfg_text(u8* dfg_node_info_file) {
+
+  u8 *files = ck_strdup(dfg_node_info_file), *saveptr = NULL, *fn;
+  u32 idx = 0;
+  u32 score, max_paths;
+  u8 node_name[256];
+
+  for (fn = (u8*)strtok_r((char*)files, ":", (char**)&saveptr); fn;
+       fn = (u8*)strtok_r(NULL, ":", (char**)&saveptr)) {
+
+    FILE *file = fopen(fn, "r");
+    if (!file) {
+      if (use_moo_scheduler)
+        PFATAL("Unable to open '%s'", fn);
+      else
+        break;
+    }
+
+    struct dafl_target *t = dfg_add_target(idx);
+
+    // Read the score and max_paths
+    while(fscanf(file, "%d %d %255s", &score, &max_paths, node_name) == 3)
+      dfg_add_node(t, idx++, score, max_paths);
+    fclose(file);
+  }
+  ck_free(files);
+
+}
+
+/* The same, from an index built by afl-dfg-index (see dfgindex.h). */
+
+static void init_dfg_index(u8* fn) {
+
+  const struct dfgi_header *h;
+  const struct dfgi_target *targets;
+  const struct dfgi_node *nodes;
+  const u8 *map;
+  u64 len;
+  s32 stale;
+
+  map = (const u8*)dfgi_map(fn, &len);
+  h = map ? dfgi_check(map, len) : NULL;
+
+  if (!h) FATAL("'%s' is not a valid DFG index", fn);
+
+  if ((stale = dfgi_stale(h)) >= 0)
+    FATAL("DFG index '%s' is out of date ('%s' changed), rebuild it with afl-dfg-index",
+          fn, dfgi_str(h, DFGI_AT(h, h->src_off, struct dfgi_source)[stale].path));
+
+  if (!h->target_cnt) FATAL("DFG index '%s' holds no DFG", fn);
+
+  targets = DFGI_AT(h, h->target_off, struct dfgi_target);
+  nodes = DFGI_AT(h, h->node_off, struct dfgi_node);
+
+  for (u32 i = 0; i < h->target_cnt; i++) {
+
+    struct dafl_target *t = dfg_add_target(targets[i].base);
+
+    if ((u64)targets[i].base + targets[i].nodes > h->node_cnt)
+      FATAL("DFG index '%s' is corrupt", fn);
+
+    for (u32 n = targets[i].base; n < targets[i].base + targets[i].nodes; n++)
+      dfg_add_node(t, n, nodes[n].score, nodes[n].max_paths);
+
+  }
+
+  OKF("Loaded DFG index '%s' (%u nodes).", fn, h->node_cnt);
+
+  munmap((void*)map, len);
+
+}
+
 static void init_dfg(u8* dfg_node_info_file) {
 
   dfg_count_map = ck_alloc(DFG_MAP_SIZE * sizeof(u32));
@@ -2079,39 +2938,169 @@ static void init_dfg(u8* dfg_node_info_file) {
     }
   }
 
-  FILE *file = fopen(dfg_node_info_file, "r");
-  if (!file) {
-    if (use_moo_scheduler)
-      PFATAL("Unable to open '%s'", dfg_node_info_file);
-    else
-      return;
-  }
+  if (dfgi_is_index(dfg_node_info_file)) init_dfg_index(dfg_node_info_file);
+  else init_dfg_text(dfg_node_info_file);
+
+  if (!dfg_node_info_map) return;
+
+  dfg_target_idx = dafl_targets[0].idx;
 
-  dfg_node_info_map = ck_alloc(DFG_MAP_SIZE * sizeof(struct dfg_node_info));
-  u32 idx = 0, max_score = 0;
-  u32 score, max_paths;
-  u8 node_name[256];
-  // Read the score and max_paths
-  while(fscanf(file, "%d %d %255s", &score, &max_paths, node_name) == 3) {
-    // Insert to dfg_node_info_map
-    struct dfg_node_info *node_info = &dfg_node_info_map[idx];
-    node_info->idx = idx;
-    node_info->score = score;
-    node_info->max_paths = max_paths;
-    if (score > max_score) {
-      max_score = score;
-      dfg_target_idx = idx;
-    }
-    idx++;
-  }
-  fclose(file);
   for (u32 i = 0; i < DFG_MAP_SIZE; i++) {
     dfg_targets[i] = MAP_SIZE + 1;
   }
-  ACTF("Check dfg_node_info_map target: %u, max_score: %u vs idx %u, score %u", dfg_target_idx, max_score,
+
+  if (dafl_target_cnt > 1) {
+    dafl_targets[0].vm = vertical_manager;
+    dafl_targets[0].ps = pareto_scheduler;
+    dafl_targets[0].ss = stride_scheduler;
+    for (u32 i = 1; i < dafl_target_cnt; i++) {
+      dafl_targets[i].vm = vertical_manager_create();
+      dafl_targets[i].ps = pareto_scheduler_create();
+      dafl_targets[i].ss = stride_scheduler_create();
+    }
+    dafl_target_log = vector_create();
+    OKF("Fuzzing towards %u targets.", dafl_target_cnt);
+  } else {
+    ck_free(dafl_targets);
+    dafl_targets = NULL;
+    dafl_target_cnt = 0;
+  }
+
+  ACTF("Check dfg_node_info_map target: %u, max_score: %u vs idx %u, score %u", dfg_target_idx,
+       dfg_node_info_map[dfg_target_idx].score,
        dfg_node_info_map[dfg_target_idx].idx, dfg_node_info_map[dfg_target_idx].score);
 }
 
+/* Multi-target campaigns (-p a.txt:b.txt:..., built with the same list in
+   DAFL_DFG_SCORE). Every target has its own slice of the DFG map, its own
+   pareto scheduler, vertical manager and stride scheduler; the queue, the
+   coverage maps and the DFG counts are shared. The targets take turns, one
+   queue selection each: the state of the target in focus is swapped into
+   vertical_manager, pareto_scheduler, stride_scheduler and dfg_target_idx,
+   and the rest of the fuzzer works on it as it would on a single target.
+
+   Some state stays global on purpose. dfg_hashmap and unique_mem_hashmap
+   are keyed by checksums of the whole DFG map and of the valuation, which
+   span the slices of all targets: a path or valuation is one fact about
+   the program, and telling it apart per target would only make each
+   target rediscover what another has seen (the vertical managers, which
+   are per target, still get their own entries). max_prox_score and the
+   other proximity statistics are taken over the whole queue, whose scores
+   also add up all slices, and only feed the event log.
+
+   New entries are handed out before each turn, once calibrated: an entry
+   goes to the scheduler of the target it scores best on, and joins the
+   vertical state of every target it reaches, so that an execution that
+   feeds several targets is not repeated for each of them. */
+
+/* The scheduler holding q. */
+
+static struct pareto_scheduler* target_scheduler(struct queue_entry* q) {
+
+  if (dafl_target_cnt > 1) return dafl_targets[q->target_home].ps;
+  return pareto_scheduler;
+
+}
+
+/* Add q to the vertical state of target t, the way save_valuation() adds
+   an entry with a new valuation. */
+
+static void target_add_vertical(u32 t, struct queue_entry* q) {
+
+  struct vertical_manager* vm = dafl_targets[t].vm;
+  struct key_value_pair* kvp = hashmap_get(vm->map, q->dfg_cksum);
+  struct vertical_entry* ve;
+
+  if (!kvp) {
+    ve = vertical_entry_create(q->dfg_cksum);
+    hashmap_insert(vm->map, q->dfg_cksum, ve);
+  } else ve = kvp->value;
+
+  if (hashmap_get(ve->value_map, q->val_hash)) return;
+
+  vertical_entry_add(vm, ve, q, NULL);
+  hashmap_insert(ve->value_map, q->val_hash, q);
+
+}
+
+/* Hand out the entries added since the last turn. */
+
+static void targets_take_new(void) {
+
+  static u64 scores[MULTI_TARGET_MAX];
+  static u8  reached[MULTI_TARGET_MAX];
+
+  while (dafl_target_seen < vector_size(dafl_target_log)) {
+
+    struct queue_entry* q = vector_get(dafl_target_log, dafl_target_seen++);
+    u8* p   = q->prox_score.dfg_packed_map;
+    u8* end = p + q->prox_score.dfg_packed_len;
+    u32 index = 0, t = 0, home = 0;
+
+    if (q->removed) continue;
+
+    memset(scores, 0, sizeof(scores));
+    memset(reached, 0, sizeof(reached));
+
+    while (p && p < end) {
+
+      index += varint_get(&p);
+
+      while (t + 1 < dafl_target_cnt && index >= dafl_targets[t + 1].base) t++;
+
+      scores[t] += varint_get(&p);
+      if (index == dafl_targets[t].idx) reached[t] = 1;
+
+    }
+
+    /* Best score wins; entries that score nowhere go where there are the
+       fewest. */
+
+    for (t = 1; t < dafl_target_cnt; t++)
+      if (scores[t] > scores[home] ||
+          (!scores[home] && dafl_targets[t].homed < dafl_targets[home].homed))
+        home = t;
+
+    q->target_home = home;
+    dafl_targets[home].homed++;
+    pareto_scheduler_push(dafl_targets[home].ps, q);
+
+    /* The target in focus when q was found has seen it already. */
+
+    for (t = 0; t < dafl_target_cnt; t++)
+      if (reached[t] && t != q->target_found) target_add_vertical(t, q);
+
+  }
+
+}
+
+/* Move the focus to the next target that has anything to work on. */
+
+static void targets_next_turn(void) {
+
+  u32 n;
+
+  targets_take_new();
+
+  for (n = 1; n <= dafl_target_cnt; n++) {
+
+    struct dafl_target* t = dafl_targets + (dafl_target_cur + n) % dafl_target_cnt;
+
+    if (!t->homed && !t->vm->head && !t->vm->old) continue;
+
+    dafl_target_cur    = t - dafl_targets;
+    vertical_manager   = t->vm;
+    pareto_scheduler   = t->ps;
+    stride_scheduler   = t->ss;
+    dfg_target_idx     = t->idx;
+    t->turns++;
+
+    return;
+
+  }
+
+}
+
 static void update_global_prox_score(struct proximity_score *prox_score) {
 
   if (prox_score->original > max_prox_score.original) {
@@ -2141,10 +3130,8 @@ void update_dfg_score_moo() {
   }
   avg_prox_score.original = total_prox_score.original / queued_paths_cur;
   avg_prox_score.adjusted = total_prox_score.adjusted / queued_paths_cur;
-  LOGF("[stat] [moo] [orig] [min %llu] [max %llu] [avg %llu] [total %llu]\n",
-          min_prox_score.original, max_prox_score.original, avg_prox_score.original, total_prox_score.original);
-  LOGF("[stat] [moo] [adj] [min %f] [max %f] [avg %f] [total %f]\n",
-          min_prox_score.adjusted, max_prox_score.adjusted, avg_prox_score.adjusted, total_prox_score.adjusted);
+  EVLOG(EV_STAT_MOO_ORIG, min_prox_score.original, max_prox_score.original, avg_prox_score.original, total_prox_score.original);
+  EVLOG(EV_STAT_MOO_ADJ, min_prox_score.adjusted, max_prox_score.adjusted, avg_prox_score.adjusted, total_prox_score.adjusted);
 }
 
 /* Destructively simplify trace by eliminating hit count information
@@ -2163,7 +3150,7 @@ static const u8 simplify_lookup[256] = {
 
 static void simplify_trace(u64* mem) {
 
-  u32 i = MAP_SIZE >> 3;
+  u32 i = map_size >> 3;
 
   while (i--) {
 
@@ -2188,13 +3175,15 @@ static void simplify_trace(u64* mem) {
 
   }
 
+  invalidate_trace_idx();
+
 }
 
 #else
 
 static void simplify_trace(u32* mem) {
 
-  u32 i = MAP_SIZE >> 2;
+  u32 i = map_size >> 2;
 
   while (i--) {
 
@@ -2214,6 +3203,8 @@ static void simplify_trace(u32* mem) {
     mem++;
   }
 
+  invalidate_trace_idx();
+
 }
 
 #endif /* ^WORD_SIZE_64 */
@@ -2257,7 +3248,7 @@ EXP_ST void init_count_class16(void) {
 
 static inline void classify_counts(u64* mem) {
 
-  u32 i = MAP_SIZE >> 3;
+  u32 i = map_size >> 3;
 
   while (i--) {
 
@@ -2284,7 +3275,7 @@ static inline void classify_counts(u64* mem) {
 
 static inline void classify_counts(u32* mem) {
 
-  u32 i = MAP_SIZE >> 2;
+  u32 i = map_size >> 2;
 
   while (i--) {
 
@@ -2308,6 +3299,39 @@ static inline void classify_counts(u32* mem) {
 #endif /* ^WORD_SIZE_64 */
 
 
+/* Bucket the counts in trace_bits[] unless that has already been done. */
+
+static void classify_trace(void) {
+
+#ifdef WORD_SIZE_64
+  classify_counts((u64*)trace_bits);
+#else
+  classify_counts((u32*)trace_bits);
+#endif /* ^WORD_SIZE_64 */
+
+  trace_raw = 0;
+
+}
+
+
+/* has_new_bits() and hash32() of trace_bits[] in one pass, also taking care
+   of the bucketing if run_target() deferred it. */
+
+static u8 has_new_bits_cksum(u8* virgin_map, u32* cksum) {
+
+  u8 ret = fused_trace_scan(trace_bits, virgin_map, map_size,
+                            trace_raw ? count_class_lookup16 : NULL,
+                            cksum, HASH_CONST);
+
+  trace_raw = 0;
+
+  if (ret && virgin_map == virgin_bits) bitmap_changed = 1;
+
+  return ret;
+
+}
+
+
 /* Get rid of shared memory (atexit handler). */
 
 static void remove_shm(void) {
@@ -2322,18 +3346,16 @@ static void remove_shm(void) {
 
 /* Compact trace bytes into a smaller bitmap. We effectively just drop the
    count information here. This is called only sporadically, for some
-   new paths. */
+   new paths. Works off the nonzero index list for trace_bits[]. */
 
-static void minimize_bits(u8* dst, u8* src) {
+static void minimize_bits(u8* dst) {
 
-  u32 i = 0;
+  u32 i;
 
-  while (i < MAP_SIZE) {
+  collect_trace_idx();
 
-    if (*(src++)) dst[i >> 3] |= 1 << (i & 7);
-    i++;
-
-  }
+  for (i = 0; i < trace_idx_cnt; i++)
+    dst[trace_idx[i] >> 3] |= 1 << (trace_idx[i] & 7);
 
 }
 
@@ -2350,53 +3372,55 @@ static void minimize_bits(u8* dst, u8* src) {
 
 static void update_bitmap_score(struct queue_entry* q) {
 
-  u32 i;
+  u32 k;
   u64 fav_factor = q->exec_us * q->len;
 
   /* For every byte set in trace_bits[], see if there is a previous winner,
-     and how it compares to us. */
+     and how it compares to us. Only the nonzero tuples are visited. */
 
-  for (i = 0; i < MAP_SIZE; i++)
+  collect_trace_idx();
 
-    if (trace_bits[i]) {
+  for (k = 0; k < trace_idx_cnt; k++) {
 
-       if (top_rated[i]) {
+    u32 i = trace_idx[k];
 
-         /* Faster-executing or smaller test cases are favored. */
+    if (top_rated[i]) {
 
-         if (!top_rated[i]->removed) {
+      /* Faster-executing or smaller test cases are favored. */
 
-            if (fav_factor > top_rated[i]->exec_us * top_rated[i]->len) continue;
+      if (!top_rated[i]->removed) {
 
-            /* Looks like we're going to win. Decrease ref count for the
-                previous winner, discard its trace_bits[] if necessary. */
+        if (fav_factor > top_rated[i]->exec_us * top_rated[i]->len) continue;
 
-            if (!--top_rated[i]->tc_ref) {
-              ck_free(top_rated[i]->trace_mini);
-              top_rated[i]->trace_mini = 0;
-            }
+        /* Looks like we're going to win. Decrease ref count for the
+           previous winner, discard its trace_bits[] if necessary. */
+
+        if (!--top_rated[i]->tc_ref) {
+          ck_free(top_rated[i]->trace_mini);
+          top_rated[i]->trace_mini = 0;
+        }
 
-         } else {
+      } else {
 
-           top_rated[i] = NULL;
+        top_rated[i] = NULL;
 
-         }
+      }
 
-       }
+    }
 
-       /* Insert ourselves as the new winner. */
+    /* Insert ourselves as the new winner. */
 
-       top_rated[i] = q;
-       q->tc_ref++;
+    top_rated[i] = q;
+    q->tc_ref++;
 
-       if (!q->trace_mini) {
-         q->trace_mini = ck_alloc(MAP_SIZE >> 3);
-         minimize_bits(q->trace_mini, trace_bits);
-       }
+    if (!q->trace_mini) {
+      q->trace_mini = ck_alloc(MAP_SIZE >> 3);
+      minimize_bits(q->trace_mini);
+    }
 
-       score_changed = 1;
+    score_changed = 1;
 
-     }
+  }
 
 }
 
@@ -2432,10 +3456,10 @@ static void cull_queue(void) {
   /* Let's see if anything in the bitmap isn't captured in temp_v.
      If yes, and if it has a top_rated[] contender, let's use it. */
 
-  for (i = 0; i < MAP_SIZE; i++)
+  for (i = 0; i < map_size; i++)
     if (top_rated[i] && !top_rated[i]->removed && (temp_v[i >> 3] & (1 << (i & 7)))) {
 
-      u32 j = MAP_SIZE >> 3;
+      u32 j = map_size >> 3;
 
       /* Remove all bits belonging to the current entry from temp_v. */
 
@@ -2468,24 +3492,42 @@ struct vertical_entry *vertical_manager_select_entry(struct vertical_manager *ma
     // while (entry && hashmap_size(entry->value_map) == 0) {
     //   entry = entry->next;
     // }
-    manager->head = entry->next;
+    // With AFL_DFG_PARTITION, take the first path that is ours
+    struct vertical_entry *prev = NULL;
+    while (entry && partition_on && !partition_owns(entry->hash)) {
+      prev = entry;
+      entry = entry->next;
+    }
+    if (!entry) return NULL;
+    if (prev) prev->next = entry->next;
+    else manager->head = entry->next;
     entry->next = NULL;
     vertical_entry_sorted_insert(manager, entry, 0);
-    LOGF("[vert-entry] [sel] [selected %u] [vals %u] [entries %u]\n", entry ? entry->hash : -1, entry ? hashmap_size(entry->value_map) : 0, entry ? vector_size(entry->entries) + vector_size(entry->old_entries) : 0);
+    EVLOG(EV_VERT_ENTRY_SEL, entry ? entry->hash : -1, entry ? hashmap_size(entry->value_map) : 0, entry ? vector_size(entry->entries) + vector_size(entry->old_entries) : 0);
     return entry;
   }
-  if (entry) {
-    manager->head = entry->next;
-    entry->use_count++;
-    entry->next = NULL;
-  } else {
-    // Pop from old
-    entry = manager->old;
-    manager->old = NULL;
+  u32 skipped = 0;
+  while (1) {
+    if (!entry) {
+      // Pop from old
+      entry = manager->old;
+      manager->old = NULL;
+    }
     manager->head = entry->next;
-    entry->use_count++;
     entry->next = NULL;
+    if (!partition_on || partition_owns(entry->hash)) break;
+    // Another instance's path: send it to the back of the old queue, unused
+    if (manager->old == NULL) {
+      manager->old = entry;
+    } else {
+      struct vertical_entry *ve = manager->old;
+      while (ve->next != NULL) ve = ve->next;
+      ve->next = entry;
+    }
+    if (++skipped > hashmap_size(manager->map)) return NULL;
+    entry = manager->head;
   }
+  entry->use_count++;
   return entry;
 }
 
@@ -2534,7 +3576,7 @@ static struct queue_entry* select_next_entry_dafl() {
       q = q->next;
     }
   }
-  LOGF("[sel] [dafl] [id %d] [time %llu]\n", q ? q->entry_id : -1, get_cur_time() - start_time);
+  EVLOG(EV_SEL_DAFL, q ? q->entry_id : -1, get_cur_time() - start_time);
   return q;
 }
 
@@ -2559,7 +3601,7 @@ static struct queue_entry* select_next_entry_vertical() {
   } else {
     vertical_manager_insert_to_old(vertical_manager, entry, q);
   }
-  LOGF("[sel] [vertical] [id %d] [dfg-path %u] [time %llu]\n", q ? q->entry_id : -1, entry->hash, get_cur_time() - start_time);
+  EVLOG(EV_SEL_VERTICAL, q ? q->entry_id : -1, entry->hash, get_cur_time() - start_time);
   return q;
 }
 
@@ -2580,7 +3622,7 @@ static void handle_selected_entry(enum VerticalMode mode, struct queue_entry *en
 
   if (mode != M_EXP && use_explore) {
     // Handle explore
-    pareto_scheduler_explore_remove(pareto_scheduler, entry);
+    pareto_scheduler_explore_remove(target_scheduler(entry), entry);
   }
   
   if (mode != M_VER) {
@@ -2589,7 +3631,7 @@ static void handle_selected_entry(enum VerticalMode mode, struct queue_entry *en
 
   if (mode != M_HOR) {
     // Handle horizontal
-    pareto_scheduler_moo_remove(pareto_scheduler, entry);
+    pareto_scheduler_moo_remove(target_scheduler(entry), entry);
   }
 }
 
@@ -2597,6 +3639,8 @@ static struct queue_entry* select_next_entry() {
 
   struct queue_entry *selected_entry = NULL;
 
+  if (dafl_target_cnt > 1) targets_next_turn();
+
   // Use the default dafl scheduler
   if (!use_moo_scheduler) {
     return select_next_entry_dafl();
@@ -2687,6 +3731,9 @@ EXP_ST void setup_shm(void) {
   if (dfg_bits == (void *)-1) PFATAL("shmat() failed");
   if (last_location == (void *)-1) PFATAL("shmat() failed");
 
+  shm_prefer_node(trace_bits, MAP_SIZE, cpu_node);
+  shm_prefer_node(dfg_bits, sizeof(u32) * DFG_MAP_SIZE, cpu_node);
+
 }
 
 
@@ -2717,6 +3764,397 @@ static void setup_post(void) {
 }
 
 
+/* Packed queue storage, see pack.h. */
+
+static u8  queue_pack;                /* AFL_QUEUE_PACK set?              */
+static s32 pack_data_fd = -1,         /* Queue pack data file             */
+           pack_index_fd = -1;        /* Queue pack index file            */
+static u8* pack_map;                  /* Queue pack data, read-only       */
+static u64 pack_len;                  /* Bytes in queue pack data         */
+
+static u8* in_pack_map;               /* Packed input directory data      */
+static u64 in_pack_len;               /* Bytes in in_pack_map             */
+
+/* Create an empty queue pack in out_dir/queue/.state/pack/. The data file
+   is mapped once, with room to grow, so that entries appended later can be
+   read without remapping. */
+
+static void pack_create(void) {
+
+  struct pack_header hdr;
+  u8* fn;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.version     = PACK_VERSION;
+  hdr.record_size = sizeof(struct pack_entry);
+
+  fn = alloc_printf("%s/queue/.state/pack", out_dir);
+  if (mkdir(fn, 0700)) PFATAL("Unable to create '%s'", fn);
+  ck_free(fn);
+
+  fn = alloc_printf("%s/queue/.state/pack/data", out_dir);
+
+  pack_data_fd = open(fn, O_RDWR | O_CREAT | O_EXCL | O_APPEND, 0600);
+  if (pack_data_fd < 0) PFATAL("Unable to create '%s'", fn);
+
+  memcpy(hdr.magic, PACK_DATA_MAGIC, sizeof(hdr.magic));
+  ck_write(pack_data_fd, &hdr, sizeof(hdr), fn);
+  pack_len = sizeof(hdr);
+
+  pack_map = mmap(0, PACK_MAP_SIZE, PROT_READ, MAP_SHARED | MAP_NORESERVE,
+                  pack_data_fd, 0);
+  if (pack_map == MAP_FAILED) PFATAL("Unable to mmap '%s'", fn);
+
+  ck_free(fn);
+
+  fn = alloc_printf("%s/queue/.state/pack/index", out_dir);
+
+  pack_index_fd = open(fn, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (pack_index_fd < 0) PFATAL("Unable to create '%s'", fn);
+
+  memcpy(hdr.magic, PACK_INDEX_MAGIC, sizeof(hdr.magic));
+  ck_write(pack_index_fd, &hdr, sizeof(hdr), fn);
+
+  ck_free(fn);
+
+}
+
+
+/* Map a pack file read-only and check its header. Returns NULL if it
+   does not exist or is not a pack of this version. */
+
+static u8* pack_map_file(u8* fn, u8* magic, u64* len) {
+
+  struct pack_header* hdr;
+  struct stat st;
+  u8* map;
+  s32 fd;
+
+  fd = open(fn, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  if (fstat(fd, &st) || st.st_size < sizeof(struct pack_header)) {
+    close(fd);
+    return NULL;
+  }
+
+  map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) return NULL;
+
+  hdr = (struct pack_header*)map;
+
+  if (memcmp(hdr->magic, magic, sizeof(hdr->magic)) ||
+      hdr->version != PACK_VERSION ||
+      hdr->record_size != sizeof(struct pack_entry)) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  *len = st.st_size;
+  return map;
+
+}
+
+
+/* Contents of a packed entry, or NULL if q is stored as a regular file. */
+
+static inline u8* packed_entry_mem(struct queue_entry* q) {
+
+  if (q->packed == 2) return pack_map + q->pack_off;
+  if (q->packed == 1) return in_pack_map + q->pack_off;
+  return NULL;
+
+}
+
+
+/* Read the contents of q into a new buffer. */
+
+static u8* load_queue_entry(struct queue_entry* q) {
+
+  u8* mem = ck_alloc_nozero(q->len);
+  u8* src = packed_entry_mem(q);
+  s32 fd;
+
+  if (src) {
+    memcpy(mem, src, q->len);
+    return mem;
+  }
+
+  fd = open(q->fname, O_RDONLY);
+  if (fd < 0) PFATAL("Unable to open '%s'", q->fname);
+
+  ck_read(fd, mem, q->len, q->fname);
+  close(fd);
+
+  return mem;
+
+}
+
+
+/* Seed cache: contents of recently selected entries, kept in LRU order
+   within seed_cache_limit bytes, so that reselecting a seed does not go
+   back to the disk. Buffers handed out by seed_cache_get() are pinned
+   until seed_cache_put() and are never evicted while pinned. */
+
+static struct seed_cache_ent *seed_cache_head,  /* Most recently used      */
+                             *seed_cache_tail;  /* Least recently used     */
+static u64 seed_cache_used,           /* Bytes of cached contents         */
+           seed_cache_limit,          /* Budget, from AFL_SEED_CACHE_MB   */
+           seed_cache_hits,           /* Lookups served from the cache    */
+           seed_cache_misses;         /* Lookups that had to load         */
+
+static void seed_cache_unlink(struct seed_cache_ent* e) {
+
+  if (e->prev) e->prev->next = e->next; else seed_cache_head = e->next;
+  if (e->next) e->next->prev = e->prev; else seed_cache_tail = e->prev;
+
+  e->prev = e->next = NULL;
+
+}
+
+
+static void seed_cache_push(struct seed_cache_ent* e) {
+
+  e->next = seed_cache_head;
+  if (seed_cache_head) seed_cache_head->prev = e;
+  seed_cache_head = e;
+  if (!seed_cache_tail) seed_cache_tail = e;
+
+}
+
+
+/* Drop the cached contents of q. If a caller still holds them, the buffer
+   becomes theirs and is freed by their seed_cache_put(). */
+
+static void seed_cache_drop(struct queue_entry* q) {
+
+  struct seed_cache_ent* e = q->cache_ent;
+
+  if (!e) return;
+
+  seed_cache_unlink(e);
+  seed_cache_used -= e->len;
+
+  if (!e->pins) ck_free(e->mem);
+
+  ck_free(e);
+  q->cache_ent = NULL;
+
+}
+
+
+/* Contents of q, as a writable buffer that may be shared with later
+   callers until q is rewritten (trim_case() edits it in place, then
+   rewrites q). Release with seed_cache_put(). */
+
+static u8* seed_cache_get(struct queue_entry* q) {
+
+  struct seed_cache_ent *e = q->cache_ent, *victim;
+
+  if (e) {
+
+    seed_cache_hits++;
+
+    seed_cache_unlink(e);
+    seed_cache_push(e);
+
+    e->pins++;
+    return e->mem;
+
+  }
+
+  seed_cache_misses++;
+
+  if (q->len > seed_cache_limit) return load_queue_entry(q);
+
+  /* Make room, skipping pinned entries. */
+
+  victim = seed_cache_tail;
+
+  while (victim && seed_cache_used + q->len > seed_cache_limit) {
+
+    struct seed_cache_ent* prev = victim->prev;
+
+    if (!victim->pins) seed_cache_drop(victim->q);
+    victim = prev;
+
+  }
+
+  if (seed_cache_used + q->len > seed_cache_limit) return load_queue_entry(q);
+
+  e = ck_alloc(sizeof(struct seed_cache_ent));
+
+  e->q    = q;
+  e->mem  = load_queue_entry(q);
+  e->len  = q->len;
+  e->pins = 1;
+
+  seed_cache_push(e);
+  seed_cache_used += e->len;
+  q->cache_ent = e;
+
+  return e->mem;
+
+}
+
+
+static void seed_cache_put(struct queue_entry* q, u8* mem) {
+
+  if (q->cache_ent && q->cache_ent->mem == mem) q->cache_ent->pins--;
+  else ck_free(mem);
+
+}
+
+
+/* Rewrite the pack_entry of q, once data holds what it points to. */
+
+static void pack_put_index(struct queue_entry* q) {
+
+  struct pack_entry e;
+
+  memset(&e, 0, sizeof(e));
+
+  e.offset   = q->pack_off;
+  e.len      = q->len;
+  e.name_len = strlen(strrchr(q->fname, '/') + 1);
+  e.cal_off  = q->cal_off;
+  e.cal_len  = q->cal_len;
+
+  if (pwrite(pack_index_fd, &e, sizeof(e), sizeof(struct pack_header) +
+             (u64)q->entry_id * sizeof(e)) != sizeof(e))
+    PFATAL("Short write to queue pack index");
+
+}
+
+
+/* Store the contents of q, replacing the previous version if there was
+   one. The calibration record of the old version no longer applies. */
+
+static void write_queue_entry(struct queue_entry* q, u8* mem, u32 len) {
+
+  struct iovec iov[2];
+  u32 name_len;
+  u8* name;
+  s32 fd;
+
+  q->cal_len      = 0;
+  q->content_hash = hash64(mem, len, HASH_CONST);
+
+  if (!queue_pack) {
+
+    q->packed = 0;
+    seed_cache_drop(q);
+
+    unlink(q->fname); /* ignore errors */
+
+    fd = open(q->fname, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) PFATAL("Unable to create '%s'", q->fname);
+
+    ck_write(fd, mem, len, q->fname);
+    close(fd);
+
+    return;
+
+  }
+
+  name     = strrchr(q->fname, '/') + 1;
+  name_len = strlen(name);
+
+  if (pack_len + name_len + len > PACK_MAP_SIZE)
+    FATAL("Queue pack is full (limit is %s)", DMS(PACK_MAP_SIZE));
+
+  seed_cache_drop(q);
+
+  iov[0].iov_base = name;
+  iov[0].iov_len  = name_len;
+  iov[1].iov_base = mem;
+  iov[1].iov_len  = len;
+
+  if (writev(pack_data_fd, iov, 2) != name_len + len)
+    PFATAL("Short write to queue pack");
+
+  q->pack_off = pack_len + name_len;
+  q->packed   = 2;
+  pack_len   += name_len + len;
+
+  pack_put_index(q);
+
+}
+
+
+/* Queue the entries of a packed input directory. Their contents stay in
+   in_pack_map until pivot_inputs() has copied them. Returns 0 if dir has
+   no pack. */
+
+static u8 read_packed_testcases(u8* dir) {
+
+  struct pack_entry* idx;
+  u64 idx_len, cnt, i;
+  u8* fn;
+
+  fn = alloc_printf("%s/.state/pack/index", dir);
+  idx = (struct pack_entry*)pack_map_file(fn, PACK_INDEX_MAGIC, &idx_len);
+  ck_free(fn);
+
+  if (!idx) return 0;
+
+  fn = alloc_printf("%s/.state/pack/data", dir);
+  in_pack_map = pack_map_file(fn, PACK_DATA_MAGIC, &in_pack_len);
+
+  if (!in_pack_map) FATAL("Queue pack in '%s' has an index but no data", dir);
+
+  ck_free(fn);
+
+  ACTF("Reading the queue pack in '%s'...", dir);
+
+  cnt = (idx_len - sizeof(struct pack_header)) / sizeof(struct pack_entry);
+
+  for (i = 0; i < cnt; i++) {
+
+    struct pack_entry* e = (struct pack_entry*)
+                           ((u8*)idx + sizeof(struct pack_header)) + i;
+    struct proximity_score temp_prox_score = {.original = 0, .adjusted = .0};
+    u8* name = pack_entry_name(in_pack_map, in_pack_len, e);
+    u8* dfn;
+    u8  passed_det;
+
+    if (!name || !e->len) continue;
+
+    if (e->len > MAX_FILE)
+      FATAL("Test case '%.*s' is too big (%s, limit is %s)", e->name_len,
+            name, DMS(e->len), DMS(MAX_FILE));
+
+    fn  = alloc_printf("%s/%.*s", dir, e->name_len, name);
+    dfn = alloc_printf("%s/.state/deterministic_done/%.*s", dir, e->name_len,
+                       name);
+
+    passed_det = !access(dfn, F_OK);
+    ck_free(dfn);
+
+    add_to_queue(fn, e->len, passed_det, &temp_prox_score);
+
+    queue_last->packed   = 1;
+    queue_last->pack_off = e->offset;
+
+    /* Until pivot_inputs(), the calibration record is in in_pack_map as
+       well. */
+
+    if (pack_entry_cal(in_pack_map, in_pack_len, e)) {
+      queue_last->cal_off = e->cal_off;
+      queue_last->cal_len = e->cal_len;
+    }
+
+  }
+
+  munmap(idx, idx_len);
+
+  return 1;
+
+}
+
+
 /* Read all testcases from the input directory, then queue them for testing.
    Called at startup. */
 
@@ -2732,6 +4170,10 @@ static void read_testcases(void) {
   fn = alloc_printf("%s/queue", in_dir);
   if (!access(fn, F_OK)) in_dir = fn; else ck_free(fn);
 
+  /* A packed queue directory holds nothing else worth reading. */
+
+  if (read_packed_testcases(in_dir)) goto check_queued;
+
   ACTF("Scanning '%s'...", in_dir);
 
   /* We use scandir() + alphasort() rather than readdir() because otherwise,
@@ -2805,6 +4247,8 @@ static void read_testcases(void) {
 
   free(nl); /* not tracked */
 
+check_queued:
+
   if (!queued_paths) {
 
     SAYF("\n" cLRD "[-] " cRST
@@ -3293,6 +4737,33 @@ static void destroy_extras(void) {
    cloning a stopped child. So, we just execute once, and then send commands
    through a pipe. The other part of this logic is in afl-as.h. */
 
+/* Use only the first size bytes of trace_bits[], as told by a target built
+   with DAFL_SEQ_IDS. The word scans want a multiple of 64; the virgin maps,
+   checkpoints and the SHM itself stay at MAP_SIZE. */
+
+static void set_map_size(u32 size) {
+
+  size = (size + 63) & ~63;
+
+  if (size > MAP_SIZE) {
+    WARNF("Target uses %u map bytes, more than MAP_SIZE; IDs will collide.",
+          size);
+    size = MAP_SIZE;
+  }
+
+  if (size == map_size) return;
+
+  if (map_size != MAP_SIZE)
+    FATAL("Target changed its map size from %u to %u", map_size, size);
+
+  map_size = size;
+  invalidate_trace_idx();
+
+  OKF("Target has sequential edge IDs, using %u bytes of the map.", map_size);
+
+}
+
+
 EXP_ST void init_forkserver(char** argv) {
 
   static struct itimerval it;
@@ -3448,6 +4919,9 @@ EXP_ST void init_forkserver(char** argv) {
      Otherwise, try to figure out what went wrong. */
 
   if (rlen == 4) {
+    if ((status & (FS_OPT_ENABLED | FS_OPT_MAPSIZE)) ==
+        (FS_OPT_ENABLED | FS_OPT_MAPSIZE))
+      set_map_size(status & FS_OPT_SIZE_MASK);
     OKF("All right - fork server is up.");
     return;
   }
@@ -3582,17 +5056,14 @@ EXP_ST void init_forkserver(char** argv) {
 }
 
 
-/* Execute target application, monitoring for timeouts. Return status
-   information. The called program will update trace_bits[]. */
-
-static u8 run_target(char** argv, u32 timeout, char* env_opt, u8 force_dumb_mode) {
+/* Start the target application on the current test case and arm the
+   timeout, without waiting for it to finish; run_target_wait() collects
+   the result. Returns 0 if the fork server went away while stopping. */
 
-  static struct itimerval it;
-  static u32 prev_timed_out = 0;
-  static u64 exec_ms = 0;
+static u8 run_target_start(char** argv, u32 timeout, char* env_opt,
+                           u8 force_dumb_mode) {
 
-  int status = 0;
-  u32 tb4;
+  struct itimerval it;
 
   child_timed_out = 0;
 
@@ -3600,8 +5071,9 @@ static u8 run_target(char** argv, u32 timeout, char* env_opt, u8 force_dumb_mode
      must prevent any earlier operations from venturing into that
      territory. */
 
-  memset(trace_bits, 0, MAP_SIZE);
+  memset(trace_bits, 0, map_size);
   memset(dfg_bits, 0, sizeof(u32) * DFG_MAP_SIZE);
+  invalidate_trace_idx();
   *last_location = MAP_SIZE + 1;
   MEM_BARRIER();
 
@@ -3712,14 +5184,30 @@ static u8 run_target(char** argv, u32 timeout, char* env_opt, u8 force_dumb_mode
 
   }
 
-  /* Configure timeout, as requested by user, then wait for child to terminate. */
+  /* Configure timeout, as requested by user. The SIGALRM handler simply
+     kills the child_pid and sets child_timed_out. */
 
+  memset(&it, 0, sizeof(it));
   it.it_value.tv_sec = (timeout / 1000);
   it.it_value.tv_usec = (timeout % 1000) * 1000;
 
   setitimer(ITIMER_REAL, &it, NULL);
 
-  /* The SIGALRM handler simply kills the child_pid and sets child_timed_out. */
+  return 1;
+
+}
+
+
+/* Wait for the child started by run_target_start() to terminate. Return
+   status information. The called program will update trace_bits[]. */
+
+static u8 run_target_wait(u32 timeout, u8 force_dumb_mode) {
+
+  struct itimerval it;
+  u64 exec_ms;
+
+  int status = 0;
+  u32 tb4;
 
   if (force_dumb_mode == 1 || dumb_mode == 1 || no_forkserver) {
 
@@ -3759,11 +5247,11 @@ static u8 run_target(char** argv, u32 timeout, char* env_opt, u8 force_dumb_mode
 
   tb4 = *(u32*)trace_bits;
 
-#ifdef WORD_SIZE_64
-  classify_counts((u64*)trace_bits);
-#else
-  classify_counts((u32*)trace_bits);
-#endif /* ^WORD_SIZE_64 */
+  /* Callers that go straight to save_if_interesting() let it bucket the
+     counts as part of its fused scan instead. */
+
+  if (defer_classify) trace_raw = 1;
+  else classify_trace();
 
   prev_timed_out = child_timed_out;
 
@@ -3801,11 +5289,23 @@ static u8 run_target(char** argv, u32 timeout, char* env_opt, u8 force_dumb_mode
 }
 
 
-/* Write modified data to file for testing. If out_file is set, the old file
-   is unlinked and a new one is created. Otherwise, out_fd is rewound and
-   truncated. */
+/* Execute target application, monitoring for timeouts. Return status
+   information. The called program will update trace_bits[]. */
 
-static void write_to_testcase(void* mem, u32 len) {
+static u8 run_target(char** argv, u32 timeout, char* env_opt, u8 force_dumb_mode) {
+
+  if (!run_target_start(argv, timeout, env_opt, force_dumb_mode)) return 0;
+
+  return run_target_wait(timeout, force_dumb_mode);
+
+}
+
+
+/* Write modified data to file for testing. If out_file is set, the old file
+   is unlinked and a new one is created. Otherwise, out_fd is rewound and
+   truncated. */
+
+static void write_to_testcase(void* mem, u32 len) {
 
   s32 fd = out_fd;
 
@@ -3864,22 +5364,24 @@ static void write_with_gap(void* mem, u32 len, u32 skip_at, u32 skip_len) {
 static u8 check_unique_path() {
   if (!check_covered_target()) return 0;
   // q->trace_mini = ck_alloc(MAP_SIZE >> 3);
-  // minimize_bits(q->trace_mini, trace_bits);
+  // minimize_bits(q->trace_mini);
   u32 checksum = get_dfg_checksum();
   // SAYF("[unique-path] [id %u] [checksum %u]\n", queued_paths, checksum);
   struct key_value_pair *kvp = hashmap_get(dfg_hashmap, checksum);
   if (!kvp) {
-    if (not_on_tty) {
+    // With shared DFG state, a path a sibling has seen is known, not unique
+    u8 is_new = !dfg_shm || dfgshm_set_add(dfg_shm->paths, DFGSHM_SET_SIZE, checksum);
+    if (is_new && not_on_tty) {
       ACTF("Found unique path %u, checksum %u", queued_paths, checksum);
     }
     hashmap_insert(dfg_hashmap, checksum, NULL);
-    update_dfg_count_map(NULL);
+    if (is_new) update_dfg_count_map(NULL);
     if (vertical_experiment || vertical_use_dynamic) {
       struct vertical_entry *ve = vertical_entry_create(checksum);
       hashmap_insert(vertical_manager->map, checksum, ve);
-      LOGF("[vertical] [entry-add] [id %u] [checksum %u]\n", hashmap_size(vertical_manager->map), checksum);
+      EVLOG(EV_VERTICAL_ENTRY_ADD, hashmap_size(vertical_manager->map), checksum);
     }
-    return 1;
+    if (is_new) return 1;
   }
   // SAYF("[non-unique-path] [id %u] [checksum %u]\n", queued_paths, checksum);
   vertical_is_persistent = queue_cur ? (checksum == queue_cur->dfg_cksum) : 0;
@@ -3990,7 +5492,7 @@ static u8 check_coverage(u8 crashed, char** argv, void* mem, u32 len) {
     if (result == NULL) return 0;
     if(sscanf(covered, "__localize: %d", &parsed_line) != 1) return 0;
     if(parsed_line == line) {
-      LOGF("[cov] [new %u] [old 1]\n", coverage_result);
+      EVLOG(EV_COV, coverage_result);
       return 1;
     }
     else return 0;
@@ -4020,7 +5522,7 @@ static void save_valuation(u8 crashed, u8 is_unique, u32 dfg_cksum, u32 hash, st
     hashmap_insert(unique_mem_hashmap, hash, NULL);
     u8 *target_file = alloc_printf("memory/%s/id:%06llu", crashed ? "neg" : "pos",
                                    crashed ? total_saved_crashes : total_saved_positives);
-    LOGF("[pacfix] [mem] [%s] [seed %d] [entry %d] [id %llu] [hash %u] [time %llu] [file %s]\n", crashed == 1 ? "neg" : "pos", queue_cur ? queue_cur->entry_id : -1, q ? q->entry_id : -1,
+    EVLOG(EV_PACFIX_MEM, crashed == 1 ? "neg" : "pos", queue_cur ? queue_cur->entry_id : -1, q ? q->entry_id : -1,
        crashed ? total_saved_crashes : total_saved_positives, hash, get_cur_time() - start_time, target_file);
     u8 *target_file_full = alloc_printf("%s/%s", out_dir, target_file);
     rename(valuation_file, target_file_full);
@@ -4035,13 +5537,13 @@ static void save_valuation(u8 crashed, u8 is_unique, u32 dfg_cksum, u32 hash, st
   }
   
   if (no_unique_val) {
-    LOGF("[nuv] [dfg-path %u] [hash %u] [seed %d] [crash %u] [time %llu]\n", dfg_cksum, hash, queue_cur ? queue_cur->entry_id : -1, crashed, get_cur_time() - start_time);
+    EVLOG(EV_NUV, dfg_cksum, hash, queue_cur ? queue_cur->entry_id : -1, crashed, get_cur_time() - start_time);
   }
   struct key_value_pair *local_kvp = hashmap_get(vertical_manager->map, dfg_cksum);
   if (!local_kvp) {
     struct vertical_entry *ve = vertical_entry_create(dfg_cksum);
     hashmap_insert(vertical_manager->map, dfg_cksum, ve);
-    LOGF("[vertical] [entry-add-late] [id %u] [checksum %u]\n", hashmap_size(vertical_manager->map), dfg_cksum);
+    EVLOG(EV_VERTICAL_ENTRY_ADD_LATE, hashmap_size(vertical_manager->map), dfg_cksum);
     local_kvp = hashmap_get(vertical_manager->map, dfg_cksum);
   }
   if (local_kvp) {
@@ -4061,12 +5563,28 @@ static void save_valuation(u8 crashed, u8 is_unique, u32 dfg_cksum, u32 hash, st
       } else {
         vertical_entry_add(vertical_manager, local_entry, q, local_valuation_kvp);
         hashmap_insert(local_valuation_hashmap, hash, q);
-        LOGF("[vertical] [valuation] [seed %d] [entry %d] [dfg-path %u] [hash %u] [id %u] [persistent %u] [time %llu]\n", queue_cur ? queue_cur->entry_id : -1, q ? q->entry_id : -1, dfg_cksum, hash, hashmap_size(local_valuation_hashmap), vertical_is_persistent, get_cur_time() - start_time);
+        EVLOG(EV_VERTICAL_VALUATION, queue_cur ? queue_cur->entry_id : -1, q ? q->entry_id : -1, dfg_cksum, hash, hashmap_size(local_valuation_hashmap), vertical_is_persistent, get_cur_time() - start_time);
       }
     }
   } else {
-    LOGF("[error] [valuation] [no local hashmap found] [dfg-path %u] [hash %u]\n", dfg_cksum, hash);
+    EVLOG(EV_ERR_VALUATION, dfg_cksum, hash);
+  }
+}
+
+// A valuation that is not unique may still be new for the DFG path
+static void note_known_valuation(u32 dfg_cksum, u32 hash) {
+  struct key_value_pair *local_kvp = hashmap_get(vertical_manager->map, dfg_cksum);
+  if (!local_kvp) {
+    struct vertical_entry *ve = vertical_entry_create(dfg_cksum);
+    hashmap_insert(vertical_manager->map, dfg_cksum, ve);
+    EVLOG(EV_VERTICAL_ENTRY_ADD_LATE, hashmap_size(vertical_manager->map), dfg_cksum);
+    local_kvp = hashmap_get(vertical_manager->map, dfg_cksum);
   }
+  struct vertical_entry *local_entry = local_kvp->value;
+  struct hashmap *local_valuation_hashmap = local_entry->value_map;
+  struct key_value_pair *local_valuation_kvp = hashmap_get(local_valuation_hashmap, hash);
+  if (!local_valuation_kvp)
+    vertical_is_new_valuation = 1;
 }
 
 static u8 get_valuation(u8 crashed, char** argv, void* mem, u32 len, u32 dfg_cksum, u32 *val_hash, u8 **valuation_file) {
@@ -4083,6 +5601,20 @@ static u8 get_valuation(u8 crashed, char** argv, void* mem, u32 len, u32 dfg_cks
 
   if(!getenv("PACFIX_VAL_EXE")) return 0;
   if(!getenv("PACFIX_COV_DIR")) return 0;
+
+  // With shared DFG state, a sibling may have run the valuation already
+  u64 content_hash = 0;
+  u32 hash;
+  if (dfg_shm) {
+    content_hash = hash64(mem, len, HASH_CONST);
+    if (dfgshm_memo_get(dfg_shm, content_hash, len, &hash)) {
+      dfg_shm_val_skips++;
+      *val_hash = hash;
+      note_known_valuation(dfg_cksum, hash);
+      return 0;
+    }
+  }
+
   valexe = getenv("PACFIX_VAL_EXE");
   covdir = getenv("PACFIX_COV_DIR");
   tmpfile = alloc_printf((crashed ? "%s/__valuation_file_%llu" : "%s/__valuation_file_noncrash_%llu"), covdir, (crashed ? total_saved_crashes : total_saved_positives));
@@ -4104,25 +5636,15 @@ static u8 get_valuation(u8 crashed, char** argv, void* mem, u32 len, u32 dfg_cks
     return 0;
   }
 
-  u32 hash = hash_file(tmpfile);
+  hash = hash_file(tmpfile);
   *val_hash = hash;
+  if (dfg_shm) dfgshm_memo_put(dfg_shm, content_hash, len, hash);
   struct key_value_pair *kvp = hashmap_get(unique_mem_hashmap, hash);
-  // Check if the hash is already in the hashmap
-  if (kvp) {
+  // Check if the hash is already in the hashmap (or known to a sibling)
+  if (kvp || (dfg_shm && !dfgshm_set_add(dfg_shm->valuations, DFGSHM_SET_SIZE, hash))) {
     remove(tmpfile);
     ck_free(tmpfile);
-    struct key_value_pair *local_kvp = hashmap_get(vertical_manager->map, dfg_cksum);
-    if (!local_kvp) {
-      struct vertical_entry *ve = vertical_entry_create(dfg_cksum);
-      hashmap_insert(vertical_manager->map, dfg_cksum, ve);
-      LOGF("[vertical] [entry-add-late] [id %u] [checksum %u]\n", hashmap_size(vertical_manager->map), dfg_cksum);
-      local_kvp = hashmap_get(vertical_manager->map, dfg_cksum);
-    }
-    struct vertical_entry *local_entry = local_kvp->value;
-    struct hashmap *local_valuation_hashmap = local_entry->value_map;
-    struct key_value_pair *local_valuation_kvp = hashmap_get(local_valuation_hashmap, hash);
-    if (!local_valuation_kvp)
-      vertical_is_new_valuation = 1;
+    note_known_valuation(dfg_cksum, hash);
     return 0;
   } else {
     *valuation_file = tmpfile;
@@ -4174,7 +5696,7 @@ static u8 calibrate_case(char** argv, struct queue_entry* q, u8* use_mem,
 
   if (q->exec_cksum) {
 
-    memcpy(first_trace, trace_bits, MAP_SIZE);
+    memcpy(first_trace, trace_bits, map_size);
     hnb = has_new_bits(virgin_bits);
     if (hnb > new_bits) new_bits = hnb;
 
@@ -4197,12 +5719,12 @@ static u8 calibrate_case(char** argv, struct queue_entry* q, u8* use_mem,
 
     if (stop_soon || !(fault == FAULT_CRASH || fault == FAULT_NONE)) goto abort_calibration;
 
-    if (!dumb_mode && !stage_cur && !count_bytes(trace_bits)) {
+    if (!dumb_mode && !stage_cur && !count_trace_bytes()) {
       fault = FAULT_NOINST;
       goto abort_calibration;
     }
 
-    cksum = hash32(trace_bits, MAP_SIZE, HASH_CONST);
+    cksum = hash32(trace_bits, map_size, HASH_CONST);
 
     if (q->exec_cksum != cksum) {
 
@@ -4213,7 +5735,7 @@ static u8 calibrate_case(char** argv, struct queue_entry* q, u8* use_mem,
 
         u32 i;
 
-        for (i = 0; i < MAP_SIZE; i++) {
+        for (i = 0; i < map_size; i++) {
 
           if (!var_bytes[i] && first_trace[i] != trace_bits[i]) {
 
@@ -4229,7 +5751,7 @@ static u8 calibrate_case(char** argv, struct queue_entry* q, u8* use_mem,
       } else {
 
         q->exec_cksum = cksum;
-        memcpy(first_trace, trace_bits, MAP_SIZE);
+        memcpy(first_trace, trace_bits, map_size);
 
       }
 
@@ -4246,7 +5768,7 @@ static u8 calibrate_case(char** argv, struct queue_entry* q, u8* use_mem,
      This is used for fuzzing air time calculations in calculate_score(). */
 
   q->exec_us     = (stop_us - start_us) / stage_max;
-  q->bitmap_size = count_bytes(trace_bits);
+  q->bitmap_size = count_trace_bytes();
   compute_proximity_score(&q->prox_score, dfg_bits, 1);
   if (q->base_crash_seed) return fault;
 
@@ -4304,6135 +5826,9434 @@ abort_calibration:
 }
 
 
-/* Examine map coverage. Called once, for first test case. */
-
-static void check_map_coverage(void) {
+/* Scheduler checkpoints, see ckpt.h. */
 
-  u32 i;
+static u8  *ckpt_buf,                 /* Checkpoint loaded for resume     */
+           *ckpt_pos,                 /* Read cursor in ckpt_buf          */
+           *ckpt_end;                 /* End of ckpt_buf                  */
+static u8  ckpt_bad;                  /* Parse error in ckpt_buf          */
+static u32 ckpt_count;                /* Entry ids known to ckpt_buf      */
+static struct queue_entry**
+           ckpt_by_id;                /* Current queue, by entry_id       */
+static FILE* ckpt_file;               /* Checkpoint being written         */
+static u64 last_ckpt_time;            /* Time of the last checkpoint      */
+static u8  no_checkpoint;             /* AFL_NO_CHECKPOINT set?           */
 
-  if (count_bytes(trace_bits) < 100) return;
+static u8 delete_files(u8* path, u8* prefix);
 
-  for (i = (1 << (MAP_SIZE_POW2 - 1)); i < MAP_SIZE; i++)
-    if (trace_bits[i]) return;
+static void ckpt_put(const void* data, u32 len) {
 
-  WARNF("Recompile binary with newer version of afl to improve coverage!");
+  fwrite(data, 1, len, ckpt_file);
 
 }
 
+static void ckpt_put_u32(u32 val) {
 
-/* Perform dry run of all test cases to confirm that the app is working as
-   expected. This is done only for the initial inputs, and only once. */
-
-static void perform_dry_run(char** argv, char *base_crash_seed) {
-
-  struct queue_entry* q = queue;
-  u32 cal_failures = 0;
-  u8 has_crashing_seed = 0;
-  u8* skip_crashes = getenv("AFL_SKIP_CRASHES");
+  ckpt_put(&val, sizeof(u32));
 
-  if (base_crash_seed) {
+}
 
-    s32 fd = open(base_crash_seed, O_RDONLY);
-    if (fd < 0) PFATAL("Unable to open base crash seed '%s'", base_crash_seed);
-    struct stat st;
-    if (fstat(fd, &st) < 0) PFATAL("fstat() failed");
-    u64 len = st.st_size;
-    u8* use_mem = ck_alloc_nozero(len);
-    if (read(fd, use_mem, len) != len) FATAL("Short read from '%s'", base_crash_seed);
-    close(fd);
+static u32 ckpt_id(struct queue_entry* q) {
 
-    struct queue_entry base_entry;
-    memset(&base_entry, 0, sizeof(struct queue_entry));
-    base_entry.fname = base_crash_seed;
-    base_entry.len = len;
-    base_entry.base_crash_seed = 1;
-    u8 res = calibrate_case(argv, &base_entry, use_mem, 0, 1);
-    if (res != FAULT_CRASH) PFATAL("Base crash seed *does not* crash");
-    has_crashing_seed = 1;
+  return q ? q->entry_id : CKPT_NONE;
 
-    u32 checksum = get_dfg_checksum();
-    if (check_covered_target()) {
-      for (u32 i = 0; i < DFG_MAP_SIZE; i++) {
-        if (dfg_targets[i] > MAP_SIZE) {
-          dfg_targets[i] = *last_location;
-          break;
-        } else if (dfg_targets[i] == *last_location) {
-          break;
-        }
-      }
-    }
+}
 
-  }
+static void ckpt_put_id_pair(u32 key, void* value) {
 
-  while (q) {
+  ckpt_put_u32(key);
+  ckpt_put_u32(ckpt_id(value));
 
-    u8* use_mem;
-    u8  res;
-    s32 fd;
+}
 
-    u8* fn = strrchr(q->fname, '/') + 1;
+static void ckpt_put_key(u32 key, void* value) {
 
-    ACTF("Attempting dry run with '%s'...", fn);
+  ckpt_put_u32(key);
 
-    fd = open(q->fname, O_RDONLY);
-    if (fd < 0) PFATAL("Unable to open '%s'", q->fname);
+}
 
-    use_mem = ck_alloc_nozero(q->len);
+static void ckpt_put_count_pair(u32 key, void* value) {
 
-    if (read(fd, use_mem, q->len) != q->len)
-      FATAL("Short read from '%s'", q->fname);
+  u64 count = (u64)value;
 
-    close(fd);
+  ckpt_put_u32(key);
+  ckpt_put(&count, sizeof(u64));
 
-    res = calibrate_case(argv, q, use_mem, 0, 1);
-    u32 checksum = get_dfg_checksum();
-    q->dfg_cksum = checksum;
-    q->last_location = *last_location;
-    u8 *valuation_file;
-    u8 val_result = 0;
-    LOGF("[vertical] [dry-run] [id %u] [dfg-path %u] [res %u] [file %s] [last-loc %u]\n", q->entry_id, checksum, res, q->fname, *last_location);
+}
 
-    if (stop_soon) return;
+static void ckpt_put_vector(struct vector* vec) {
 
-    if (res == crash_mode || res == FAULT_NOBITS)
-      SAYF(cGRA "    len = %u, map size = %u, exec speed = %llu us\n" cRST,
-           q->len, q->bitmap_size, q->exec_us);
+  u32 i, size = vector_size(vec);
 
-    switch (res) {
+  ckpt_put_u32(size);
 
-      case FAULT_NONE:
+  for (i = 0; i < size; i++)
+    ckpt_put_u32(ckpt_id(vector_get(vec, i)));
 
-        if (q == queue) check_map_coverage();
+}
 
-        if (check_covered_target()) {
+static void ckpt_put_hashmap(struct hashmap* map, hashmap_iterate_fn fn) {
 
-          if (dfg_node_info_map) {
-            check_unique_path();
-          }
-          u32 val_hash;
-          val_result = get_valuation(0, argv, use_mem, q->len, checksum, &val_hash, &valuation_file);
-          save_valuation(0, val_result, checksum, val_hash, q, valuation_file);
-        }
+  ckpt_put_u32(hashmap_size(map));
+  hashmap_iterate(map, fn);
 
-        break;
+}
 
-      case FAULT_TMOUT:
+static void ckpt_put_vertical_entry(u32 key, void* value) {
 
-        if (timeout_given) {
+  struct vertical_entry* ve = value;
 
-          /* The -t nn+ syntax in the command line sets timeout_given to '2' and
-             instructs afl-fuzz to tolerate but skip queue entries that time
-             out. */
+  ckpt_put_u32(ve->hash);
+  ckpt_put_u32(ve->use_count);
+  ckpt_put_vector(ve->entries);
+  ckpt_put_vector(ve->old_entries);
+  ckpt_put_hashmap(ve->value_map, ckpt_put_id_pair);
 
-          if (timeout_given > 1) {
-            WARNF("Test case results in a timeout (skipping)");
-            q->cal_failed = CAL_CHANCES;
-            cal_failures++;
-            break;
-          }
+}
 
-          SAYF("\n" cLRD "[-] " cRST
-               "The program took more than %u ms to process one of the initial test cases.\n"
-               "    Usually, the right thing to do is to relax the -t option - or to delete it\n"
-               "    altogether and allow the fuzzer to auto-calibrate. That said, if you know\n"
-               "    what you are doing and want to simply skip the unruly test cases, append\n"
-               "    '+' at the end of the value passed to -t ('-t %u+').\n", exec_tmout,
-               exec_tmout);
+static void ckpt_put_vertical_list(struct vertical_entry* ve) {
 
-          FATAL("Test case '%s' results in a timeout", fn);
+  struct vertical_entry* cur;
+  u32 count = 0;
 
-        } else {
+  for (cur = ve; cur; cur = cur->next) count++;
 
-          SAYF("\n" cLRD "[-] " cRST
-               "The program took more than %u ms to process one of the initial test cases.\n"
-               "    This is bad news; raising the limit with the -t option is possible, but\n"
-               "    will probably make the fuzzing process extremely slow.\n\n"
+  ckpt_put_u32(count);
 
-               "    If this test case is just a fluke, the other option is to just avoid it\n"
-               "    altogether, and find one that is less of a CPU hog.\n", exec_tmout);
+  for (cur = ve; cur; cur = cur->next) ckpt_put_u32(cur->hash);
 
-          FATAL("Test case '%s' results in a timeout", fn);
+}
 
-        }
+static void ckpt_put_prox(struct ckpt_prox* dst, struct proximity_score* src) {
 
-      case FAULT_CRASH:
-        has_crashing_seed = 1;
-        if (check_covered_target()) {
-          // Add to crash location only if base_crash_seed not provided
-          if (!base_crash_seed) {
-            for (u32 i = 0; i < DFG_MAP_SIZE; i++) {
-              if (dfg_targets[i] > MAP_SIZE) {
-                dfg_targets[i] = *last_location;
-                break;
-              } else if (dfg_targets[i] == *last_location) {
-                break;
-              }
-            }
-          }
-          if (dfg_node_info_map) {
-            check_unique_path();
-          }
-          u8 is_neg_val = check_last_location(*last_location);
-          u32 val_hash;
-          val_result = get_valuation(is_neg_val, argv, use_mem, q->len, checksum, &val_hash, &valuation_file);
-          save_valuation(is_neg_val, val_result, checksum, val_hash, q, valuation_file);
-        }
+  dst->original = src->original;
+  dst->adjusted = src->adjusted;
+  dst->covered  = src->covered;
 
-        if (crash_mode) break;
+}
 
-        if (skip_crashes) {
-          WARNF("Test case results in a crash (skipping)");
-          q->cal_failed = CAL_CHANCES;
-          cal_failures++;
-          break;
-        }
+static void ckpt_get_prox(struct proximity_score* dst, struct ckpt_prox* src) {
 
-        if (mem_limit) {
+  dst->original = src->original;
+  dst->adjusted = src->adjusted;
+  dst->covered  = src->covered;
 
-          SAYF("\n" cLRD "[-] " cRST
-               "Oops, the program crashed with one of the test cases provided. There are\n"
-               "    several possible explanations:\n\n"
+}
 
-               "    - The test case causes known crashes under normal working conditions. If\n"
-               "      so, please remove it. The fuzzer should be seeded with interesting\n"
-               "      inputs - but not ones that cause an outright crash.\n\n"
+/* Hash of the contents of an input. Calibration records and afl-syncd
+   messages keep the low 32 bits of it. */
 
-               "    - The current memory limit (%s) is too low for this program, causing\n"
-               "      it to die due to OOM when parsing valid files. To fix this, try\n"
-               "      bumping it up with the -m setting in the command line. If in doubt,\n"
-               "      try something along the lines of:\n\n"
+static u32 cal_content_hash(u8* mem, u32 len) {
 
-#ifdef RLIMIT_AS
-               "      ( ulimit -Sv $[%llu << 10]; /path/to/binary [...] <testcase )\n\n"
-#else
-               "      ( ulimit -Sd $[%llu << 10]; /path/to/binary [...] <testcase )\n\n"
-#endif /* ^RLIMIT_AS */
+  return hash64(mem, len, HASH_CONST);
 
-               "      Tip: you can use http://jwilk.net/software/recidivm to quickly\n"
-               "      estimate the required amount of virtual memory for the binary. Also,\n"
-               "      if you are using ASAN, see %s/notes_for_asan.txt.\n\n"
+}
 
-#ifdef __APPLE__
 
-               "    - On MacOS X, the semantics of fork() syscalls are non-standard and may\n"
-               "      break afl-fuzz performance optimizations when running platform-specific\n"
-               "      binaries. To fix this, set AFL_NO_FORKSRV=1 in the environment.\n\n"
+/* hash64() of the contents of q, packed or not. write_queue_entry() sets
+   it; entries queued from the input dir are hashed on first use. */
 
-#endif /* __APPLE__ */
+static u64 hash_queue_entry(struct queue_entry* q) {
 
-               "    - Least likely, there is a horrible bug in the fuzzer. If other options\n"
-               "      fail, poke <lcamtuf@coredump.cx> for troubleshooting tips.\n",
-               DMS(mem_limit << 20), mem_limit - 1, doc_path);
+  u8* mem;
 
-        } else {
+  if (q->content_hash) return q->content_hash;
 
-          SAYF("\n" cLRD "[-] " cRST
-               "Oops, the program crashed with one of the test cases provided. There are\n"
-               "    several possible explanations:\n\n"
+  mem = packed_entry_mem(q);
 
-               "    - The test case causes known crashes under normal working conditions. If\n"
-               "      so, please remove it. The fuzzer should be seeded with interesting\n"
-               "      inputs - but not ones that cause an outright crash.\n\n"
+  if (mem) {
+    q->content_hash = hash64(mem, q->len, HASH_CONST);
+  } else {
+    mem = load_queue_entry(q);
+    q->content_hash = hash64(mem, q->len, HASH_CONST);
+    ck_free(mem);
+  }
 
-#ifdef __APPLE__
+  return q->content_hash;
 
-               "    - On MacOS X, the semantics of fork() syscalls are non-standard and may\n"
-               "      break afl-fuzz performance optimizations when running platform-specific\n"
-               "      binaries. To fix this, set AFL_NO_FORKSRV=1 in the environment.\n\n"
+}
 
-#endif /* __APPLE__ */
 
-               "    - Least likely, there is a horrible bug in the fuzzer. If other options\n"
-               "      fail, poke <lcamtuf@coredump.cx> for troubleshooting tips.\n");
+/* Identifies the target binary, so that a checkpoint or calibration record
+   is not applied to a rebuilt target whose coverage or DFG ids may have
+   changed. The binary is hashed once per run. */
 
-        }
+static void get_target_id(u64* size, u32* hash) {
 
-        FATAL("Test case '%s' results in a crash", fn);
+  static u64 target_size;
+  static u32 target_hash;
+  static u8  target_known;
 
-      case FAULT_ERROR:
+  if (!target_known) {
 
-        FATAL("Unable to execute target application ('%s')", argv[0]);
+    struct stat st;
 
-      case FAULT_NOINST:
+    if (stat(target_path, &st)) PFATAL("Unable to stat '%s'", target_path);
 
-        FATAL("No instrumentation detected");
+    target_size  = st.st_size;
+    target_hash  = hash_file(target_path);
+    target_known = 1;
 
-      case FAULT_NOBITS:
+  }
 
-        useless_at_start++;
+  *size = target_size;
+  *hash = target_hash;
 
-        if (!in_bitmap && !shuffle_queue)
-          WARNF("No new instrumentation output, test case may be useless.");
+}
 
-        break;
 
-    }
+/* Write the scheduler state to out_dir/scheduler.ckpt. */
 
-    if (q->var_behavior) WARNF("Instrumentation output varies across runs.");
+static void write_checkpoint(void) {
 
-    q = q->next;
+  struct ckpt_header hdr;
+  struct ckpt_globals g;
+  struct queue_entry* q;
+  u8 *fn, *tmp;
+  u32 i;
+  s32 fd;
 
-    ck_free(use_mem);
+  if (no_checkpoint) return;
 
-  }
+  tmp = alloc_printf("%s/scheduler.ckpt.tmp", out_dir);
+  fn  = alloc_printf("%s/scheduler.ckpt", out_dir);
 
-  if (!vertical_experiment && crash_mode && !has_crashing_seed)
-    FATAL("All test cases did *NOT* crash: invalid -C setting?");
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) PFATAL("Unable to create '%s'", tmp);
 
-  if (cal_failures) {
+  ckpt_file = fdopen(fd, "w");
+  if (!ckpt_file) PFATAL("fdopen() failed");
+
+  ckpt_by_id = ck_realloc(ckpt_by_id, MAX(queued_paths, 1) *
+                                      sizeof(struct queue_entry*));
+  memset(ckpt_by_id, 0, queued_paths * sizeof(struct queue_entry*));
+
+  for (q = queue; q; q = q->next)
+    if (q->entry_id < queued_paths) ckpt_by_id[q->entry_id] = q;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, CKPT_MAGIC, sizeof(hdr.magic));
+  hdr.version       = CKPT_VERSION;
+  hdr.entry_count   = queued_paths;
+  hdr.map_size      = MAP_SIZE;
+  hdr.dfg_map_size  = DFG_MAP_SIZE;
+  hdr.interval_size = INTERVAL_SIZE;
+  get_target_id(&hdr.target_size, &hdr.target_hash);
+
+  ckpt_put(&hdr, sizeof(hdr));
+
+  /* Globals. */
+
+  memset(&g, 0, sizeof(g));
+  ckpt_put_prox(&g.min, &min_prox_score);
+  ckpt_put_prox(&g.max, &max_prox_score);
+  ckpt_put_prox(&g.total, &total_prox_score);
+  ckpt_put_prox(&g.avg, &avg_prox_score);
+  g.total_prox_original   = total_prox_original;
+  g.total_prox_cnt        = total_prox_cnt;
+  g.total_saved_crashes   = total_saved_crashes;
+  g.total_saved_positives = total_saved_positives;
+  g.unique_dafl_input     = unique_dafl_input;
+  g.moo_cycle             = moo_cycle;
+
+  ckpt_put_u32(CKPT_GLOBALS);
+  ckpt_put(&g, sizeof(g));
+
+  ckpt_put_u32(CKPT_MAPS);
+  ckpt_put(dfg_count_map, DFG_MAP_SIZE * sizeof(u32));
+  ckpt_put(virgin_bits, MAP_SIZE);
+  ckpt_put(virgin_tmout, MAP_SIZE);
+  ckpt_put(virgin_crash, MAP_SIZE);
+
+  /* Queue entries. */
+
+  ckpt_put_u32(CKPT_ENTRIES);
+
+  for (i = 0; i < queued_paths; i++) {
+
+    struct ckpt_entry e;
+
+    memset(&e, 0, sizeof(e));
+    q = ckpt_by_id[i];
+
+    if (q) {
+
+      e.present         = 1;
+      e.len             = q->len;
+      e.content_hash    = hash_queue_entry(q);
+      e.exec_cksum      = q->exec_cksum;
+      e.dfg_cksum       = q->dfg_cksum;
+      e.bitmap_size     = q->bitmap_size;
+      e.selection_count = q->selection_count;
+      e.moo_status      = q->moo_info.status;
+      e.moo_index       = q->moo_info.index;
+      e.explore_status  = q->explore_info.status;
+      e.explore_index   = q->explore_info.index;
+      e.last_location   = q->last_location;
+      e.rank_moo        = q->rank_moo;
+      e.rank_explore    = q->rank_explore;
+      e.prox_original   = q->prox_score.original;
+      e.prox_adjusted   = q->prox_score.adjusted;
+      e.prox_covered    = q->prox_score.covered;
+      e.packed_len      = q->prox_score.dfg_packed_map ?
+                          q->prox_score.dfg_packed_len : 0;
+      e.exec_us         = q->exec_us;
+      e.handicap        = q->handicap;
+      e.depth           = q->depth;
+      e.was_fuzzed      = q->was_fuzzed;
+      e.passed_det      = q->passed_det;
+      e.has_new_cov     = q->has_new_cov;
+      e.var_behavior    = q->var_behavior;
+      e.has_trace_mini  = !!q->trace_mini;
 
-    if (cal_failures == queued_paths)
-      FATAL("All test cases time out%s, giving up!",
-            skip_crashes ? " or crash" : "");
+    }
 
-    WARNF("Skipped %u test cases (%0.02f%%) due to timeouts%s.", cal_failures,
-          ((double)cal_failures) * 100 / queued_paths,
-          skip_crashes ? " or crashes" : "");
+    ckpt_put(&e, sizeof(e));
 
-    if (cal_failures * 5 > queued_paths)
-      WARNF(cLRD "High percentage of rejected test cases, check settings!");
+    if (e.packed_len) ckpt_put(q->prox_score.dfg_packed_map, e.packed_len);
+    if (e.has_trace_mini) ckpt_put(q->trace_mini, MAP_SIZE >> 3);
 
   }
 
-  OKF("All test cases processed.");
+  ckpt_put_u32(CKPT_TOP_RATED);
 
-}
+  for (i = 0; i < MAP_SIZE; i++)
+    ckpt_put_u32(top_rated[i] && !top_rated[i]->removed ?
+                 top_rated[i]->entry_id : CKPT_NONE);
+
+  ckpt_put_u32(CKPT_HASHMAPS);
+  ckpt_put_hashmap(dfg_hashmap, ckpt_put_id_pair);
+  ckpt_put_hashmap(unique_mem_hashmap, ckpt_put_key);
+  ckpt_put_hashmap(pareto_scheduler->count_dfg_path, ckpt_put_count_pair);
+
+  ckpt_put_u32(CKPT_PARETO);
+  ckpt_put_vector(pareto_scheduler->moo_pareto_frontier);
+  ckpt_put_vector(pareto_scheduler->moo_dominated);
+  ckpt_put_vector(pareto_scheduler->moo_newly_added);
+  ckpt_put_vector(pareto_scheduler->moo_recycled);
+  ckpt_put_vector(pareto_scheduler->explore_pareto_frontier);
+  ckpt_put_vector(pareto_scheduler->explore_dominated);
+  ckpt_put_vector((struct vector*)pareto_scheduler->explore_newly_added);
+  ckpt_put_vector(pareto_scheduler->explore_recycled);
+
+  ckpt_put_u32(CKPT_VERTICAL);
+  ckpt_put_u32(vertical_manager->use_vertical);
+  ckpt_put_u32(vertical_manager->dynamic_mode);
+  ckpt_put_hashmap(vertical_manager->map, ckpt_put_vertical_entry);
+  ckpt_put_vertical_list(vertical_manager->head);
+  ckpt_put_vertical_list(vertical_manager->old);
+  ckpt_put(vertical_manager->tree->count, sizeof(vertical_manager->tree->count));
+  ckpt_put(vertical_manager->tree->score, sizeof(vertical_manager->tree->score));
+
+  ckpt_put_u32(CKPT_STRIDE);
+  ckpt_put(stride_scheduler, sizeof(struct stride_scheduler));
+
+  ckpt_put_u32(CKPT_END);
+
+  if (fflush(ckpt_file) || ferror(ckpt_file) || fsync(fd))
+    PFATAL("Unable to write '%s'", tmp);
+
+  fclose(ckpt_file);
+  ckpt_file = NULL;
+
+  if (rename(tmp, fn)) PFATAL("Unable to rename '%s'", tmp);
 
+  ck_free(tmp);
+  ck_free(fn);
 
-/* Helper function: link() if possible, copy otherwise. */
-
-static void link_or_copy(u8* old_path, u8* new_path) {
-
-  s32 i = link(old_path, new_path);
-  s32 sfd, dfd;
-  u8* tmp;
+  last_ckpt_time = get_cur_time();
 
-  if (!i) return;
+}
 
-  sfd = open(old_path, O_RDONLY);
-  if (sfd < 0) PFATAL("Unable to open '%s'", old_path);
 
-  dfd = open(new_path, O_WRONLY | O_CREAT | O_EXCL, 0600);
-  if (dfd < 0) PFATAL("Unable to create '%s'", new_path);
+/* Read out_dir/scheduler.ckpt, if any, before the old session data is
+   deleted. It is applied by restore_checkpoint() once the queue is back. */
 
-  tmp = ck_alloc(64 * 1024);
+static void load_checkpoint(void) {
 
-  while ((i = read(sfd, tmp, 64 * 1024)) > 0)
-    ck_write(dfd, tmp, i, new_path);
+  u8* fn = alloc_printf("%s/scheduler.ckpt", out_dir);
+  struct stat st;
+  s32 fd;
 
-  if (i < 0) PFATAL("read() failed");
+  fd = open(fn, O_RDONLY);
 
-  ck_free(tmp);
-  close(sfd);
-  close(dfd);
+  if (fd < 0 || no_checkpoint) {
+    if (fd >= 0) close(fd);
+    ck_free(fn);
+    return;
+  }
 
-}
+  if (fstat(fd, &st)) PFATAL("fstat() failed");
 
+  if (st.st_size >= sizeof(struct ckpt_header) && st.st_size < MAX_ALLOC) {
 
-static void nuke_resume_dir(void);
+    ckpt_buf = ck_alloc_nozero(st.st_size);
+    ck_read(fd, ckpt_buf, st.st_size, fn);
+    ckpt_end = ckpt_buf + st.st_size;
 
-/* Create hard links for input test cases in the output directory, choosing
-   good names and pivoting accordingly. */
+  }
 
-static void pivot_inputs(void) {
+  close(fd);
+  ck_free(fn);
 
-  struct queue_entry* q = queue;
-  u32 id = 0;
+}
 
-  ACTF("Creating hard links for all input files...");
 
-  while (q) {
+static void ckpt_get(void* dst, u32 len) {
 
-    u8  *nfn, *rsl = strrchr(q->fname, '/');
-    u32 orig_id;
+  if (ckpt_bad || ckpt_end - ckpt_pos < len) {
+    ckpt_bad = 1;
+    memset(dst, 0, len);
+    return;
+  }
 
-    if (!rsl) rsl = q->fname; else rsl++;
+  memcpy(dst, ckpt_pos, len);
+  ckpt_pos += len;
 
-    /* If the original file name conforms to the syntax and the recorded
-       ID matches the one we'd assign, just use the original file name.
-       This is valuable for resuming fuzzing runs. */
+}
 
-#ifndef SIMPLE_FILES
-#  define CASE_PREFIX "id:"
-#else
-#  define CASE_PREFIX "id_"
-#endif /* ^!SIMPLE_FILES */
+/* Returns a pointer to the next len bytes of ckpt_buf and skips them. */
 
-    if (!strncmp(rsl, CASE_PREFIX, 3) &&
-        sscanf(rsl + 3, "%06u", &orig_id) == 1 && orig_id == id) {
+static u8* ckpt_skip(u32 len) {
 
-      u8* src_str;
-      u32 src_id;
+  u8* ret = ckpt_pos;
 
-      resuming_fuzz = 1;
-      nfn = alloc_printf("%s/queue/%s", out_dir, rsl);
+  if (ckpt_bad || ckpt_end - ckpt_pos < len) {
+    ckpt_bad = 1;
+    return NULL;
+  }
 
-      /* Since we're at it, let's also try to find parent and figure out the
-         appropriate depth for this entry. */
+  ckpt_pos += len;
+  return ret;
 
-      src_str = strchr(rsl + 3, ':');
+}
 
-      if (src_str && sscanf(src_str + 1, "%06u", &src_id) == 1) {
+static u32 ckpt_get_u32(void) {
 
-        struct queue_entry* s = queue;
-        while (src_id-- && s) s = s->next;
-        if (s) q->depth = s->depth + 1;
+  u32 val;
+  ckpt_get(&val, sizeof(u32));
+  return val;
 
-        if (max_depth < q->depth) max_depth = q->depth;
+}
 
-      }
+static void ckpt_expect(u32 tag) {
 
-    } else {
+  if (ckpt_get_u32() != tag) ckpt_bad = 1;
 
-      /* No dice - invent a new name, capturing the original one as a
-         substring. */
+}
 
-#ifndef SIMPLE_FILES
+/* Entries the checkpoint knows about but that have no match in the queue
+   map to NULL, same as CKPT_NONE. */
 
-      u8* use_name = strstr(rsl, ",orig:");
+static struct queue_entry* ckpt_get_entry(void) {
 
-      if (use_name) use_name += 6; else use_name = rsl;
-      nfn = alloc_printf("%s/queue/id:%06u,orig:%s", out_dir, id, use_name);
+  u32 id = ckpt_get_u32();
 
-#else
+  if (id == CKPT_NONE) return NULL;
+  if (id >= ckpt_count) { ckpt_bad = 1; return NULL; }
 
-      nfn = alloc_printf("%s/queue/id_%06u", out_dir, id);
+  return ckpt_by_id[id];
 
-#endif /* ^!SIMPLE_FILES */
+}
 
-    }
+static void ckpt_get_vector(struct vector* vec) {
 
-    /* Pivot to the new queue entry. */
+  u32 i, size = ckpt_get_u32();
 
-    link_or_copy(q->fname, nfn);
-    ck_free(q->fname);
-    q->fname = nfn;
+  for (i = 0; i < size && !ckpt_bad; i++) {
+    struct queue_entry* q = ckpt_get_entry();
+    if (q) push_back(vec, q);
+  }
 
-    /* Make sure that the passed_det value carries over, too. */
+}
 
-    if (q->passed_det) mark_as_det_done(q);
+static void ckpt_get_id_map(struct hashmap* map) {
 
-    q = q->next;
-    id++;
+  u32 i, size = ckpt_get_u32();
 
+  for (i = 0; i < size && !ckpt_bad; i++) {
+    u32 key = ckpt_get_u32();
+    hashmap_insert(map, key, ckpt_get_entry());
   }
 
-  if (in_place_resume) nuke_resume_dir();
-
 }
 
+static struct vertical_entry* ckpt_get_vertical_list(struct hashmap* map) {
 
-#ifndef SIMPLE_FILES
-
-/* Construct a file name for a new test case, capturing the operation
-   that led to its discovery. Uses a static buffer. */
+  struct vertical_entry *head = NULL, *tail = NULL;
+  u32 i, count = ckpt_get_u32();
 
-static u8* describe_op(u8 hnb) {
+  for (i = 0; i < count && !ckpt_bad; i++) {
 
-  static u8 ret[256];
+    struct key_value_pair* kvp = hashmap_get(map, ckpt_get_u32());
 
-  if (syncing_party) {
+    if (!kvp) { ckpt_bad = 1; break; }
 
-    sprintf(ret, "sync:%s,src:%06u", syncing_party, syncing_case);
+    if (tail) tail->next = kvp->value; else head = kvp->value;
+    tail = kvp->value;
+    tail->next = NULL;
 
-  } else {
+  }
 
-    sprintf(ret, "src:%06u", current_entry);
+  return head;
 
-    if (splicing_with >= 0)
-      sprintf(ret + strlen(ret), "+%06u", splicing_with);
+}
 
-    sprintf(ret + strlen(ret), ",op:%s", stage_short);
+/* Interval tree nodes only hold sums over tree->count[] and tree->score[];
+   rebuild them the way interval_node_insert() would have left them. */
 
-    if (stage_cur_byte >= 0) {
+static void ckpt_rebuild_interval_node(struct interval_tree* tree,
+                                       struct interval_node* node) {
 
-      sprintf(ret + strlen(ret), ",pos:%u", stage_cur_byte);
+  u32 i;
 
-      if (stage_val_type != STAGE_VAL_NONE)
-        sprintf(ret + strlen(ret), ",val:%s%+d",
-                (stage_val_type == STAGE_VAL_BE) ? "be:" : "",
-                stage_cur_val);
+  if (!node) return;
 
-    } else sprintf(ret + strlen(ret), ",rep:%u", stage_cur_val);
+  node->count = node->score = 0;
 
+  for (i = node->start; i <= node->end; i++) {
+    node->count += tree->count[i];
+    node->score += tree->score[i];
   }
 
-  if (hnb == 2) strcat(ret, ",+cov");
+  if (node->end - node->start < 2) return;
 
-  return ret;
+  ckpt_rebuild_interval_node(tree, node->left);
+  ckpt_rebuild_interval_node(tree, node->right);
 
 }
 
-#endif /* !SIMPLE_FILES */
+static void ckpt_free_vertical_entry(u32 key, void* value) {
 
+  struct vertical_entry* ve = value;
 
-/* Write a message accompanying the crash directory :-) */
+  vector_free(ve->entries);
+  vector_free(ve->old_entries);
+  hashmap_free(ve->value_map);
+  ck_free(ve);
 
-static void write_crash_readme(void) {
+}
 
-  u8* fn = alloc_printf("%s/crashes/README.txt", out_dir);
-  s32 fd;
-  FILE* f;
+/* vertical_manager_free() only walks the head and old lists, which need not
+   cover every entry; free them all through the map instead. */
 
-  fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
-  ck_free(fn);
+static void ckpt_free_vertical_manager(struct vertical_manager* vm) {
 
-  /* Do not die on errors here - that would be impolite. */
+  hashmap_iterate(vm->map, ckpt_free_vertical_entry);
 
-  if (fd < 0) return;
+  vm->head = vm->old = NULL;
+  vertical_manager_free(vm);
 
-  f = fdopen(fd, "w");
+}
 
-  if (!f) {
-    close(fd);
-    return;
-  }
 
-  fprintf(f, "Command line used to find this crash:\n\n"
+static int ckpt_match_cmp(const void* a, const void* b) {
 
-             "%s\n\n"
+  struct queue_entry *x = *(struct queue_entry**)a,
+                     *y = *(struct queue_entry**)b;
 
-             "If you can't reproduce a bug outside of afl-fuzz, be sure to set the same\n"
-             "memory limit. The limit used for this fuzzing session was %s.\n\n"
+  if (x->len != y->len) return x->len < y->len ? -1 : 1;
 
-             "Need a tool to minimize test cases before investigating the crashes or sending\n"
-             "them to a vendor? Check out the afl-tmin that comes with the fuzzer!\n\n"
+  if (x->content_hash != y->content_hash)
+    return x->content_hash < y->content_hash ? -1 : 1;
 
-             "Found any cool bugs in open-source tools using afl-fuzz? If yes, please drop\n"
-             "me a mail at <lcamtuf@coredump.cx> once the issues are fixed - I'd love to\n"
-             "add your finds to the gallery at:\n\n"
+  return x->entry_id < y->entry_id ? -1 : x->entry_id > y->entry_id;
 
-             "  http://lcamtuf.coredump.cx/afl/\n\n"
+}
 
-             "Thanks :-)\n",
+/* Point ckpt_by_id[] at the current entry each of the ckpt_count records
+   stands for: the entry with the same id if its length and contents still
+   match, otherwise the first unclaimed entry that does. Records with no
+   match are left at NULL. Returns the number of those. */
 
-             orig_cmdline, DMS(mem_limit << 20)); /* ignore errors */
+static u32 ckpt_match_entries(struct ckpt_entry* recs) {
 
-  fclose(f);
+  struct queue_entry **by_id, **sorted, *q;
+  u8* taken;
+  u32 i, n = 0, lost = 0;
 
-}
+  by_id  = ck_alloc(MAX(queued_paths, 1) * sizeof(struct queue_entry*));
+  sorted = ck_alloc(MAX(queued_paths, 1) * sizeof(struct queue_entry*));
+  taken  = ck_alloc(MAX(queued_paths, 1));
 
+  for (q = queue; q; q = q->next) {
 
-/* Check if the result of an execve() during routine fuzzing is interesting,
-   save or queue the input test case for further analysis if so. Returns 1 if
-   entry is saved, 0 otherwise. */
+    if (q->entry_id >= queued_paths) continue;
 
-static u8 save_if_interesting(char** argv, void* mem, u32 len, u8 fault) {
+    hash_queue_entry(q);
+
+    by_id[q->entry_id] = q;
+    sorted[n++] = q;
 
-  u8  *fn = "";
-  u8  hnb = 0;
-  u8  is_interesting = 0;
-  u32 exec_cksum = 0;
-  s32 fd;
-  u8  keeping = 0, res;
-  u8 has_valid_unique_path = 0;
-  u8 save_to_file = 0;
-  u8 has_unique_val_per_path = 0;
-  u32 val_hash = 0;
-  u8 *valuation = NULL;
-  u8 is_covered_target = 0;
-  u8 is_neg_val = fault == FAULT_CRASH;
-  struct proximity_score prox_score;
-  if (fault == FAULT_CRASH || fault == FAULT_NONE) {
-    if (!use_old_dafl_seed_pool_add || crash_mode == fault) {
-      // memcpy(trace_bits_tmp, trace_bits, MAP_SIZE);
-      exec_cksum = hash32(trace_bits, MAP_SIZE, HASH_CONST);
-      hnb = has_new_bits(virgin_bits);
-      compute_proximity_score(&prox_score, dfg_bits, 0);
-    }
-    is_covered_target = check_coverage(fault == FAULT_CRASH, argv, mem, len);
-    if (is_neg_val) {
-      is_neg_val = check_last_location(*last_location);
-    }
-  }
-  struct queue_entry *new_seed = NULL;
-  u32 dfg_checksum = get_dfg_checksum();
-  vertical_is_new_valuation = 0;
-  pareto_scheduler_update_dfg_count(pareto_scheduler, dfg_checksum);
-  // LOGF("[sii] [seed %d] [dfg-path %u] [cov %u] [prox %llu] [adj %f] [mut %s] [time %llu]\n",
-  //      queue_cur ? queue_cur->entry_id : -1, dfg_checksum, check_covered_target(), prox_score.original, prox_score.adjusted, stage_short, get_cur_time() - start_time);
-  if (dfg_node_info_map) {
-    if (is_covered_target) {
-      save_to_file = get_valuation(fault == FAULT_CRASH, argv, mem, len, dfg_checksum, &val_hash, &valuation);
-    }
-    has_valid_unique_path = check_unique_path();
-    if (has_valid_unique_path) {
-      LOGF("[moo] [uniq-path] [seed %d] [moo-id %u]\n", queue_cur ? queue_cur->entry_id : -1, hashmap_size(dfg_hashmap));
-    }
-  }
-  // Stride scheduler
-  if (vertical_is_new_valuation || has_valid_unique_path) {
-    stride_scheduler_update_found_count(stride_scheduler, 1);
-  }
-  if (vertical_experiment && (fault == FAULT_CRASH || fault == FAULT_NONE)) {
-    if (save_to_file) {
-      return 1;
-    }
-    return 0;
   }
-  //  || (use_moo_scheduler && has_valid_unique_path)
-  if ((fault == FAULT_CRASH) || (fault == FAULT_NONE)) {
-    // hnb = has_new_bits(virgin_bits);
-    switch (add_queue_mode) {
-    case ADD_QUEUE_DEFAULT:  is_interesting = hnb; break;
-    case ADD_QUEUE_UNIQUE_VAL_PER_PATH: is_interesting = vertical_is_new_valuation; break;
-    case ADD_QUEUE_UNIQUE_VAL:  is_interesting = save_to_file; break;
-    case ADD_QUEUE_ALL:  is_interesting = (hnb || vertical_is_new_valuation); break;
-    case ADD_QUEUE_NONE:  is_interesting = 0; break;
-    case ADD_QUEUE_UNIQUE_VAL_PER_PATH_IN_VER:  {
-      if (stride_scheduler_get_mode(stride_scheduler) == M_VER)
-        is_interesting = (vertical_is_new_valuation);
-      else
-        is_interesting = (hnb);
-      break;
-    }
-    case ADD_QUEUE_UNIQUE_VAL_PER_PATH_IN_VER_PLUS_DEF: {
-      if (stride_scheduler_get_mode(stride_scheduler) == M_VER)
-        is_interesting = (hnb || vertical_is_new_valuation);
-      else
-        is_interesting = (hnb);
-      break;
-    }
-    default:
-      is_interesting = hnb;
-      break;
-    }
 
-    if (use_old_dafl_seed_pool_add) {
-      if (crash_mode != fault) {
-        is_interesting = 0;
-      }
+  qsort(sorted, n, sizeof(struct queue_entry*), ckpt_match_cmp);
+
+  ckpt_by_id = ck_realloc(ckpt_by_id, MAX(ckpt_count, 1) *
+                                      sizeof(struct queue_entry*));
+  memset(ckpt_by_id, 0, ckpt_count * sizeof(struct queue_entry*));
+
+  /* Same position first, so that those are not claimed by another record
+     with the same contents. */
+
+  for (i = 0; i < ckpt_count && i < queued_paths; i++) {
+
+    q = by_id[i];
+
+    if (recs[i].present && q && q->len == recs[i].len &&
+        q->content_hash == recs[i].content_hash) {
+      ckpt_by_id[i] = q;
+      taken[i] = 1;
     }
 
-    if (is_interesting) {
+  }
 
-    /* Keep only if there are new bits in the map, add to queue for
-       future fuzzing, etc. */
-      // compute_proximity_score(&prox_score, dfg_bits, 0);
-      vertical_is_interesting = 1;
-      if (has_valid_unique_path) {
-          LOGF("[moo] [uniq] [seed %d] [id %u] [moo-id %u] [cov %u] [prox %llu] [adj %f] [mut %s] [time %llu]\n",
-                queue_cur ? queue_cur->entry_id : -1, queued_paths, hashmap_size(dfg_hashmap), prox_score.covered, prox_score.original, prox_score.adjusted, stage_short, get_cur_time() - start_time);
-      } else {
-          LOGF("[moo] [no-uniq] [seed %d] [id %u] [cov %u] [prox %llu] [adj %f] [tgt %u] [mut %s] [time %llu]\n",
-               queue_cur ? queue_cur->entry_id : -1, queued_paths, prox_score.covered, prox_score.original, prox_score.adjusted, check_covered_target(), stage_short, get_cur_time() - start_time);
-      }
-#ifndef SIMPLE_FILES
+  for (i = 0; i < ckpt_count; i++) {
 
-      fn = alloc_printf("%s/queue/id:%06u,%llu,%s", out_dir, queued_paths,
-                        prox_score.original, describe_op(hnb));
+    u32 lo = 0, hi = n;
 
-#else
+    if (!recs[i].present || ckpt_by_id[i]) continue;
 
-      fn = alloc_printf("%s/queue/id_%06u", out_dir, queued_paths);
+    /* Lower bound of (len, content_hash) in sorted[]. */
 
-#endif /* ^!SIMPLE_FILES */
+    while (lo < hi) {
 
-      add_to_queue(fn, len, 0, &prox_score);
+      u32 mid = (lo + hi) / 2;
 
-      new_seed = queue_last;
+      if (sorted[mid]->len < recs[i].len ||
+          (sorted[mid]->len == recs[i].len &&
+           sorted[mid]->content_hash < recs[i].content_hash)) lo = mid + 1;
+      else hi = mid;
 
-      if (hnb == 2) {
-        queue_last->has_new_cov = 1;
-        queued_with_cov++;
-      }
+    }
 
-      queue_last->exec_cksum = exec_cksum; // hash32(trace_bits_tmp, MAP_SIZE, HASH_CONST);
-      queue_last->dfg_cksum = dfg_checksum;
-      queue_last->last_location = *last_location;
-      LOGF("[vertical] [save] [seed %d] [id %u] [crash %u] [dfg-path %u] [cov %u] [prox %llu] [adj %f] [mut %s] [file %s] [time %llu] [last-loc %u] [val-hash %u] [stf %d] [neg %d] [exec %u]\n",
-           queue_cur ? queue_cur->entry_id : -1, queue_last->entry_id, fault == FAULT_CRASH, queue_last->dfg_cksum, prox_score.covered, prox_score.original, prox_score.adjusted, stage_short, fn, get_cur_time() - start_time, *last_location, val_hash, save_to_file, is_neg_val, queue_last->exec_cksum);
+    while (lo < n && sorted[lo]->len == recs[i].len &&
+           sorted[lo]->content_hash == recs[i].content_hash &&
+           taken[sorted[lo]->entry_id]) lo++;
 
-      /* Try to calibrate inline; this also calls update_bitmap_score() when
-        successful. */
+    if (lo < n && sorted[lo]->len == recs[i].len &&
+        sorted[lo]->content_hash == recs[i].content_hash) {
+      ckpt_by_id[i] = sorted[lo];
+      taken[sorted[lo]->entry_id] = 1;
+    } else lost++;
 
-      res = calibrate_case(argv, queue_last, mem, queue_cycle - 1, 0);
+  }
 
-      if (res == FAULT_ERROR)
-        FATAL("Unable to execute target application");
+  ck_free(by_id);
+  ck_free(sorted);
+  ck_free(taken);
 
-      fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
-      if (fd < 0) PFATAL("Unable to create '%s'", fn);
-      ck_write(fd, mem, len, fn);
-      close(fd);
+  return lost;
 
-      keeping = 1;
-    }
+}
 
-  }
 
-  switch (fault) {
+/* Apply the checkpoint read by load_checkpoint() to the freshly loaded
+   queue. Everything is parsed into new structures first and only swapped
+   in if the whole file checks out. Returns the number of restored entries;
+   perform_dry_run() does not execute those. */
 
-    case FAULT_TMOUT:
+static u32 restore_checkpoint(void) {
 
-      /* Timeouts are not very interesting, but we're still obliged to keep
-         a handful of samples. We use the presence of new bits in the
-         hang-specific bitmap as a signal of uniqueness. In "dumb" mode, we
-         just keep everything. */
+  struct ckpt_header hdr;
+  struct ckpt_globals g;
+  struct ckpt_entry* recs;
+  u8 **packed, **mini;
+  u8 *maps, *top;
+  struct hashmap *new_dfg, *new_mem;
+  struct pareto_scheduler* new_pareto;
+  struct vertical_manager* new_vm;
+  struct stride_scheduler new_stride;
+  struct queue_entry* q;
+  u64 target_size;
+  u32 target_hash, i, restored = 0, lost = 0;
 
-      total_tmouts++;
+  if (!ckpt_buf) return 0;
 
-      if (unique_hangs >= KEEP_UNIQUE_HANG) return keeping;
+  ckpt_pos = ckpt_buf;
+  ckpt_bad = 0;
 
-      if (!dumb_mode) {
+  ckpt_get(&hdr, sizeof(hdr));
 
-#ifdef WORD_SIZE_64
-        simplify_trace((u64*)trace_bits);
-#else
-        simplify_trace((u32*)trace_bits);
-#endif /* ^WORD_SIZE_64 */
+  if (memcmp(hdr.magic, CKPT_MAGIC, sizeof(hdr.magic)) ||
+      hdr.version != CKPT_VERSION || hdr.map_size != MAP_SIZE ||
+      hdr.dfg_map_size != DFG_MAP_SIZE || hdr.interval_size != INTERVAL_SIZE) {
+    WARNF("Ignoring incompatible scheduler checkpoint.");
+    goto restore_failed_early;
+  }
 
-        if (!has_new_bits(virgin_tmout)) return keeping;
+  get_target_id(&target_size, &target_hash);
 
-      }
+  if (hdr.target_size != target_size || hdr.target_hash != target_hash) {
+    WARNF("Target binary changed, ignoring scheduler checkpoint.");
+    goto restore_failed_early;
+  }
 
-      unique_tmouts++;
+  ckpt_count = hdr.entry_count;
 
-      /* Before saving, we make sure that it's a genuine hang by re-running
-         the target with a more generous timeout (unless the default timeout
-         is already generous). */
+  recs   = ck_alloc(MAX(ckpt_count, 1) * sizeof(struct ckpt_entry));
+  packed = ck_alloc(MAX(ckpt_count, 1) * sizeof(u8*));
+  mini   = ck_alloc(MAX(ckpt_count, 1) * sizeof(u8*));
 
-      if (exec_tmout < hang_tmout) {
+  new_dfg    = hashmap_create(max_queue_size);
+  new_mem    = hashmap_create(max_queue_size);
+  new_pareto = pareto_scheduler_create();
+  new_vm     = vertical_manager_create();
 
-        u8 new_fault;
-        write_to_testcase(mem, len);
-        new_fault = run_target(argv, hang_tmout, "USELESS=0", 0);
+  ckpt_expect(CKPT_GLOBALS);
+  ckpt_get(&g, sizeof(g));
 
-        /* A corner case that one user reported bumping into: increasing the
-           timeout actually uncovers a crash. Make sure we don't discard it if
-           so. */
+  ckpt_expect(CKPT_MAPS);
+  maps = ckpt_skip(DFG_MAP_SIZE * sizeof(u32) + 3 * MAP_SIZE);
 
-        if (!stop_soon && new_fault == FAULT_CRASH) goto keep_as_crash;
+  ckpt_expect(CKPT_ENTRIES);
 
-        if (stop_soon || new_fault != FAULT_TMOUT) return keeping;
+  for (i = 0; i < ckpt_count && !ckpt_bad; i++) {
 
-      }
+    ckpt_get(&recs[i], sizeof(struct ckpt_entry));
+    packed[i] = ckpt_skip(recs[i].packed_len);
+    if (recs[i].has_trace_mini) mini[i] = ckpt_skip(MAP_SIZE >> 3);
 
-#ifndef SIMPLE_FILES
+  }
 
-      fn = alloc_printf("%s/hangs/id:%06llu,%s", out_dir,
-                        unique_hangs, describe_op(0));
+  /* The remaining sections refer to entries by id; resolve those to the
+     current queue before reading them. */
 
-#else
+  if (!ckpt_bad) lost = ckpt_match_entries(recs);
 
-      fn = alloc_printf("%s/hangs/id_%06llu", out_dir,
-                        unique_hangs);
+  ckpt_expect(CKPT_TOP_RATED);
+  top = ckpt_skip(MAP_SIZE * sizeof(u32));
 
-#endif /* ^!SIMPLE_FILES */
+  ckpt_expect(CKPT_HASHMAPS);
+  ckpt_get_id_map(new_dfg);
 
-      unique_hangs++;
+  {
+    u32 size = ckpt_get_u32();
 
-      last_hang_time = get_cur_time();
+    for (i = 0; i < size && !ckpt_bad; i++)
+      hashmap_insert(new_mem, ckpt_get_u32(), NULL);
 
-      break;
+    size = ckpt_get_u32();
 
-    case FAULT_CRASH:
+    for (i = 0; i < size && !ckpt_bad; i++) {
+      u32 key = ckpt_get_u32();
+      u64 count;
+      ckpt_get(&count, sizeof(u64));
+      hashmap_insert(new_pareto->count_dfg_path, key, (void*)count);
+    }
+  }
 
-keep_as_crash:
+  ckpt_expect(CKPT_PARETO);
+  ckpt_get_vector(new_pareto->moo_pareto_frontier);
+  ckpt_get_vector(new_pareto->moo_dominated);
+  ckpt_get_vector(new_pareto->moo_newly_added);
+  ckpt_get_vector(new_pareto->moo_recycled);
+  ckpt_get_vector(new_pareto->explore_pareto_frontier);
+  ckpt_get_vector(new_pareto->explore_dominated);
+  ckpt_get_vector((struct vector*)new_pareto->explore_newly_added);
+  ckpt_get_vector(new_pareto->explore_recycled);
 
-      if (!is_covered_target) return keeping;
-      // save_to_file = get_valuation(1, argv, mem, len, dfg_checksum, new_seed, &val_hash);
-      save_valuation(is_neg_val, save_to_file, dfg_checksum, val_hash, new_seed, valuation);
+  ckpt_expect(CKPT_VERTICAL);
+  new_vm->use_vertical = ckpt_get_u32();
+  new_vm->dynamic_mode = ckpt_get_u32();
 
-      /* This is handled in a manner roughly similar to timeouts,
-         except for slightly different limits and no need to re-run test
-         cases. */
+  {
+    u32 size = ckpt_get_u32();
 
-      total_crashes++;
+    for (i = 0; i < size && !ckpt_bad; i++) {
 
-      if (unique_crashes >= KEEP_UNIQUE_CRASH) return keeping;
+      struct vertical_entry* ve = vertical_entry_create(ckpt_get_u32());
 
-      if (!dumb_mode) {
+      ve->use_count = ckpt_get_u32();
+      ckpt_get_vector(ve->entries);
+      ckpt_get_vector(ve->old_entries);
+      ckpt_get_id_map(ve->value_map);
 
-#ifdef WORD_SIZE_64
-        simplify_trace((u64*)trace_bits);
-#else
-        simplify_trace((u32*)trace_bits);
-#endif /* ^WORD_SIZE_64 */
+      hashmap_insert(new_vm->map, ve->hash, ve);
 
-        // if (!has_new_bits(virgin_crash)) return keeping;
+    }
+  }
 
-      }
+  new_vm->head = ckpt_get_vertical_list(new_vm->map);
+  new_vm->old  = ckpt_get_vertical_list(new_vm->map);
+  ckpt_get(new_vm->tree->count, sizeof(new_vm->tree->count));
+  ckpt_get(new_vm->tree->score, sizeof(new_vm->tree->score));
 
-      if (!unique_crashes) write_crash_readme();
+  ckpt_expect(CKPT_STRIDE);
+  ckpt_get(&new_stride, sizeof(struct stride_scheduler));
 
-      // Temporary computation for debugging.
-      compute_proximity_score(&prox_score, dfg_bits, 0);
+  ckpt_expect(CKPT_END);
 
-#ifndef SIMPLE_FILES
+  if (ckpt_bad) {
 
-      fn = alloc_printf("%s/crashes/id:%06llu,%llu,sig:%02u,%s", out_dir,
-                        total_crashes, prox_score.original, kill_signal,
-                        describe_op(0));
+    WARNF("Scheduler checkpoint is corrupt, ignoring it.");
 
-#else
+    hashmap_free(new_dfg);
+    hashmap_free(new_mem);
+    pareto_scheduler_free(new_pareto);
+    ckpt_free_vertical_manager(new_vm);
+    ck_free(recs);
+    ck_free(packed);
+    ck_free(mini);
+    goto restore_failed_early;
 
-      fn = alloc_printf("%s/crashes/id_%06llu_%02u", out_dir, total_crashes,
-                        kill_signal);
+  }
 
-#endif /* ^!SIMPLE_FILES */
+  /* Point of no return: swap in the restored state. */
 
-      if (has_new_bits(virgin_crash)) {
-        unique_crashes++;
+  /* Shared counts are rebuilt by the dry run instead. */
 
-        last_crash_time = get_cur_time();
-        last_crash_execs = total_execs;
-      }
+  if (!dfg_shm) memcpy(dfg_count_map, maps, DFG_MAP_SIZE * sizeof(u32));
+  maps += DFG_MAP_SIZE * sizeof(u32);
+  memcpy(virgin_bits, maps, MAP_SIZE);
+  memcpy(virgin_tmout, maps + MAP_SIZE, MAP_SIZE);
+  memcpy(virgin_crash, maps + 2 * MAP_SIZE, MAP_SIZE);
 
-      break;
-    case FAULT_NONE:
-      if (!is_covered_target) return keeping;
-      // save_to_file = get_valuation(0, argv, mem, len, dfg_checksum, new_seed, &val_hash);
-      save_valuation(0, save_to_file, dfg_checksum, val_hash, new_seed, valuation);
-      total_normals++;
+  ckpt_get_prox(&min_prox_score, &g.min);
+  ckpt_get_prox(&max_prox_score, &g.max);
+  ckpt_get_prox(&total_prox_score, &g.total);
+  ckpt_get_prox(&avg_prox_score, &g.avg);
+  total_prox_original   = g.total_prox_original;
+  total_prox_cnt        = g.total_prox_cnt;
+  total_saved_crashes   = g.total_saved_crashes;
+  total_saved_positives = g.total_saved_positives;
+  unique_dafl_input     = g.unique_dafl_input;
+  moo_cycle             = g.moo_cycle;
 
-#ifndef SIMPLE_FILES
+  hashmap_free(dfg_hashmap);
+  hashmap_free(unique_mem_hashmap);
+  pareto_scheduler_free(pareto_scheduler);
+  ckpt_free_vertical_manager(vertical_manager);
+
+  dfg_hashmap        = new_dfg;
+  unique_mem_hashmap = new_mem;
+  pareto_scheduler   = new_pareto;
+  vertical_manager   = new_vm;
+
+  ckpt_rebuild_interval_node(new_vm->tree, new_vm->tree->root);
+
+  memcpy(stride_scheduler, &new_stride, sizeof(struct stride_scheduler));
+  stride_scheduler->last_update = get_cur_time();
+
+  for (i = 0; i < ckpt_count; i++) {
+
+    struct ckpt_entry* e = &recs[i];
+
+    q = ckpt_by_id[i];
+    if (!q) continue;
+
+    q->exec_cksum        = e->exec_cksum;
+    q->dfg_cksum         = e->dfg_cksum;
+    q->bitmap_size       = e->bitmap_size;
+    q->selection_count   = e->selection_count;
+    q->last_location     = e->last_location;
+    q->rank_moo          = e->rank_moo;
+    q->rank_explore      = e->rank_explore;
+    q->exec_us           = e->exec_us;
+    q->handicap          = e->handicap;
+    q->depth             = e->depth;
+    q->passed_det       |= e->passed_det;
+    q->has_new_cov       = e->has_new_cov;
+    q->var_behavior      = e->var_behavior;
+    q->cal_failed        = 0;
+
+    pareto_info_set(&q->moo_info, e->moo_status, e->moo_index);
+    pareto_info_set(&q->explore_info, e->explore_status, e->explore_index);
+
+    q->prox_score.original = e->prox_original;
+    q->prox_score.adjusted = e->prox_adjusted;
+    q->prox_score.covered  = e->prox_covered;
+    q->prox_score.dfg_packed_map = arena_alloc(&queue_arena,
+                                               MAX(e->packed_len, 1));
+    q->prox_score.dfg_packed_len = e->packed_len;
+    memcpy(q->prox_score.dfg_packed_map, packed[i], e->packed_len);
+
+    if (mini[i]) {
+      if (!q->trace_mini) q->trace_mini = ck_alloc(MAP_SIZE >> 3);
+      memcpy(q->trace_mini, mini[i], MAP_SIZE >> 3);
+    }
 
-      fn = alloc_printf("%s/normals/id:%06llu,%llu,sig:%02u,%s", out_dir,
-                        total_normals, prox_score.original, kill_signal,
-                        describe_op(0));
+    if (q->depth > max_depth) max_depth = q->depth;
+    if (q->has_new_cov) queued_with_cov++;
+    if (q->var_behavior) queued_variable++;
 
-#else
+    if (e->was_fuzzed && !q->was_fuzzed) {
+      q->was_fuzzed = 1;
+      pending_not_fuzzed--;
+    }
 
-      fn = alloc_printf("%s/normals/id_%06llu_%02u", out_dir, total_normals,
-                        kill_signal);
+    q->restored = 1;
+    restored++;
 
-#endif /* ^!SIMPLE_FILES */
-      break;
+  }
 
-    case FAULT_ERROR: FATAL("Unable to execute target application");
+  /* Entries found after the last checkpoint, or rewritten since, go
+     through the regular dry run; they only need to rejoin the new pareto
+     buckets. */
 
-    default: return keeping;
+  for (q = queue; q; q = q->next)
+    if (!q->restored) pareto_scheduler_push(pareto_scheduler, q);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+
+    u32 id;
+
+    memcpy(&id, top + i * sizeof(u32), sizeof(u32));
+
+    if (id < ckpt_count && ckpt_by_id[id] && ckpt_by_id[id]->trace_mini) {
+      top_rated[i] = ckpt_by_id[id];
+      top_rated[i]->tc_ref++;
+    }
 
   }
 
-  /* If we're here, we apparently want to save the crash or hang
-     test case, too. */
-  if (has_valid_unique_path || save_to_file) {
-    LOGF("[moo] [save] [seed %d] [moo-id %u] [fault %u] [path %u] [val %u] [file %s] [mut %s] [time %llu]\n",
-           queue_cur ? queue_cur->entry_id : -1, hashmap_size(dfg_hashmap), fault, has_valid_unique_path, save_to_file, fn, stage_short, get_cur_time() - start_time);
-    fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
-    if (fd < 0) PFATAL("Unable to create '%s'", fn);
-    ck_write(fd, mem, len, fn);
-    close(fd);
+  score_changed = 1;
+
+  OKF("Restored scheduler state for %u entries from checkpoint (%u records "
+      "without a match).", restored, lost);
+
+  ck_free(recs);
+  ck_free(packed);
+  ck_free(mini);
+  ck_free(ckpt_buf);
+  ckpt_buf = NULL;
+
+  return restored;
+
+restore_failed_early:
+
+  /* The old memory/ valuations were kept for the checkpoint; without it,
+     they are rebuilt by the dry run. */
+
+  {
+    u8* fn;
+
+    fn = alloc_printf("%s/memory/neg", out_dir);
+    delete_files(fn, NULL);
+    if (mkdir(fn, 0700) && errno != EEXIST) PFATAL("Unable to create '%s'", fn);
+    ck_free(fn);
+
+    fn = alloc_printf("%s/memory/pos", out_dir);
+    delete_files(fn, NULL);
+    if (mkdir(fn, 0700) && errno != EEXIST) PFATAL("Unable to create '%s'", fn);
+    ck_free(fn);
   }
 
-  ck_free(fn);
+  ck_free(ckpt_buf);
+  ckpt_buf = NULL;
 
-  return keeping;
+  return 0;
 
 }
 
 
-/* The same, but for timeouts. The idea is that when resuming sessions without
-   -t given, we don't want to keep auto-scaling the timeout over and over
-   again to prevent it from growing due to random flukes. */
+/* Dry run stand-in for entries restored from a checkpoint: account for them
+   like calibrate_case() would, without running them. */
 
-static void find_timeout(void) {
+static void restore_dry_run_entry(struct queue_entry* q) {
 
-  static u8 tmp[4096]; /* Ought to be enough for anybody. */
+  total_cal_us     += q->exec_us;
+  total_cal_cycles++;
 
-  u8  *fn, *off;
-  s32 fd, i;
-  u32 ret;
+  total_bitmap_size += q->bitmap_size;
+  total_bitmap_entries++;
 
-  if (!resuming_fuzz) return;
+  if (dfg_shm) dfg_shm_count_packed(q);
 
-  if (in_place_resume) fn = alloc_printf("%s/fuzzer_stats", out_dir);
-  else fn = alloc_printf("%s/../fuzzer_stats", in_dir);
+}
 
-  fd = open(fn, O_RDONLY);
-  ck_free(fn);
 
-  if (fd < 0) return;
+/* Calibration cache, see calcache.h. */
 
-  i = read(fd, tmp, sizeof(tmp) - 1); (void)i; /* Ignore errors */
-  close(fd);
+static u8  no_cal_cache;              /* AFL_NO_CAL_CACHE set?            */
+static u32 cal_spot_check,            /* AFL_CAL_SPOT_CHECK percentage    */
+           cal_cache_hits,            /* Dry-run entries taken from cache */
+           cal_cache_stale;           /* Records failing the spot check   */
+static s32 cal_fd = -1;               /* Our records file, once opened    */
 
-  off = strstr(tmp, "exec_timeout      : ");
-  if (!off) return;
+/* Records of another queue dir (the input dir, a peer), looked up by entry
+   name. The file is parsed up to the first record not fully written yet,
+   and picked up from there on the next lookup. */
 
-  ret = atoi(off + 20);
-  if (ret <= 4) return;
+struct cal_index_ent {
 
-  exec_tmout = ret;
-  timeout_given = 3;
+  u64 off;                            /* Record offset in the file        */
+  u32 len;                            /* Record size                      */
+  struct cal_index_ent* next;         /* Older records, same name hash    */
+
+};
+
+struct cal_index {
+
+  u8* fn;                             /* Records file                     */
+  ino_t ino;                          /* Its inode, to notice a new file  */
+  u64 parsed;                         /* Bytes indexed so far             */
+  struct hashmap* map;                /* hash32() of the name -> records  */
+
+};
+
+/* Size of a record as announced by its header, or 0 if the header cannot
+   be right. */
+
+static u64 cal_record_size(struct cal_record* rec) {
+
+  if (memcmp(rec->magic, CAL_MAGIC, sizeof(rec->magic)) ||
+      rec->version != CAL_VERSION || rec->trace_len > MAP_SIZE ||
+      rec->packed_len > DFG_MAP_SIZE * 10 || !rec->name_len ||
+      rec->name_len > PATH_MAX) return 0;
+
+  return sizeof(struct cal_record) + (u64)rec->trace_len * 5 +
+         rec->packed_len + rec->name_len;
 
 }
 
 
-/* Update stats file for unattended monitoring. */
+/* Check a record of size bytes against the target and the input it is
+   meant for. Returns 1 if it is usable. The packed DFG map is left for the
+   caller to decode. */
 
-static void write_stats_file(double bitmap_cvg, double stability, double eps) {
+static u8 cal_record_check(struct cal_record* rec, u64 size, u8* mem,
+                           u32 len) {
 
-  static double last_bcvg, last_stab, last_eps;
-  static struct rusage usage;
+  u64 target_size;
+  u32 target_hash, *idx, i;
 
-  u8* fn = alloc_printf("%s/fuzzer_stats", out_dir);
-  s32 fd;
-  FILE* f;
+  if (size < sizeof(struct cal_record)) return 0;
 
-  fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  get_target_id(&target_size, &target_hash);
 
-  if (fd < 0) PFATAL("Unable to create '%s'", fn);
+  if (cal_record_size(rec) != size || rec->len != len ||
+      rec->target_size != target_size || rec->target_hash != target_hash ||
+      rec->content_hash != cal_content_hash(mem, len)) return 0;
+
+  idx = (u32*)(rec + 1);
+
+  for (i = 0; i < rec->trace_len; i++)
+    if (idx[i] >= MAP_SIZE) return 0;
+
+  return 1;
+
+}
+
+
+/* Read the size-byte record at off in fd. Returns the record (to be freed
+   by the caller), NULL if it could not be read whole. */
+
+static struct cal_record* cal_record_pread(s32 fd, u64 off, u32 size) {
+
+  struct cal_record* rec;
+
+  if (size < sizeof(struct cal_record)) return NULL;
+
+  rec = ck_alloc_nozero(size);
+
+  if (pread(fd, rec, size, off) != size) {
+    ck_free(rec);
+    return NULL;
+  }
+
+  return rec;
+
+}
+
+
+/* Open our records file on first use. With a queue pack, the records go
+   to its data file. */
+
+static void cal_open(void) {
+
+  u8* fn;
+
+  if (cal_fd >= 0) return;
+
+  if (queue_pack) {
+    cal_fd = pack_data_fd;
+    return;
+  }
+
+  fn = alloc_printf("%s/queue/.state/calibration/records", out_dir);
+
+  cal_fd = open(fn, O_RDWR | O_CREAT | O_APPEND, 0600);
+  if (cal_fd < 0) PFATAL("Unable to create '%s'", fn);
 
   ck_free(fn);
 
-  f = fdopen(fd, "w");
+}
 
-  if (!f) PFATAL("fdopen() failed");
 
-  /* Keep last values in case we're called from another context
-     where exec/sec stats and such are not readily available. */
+/* Append a record for q, with its header and body given separately, and
+   make it the one q is looked up by. Later records supersede earlier ones
+   for the same name. */
+
+static void cal_append(struct queue_entry* q, struct cal_record* rec,
+                       u8* body, u32 body_len) {
+
+  u8* name = strrchr(q->fname, '/') + 1;
+  u8* buf;
+  u32 len;
+  off_t off;
+
+  cal_open();
+
+  rec->name_len = strlen(name);
+  len = sizeof(struct cal_record) + body_len + rec->name_len;
+
+  buf = ck_alloc_nozero(len);
+
+  memcpy(buf, rec, sizeof(struct cal_record));
+  memcpy(buf + sizeof(struct cal_record), body, body_len);
+  memcpy(buf + sizeof(struct cal_record) + body_len, name, rec->name_len);
+
+  if (queue_pack) {
+
+    if (pack_len + len > PACK_MAP_SIZE)
+      FATAL("Queue pack is full (limit is %s)", DMS(PACK_MAP_SIZE));
+
+    off = pack_len;
 
-  if (!bitmap_cvg && !stability && !eps) {
-    bitmap_cvg = last_bcvg;
-    stability  = last_stab;
-    eps        = last_eps;
   } else {
-    last_bcvg = bitmap_cvg;
-    last_stab = stability;
-    last_eps  = eps;
+
+    off = lseek(cal_fd, 0, SEEK_END);
+    if (off < 0) PFATAL("lseek() failed");
+
   }
 
-  fprintf(f, "start_time        : %llu\n"
-             "last_update       : %llu\n"
-             "fuzzer_pid        : %u\n"
-             "cycles_done       : %llu\n"
-             "execs_done        : %llu\n"
-             "execs_per_sec     : %0.02f\n"
-             "paths_total       : %u\n"
-             "paths_favored     : %u\n"
-             "paths_found       : %u\n"
-             "paths_imported    : %u\n"
-             "max_depth         : %u\n"
-             "cur_path          : %u\n" /* Must match find_start_position() */
-             "pending_favs      : %u\n"
-             "pending_total     : %u\n"
-             "variable_paths    : %u\n"
-             "stability         : %0.02f%%\n"
-             "bitmap_cvg        : %0.02f%%\n"
-             "unique_crashes    : %llu\n"
-             "unique_hangs      : %llu\n"
-             "last_path         : %llu\n"
-             "last_crash        : %llu\n"
-             "last_hang         : %llu\n"
-             "execs_since_crash : %llu\n"
-             "exec_timeout      : %u\n" /* Must match find_timeout() */
-             "afl_banner        : %s\n"
-             "afl_version       : " VERSION "\n"
-             "target_mode       : %s%s%s%s%s%s%s\n"
-             "command_line      : %s\n"
-             "slowest_exec_ms   : %llu\n",
-             start_time / 1000, get_cur_time() / 1000, getpid(),
-             queue_cycle ? (queue_cycle - 1) : 0, total_execs, eps,
-             queued_paths, queued_favored, queued_discovered, queued_imported,
-             max_depth, current_entry, pending_favored, pending_not_fuzzed,
-             queued_variable, stability, bitmap_cvg, unique_crashes,
-             unique_hangs, last_path_time / 1000, last_crash_time / 1000,
-             last_hang_time / 1000, total_execs - last_crash_execs,
-             exec_tmout, use_banner,
-             qemu_mode ? "qemu " : "", dumb_mode ? " dumb " : "",
-             no_forkserver ? "no_forksrv " : "", crash_mode ? "crash " : "",
-             persistent_mode ? "persistent " : "", deferred_mode ? "deferred " : "",
-             (qemu_mode || dumb_mode || no_forkserver || crash_mode ||
-              persistent_mode || deferred_mode) ? "" : "default",
-             orig_cmdline, slowest_exec_ms);
-             /* ignore errors */
+  /* One write per record, so that a peer never sees half a header. */
 
-  /* Get rss value from the children
-     We must have killed the forkserver process and called waitpid
-     before calling getrusage */
-  if (getrusage(RUSAGE_CHILDREN, &usage)) {
-      WARNF("getrusage failed");
-  } else if (usage.ru_maxrss == 0) {
-    fprintf(f, "peak_rss_mb       : not available while afl is running\n");
-  } else {
-#ifdef __APPLE__
-    fprintf(f, "peak_rss_mb       : %zu\n", usage.ru_maxrss >> 20);
-#else
-    fprintf(f, "peak_rss_mb       : %zu\n", usage.ru_maxrss >> 10);
-#endif /* ^__APPLE__ */
-  }
+  ck_write(cal_fd, buf, len, "calibration records");
+  ck_free(buf);
 
-  fclose(f);
+  q->cal_off = off;
+  q->cal_len = len;
+
+  if (queue_pack) {
+    pack_len += len;
+    pack_put_index(q);
+  }
 
 }
 
 
-/* Update the plot file if there is a reason to. */
+static void cal_index_free_ent(u32 key, void* value) {
 
-static void maybe_update_plot_file(double bitmap_cvg, double eps) {
+  struct cal_index_ent* e = value;
 
-  static u32 prev_qp, prev_pf, prev_pnf, prev_ce, prev_md;
-  static u64 prev_qc, prev_uc, prev_uh;
+  while (e) {
+    struct cal_index_ent* next = e->next;
+    ck_free(e);
+    e = next;
+  }
 
-  if (prev_qp == queued_paths && prev_pf == pending_favored &&
-      prev_pnf == pending_not_fuzzed && prev_ce == current_entry &&
-      prev_qc == queue_cycle && prev_uc == unique_crashes &&
-      prev_uh == unique_hangs && prev_md == max_depth) return;
+}
 
-  prev_qp  = queued_paths;
-  prev_pf  = pending_favored;
-  prev_pnf = pending_not_fuzzed;
-  prev_ce  = current_entry;
-  prev_qc  = queue_cycle;
-  prev_uc  = unique_crashes;
-  prev_uh  = unique_hangs;
-  prev_md  = max_depth;
+/* Drop what idx has indexed so far. */
 
-  /* Fields in the file:
+static void cal_index_reset(struct cal_index* idx) {
 
-     unix_time, cycles_done, cur_path, paths_total, paths_not_fuzzed,
-     favored_not_fuzzed, unique_crashes, unique_hangs, max_depth,
-     execs_per_sec */
+  if (idx->map) {
+    hashmap_iterate(idx->map, cal_index_free_ent);
+    hashmap_free(idx->map);
+  }
 
-  fprintf(plot_file,
-          "%llu, %llu, %u, %u, %u, %u, %0.02f%%, %llu, %llu, %u, %0.02f\n",
-          get_cur_time() / 1000, queue_cycle - 1, current_entry, queued_paths,
-          pending_not_fuzzed, pending_favored, bitmap_cvg, unique_crashes,
-          unique_hangs, max_depth, eps); /* ignore errors */
+  idx->map    = NULL;
+  idx->parsed = 0;
 
-  fflush(plot_file);
+}
+
+static void cal_index_free(struct cal_index* idx) {
+
+  cal_index_reset(idx);
+  ck_free(idx->fn);
+  idx->fn = NULL;
 
 }
 
 
+/* Index the records appended to idx->fn since the last call. */
 
-/* A helper function for maybe_delete_out_dir(), deleting all prefixed
-   files in a directory. */
+static void cal_index_update(struct cal_index* idx) {
 
-static u8 delete_files(u8* path, u8* prefix) {
+  struct cal_record hdr;
+  struct stat st;
+  s32 fd;
 
-  DIR* d;
-  struct dirent* d_ent;
+  fd = open(idx->fn, O_RDONLY);
+  if (fd < 0) return;
 
-  d = opendir(path);
+  if (fstat(fd, &st)) PFATAL("fstat() failed");
 
-  if (!d) return 0;
+  /* A peer that restarted has a new file. */
 
-  while ((d_ent = readdir(d))) {
+  if (st.st_ino != idx->ino || st.st_size < idx->parsed) {
+    cal_index_reset(idx);
+    idx->ino = st.st_ino;
+  }
 
-    if (d_ent->d_name[0] != '.' && (!prefix ||
-        !strncmp(d_ent->d_name, prefix, strlen(prefix)))) {
+  if (!idx->map) idx->map = hashmap_create(1024);
 
-      u8* fname = alloc_printf("%s/%s", path, d_ent->d_name);
-      if (unlink(fname)) PFATAL("Unable to delete '%s'", fname);
-      ck_free(fname);
+  while (idx->parsed + sizeof(hdr) <= st.st_size &&
+         pread(fd, &hdr, sizeof(hdr), idx->parsed) == sizeof(hdr)) {
 
-    }
+    struct cal_index_ent* e;
+    struct key_value_pair* kvp;
+    u8 name[PATH_MAX];
+    u64 size = cal_record_size(&hdr);
+    u32 h;
 
-  }
+    /* Stop at anything that is not a record, since nothing past it can be
+       trusted, and at a partial tail, which is picked up next time. */
 
-  closedir(d);
+    if (!size || idx->parsed + size > st.st_size ||
+        pread(fd, name, hdr.name_len, idx->parsed + size - hdr.name_len) !=
+        hdr.name_len) break;
 
-  return !!rmdir(path);
+    h = hash32(name, hdr.name_len, HASH_CONST);
 
-}
+    e = ck_alloc(sizeof(struct cal_index_ent));
+    e->off = idx->parsed;
+    e->len = size;
 
+    kvp = hashmap_get(idx->map, h);
 
-/* Get the number of runnable processes, with some simple smoothing. */
+    if (kvp) {
+      e->next = kvp->value;
+      kvp->value = e;
+    } else hashmap_insert(idx->map, h, e);
 
-static double get_runnable_processes(void) {
+    idx->parsed += size;
 
-  static double res;
+  }
 
-#if defined(__APPLE__) || defined(__FreeBSD__) || defined (__OpenBSD__)
+  close(fd);
 
-  /* I don't see any portable sysctl or so that would quickly give us the
-     number of runnable processes; the 1-minute load average can be a
-     semi-decent approximation, though. */
+}
 
-  if (getloadavg(&res, 1) != 1) return 0;
 
-#else
+/* Look up the latest record for name in idx. Returns the record (to be
+   freed by the caller) and its size in *size, NULL if there is none. The
+   record still has to go through cal_record_check(). */
 
-  /* On Linux, /proc/stat is probably the best way; load averages are
-     computed in funny ways and sometimes don't reflect extremely short-lived
-     processes well. */
+static struct cal_record* cal_index_find(struct cal_index* idx, u8* name,
+                                         u32 name_len, u32* size) {
 
-  FILE* f = fopen("/proc/stat", "r");
-  u8 tmp[1024];
-  u32 val = 0;
+  struct key_value_pair* kvp;
+  struct cal_index_ent* e;
+  struct cal_record* rec = NULL;
+  s32 fd;
 
-  if (!f) return 0;
+  cal_index_update(idx);
 
-  while (fgets(tmp, sizeof(tmp), f)) {
+  if (!idx->map) return NULL;
 
-    if (!strncmp(tmp, "procs_running ", 14) ||
-        !strncmp(tmp, "procs_blocked ", 14)) val += atoi(tmp + 14);
+  kvp = hashmap_get(idx->map, hash32(name, name_len, HASH_CONST));
+  if (!kvp) return NULL;
+
+  fd = open(idx->fn, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  for (e = kvp->value; e; e = e->next) {
+
+    rec = cal_record_pread(fd, e->off, e->len);
+
+    if (rec && rec->name_len == name_len &&
+        !memcmp((u8*)rec + e->len - name_len, name, name_len)) {
+      *size = e->len;
+      break;
+    }
+
+    ck_free(rec);
+    rec = NULL;
 
   }
 
-  fclose(f);
+  close(fd);
+  return rec;
 
-  if (!res) {
+}
 
-    res = val;
 
-  } else {
+/* Read the latest record of q, if usable for mem. */
 
-    res = res * (1.0 - 1.0 / AVG_SMOOTHING) +
-          ((double)val) * (1.0 / AVG_SMOOTHING);
+static struct cal_record* cal_record_get(struct queue_entry* q, u8* mem) {
 
-  }
+  struct cal_record* rec;
 
-#endif /* ^(__APPLE__ || __FreeBSD__ || __OpenBSD__) */
+  if (!q->cal_len || cal_fd < 0) return NULL;
 
-  return res;
+  rec = cal_record_pread(cal_fd, q->cal_off, q->cal_len);
+
+  if (rec && !cal_record_check(rec, q->cal_len, mem, q->len)) {
+    ck_free(rec);
+    return NULL;
+  }
+
+  return rec;
 
 }
 
 
-/* Delete the temporary directory used for in-place session resume. */
+/* Save the calibration results of q. trace_bits must still hold its
+   classified trace; the DFG map is the one stored with its proximity
+   score. */
 
-static void nuke_resume_dir(void) {
+static void cal_cache_save(struct queue_entry* q, u8* mem) {
 
-  u8* fn;
+  struct cal_record rec;
+  u32 i, packed_len;
+  u8* body;
 
-  fn = alloc_printf("%s/_resume/.state/deterministic_done", out_dir);
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+  if (no_cal_cache || dumb_mode || crash_mode) return;
 
-  fn = alloc_printf("%s/_resume/.state/auto_extras", out_dir);
-  if (delete_files(fn, "auto_")) goto dir_cleanup_failed;
-  ck_free(fn);
+  collect_trace_idx();
 
-  fn = alloc_printf("%s/_resume/.state/redundant_edges", out_dir);
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+  packed_len = q->prox_score.dfg_packed_map ? q->prox_score.dfg_packed_len : 0;
 
-  fn = alloc_printf("%s/_resume/.state/variable_behavior", out_dir);
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+  body = ck_alloc_nozero(trace_idx_cnt * 5 + packed_len);
 
-  fn = alloc_printf("%s/_resume/.state", out_dir);
-  if (rmdir(fn) && errno != ENOENT) goto dir_cleanup_failed;
-  ck_free(fn);
+  memcpy(body, trace_idx, trace_idx_cnt * sizeof(u32));
 
-  fn = alloc_printf("%s/_resume", out_dir);
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+  for (i = 0; i < trace_idx_cnt; i++)
+    body[trace_idx_cnt * sizeof(u32) + i] = trace_bits[trace_idx[i]];
 
-  return;
+  if (packed_len)
+    memcpy(body + trace_idx_cnt * 5, q->prox_score.dfg_packed_map, packed_len);
 
-dir_cleanup_failed:
+  memset(&rec, 0, sizeof(rec));
+  memcpy(rec.magic, CAL_MAGIC, sizeof(rec.magic));
 
-  FATAL("_resume directory cleanup failed");
+  rec.version       = CAL_VERSION;
+  rec.len           = q->len;
+  rec.content_hash  = cal_content_hash(mem, q->len);
+  rec.exec_us       = q->exec_us;
+  rec.exec_cksum    = q->exec_cksum;
+  rec.dfg_cksum     = q->dfg_cksum;
+  rec.bitmap_size   = q->bitmap_size;
+  rec.last_location = q->last_location;
+  rec.trace_len     = trace_idx_cnt;
+  rec.packed_len    = packed_len;
+  rec.var_behavior  = q->var_behavior;
+  rec.val_hash      = q->val_hash;
+
+  get_target_id(&rec.target_size, &rec.target_hash);
+
+  cal_append(q, &rec, body, trace_idx_cnt * 5 + packed_len);
+  ck_free(body);
 
 }
 
 
-/* Delete fuzzer output directory if we recognize it as ours, if the fuzzer
-   is not currently running, and if the last run time isn't too great. */
+/* Store q->val_hash in the record of q, once the dry run has learned it,
+   by appending a copy that supersedes the old one. */
 
-static void maybe_delete_out_dir(void) {
+static void cal_cache_set_val(struct queue_entry* q) {
 
-  FILE* f;
-  u8 *fn = alloc_printf("%s/fuzzer_stats", out_dir);
+  struct cal_record* rec;
 
-  /* See if the output directory is locked. If yes, bail out. If not,
-     create a lock that will persist for the lifetime of the process
-     (this requires leaving the descriptor open).*/
+  if (no_cal_cache || dumb_mode || crash_mode || !q->cal_len ||
+      cal_fd < 0) return;
 
-  out_dir_fd = open(out_dir, O_RDONLY);
-  if (out_dir_fd < 0) PFATAL("Unable to open '%s'", out_dir);
+  rec = cal_record_pread(cal_fd, q->cal_off, q->cal_len);
+  if (!rec) return;
 
-#ifndef __sun
+  rec->val_hash = q->val_hash;
 
-  if (flock(out_dir_fd, LOCK_EX | LOCK_NB) && errno == EWOULDBLOCK) {
+  cal_append(q, rec, (u8*)(rec + 1),
+             q->cal_len - sizeof(struct cal_record) - rec->name_len);
 
-    SAYF("\n" cLRD "[-] " cRST
-         "Looks like the job output directory is being actively used by another\n"
-         "    instance of afl-fuzz. You will need to choose a different %s\n"
-         "    or stop the other process first.\n",
-         sync_id ? "fuzzer ID" : "output location");
+  ck_free(rec);
 
-    FATAL("Directory '%s' is in use", out_dir);
+}
 
-  }
 
-#endif /* !__sun */
+/* Try to take the dry-run calibration of q from its record. Returns 0 if
+   there is no usable record. Otherwise, leaves trace_bits, dfg_bits and
+   *last_location as the last calibration run did, does the bookkeeping of
+   the tail of calibrate_case(), stores the result in *res and returns 1. */
 
-  f = fopen(fn, "r");
+static u8 cal_cache_load(char** argv, struct queue_entry* q, u8* use_mem,
+                         u8* res) {
 
-  if (f) {
+  struct cal_record* rec;
+  u8 *p, *end;
+  u32 *idx, i, dfg_idx = 0;
+  u8  new_bits, ret = 0;
 
-    u64 start_time, last_update;
+  if (no_cal_cache || dumb_mode || crash_mode) return 0;
 
-    if (fscanf(f, "start_time     : %llu\n"
-                  "last_update    : %llu\n", &start_time, &last_update) != 2)
-      FATAL("Malformed data in '%s'", fn);
+  rec = cal_record_get(q, use_mem);
+  if (!rec) return 0;
 
-    fclose(f);
+  idx = (u32*)(rec + 1);
+  p   = (u8*)(idx + rec->trace_len) + rec->trace_len;
+  end = p + rec->packed_len;
 
-    /* Let's see how much work is at stake. */
+  /* Optionally re-run a sample of the entries once and make sure that the
+     trace still matches the record. */
 
-    if (!in_place_resume && last_update - start_time > OUTPUT_GRACE * 60) {
+  if (cal_spot_check && UR(100) < cal_spot_check) {
 
-      SAYF("\n" cLRD "[-] " cRST
-           "The job output directory already exists and contains the results of more\n"
-           "    than %u minutes worth of fuzzing. To avoid data loss, afl-fuzz will *NOT*\n"
-           "    automatically delete this data for you.\n\n"
+    if (!no_forkserver && !forksrv_pid) init_forkserver(argv);
 
-           "    If you wish to start a new session, remove or rename the directory manually,\n"
-           "    or specify a different output location for this job. To resume the old\n"
-           "    session, put '-' as the input directory in the command line ('-i -') and\n"
-           "    try again.\n", OUTPUT_GRACE);
+    write_to_testcase(use_mem, q->len);
+    run_target(argv, exec_tmout, "USELESS=0", 0);
 
-       FATAL("At-risk data found in '%s'", out_dir);
+    if (stop_soon) goto done;
 
+    if (hash32(trace_bits, map_size, HASH_CONST) != rec->exec_cksum) {
+      cal_cache_stale++;
+      goto done;
     }
 
   }
 
-  ck_free(fn);
-
-  /* The idea for in-place resume is pretty simple: we temporarily move the old
-     queue/ to a new location that gets deleted once import to the new queue/
-     is finished. If _resume/ already exists, the current queue/ may be
-     incomplete due to an earlier abort, so we want to use the old _resume/
-     dir instead, and we let rename() fail silently. */
+  /* Rebuild the state of the last calibration run. The DFG map is decoded
+     with bounds checks, since the record comes from disk. */
 
-  if (in_place_resume) {
+  memset(trace_bits, 0, map_size);
 
-    u8* orig_q = alloc_printf("%s/queue", out_dir);
+  for (i = 0; i < rec->trace_len; i++)
+    trace_bits[idx[i]] = ((u8*)(idx + rec->trace_len))[i];
 
-    in_dir = alloc_printf("%s/_resume", out_dir);
+  invalidate_trace_idx();
 
-    rename(orig_q, in_dir); /* Ignore errors */
+  memset(dfg_bits, 0, DFG_MAP_SIZE * sizeof(u32));
 
-    OKF("Output directory exists, will attempt session resume.");
+  while (p < end) {
 
-    ck_free(orig_q);
+    u32 delta, count;
 
-  } else {
+    if (!varint_get_checked(&p, end, &delta) ||
+        !varint_get_checked(&p, end, &count)) goto done;
 
-    OKF("Output directory exists but deemed OK to reuse.");
+    dfg_idx += delta;
+    if (dfg_idx >= DFG_MAP_SIZE) goto done;
+    dfg_bits[dfg_idx] = count;
 
   }
 
-  ACTF("Deleting old session data...");
+  *last_location = rec->last_location;
 
-  /* Okay, let's get the ball rolling! First, we need to get rid of the entries
-     in <out_dir>/.synced/.../id:*, if any are present. */
+  /* What follows mirrors the end of calibrate_case(). */
 
-  if (!in_place_resume) {
+  new_bits = has_new_bits(virgin_bits);
 
-    fn = alloc_printf("%s/.synced", out_dir);
-    if (delete_files(fn, NULL)) goto dir_cleanup_failed;
-    ck_free(fn);
+  q->exec_cksum  = rec->exec_cksum;
+  q->exec_us     = rec->exec_us;
+  q->bitmap_size = rec->bitmap_size;
+  compute_proximity_score(&q->prox_score, dfg_bits, 1);
 
-  }
+  total_prox_original += q->prox_score.original;
+  total_prox_cnt++;
+  q->handicap    = 0;
+  q->cal_failed  = 0;
 
-  /* Next, we need to clean up <out_dir>/queue/.state/ subdirectories: */
+  total_bitmap_size += q->bitmap_size;
+  total_bitmap_entries++;
 
-  fn = alloc_printf("%s/queue/.state/deterministic_done", out_dir);
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+  total_cal_us     += q->exec_us;
+  total_cal_cycles++;
 
-  fn = alloc_printf("%s/queue/.state/auto_extras", out_dir);
-  if (delete_files(fn, "auto_")) goto dir_cleanup_failed;
+  update_dfg_count_map(q);
+  update_bitmap_score(q);
+
+  if (new_bits == 2 && !q->has_new_cov) {
+    q->has_new_cov = 1;
+    queued_with_cov++;
+  }
+
+  q->val_hash = rec->val_hash;
+
+  if (rec->var_behavior && !q->var_behavior) {
+    mark_as_variable(q);
+    queued_variable++;
+  }
+
+  *res = new_bits ? FAULT_NONE : FAULT_NOBITS;
+  cal_cache_hits++;
+  ret = 1;
+
+done:
+
+  ck_free(rec);
+  return ret;
+
+}
+
+
+/* Examine map coverage. Called once, for first test case. */
+
+static void check_map_coverage(void) {
+
+  u32 i;
+
+  if (count_trace_bytes() < 100 || map_size < MAP_SIZE) return;
+
+  for (i = (1 << (MAP_SIZE_POW2 - 1)); i < MAP_SIZE; i++)
+    if (trace_bits[i]) return;
+
+  WARNF("Recompile binary with newer version of afl to improve coverage!");
+
+}
+
+
+/* Perform dry run of all test cases to confirm that the app is working as
+   expected. This is done only for the initial inputs, and only once. */
+
+static void perform_dry_run(char** argv, char *base_crash_seed) {
+
+  struct queue_entry* q = queue;
+  u32 cal_failures = 0;
+  u8 has_crashing_seed = 0;
+  u8* skip_crashes = getenv("AFL_SKIP_CRASHES");
+
+  if (base_crash_seed) {
+
+    s32 fd = open(base_crash_seed, O_RDONLY);
+    if (fd < 0) PFATAL("Unable to open base crash seed '%s'", base_crash_seed);
+    struct stat st;
+    if (fstat(fd, &st) < 0) PFATAL("fstat() failed");
+    u64 len = st.st_size;
+    u8* use_mem = ck_alloc_nozero(len);
+    if (read(fd, use_mem, len) != len) FATAL("Short read from '%s'", base_crash_seed);
+    close(fd);
+
+    struct queue_entry base_entry;
+    memset(&base_entry, 0, sizeof(struct queue_entry));
+    base_entry.fname = base_crash_seed;
+    base_entry.len = len;
+    base_entry.base_crash_seed = 1;
+    u8 res = calibrate_case(argv, &base_entry, use_mem, 0, 1);
+    if (res != FAULT_CRASH) PFATAL("Base crash seed *does not* crash");
+    has_crashing_seed = 1;
+
+    u32 checksum = get_dfg_checksum();
+    if (check_covered_target()) {
+      for (u32 i = 0; i < DFG_MAP_SIZE; i++) {
+        if (dfg_targets[i] > MAP_SIZE) {
+          dfg_targets[i] = *last_location;
+          break;
+        } else if (dfg_targets[i] == *last_location) {
+          break;
+        }
+      }
+    }
+
+  }
+
+  while (q) {
+
+    u8* use_mem;
+    u8  res;
+
+    u8* fn = strrchr(q->fname, '/') + 1;
+
+    /* Already calibrated according to the scheduler checkpoint. */
+
+    if (q->restored) {
+
+      restore_dry_run_entry(q);
+      if (crash_mode) has_crashing_seed = 1;
+
+      q = q->next;
+      continue;
+
+    }
+
+    ACTF("Attempting dry run with '%s'...", fn);
+
+    use_mem = load_queue_entry(q);
+
+    if (!q->content_hash) q->content_hash = hash64(use_mem, q->len, HASH_CONST);
+
+    u8 from_cache = cal_cache_load(argv, q, use_mem, &res);
+
+    if (!from_cache) res = calibrate_case(argv, q, use_mem, 0, 1);
+
+    u32 checksum = get_dfg_checksum();
+    q->dfg_cksum = checksum;
+    q->last_location = *last_location;
+
+    if (!from_cache && !stop_soon && (res == FAULT_NONE || res == FAULT_NOBITS))
+      cal_cache_save(q, use_mem);
+
+    u8 *valuation_file;
+    u8 val_result = 0;
+    EVLOG(EV_VERTICAL_DRY_RUN, q->entry_id, checksum, res, q->fname, *last_location);
+
+    if (stop_soon) return;
+
+    if (res == crash_mode || res == FAULT_NOBITS)
+      SAYF(cGRA "    len = %u, map size = %u, exec speed = %llu us\n" cRST,
+           q->len, q->bitmap_size, q->exec_us);
+
+    switch (res) {
+
+      case FAULT_NONE:
+
+        if (q == queue) check_map_coverage();
+
+        if (check_covered_target()) {
+
+          if (dfg_node_info_map) {
+            check_unique_path();
+          }
+          u32 val_hash;
+          val_result = get_valuation(0, argv, use_mem, q->len, checksum, &val_hash, &valuation_file);
+          save_valuation(0, val_result, checksum, val_hash, q, valuation_file);
+          if (val_hash != q->val_hash) {
+            q->val_hash = val_hash;
+            cal_cache_set_val(q);
+          }
+        }
+
+        break;
+
+      case FAULT_TMOUT:
+
+        if (timeout_given) {
+
+          /* The -t nn+ syntax in the command line sets timeout_given to '2' and
+             instructs afl-fuzz to tolerate but skip queue entries that time
+             out. */
+
+          if (timeout_given > 1) {
+            WARNF("Test case results in a timeout (skipping)");
+            q->cal_failed = CAL_CHANCES;
+            cal_failures++;
+            break;
+          }
+
+          SAYF("\n" cLRD "[-] " cRST
+               "The program took more than %u ms to process one of the initial test cases.\n"
+               "    Usually, the right thing to do is to relax the -t option - or to delete it\n"
+               "    altogether and allow the fuzzer to auto-calibrate. That said, if you know\n"
+               "    what you are doing and want to simply skip the unruly test cases, append\n"
+               "    '+' at the end of the value passed to -t ('-t %u+').\n", exec_tmout,
+               exec_tmout);
+
+          FATAL("Test case '%s' results in a timeout", fn);
+
+        } else {
+
+          SAYF("\n" cLRD "[-] " cRST
+               "The program took more than %u ms to process one of the initial test cases.\n"
+               "    This is bad news; raising the limit with the -t option is possible, but\n"
+               "    will probably make the fuzzing process extremely slow.\n\n"
+
+               "    If this test case is just a fluke, the other option is to just avoid it\n"
+               "    altogether, and find one that is less of a CPU hog.\n", exec_tmout);
+
+          FATAL("Test case '%s' results in a timeout", fn);
+
+        }
+
+      case FAULT_CRASH:
+        has_crashing_seed = 1;
+        if (check_covered_target()) {
+          // Add to crash location only if base_crash_seed not provided
+          if (!base_crash_seed) {
+            for (u32 i = 0; i < DFG_MAP_SIZE; i++) {
+              if (dfg_targets[i] > MAP_SIZE) {
+                dfg_targets[i] = *last_location;
+                break;
+              } else if (dfg_targets[i] == *last_location) {
+                break;
+              }
+            }
+          }
+          if (dfg_node_info_map) {
+            check_unique_path();
+          }
+          u8 is_neg_val = check_last_location(*last_location);
+          u32 val_hash;
+          val_result = get_valuation(is_neg_val, argv, use_mem, q->len, checksum, &val_hash, &valuation_file);
+          save_valuation(is_neg_val, val_result, checksum, val_hash, q, valuation_file);
+        }
+
+        if (crash_mode) break;
+
+        if (skip_crashes) {
+          WARNF("Test case results in a crash (skipping)");
+          q->cal_failed = CAL_CHANCES;
+          cal_failures++;
+          break;
+        }
+
+        if (mem_limit) {
+
+          SAYF("\n" cLRD "[-] " cRST
+               "Oops, the program crashed with one of the test cases provided. There are\n"
+               "    several possible explanations:\n\n"
+
+               "    - The test case causes known crashes under normal working conditions. If\n"
+               "      so, please remove it. The fuzzer should be seeded with interesting\n"
+               "      inputs - but not ones that cause an outright crash.\n\n"
+
+               "    - The current memory limit (%s) is too low for this program, causing\n"
+               "      it to die due to OOM when parsing valid files. To fix this, try\n"
+               "      bumping it up with the -m setting in the command line. If in doubt,\n"
+               "      try something along the lines of:\n\n"
+
+#ifdef RLIMIT_AS
+               "      ( ulimit -Sv $[%llu << 10]; /path/to/binary [...] <testcase )\n\n"
+#else
+               "      ( ulimit -Sd $[%llu << 10]; /path/to/binary [...] <testcase )\n\n"
+#endif /* ^RLIMIT_AS */
+
+               "      Tip: you can use http://jwilk.net/software/recidivm to quickly\n"
+               "      estimate the required amount of virtual memory for the binary. Also,\n"
+               "      if you are using ASAN, see %s/notes_for_asan.txt.\n\n"
+
+#ifdef __APPLE__
+
+               "    - On MacOS X, the semantics of fork() syscalls are non-standard and may\n"
+               "      break afl-fuzz performance optimizations when running platform-specific\n"
+               "      binaries. To fix this, set AFL_NO_FORKSRV=1 in the environment.\n\n"
+
+#endif /* __APPLE__ */
+
+               "    - Least likely, there is a horrible bug in the fuzzer. If other options\n"
+               "      fail, poke <lcamtuf@coredump.cx> for troubleshooting tips.\n",
+               DMS(mem_limit << 20), mem_limit - 1, doc_path);
+
+        } else {
+
+          SAYF("\n" cLRD "[-] " cRST
+               "Oops, the program crashed with one of the test cases provided. There are\n"
+               "    several possible explanations:\n\n"
+
+               "    - The test case causes known crashes under normal working conditions. If\n"
+               "      so, please remove it. The fuzzer should be seeded with interesting\n"
+               "      inputs - but not ones that cause an outright crash.\n\n"
+
+#ifdef __APPLE__
+
+               "    - On MacOS X, the semantics of fork() syscalls are non-standard and may\n"
+               "      break afl-fuzz performance optimizations when running platform-specific\n"
+               "      binaries. To fix this, set AFL_NO_FORKSRV=1 in the environment.\n\n"
+
+#endif /* __APPLE__ */
+
+               "    - Least likely, there is a horrible bug in the fuzzer. If other options\n"
+               "      fail, poke <lcamtuf@coredump.cx> for troubleshooting tips.\n");
+
+        }
+
+        FATAL("Test case '%s' results in a crash", fn);
+
+      case FAULT_ERROR:
+
+        FATAL("Unable to execute target application ('%s')", argv[0]);
+
+      case FAULT_NOINST:
+
+        FATAL("No instrumentation detected");
+
+      case FAULT_NOBITS:
+
+        useless_at_start++;
+
+        if (!in_bitmap && !shuffle_queue)
+          WARNF("No new instrumentation output, test case may be useless.");
+
+        break;
+
+    }
+
+    if (q->var_behavior) WARNF("Instrumentation output varies across runs.");
+
+    q = q->next;
+
+    ck_free(use_mem);
+
+  }
+
+  /* If every entry came from the checkpoint, nothing has started the
+     forkserver yet. */
+
+  if (dumb_mode != 1 && !no_forkserver && !forksrv_pid) init_forkserver(argv);
+
+  if (!vertical_experiment && crash_mode && !has_crashing_seed)
+    FATAL("All test cases did *NOT* crash: invalid -C setting?");
+
+  if (cal_failures) {
+
+    if (cal_failures == queued_paths)
+      FATAL("All test cases time out%s, giving up!",
+            skip_crashes ? " or crash" : "");
+
+    WARNF("Skipped %u test cases (%0.02f%%) due to timeouts%s.", cal_failures,
+          ((double)cal_failures) * 100 / queued_paths,
+          skip_crashes ? " or crashes" : "");
+
+    if (cal_failures * 5 > queued_paths)
+      WARNF(cLRD "High percentage of rejected test cases, check settings!");
+
+  }
+
+  if (cal_cache_hits || cal_cache_stale)
+    OKF("Took %u test cases from the calibration cache (%u stale records).",
+        cal_cache_hits, cal_cache_stale);
+
+  OKF("All test cases processed.");
+
+}
+
+
+/* Helper function: link() if possible, copy otherwise. */
+
+static void link_or_copy(u8* old_path, u8* new_path) {
+
+  s32 i = link(old_path, new_path);
+  s32 sfd, dfd;
+  u8* tmp;
+
+  if (!i) return;
+
+  sfd = open(old_path, O_RDONLY);
+  if (sfd < 0) PFATAL("Unable to open '%s'", old_path);
+
+  dfd = open(new_path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (dfd < 0) PFATAL("Unable to create '%s'", new_path);
+
+  tmp = ck_alloc(64 * 1024);
+
+  while ((i = read(sfd, tmp, 64 * 1024)) > 0)
+    ck_write(dfd, tmp, i, new_path);
+
+  if (i < 0) PFATAL("read() failed");
+
+  ck_free(tmp);
+  close(sfd);
+  close(dfd);
+
+}
+
+
+static void nuke_resume_dir(void);
+
+/* Create hard links for input test cases in the output directory, choosing
+   good names and pivoting accordingly. */
+
+static void pivot_inputs(void) {
+
+  struct queue_entry* q = queue;
+  struct cal_index in_cal = { 0 };
+  u32 id = 0;
+
+  ACTF("Creating hard links for all input files...");
+
+  in_cal.fn = alloc_printf("%s/.state/calibration/records", in_dir);
+
+  while (q) {
+
+    u8  *nfn, *rsl = strrchr(q->fname, '/');
+    u32 orig_id, cal_size;
+    struct cal_record* cal_rec = NULL;
+
+    if (!rsl) rsl = q->fname; else rsl++;
+
+    /* If the original file name conforms to the syntax and the recorded
+       ID matches the one we'd assign, just use the original file name.
+       This is valuable for resuming fuzzing runs. */
+
+#ifndef SIMPLE_FILES
+#  define CASE_PREFIX "id:"
+#else
+#  define CASE_PREFIX "id_"
+#endif /* ^!SIMPLE_FILES */
+
+    if (!strncmp(rsl, CASE_PREFIX, 3) &&
+        sscanf(rsl + 3, "%06u", &orig_id) == 1 && orig_id == id) {
+
+      u8* src_str;
+      u32 src_id;
+
+      resuming_fuzz = 1;
+      nfn = alloc_printf("%s/queue/%s", out_dir, rsl);
+
+      /* Since we're at it, let's also try to find parent and figure out the
+         appropriate depth for this entry. */
+
+      src_str = strchr(rsl + 3, ':');
+
+      if (src_str && sscanf(src_str + 1, "%06u", &src_id) == 1) {
+
+        struct queue_entry* s = queue;
+        while (src_id-- && s) s = s->next;
+        if (s) q->depth = s->depth + 1;
+
+        if (max_depth < q->depth) max_depth = q->depth;
+
+      }
+
+    } else {
+
+      /* No dice - invent a new name, capturing the original one as a
+         substring. */
+
+#ifndef SIMPLE_FILES
+
+      u8* use_name = strstr(rsl, ",orig:");
+
+      if (use_name) use_name += 6; else use_name = rsl;
+      nfn = alloc_printf("%s/queue/id:%06u,orig:%s", out_dir, id, use_name);
+
+#else
+
+      nfn = alloc_printf("%s/queue/id_%06u", out_dir, id);
+
+#endif /* ^!SIMPLE_FILES */
+
+    }
+
+    if (no_cal_cache || dumb_mode || crash_mode) {
+
+      /* Nothing to carry over. */
+
+    } else if (q->packed == 1) {
+
+      if (q->cal_len >= sizeof(struct cal_record)) {
+        cal_size = q->cal_len;
+        cal_rec  = ck_alloc_nozero(cal_size);
+        memcpy(cal_rec, in_pack_map + q->cal_off, cal_size);
+      }
+
+    } else cal_rec = cal_index_find(&in_cal, rsl, strlen(rsl), &cal_size);
+
+    /* Pivot to the new queue entry. Packed inputs, or any inputs when
+       packing the queue, are copied over. */
+
+    if (queue_pack || q->packed) {
+
+      u8* mem = load_queue_entry(q);
+
+      ck_free(q->fname);
+      q->fname = nfn;
+
+      write_queue_entry(q, mem, q->len);
+      ck_free(mem);
+
+    } else {
+
+      link_or_copy(q->fname, nfn);
+      ck_free(q->fname);
+      q->fname = nfn;
+
+    }
+
+    /* Carry over the calibration record, if the input has one, under the
+       new name. */
+
+    if (cal_rec) {
+
+      if (cal_record_size(cal_rec) == cal_size)
+        cal_append(q, cal_rec, (u8*)(cal_rec + 1),
+                   cal_size - sizeof(struct cal_record) - cal_rec->name_len);
+
+      ck_free(cal_rec);
+
+    }
+
+    /* Make sure that the passed_det value carries over, too. */
+
+    if (q->passed_det) mark_as_det_done(q);
+
+    q = q->next;
+    id++;
+
+  }
+
+  cal_index_free(&in_cal);
+
+  if (in_pack_map) {
+    munmap(in_pack_map, in_pack_len);
+    in_pack_map = NULL;
+  }
+
+  if (in_place_resume) nuke_resume_dir();
+
+}
+
+
+#ifndef SIMPLE_FILES
+
+/* Construct a file name for a new test case, capturing the operation
+   that led to its discovery. Uses a static buffer. */
+
+static u8* describe_op(u8 hnb) {
+
+  static u8 ret[256];
+
+  if (syncing_party) {
+
+    sprintf(ret, "sync:%s,src:%06u", syncing_party, syncing_case);
+
+  } else {
+
+    sprintf(ret, "src:%06u", current_entry);
+
+    if (splicing_with >= 0)
+      sprintf(ret + strlen(ret), "+%06u", splicing_with);
+
+    sprintf(ret + strlen(ret), ",op:%s", stage_short);
+
+    if (stage_cur_byte >= 0) {
+
+      sprintf(ret + strlen(ret), ",pos:%u", stage_cur_byte);
+
+      if (stage_val_type != STAGE_VAL_NONE)
+        sprintf(ret + strlen(ret), ",val:%s%+d",
+                (stage_val_type == STAGE_VAL_BE) ? "be:" : "",
+                stage_cur_val);
+
+    } else sprintf(ret + strlen(ret), ",rep:%u", stage_cur_val);
+
+  }
+
+  if (hnb == 2) strcat(ret, ",+cov");
+
+  return ret;
+
+}
+
+#endif /* !SIMPLE_FILES */
+
+
+/* Write a message accompanying the crash directory :-) */
+
+static void write_crash_readme(void) {
+
+  u8* fn = alloc_printf("%s/crashes/README.txt", out_dir);
+  s32 fd;
+  FILE* f;
+
+  fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  ck_free(fn);
+
+  /* Do not die on errors here - that would be impolite. */
+
+  if (fd < 0) return;
+
+  f = fdopen(fd, "w");
+
+  if (!f) {
+    close(fd);
+    return;
+  }
+
+  fprintf(f, "Command line used to find this crash:\n\n"
+
+             "%s\n\n"
+
+             "If you can't reproduce a bug outside of afl-fuzz, be sure to set the same\n"
+             "memory limit. The limit used for this fuzzing session was %s.\n\n"
+
+             "Need a tool to minimize test cases before investigating the crashes or sending\n"
+             "them to a vendor? Check out the afl-tmin that comes with the fuzzer!\n\n"
+
+             "Found any cool bugs in open-source tools using afl-fuzz? If yes, please drop\n"
+             "me a mail at <lcamtuf@coredump.cx> once the issues are fixed - I'd love to\n"
+             "add your finds to the gallery at:\n\n"
+
+             "  http://lcamtuf.coredump.cx/afl/\n\n"
+
+             "Thanks :-)\n",
+
+             orig_cmdline, DMS(mem_limit << 20)); /* ignore errors */
+
+  fclose(f);
+
+}
+
+
+/* Check if the result of an execve() during routine fuzzing is interesting,
+   save or queue the input test case for further analysis if so. Returns 1 if
+   entry is saved, 0 otherwise. */
+
+static u8 save_if_interesting(char** argv, void* mem, u32 len, u8 fault) {
+
+  u8  *fn = "";
+  u8  hnb = 0;
+  u8  is_interesting = 0;
+  u32 exec_cksum = 0;
+  s32 fd;
+  u8  keeping = 0, res;
+  u8 has_valid_unique_path = 0;
+  u8 save_to_file = 0;
+  u8 has_unique_val_per_path = 0;
+  u32 val_hash = 0;
+  u8 *valuation = NULL;
+  u8 is_covered_target = 0;
+  u8 is_neg_val = fault == FAULT_CRASH;
+  struct proximity_score prox_score;
+  if ((fault != FAULT_CRASH && fault != FAULT_NONE) ||
+      (use_old_dafl_seed_pool_add && crash_mode != fault)) classify_trace();
+  if (fault == FAULT_CRASH || fault == FAULT_NONE) {
+    if (!use_old_dafl_seed_pool_add || crash_mode == fault) {
+      // memcpy(trace_bits_tmp, trace_bits, MAP_SIZE);
+      hnb = has_new_bits_cksum(virgin_bits, &exec_cksum);
+      compute_proximity_score(&prox_score, dfg_bits, 0);
+    }
+    is_covered_target = check_coverage(fault == FAULT_CRASH, argv, mem, len);
+    if (is_neg_val) {
+      is_neg_val = check_last_location(*last_location);
+    }
+  }
+  struct queue_entry *new_seed = NULL;
+  u32 dfg_checksum = get_dfg_checksum();
+  vertical_is_new_valuation = 0;
+  if (dafl_target_cnt > 1) {
+    for (u32 i = 0; i < dafl_target_cnt; i++)
+      pareto_scheduler_update_dfg_count(dafl_targets[i].ps, dfg_checksum);
+  } else pareto_scheduler_update_dfg_count(pareto_scheduler, dfg_checksum);
+  // LOGF("[sii] [seed %d] [dfg-path %u] [cov %u] [prox %llu] [adj %f] [mut %s] [time %llu]\n",
+  //      queue_cur ? queue_cur->entry_id : -1, dfg_checksum, check_covered_target(), prox_score.original, prox_score.adjusted, stage_short, get_cur_time() - start_time);
+  if (dfg_node_info_map) {
+    if (is_covered_target) {
+      save_to_file = get_valuation(fault == FAULT_CRASH, argv, mem, len, dfg_checksum, &val_hash, &valuation);
+    }
+    has_valid_unique_path = check_unique_path();
+    if (has_valid_unique_path) {
+      EVLOG(EV_MOO_UNIQ_PATH, queue_cur ? queue_cur->entry_id : -1, hashmap_size(dfg_hashmap));
+    }
+  }
+  // Stride scheduler
+  if (vertical_is_new_valuation || has_valid_unique_path) {
+    stride_scheduler_update_found_count(stride_scheduler, 1);
+  }
+  if (vertical_experiment && (fault == FAULT_CRASH || fault == FAULT_NONE)) {
+    if (save_to_file) {
+      return 1;
+    }
+    return 0;
+  }
+  //  || (use_moo_scheduler && has_valid_unique_path)
+  if ((fault == FAULT_CRASH) || (fault == FAULT_NONE)) {
+    // hnb = has_new_bits(virgin_bits);
+    switch (add_queue_mode) {
+    case ADD_QUEUE_DEFAULT:  is_interesting = hnb; break;
+    case ADD_QUEUE_UNIQUE_VAL_PER_PATH: is_interesting = vertical_is_new_valuation; break;
+    case ADD_QUEUE_UNIQUE_VAL:  is_interesting = save_to_file; break;
+    case ADD_QUEUE_ALL:  is_interesting = (hnb || vertical_is_new_valuation); break;
+    case ADD_QUEUE_NONE:  is_interesting = 0; break;
+    case ADD_QUEUE_UNIQUE_VAL_PER_PATH_IN_VER:  {
+      if (stride_scheduler_get_mode(stride_scheduler) == M_VER)
+        is_interesting = (vertical_is_new_valuation);
+      else
+        is_interesting = (hnb);
+      break;
+    }
+    case ADD_QUEUE_UNIQUE_VAL_PER_PATH_IN_VER_PLUS_DEF: {
+      if (stride_scheduler_get_mode(stride_scheduler) == M_VER)
+        is_interesting = (hnb || vertical_is_new_valuation);
+      else
+        is_interesting = (hnb);
+      break;
+    }
+    default:
+      is_interesting = hnb;
+      break;
+    }
+
+    if (use_old_dafl_seed_pool_add) {
+      if (crash_mode != fault) {
+        is_interesting = 0;
+      }
+    }
+
+    if (is_interesting) {
+
+    /* Keep only if there are new bits in the map, add to queue for
+       future fuzzing, etc. */
+      // compute_proximity_score(&prox_score, dfg_bits, 0);
+      vertical_is_interesting = 1;
+      if (has_valid_unique_path) {
+          EVLOG(EV_MOO_UNIQ, queue_cur ? queue_cur->entry_id : -1, queued_paths, hashmap_size(dfg_hashmap), prox_score.covered, prox_score.original, prox_score.adjusted, stage_short, get_cur_time() - start_time);
+      } else {
+          EVLOG(EV_MOO_NO_UNIQ, queue_cur ? queue_cur->entry_id : -1, queued_paths, prox_score.covered, prox_score.original, prox_score.adjusted, check_covered_target(), stage_short, get_cur_time() - start_time);
+      }
+#ifndef SIMPLE_FILES
+
+      fn = alloc_printf("%s/queue/id:%06u,%llu,%s", out_dir, queued_paths,
+                        prox_score.original, describe_op(hnb));
+
+#else
+
+      fn = alloc_printf("%s/queue/id_%06u", out_dir, queued_paths);
+
+#endif /* ^!SIMPLE_FILES */
+
+      add_to_queue(fn, len, 0, &prox_score);
+
+      new_seed = queue_last;
+
+      if (hnb == 2) {
+        queue_last->has_new_cov = 1;
+        queued_with_cov++;
+      }
+
+      queue_last->exec_cksum = exec_cksum; // hash32(trace_bits_tmp, MAP_SIZE, HASH_CONST);
+      queue_last->dfg_cksum = dfg_checksum;
+      queue_last->val_hash = val_hash;
+      queue_last->last_location = *last_location;
+      EVLOG(EV_VERTICAL_SAVE, queue_cur ? queue_cur->entry_id : -1, queue_last->entry_id, fault == FAULT_CRASH, queue_last->dfg_cksum, prox_score.covered, prox_score.original, prox_score.adjusted, stage_short, fn, get_cur_time() - start_time, *last_location, val_hash, save_to_file, is_neg_val, queue_last->exec_cksum);
+
+      /* Try to calibrate inline; this also calls update_bitmap_score() when
+        successful. */
+
+      res = calibrate_case(argv, queue_last, mem, queue_cycle - 1, 0);
+
+      if (res == FAULT_ERROR)
+        FATAL("Unable to execute target application");
+
+      write_queue_entry(queue_last, mem, len);
+
+      if (res == FAULT_NONE && !queue_last->cal_failed)
+        cal_cache_save(queue_last, mem);
+
+      if (!syncing_party) syncd_push(queue_last, mem);
+
+      keeping = 1;
+    }
+
+  }
+
+  switch (fault) {
+
+    case FAULT_TMOUT:
+
+      /* Timeouts are not very interesting, but we're still obliged to keep
+         a handful of samples. We use the presence of new bits in the
+         hang-specific bitmap as a signal of uniqueness. In "dumb" mode, we
+         just keep everything. */
+
+      total_tmouts++;
+
+      if (unique_hangs >= KEEP_UNIQUE_HANG) return keeping;
+
+      if (!dumb_mode) {
+
+#ifdef WORD_SIZE_64
+        simplify_trace((u64*)trace_bits);
+#else
+        simplify_trace((u32*)trace_bits);
+#endif /* ^WORD_SIZE_64 */
+
+        if (!has_new_bits(virgin_tmout)) return keeping;
+
+      }
+
+      unique_tmouts++;
+
+      /* Before saving, we make sure that it's a genuine hang by re-running
+         the target with a more generous timeout (unless the default timeout
+         is already generous). */
+
+      if (exec_tmout < hang_tmout) {
+
+        u8 new_fault;
+        write_to_testcase(mem, len);
+        new_fault = run_target(argv, hang_tmout, "USELESS=0", 0);
+
+        /* A corner case that one user reported bumping into: increasing the
+           timeout actually uncovers a crash. Make sure we don't discard it if
+           so. */
+
+        if (!stop_soon && new_fault == FAULT_CRASH) goto keep_as_crash;
+
+        if (stop_soon || new_fault != FAULT_TMOUT) return keeping;
+
+      }
+
+#ifndef SIMPLE_FILES
+
+      fn = alloc_printf("%s/hangs/id:%06llu,%s", out_dir,
+                        unique_hangs, describe_op(0));
+
+#else
+
+      fn = alloc_printf("%s/hangs/id_%06llu", out_dir,
+                        unique_hangs);
+
+#endif /* ^!SIMPLE_FILES */
+
+      unique_hangs++;
+
+      last_hang_time = get_cur_time();
+
+      break;
+
+    case FAULT_CRASH:
+
+keep_as_crash:
+
+      if (!is_covered_target) return keeping;
+      // save_to_file = get_valuation(1, argv, mem, len, dfg_checksum, new_seed, &val_hash);
+      save_valuation(is_neg_val, save_to_file, dfg_checksum, val_hash, new_seed, valuation);
+
+      /* This is handled in a manner roughly similar to timeouts,
+         except for slightly different limits and no need to re-run test
+         cases. */
+
+      total_crashes++;
+
+      if (unique_crashes >= KEEP_UNIQUE_CRASH) return keeping;
+
+      if (!dumb_mode) {
+
+#ifdef WORD_SIZE_64
+        simplify_trace((u64*)trace_bits);
+#else
+        simplify_trace((u32*)trace_bits);
+#endif /* ^WORD_SIZE_64 */
+
+        // if (!has_new_bits(virgin_crash)) return keeping;
+
+      }
+
+      if (!unique_crashes) write_crash_readme();
+
+      // Temporary computation for debugging.
+      compute_proximity_score(&prox_score, dfg_bits, 0);
+
+#ifndef SIMPLE_FILES
+
+      fn = alloc_printf("%s/crashes/id:%06llu,%llu,sig:%02u,%s", out_dir,
+                        total_crashes, prox_score.original, kill_signal,
+                        describe_op(0));
+
+#else
+
+      fn = alloc_printf("%s/crashes/id_%06llu_%02u", out_dir, total_crashes,
+                        kill_signal);
+
+#endif /* ^!SIMPLE_FILES */
+
+      if (has_new_bits(virgin_crash)) {
+        unique_crashes++;
+
+        last_crash_time = get_cur_time();
+        last_crash_execs = total_execs;
+      }
+
+      break;
+    case FAULT_NONE:
+      if (!is_covered_target) return keeping;
+      // save_to_file = get_valuation(0, argv, mem, len, dfg_checksum, new_seed, &val_hash);
+      save_valuation(0, save_to_file, dfg_checksum, val_hash, new_seed, valuation);
+      total_normals++;
+
+#ifndef SIMPLE_FILES
+
+      fn = alloc_printf("%s/normals/id:%06llu,%llu,sig:%02u,%s", out_dir,
+                        total_normals, prox_score.original, kill_signal,
+                        describe_op(0));
+
+#else
+
+      fn = alloc_printf("%s/normals/id_%06llu_%02u", out_dir, total_normals,
+                        kill_signal);
+
+#endif /* ^!SIMPLE_FILES */
+      break;
+
+    case FAULT_ERROR: FATAL("Unable to execute target application");
+
+    default: return keeping;
+
+  }
+
+  /* If we're here, we apparently want to save the crash or hang
+     test case, too. */
+  if (has_valid_unique_path || save_to_file) {
+    EVLOG(EV_MOO_SAVE, queue_cur ? queue_cur->entry_id : -1, hashmap_size(dfg_hashmap), fault, has_valid_unique_path, save_to_file, fn, stage_short, get_cur_time() - start_time);
+    fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) PFATAL("Unable to create '%s'", fn);
+    ck_write(fd, mem, len, fn);
+    close(fd);
+  }
+
+  ck_free(fn);
+
+  return keeping;
+
+}
+
+
+/* The same, but for timeouts. The idea is that when resuming sessions without
+   -t given, we don't want to keep auto-scaling the timeout over and over
+   again to prevent it from growing due to random flukes. */
+
+static void find_timeout(void) {
+
+  static u8 tmp[4096]; /* Ought to be enough for anybody. */
+
+  u8  *fn, *off;
+  s32 fd, i;
+  u32 ret;
+
+  if (!resuming_fuzz) return;
+
+  if (in_place_resume) fn = alloc_printf("%s/fuzzer_stats", out_dir);
+  else fn = alloc_printf("%s/../fuzzer_stats", in_dir);
+
+  fd = open(fn, O_RDONLY);
+  ck_free(fn);
+
+  if (fd < 0) return;
+
+  i = read(fd, tmp, sizeof(tmp) - 1); (void)i; /* Ignore errors */
+  close(fd);
+
+  off = strstr(tmp, "exec_timeout      : ");
+  if (!off) return;
+
+  ret = atoi(off + 20);
+  if (ret <= 4) return;
+
+  exec_tmout = ret;
+  timeout_given = 3;
+
+}
+
+
+/* Write the scheduler's current state to out_dir/scheduler_dump (on
+   SIGUSR2). The file is rewritten on every request. */
+
+static void dump_scheduler_state(void) {
+
+  static const char* mode_names[] = { "horizontal", "vertical", "explore" };
+
+  u8* fn = alloc_printf("%s/scheduler_dump", out_dir);
+  struct queue_entry* q = queue;
+  s32 fd;
+  FILE* f;
+
+  /* A diagnostic; not worth stopping the fuzzer over. */
+
+  fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+  if (fd < 0) {
+    WARNF("Unable to create '%s': %s", fn, strerror(errno));
+    ck_free(fn);
+    return;
+  }
+
+  ck_free(fn);
+
+  f = fdopen(fd, "w");
+
+  if (!f) {
+    WARNF("fdopen() failed: %s", strerror(errno));
+    close(fd);
+    return;
+  }
+
+  fprintf(f, "# scheduler state at %llu ms\n\n"
+             "paths_total       : %u\n"
+             "cur_entry         : %d\n"
+             "moo_scheduler     : %u\n"
+             "moo_cycle         : %u\n"
+             "prox_orig         : min %llu max %llu avg %llu total %llu\n"
+             "prox_adj          : min %0.04f max %0.04f avg %0.04f total %0.04f\n"
+             "factor            : calls %llu last_prox %0.04f last %0.04f\n",
+             get_cur_time() - start_time, queued_paths,
+             queue_cur ? (s32)queue_cur->entry_id : -1, use_moo_scheduler,
+             moo_cycle, min_prox_score.original, max_prox_score.original,
+             avg_prox_score.original, total_prox_score.original,
+             min_prox_score.adjusted, max_prox_score.adjusted,
+             avg_prox_score.adjusted, total_prox_score.adjusted,
+             factor_calls, last_factor_prox, last_factor);
+
+  if (pareto_scheduler)
+    fprintf(f, "moo               : frontier %u dominated %u new %u recycled %u\n"
+               "explore           : frontier %u dominated %u new %u recycled %u\n",
+               vector_size(pareto_scheduler->moo_pareto_frontier),
+               vector_size(pareto_scheduler->moo_dominated),
+               vector_size(pareto_scheduler->moo_newly_added),
+               vector_size(pareto_scheduler->moo_recycled),
+               vector_size(pareto_scheduler->explore_pareto_frontier),
+               vector_size(pareto_scheduler->explore_dominated),
+               vector_size((struct vector*)pareto_scheduler->explore_newly_added),
+               vector_size(pareto_scheduler->explore_recycled));
+
+  if (vertical_manager)
+    fprintf(f, "vertical          : paths %u use_vertical %u dynamic %u\n",
+               hashmap_size(vertical_manager->map),
+               vertical_manager->use_vertical, vertical_manager->dynamic_mode);
+
+  if (stride_scheduler) {
+
+    u32 i;
+
+    fprintf(f, "stride            : current %s previous %s consecutive %u\n",
+               mode_names[stride_scheduler->current],
+               mode_names[stride_scheduler->previous],
+               stride_scheduler->count_consecutive);
+
+    for (i = 0; i < MIN(stride_scheduler->stride_size, 3); i++)
+      fprintf(f, "stride %-11s: value %u count %u found %u\n",
+                 mode_names[i],
+                 stride_scheduler->stride_values[i],
+                 stride_scheduler->stride_count[i],
+                 stride_scheduler->found_count[i]);
+
+  }
+
+  fprintf(f, "\n# id,depth,len,exec_us,bitmap_size,favored,was_fuzzed,"
+             "handicap,selected,rank_moo,prox_orig,prox_adj,covered,"
+             "perf_factor,dfg_cksum\n");
+
+  while (q) {
+
+    if (!q->removed)
+      fprintf(f, "%u,%llu,%u,%llu,%u,%u,%u,%llu,%u,%d,%llu,%0.04f,%u,%0.04f,"
+                 "%08x\n", q->entry_id, q->depth, q->len, q->exec_us,
+                 q->bitmap_size, q->favored, q->was_fuzzed, q->handicap,
+                 q->selection_count, q->rank_moo, q->prox_score.original,
+                 q->prox_score.adjusted, q->prox_score.covered,
+                 q->perf_factor, q->dfg_cksum);
+
+    q = q->next;
+
+  }
+
+  fclose(f);
+
+}
+
+
+/* Update stats file for unattended monitoring. */
+
+static void write_stats_file(double bitmap_cvg, double stability, double eps) {
+
+  static double last_bcvg, last_stab, last_eps;
+  static struct rusage usage;
+
+  u8* fn = alloc_printf("%s/fuzzer_stats", out_dir);
+  s32 fd;
+  FILE* f;
+
+  fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+  if (fd < 0) PFATAL("Unable to create '%s'", fn);
+
+  ck_free(fn);
+
+  f = fdopen(fd, "w");
+
+  if (!f) PFATAL("fdopen() failed");
+
+  /* Keep last values in case we're called from another context
+     where exec/sec stats and such are not readily available. */
+
+  if (!bitmap_cvg && !stability && !eps) {
+    bitmap_cvg = last_bcvg;
+    stability  = last_stab;
+    eps        = last_eps;
+  } else {
+    last_bcvg = bitmap_cvg;
+    last_stab = stability;
+    last_eps  = eps;
+  }
+
+  fprintf(f, "start_time        : %llu\n"
+             "last_update       : %llu\n"
+             "fuzzer_pid        : %u\n"
+             "cycles_done       : %llu\n"
+             "execs_done        : %llu\n"
+             "execs_per_sec     : %0.02f\n"
+             "paths_total       : %u\n"
+             "paths_favored     : %u\n"
+             "paths_found       : %u\n"
+             "paths_imported    : %u\n"
+             "max_depth         : %u\n"
+             "cur_path          : %u\n" /* Must match find_start_position() */
+             "pending_favs      : %u\n"
+             "pending_total     : %u\n"
+             "variable_paths    : %u\n"
+             "stability         : %0.02f%%\n"
+             "bitmap_cvg        : %0.02f%%\n"
+             "unique_crashes    : %llu\n"
+             "unique_hangs      : %llu\n"
+             "last_path         : %llu\n"
+             "last_crash        : %llu\n"
+             "last_hang         : %llu\n"
+             "execs_since_crash : %llu\n"
+             "exec_timeout      : %u\n" /* Must match find_timeout() */
+             "afl_banner        : %s\n"
+             "afl_version       : " VERSION "\n"
+             "target_mode       : %s%s%s%s%s%s%s\n"
+             "command_line      : %s\n"
+             "slowest_exec_ms   : %llu\n",
+             start_time / 1000, get_cur_time() / 1000, getpid(),
+             queue_cycle ? (queue_cycle - 1) : 0, total_execs, eps,
+             queued_paths, queued_favored, queued_discovered, queued_imported,
+             max_depth, current_entry, pending_favored, pending_not_fuzzed,
+             queued_variable, stability, bitmap_cvg, unique_crashes,
+             unique_hangs, last_path_time / 1000, last_crash_time / 1000,
+             last_hang_time / 1000, total_execs - last_crash_execs,
+             exec_tmout, use_banner,
+             qemu_mode ? "qemu " : "", dumb_mode ? " dumb " : "",
+             no_forkserver ? "no_forksrv " : "", crash_mode ? "crash " : "",
+             persistent_mode ? "persistent " : "", deferred_mode ? "deferred " : "",
+             (qemu_mode || dumb_mode || no_forkserver || crash_mode ||
+              persistent_mode || deferred_mode) ? "" : "default",
+             orig_cmdline, slowest_exec_ms);
+             /* ignore errors */
+
+  fprintf(f, "queue_mem_kb      : %llu\n"
+             "vlog_stalls       : %llu\n", queue_arena.reserved >> 10,
+             vlog_stalls);
+
+  if (sync_id)
+    fprintf(f, "sync_execs_saved  : %llu\n", sync_execs_saved);
+
+  if (partition_on)
+    fprintf(f, "partition_members : %u\n", partition_member_cnt);
+
+  if (map_size != MAP_SIZE)
+    fprintf(f, "map_size          : %u\n", map_size);
+
+  if (dafl_target_cnt > 1)
+    fprintf(f, "targets           : %u (focus %u)\n", dafl_target_cnt,
+            dafl_target_cur);
+
+  if (syncd_addr)
+    fprintf(f, "syncd_pushed      : %llu\n"
+               "syncd_pulled      : %llu\n", syncd_pushed, syncd_pulled);
+
+  if (dfg_shm)
+    fprintf(f, "shared_val_skips  : %u\n", dfg_shm_val_skips);
+
+  fprintf(f, "seed_cache_kb     : %llu\n"
+             "seed_cache_rate   : %0.02f%%\n", seed_cache_used >> 10,
+             seed_cache_hits + seed_cache_misses ?
+             (double)seed_cache_hits * 100 /
+             (seed_cache_hits + seed_cache_misses) : 0);
+
+  /* Get rss value from the children
+     We must have killed the forkserver process and called waitpid
+     before calling getrusage */
+  if (getrusage(RUSAGE_CHILDREN, &usage)) {
+      WARNF("getrusage failed");
+  } else if (usage.ru_maxrss == 0) {
+    fprintf(f, "peak_rss_mb       : not available while afl is running\n");
+  } else {
+#ifdef __APPLE__
+    fprintf(f, "peak_rss_mb       : %zu\n", usage.ru_maxrss >> 20);
+#else
+    fprintf(f, "peak_rss_mb       : %zu\n", usage.ru_maxrss >> 10);
+#endif /* ^__APPLE__ */
+  }
+
+  if (debug_stats) {
+
+    fprintf(f, "prox_adj_min      : %0.04f\n"
+               "prox_adj_max      : %0.04f\n"
+               "prox_adj_avg      : %0.04f\n"
+               "factor_calls      : %llu\n"
+               "factor_last_prox  : %0.04f\n"
+               "factor_last       : %0.04f\n",
+               min_prox_score.adjusted, max_prox_score.adjusted,
+               avg_prox_score.adjusted, factor_calls, last_factor_prox,
+               last_factor);
+
+  }
+
+  fclose(f);
+
+  /* Good moment to push buffered events to disk, too. */
+
+  evlog_flush();
+
+}
+
+
+/* Update the plot file if there is a reason to. */
+
+static void maybe_update_plot_file(double bitmap_cvg, double eps) {
+
+  static u32 prev_qp, prev_pf, prev_pnf, prev_ce, prev_md;
+  static u64 prev_qc, prev_uc, prev_uh;
+
+  if (prev_qp == queued_paths && prev_pf == pending_favored &&
+      prev_pnf == pending_not_fuzzed && prev_ce == current_entry &&
+      prev_qc == queue_cycle && prev_uc == unique_crashes &&
+      prev_uh == unique_hangs && prev_md == max_depth) return;
+
+  prev_qp  = queued_paths;
+  prev_pf  = pending_favored;
+  prev_pnf = pending_not_fuzzed;
+  prev_ce  = current_entry;
+  prev_qc  = queue_cycle;
+  prev_uc  = unique_crashes;
+  prev_uh  = unique_hangs;
+  prev_md  = max_depth;
+
+  /* Fields in the file:
+
+     unix_time, cycles_done, cur_path, paths_total, paths_not_fuzzed,
+     favored_not_fuzzed, unique_crashes, unique_hangs, max_depth,
+     execs_per_sec */
+
+  fprintf(plot_file,
+          "%llu, %llu, %u, %u, %u, %u, %0.02f%%, %llu, %llu, %u, %0.02f\n",
+          get_cur_time() / 1000, queue_cycle - 1, current_entry, queued_paths,
+          pending_not_fuzzed, pending_favored, bitmap_cvg, unique_crashes,
+          unique_hangs, max_depth, eps); /* ignore errors */
+
+  fflush(plot_file);
+
+}
+
+
+
+/* A helper function for maybe_delete_out_dir(), deleting all prefixed
+   files in a directory. */
+
+static u8 delete_files(u8* path, u8* prefix) {
+
+  DIR* d;
+  struct dirent* d_ent;
+
+  d = opendir(path);
+
+  if (!d) return 0;
+
+  while ((d_ent = readdir(d))) {
+
+    if (d_ent->d_name[0] != '.' && (!prefix ||
+        !strncmp(d_ent->d_name, prefix, strlen(prefix)))) {
+
+      u8* fname = alloc_printf("%s/%s", path, d_ent->d_name);
+      if (unlink(fname)) PFATAL("Unable to delete '%s'", fname);
+      ck_free(fname);
+
+    }
+
+  }
+
+  closedir(d);
+
+  return !!rmdir(path);
+
+}
+
+
+/* Get the number of runnable processes, with some simple smoothing. */
+
+static double get_runnable_processes(void) {
+
+  static double res;
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined (__OpenBSD__)
+
+  /* I don't see any portable sysctl or so that would quickly give us the
+     number of runnable processes; the 1-minute load average can be a
+     semi-decent approximation, though. */
+
+  if (getloadavg(&res, 1) != 1) return 0;
+
+#else
+
+  /* On Linux, /proc/stat is probably the best way; load averages are
+     computed in funny ways and sometimes don't reflect extremely short-lived
+     processes well. */
+
+  FILE* f = fopen("/proc/stat", "r");
+  u8 tmp[1024];
+  u32 val = 0;
+
+  if (!f) return 0;
+
+  while (fgets(tmp, sizeof(tmp), f)) {
+
+    if (!strncmp(tmp, "procs_running ", 14) ||
+        !strncmp(tmp, "procs_blocked ", 14)) val += atoi(tmp + 14);
+
+  }
+
+  fclose(f);
+
+  if (!res) {
+
+    res = val;
+
+  } else {
+
+    res = res * (1.0 - 1.0 / AVG_SMOOTHING) +
+          ((double)val) * (1.0 / AVG_SMOOTHING);
+
+  }
+
+#endif /* ^(__APPLE__ || __FreeBSD__ || __OpenBSD__) */
+
+  return res;
+
+}
+
+
+/* Delete the temporary directory used for in-place session resume. */
+
+static void nuke_resume_dir(void) {
+
+  u8* fn;
+
+  fn = alloc_printf("%s/_resume/.state/deterministic_done", out_dir);
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/_resume/.state/auto_extras", out_dir);
+  if (delete_files(fn, "auto_")) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/_resume/.state/redundant_edges", out_dir);
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/_resume/.state/variable_behavior", out_dir);
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/_resume/.state/calibration", out_dir);
+  if (delete_files(fn, NULL)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/_resume/.state/pack", out_dir);
+  if (delete_files(fn, NULL)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/_resume/.state", out_dir);
+  if (rmdir(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/_resume", out_dir);
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  return;
+
+dir_cleanup_failed:
+
+  FATAL("_resume directory cleanup failed");
+
+}
+
+
+/* Delete fuzzer output directory if we recognize it as ours, if the fuzzer
+   is not currently running, and if the last run time isn't too great. */
+
+static void maybe_delete_out_dir(void) {
+
+  FILE* f;
+  u8 *fn = alloc_printf("%s/fuzzer_stats", out_dir);
+
+  /* See if the output directory is locked. If yes, bail out. If not,
+     create a lock that will persist for the lifetime of the process
+     (this requires leaving the descriptor open).*/
+
+  out_dir_fd = open(out_dir, O_RDONLY);
+  if (out_dir_fd < 0) PFATAL("Unable to open '%s'", out_dir);
+
+#ifndef __sun
+
+  if (flock(out_dir_fd, LOCK_EX | LOCK_NB) && errno == EWOULDBLOCK) {
+
+    SAYF("\n" cLRD "[-] " cRST
+         "Looks like the job output directory is being actively used by another\n"
+         "    instance of afl-fuzz. You will need to choose a different %s\n"
+         "    or stop the other process first.\n",
+         sync_id ? "fuzzer ID" : "output location");
+
+    FATAL("Directory '%s' is in use", out_dir);
+
+  }
+
+#endif /* !__sun */
+
+  f = fopen(fn, "r");
+
+  if (f) {
+
+    u64 start_time, last_update;
+
+    if (fscanf(f, "start_time     : %llu\n"
+                  "last_update    : %llu\n", &start_time, &last_update) != 2)
+      FATAL("Malformed data in '%s'", fn);
+
+    fclose(f);
+
+    /* Let's see how much work is at stake. */
+
+    if (!in_place_resume && last_update - start_time > OUTPUT_GRACE * 60) {
+
+      SAYF("\n" cLRD "[-] " cRST
+           "The job output directory already exists and contains the results of more\n"
+           "    than %u minutes worth of fuzzing. To avoid data loss, afl-fuzz will *NOT*\n"
+           "    automatically delete this data for you.\n\n"
+
+           "    If you wish to start a new session, remove or rename the directory manually,\n"
+           "    or specify a different output location for this job. To resume the old\n"
+           "    session, put '-' as the input directory in the command line ('-i -') and\n"
+           "    try again.\n", OUTPUT_GRACE);
+
+       FATAL("At-risk data found in '%s'", out_dir);
+
+    }
+
+  }
+
+  ck_free(fn);
+
+  /* The idea for in-place resume is pretty simple: we temporarily move the old
+     queue/ to a new location that gets deleted once import to the new queue/
+     is finished. If _resume/ already exists, the current queue/ may be
+     incomplete due to an earlier abort, so we want to use the old _resume/
+     dir instead, and we let rename() fail silently. */
+
+  if (in_place_resume) {
+
+    u8* orig_q = alloc_printf("%s/queue", out_dir);
+
+    in_dir = alloc_printf("%s/_resume", out_dir);
+
+    rename(orig_q, in_dir); /* Ignore errors */
+
+    load_checkpoint();
+
+    OKF("Output directory exists, will attempt session resume.");
+
+    ck_free(orig_q);
+
+  } else {
+
+    OKF("Output directory exists but deemed OK to reuse.");
+
+  }
+
+  ACTF("Deleting old session data...");
+
+  /* Okay, let's get the ball rolling! First, we need to get rid of the entries
+     in <out_dir>/.synced/.../id:*, if any are present. */
+
+  if (!in_place_resume) {
+
+    fn = alloc_printf("%s/.synced", out_dir);
+    if (delete_files(fn, NULL)) goto dir_cleanup_failed;
+    ck_free(fn);
+
+  }
+
+  /* Next, we need to clean up <out_dir>/queue/.state/ subdirectories: */
+
+  fn = alloc_printf("%s/queue/.state/deterministic_done", out_dir);
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/queue/.state/auto_extras", out_dir);
+  if (delete_files(fn, "auto_")) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/queue/.state/redundant_edges", out_dir);
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/queue/.state/variable_behavior", out_dir);
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/queue/.state/calibration", out_dir);
+  if (delete_files(fn, NULL)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/queue/.state/pack", out_dir);
+  if (delete_files(fn, NULL)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  /* Then, get rid of the .state subdirectory itself (should be empty by now)
+     and everything matching <out_dir>/queue/id:*. */
+
+  fn = alloc_printf("%s/queue/.state", out_dir);
+  if (rmdir(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/queue", out_dir);
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  /* All right, let's do <out_dir>/crashes/id:* and <out_dir>/hangs/id:*. */
+
+  if (!in_place_resume) {
+
+    fn = alloc_printf("%s/crashes/README.txt", out_dir);
+    unlink(fn); /* Ignore errors */
+    ck_free(fn);
+
+  }
+
+  fn = alloc_printf("%s/crashes", out_dir);
+
+  /* Make backup of the crashes directory if it's not empty and if we're
+     doing in-place resume. */
+
+  if (in_place_resume && rmdir(fn)) {
+
+    time_t cur_t = time(0);
+    struct tm* t = localtime(&cur_t);
+
+#ifndef SIMPLE_FILES
+
+    u8* nfn = alloc_printf("%s.%04u-%02u-%02u-%02u:%02u:%02u", fn,
+                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+                           t->tm_hour, t->tm_min, t->tm_sec);
+
+#else
+
+    u8* nfn = alloc_printf("%s_%04u%02u%02u%02u%02u%02u", fn,
+                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+                           t->tm_hour, t->tm_min, t->tm_sec);
+
+#endif /* ^!SIMPLE_FILES */
+
+    rename(fn, nfn); /* Ignore errors. */
+    ck_free(nfn);
+
+  }
+
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/hangs", out_dir);
+
+  /* Backup hangs, too. */
+
+  if (in_place_resume && rmdir(fn)) {
+
+    time_t cur_t = time(0);
+    struct tm* t = localtime(&cur_t);
+
+#ifndef SIMPLE_FILES
+
+    u8* nfn = alloc_printf("%s.%04u-%02u-%02u-%02u:%02u:%02u", fn,
+                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+                           t->tm_hour, t->tm_min, t->tm_sec);
+
+#else
+
+    u8* nfn = alloc_printf("%s_%04u%02u%02u%02u%02u%02u", fn,
+                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+                           t->tm_hour, t->tm_min, t->tm_sec);
+
+#endif /* ^!SIMPLE_FILES */
+
+    rename(fn, nfn); /* Ignore errors. */
+    ck_free(nfn);
+
+  }
+
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/normals", out_dir);
+  if (in_place_resume && rmdir(fn)) {
+
+    time_t cur_t = time(0);
+    struct tm* t = localtime(&cur_t);
+#ifndef SIMPLE_FILES
+    u8* nfn = alloc_printf("%s.%04u-%02u-%02u-%02u:%02u:%02u", fn,
+                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+                           t->tm_hour, t->tm_min, t->tm_sec);
+#else
+    u8* nfn = alloc_printf("%s_%04u%02u%02u%02u%02u%02u", fn,
+                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+                           t->tm_hour, t->tm_min, t->tm_sec);
+#endif /* ^!SIMPLE_FILES */
+    rename(fn, nfn); /* Ignore errors. */
+    ck_free(nfn);
+  }
+  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  /* The saved valuations go together with the checkpoint's valuation
+     hashes, so keep them if we have one. */
+
+  if (!ckpt_buf) {
+
+    fn = alloc_printf("%s/memory/neg", out_dir);
+    if (delete_files(fn, NULL)) goto dir_cleanup_failed;
+    ck_free(fn);
+
+    fn = alloc_printf("%s/memory/pos", out_dir);
+    if (delete_files(fn, NULL)) goto dir_cleanup_failed;
+    ck_free(fn);
+
+    fn = alloc_printf("%s/memory", out_dir);
+    if (delete_files(fn, NULL)) goto dir_cleanup_failed;
+    ck_free(fn);
+
+  }
+
+  /* And now, for some finishing touches. */
+
+  fn = alloc_printf("%s/.cur_input", out_dir);
+  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/fuzz_bitmap", out_dir);
+  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  if (!in_place_resume) {
+    fn  = alloc_printf("%s/fuzzer_stats", out_dir);
+    if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+    ck_free(fn);
+
+    fn  = alloc_printf("%s/scheduler.ckpt", out_dir);
+    if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+    ck_free(fn);
+  }
+
+  fn = alloc_printf("%s/scheduler.ckpt.tmp", out_dir);
+  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/plot_data", out_dir);
+  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/unique_dafl.log", out_dir);
+  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+  fn = alloc_printf("%s/unique_dafl.evlog", out_dir);
+  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/vertical.log", out_dir);
+  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/vertical.bin", out_dir);
+  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
   ck_free(fn);
 
-  fn = alloc_printf("%s/queue/.state/redundant_edges", out_dir);
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+  OKF("Output dir cleanup successful.");
+
+  /* Wow... is that all? If yes, celebrate! */
+
+  return;
+
+dir_cleanup_failed:
+
+  SAYF("\n" cLRD "[-] " cRST
+       "Whoops, the fuzzer tried to reuse your output directory, but bumped into\n"
+       "    some files that shouldn't be there or that couldn't be removed - so it\n"
+       "    decided to abort! This happened while processing this path:\n\n"
+
+       "    %s\n\n"
+       "    Please examine and manually delete the files, or specify a different\n"
+       "    output location for the tool.\n", fn);
+
+  FATAL("Output directory cleanup failed");
+
+}
+
+
+static void check_term_size(void);
+
+
+/* A spiffy retro stats screen! This is called every stats_update_freq
+   execve() calls, plus in several other circumstances. */
+
+static void show_stats(void) {
+
+  static u64 last_stats_ms, last_plot_ms, last_ms, last_execs;
+  static double avg_exec;
+  double t_byte_ratio, stab_ratio;
+
+  u64 cur_ms;
+  u32 t_bytes, t_bits;
+
+  u32 banner_len, banner_pad;
+  u8  tmp[256];
+
+  cur_ms = get_cur_time();
+
+  /* If not enough time has passed since last UI update, bail out. */
+
+  if (cur_ms - last_ms < 1000 / UI_TARGET_HZ) return;
+
+  /* Check if we're past the 10 minute mark. */
+
+  if (cur_ms - start_time > 10 * 60 * 1000) run_over10m = 1;
+
+  /* Calculate smoothed exec speed stats. */
+
+  if (!last_execs) {
+
+    avg_exec = ((double)total_execs) * 1000 / (cur_ms - start_time);
+
+  } else {
+
+    double cur_avg = ((double)(total_execs - last_execs)) * 1000 /
+                     (cur_ms - last_ms);
+
+    /* If there is a dramatic (5x+) jump in speed, reset the indicator
+       more quickly. */
+
+    if (cur_avg * 5 < avg_exec || cur_avg / 5 > avg_exec)
+      avg_exec = cur_avg;
+
+    avg_exec = avg_exec * (1.0 - 1.0 / AVG_SMOOTHING) +
+               cur_avg * (1.0 / AVG_SMOOTHING);
+
+  }
+
+  last_ms = cur_ms;
+  last_execs = total_execs;
+
+  /* Tell the callers when to contact us (as measured in execs). */
+
+  stats_update_freq = avg_exec / (UI_TARGET_HZ * 10);
+  if (!stats_update_freq) stats_update_freq = 1;
+
+  /* Do some bitmap stats. */
+
+  t_bytes = count_non_255_bytes(virgin_bits);
+  t_byte_ratio = ((double)t_bytes * 100) / map_size;
+
+  if (t_bytes)
+    stab_ratio = 100 - ((double)var_byte_count) * 100 / t_bytes;
+  else
+    stab_ratio = 100;
+
+  /* Roughly every minute, update fuzzer stats and save auto tokens, and
+     see who else is around to share DFG paths with. */
+
+  if (cur_ms - last_stats_ms > STATS_UPDATE_SEC * 1000) {
+
+    last_stats_ms = cur_ms;
+    if (partition_on) partition_refresh();
+    write_stats_file(t_byte_ratio, stab_ratio, avg_exec);
+    save_auto();
+    write_bitmap();
+
+  }
+
+  /* Every now and then, write plot data. */
+
+  if (cur_ms - last_plot_ms > PLOT_UPDATE_SEC * 1000) {
+
+    last_plot_ms = cur_ms;
+    maybe_update_plot_file(t_byte_ratio, avg_exec);
+
+  }
+
+  /* Honor AFL_EXIT_WHEN_DONE and AFL_BENCH_UNTIL_CRASH. */
+
+  if (!dumb_mode && cycles_wo_finds > 100 && !pending_not_fuzzed &&
+      getenv("AFL_EXIT_WHEN_DONE")) stop_soon = 2;
+
+  if (total_crashes && getenv("AFL_BENCH_UNTIL_CRASH")) stop_soon = 2;
+
+  /* If we're not on TTY, bail out. */
+
+  if (not_on_tty) return;
+
+  /* Compute some mildly useful bitmap stats. */
+
+  t_bits = (map_size << 3) - count_bits(virgin_bits);
+
+  /* Now, for the visuals... */
+
+  if (clear_screen) {
+
+    SAYF(TERM_CLEAR CURSOR_HIDE);
+    clear_screen = 0;
+
+    check_term_size();
+
+  }
+
+  SAYF(TERM_HOME);
+
+  if (term_too_small) {
+
+    SAYF(cBRI "Your terminal is too small to display the UI.\n"
+         "Please resize terminal window to at least 80x25.\n" cRST);
+
+    return;
+
+  }
+
+  /* Let's start by drawing a centered banner. */
+
+  banner_len = (crash_mode ? 24 : 22) + strlen(VERSION) + strlen(use_banner);
+  banner_pad = (80 - banner_len) / 2;
+  memset(tmp, ' ', banner_pad);
+
+  sprintf(tmp + banner_pad, "%s " cLCY VERSION cLGN
+          " (%s)",  crash_mode ? cPIN "peruvian were-rabbit" :
+          cYEL "american fuzzy lop", use_banner);
+
+  SAYF("\n%s\n\n", tmp);
+
+  /* "Handy" shortcuts for drawing boxes... */
+
+#define bSTG    bSTART cGRA
+#define bH2     bH bH
+#define bH5     bH2 bH2 bH
+#define bH10    bH5 bH5
+#define bH20    bH10 bH10
+#define bH30    bH20 bH10
+#define SP5     "     "
+#define SP10    SP5 SP5
+#define SP20    SP10 SP10
+
+  /* Lord, forgive me this. */
+
+  SAYF(SET_G1 bSTG bLT bH bSTOP cCYA " process timing " bSTG bH30 bH5 bH2 bHB
+       bH bSTOP cCYA " overall results " bSTG bH5 bRT "\n");
+
+  if (dumb_mode) {
+
+    strcpy(tmp, cRST);
+
+  } else {
+
+    u64 min_wo_finds = (cur_ms - last_path_time) / 1000 / 60;
+
+    /* First queue cycle: don't stop now! */
+    if (queue_cycle == 1 || min_wo_finds < 15) strcpy(tmp, cMGN); else
+
+    /* Subsequent cycles, but we're still making finds. */
+    if (cycles_wo_finds < 25 || min_wo_finds < 30) strcpy(tmp, cYEL); else
+
+    /* No finds for a long time and no test cases to try. */
+    if (cycles_wo_finds > 100 && !pending_not_fuzzed && min_wo_finds > 120)
+      strcpy(tmp, cLGN);
+
+    /* Default: cautiously OK to stop? */
+    else strcpy(tmp, cLBL);
+
+  }
+
+  SAYF(bV bSTOP "        run time : " cRST "%-34s " bSTG bV bSTOP
+       "  cycles done : %s%-5s  " bSTG bV "\n",
+       DTD(cur_ms, start_time), tmp, DI(queue_cycle - 1));
+
+  /* We want to warn people about not seeing new paths after a full cycle,
+     except when resuming fuzzing or running in non-instrumented mode. */
+
+  if (!dumb_mode && (last_path_time || resuming_fuzz || queue_cycle == 1 ||
+      in_bitmap || crash_mode)) {
+
+    SAYF(bV bSTOP "   last new path : " cRST "%-34s ",
+         DTD(cur_ms, last_path_time));
+
+  } else {
+
+    if (dumb_mode)
+
+      SAYF(bV bSTOP "   last new path : " cPIN "n/a" cRST
+           " (non-instrumented mode)        ");
+
+     else
+
+      SAYF(bV bSTOP "   last new path : " cRST "none yet " cLRD
+           "(odd, check syntax!)      ");
+
+  }
+
+  SAYF(bSTG bV bSTOP "  total paths : " cRST "%-5s  " bSTG bV "\n",
+       DI(queued_paths));
+
+  /* Highlight crashes in red if found, denote going over the KEEP_UNIQUE_CRASH
+     limit with a '+' appended to the count. */
+
+  sprintf(tmp, "%s%s", DI(unique_crashes),
+          (unique_crashes >= KEEP_UNIQUE_CRASH) ? "+" : "");
+
+  SAYF(bV bSTOP " last uniq crash : " cRST "%-34s " bSTG bV bSTOP
+       " uniq crashes : %s%-6s " bSTG bV "\n",
+       DTD(cur_ms, last_crash_time), unique_crashes ? cLRD : cRST,
+       tmp);
+
+  sprintf(tmp, "%s%s", DI(unique_hangs),
+         (unique_hangs >= KEEP_UNIQUE_HANG) ? "+" : "");
+
+  SAYF(bV bSTOP "  last uniq hang : " cRST "%-34s " bSTG bV bSTOP
+       "   uniq hangs : " cRST "%-6s " bSTG bV "\n",
+       DTD(cur_ms, last_hang_time), tmp);
+
+  SAYF(bVR bH bSTOP cCYA " cycle progress " bSTG bH20 bHB bH bSTOP cCYA
+       " map coverage " bSTG bH bHT bH20 bH2 bH bVL "\n");
+
+  /* This gets funny because we want to print several variable-length variables
+     together, but then cram them into a fixed-width field - so we need to
+     put them in a temporary buffer first. */
+
+  sprintf(tmp, "%s%s (%0.02f%%)", DI(current_entry),
+          queue_cur->favored ? "" : "*",
+          ((double)current_entry * 100) / queued_paths);
+
+  SAYF(bV bSTOP "  now processing : " cRST "%-17s " bSTG bV bSTOP, tmp);
+
+  sprintf(tmp, "%0.02f%% / %0.02f%%", ((double)queue_cur->bitmap_size) *
+          100 / map_size, t_byte_ratio);
+
+  SAYF("    map density : %s%-21s " bSTG bV "\n", t_byte_ratio > 70 ? cLRD :
+       ((t_bytes < 200 && !dumb_mode) ? cPIN : cRST), tmp);
+
+  sprintf(tmp, "%s (%0.02f%%)", DI(cur_skipped_paths),
+          ((double)cur_skipped_paths * 100) / queued_paths);
+
+  SAYF(bV bSTOP " paths timed out : " cRST "%-17s " bSTG bV, tmp);
+
+  sprintf(tmp, "%0.02f bits/tuple",
+          t_bytes ? (((double)t_bits) / t_bytes) : 0);
+
+  SAYF(bSTOP " count coverage : " cRST "%-21s " bSTG bV "\n", tmp);
+
+  SAYF(bVR bH bSTOP cCYA " stage progress " bSTG bH20 bX bH bSTOP cCYA
+       " findings in depth " bSTG bH20 bVL "\n");
+
+  sprintf(tmp, "%s (%0.02f%%)", DI(queued_favored),
+          ((double)queued_favored) * 100 / queued_paths);
+
+  /* Yeah... it's still going on... halp? */
+
+  SAYF(bV bSTOP "  now trying : " cRST "%-21s " bSTG bV bSTOP
+       " favored paths : " cRST "%-22s " bSTG bV "\n", stage_name, tmp);
+
+  if (!stage_max) {
+
+    sprintf(tmp, "%s/-", DI(stage_cur));
+
+  } else {
+
+    sprintf(tmp, "%s/%s (%0.02f%%)", DI(stage_cur), DI(stage_max),
+            ((double)stage_cur) * 100 / stage_max);
+
+  }
+
+  SAYF(bV bSTOP " stage execs : " cRST "%-21s " bSTG bV bSTOP, tmp);
+
+  sprintf(tmp, "%s (%0.02f%%)", DI(queued_with_cov),
+          ((double)queued_with_cov) * 100 / queued_paths);
+
+  SAYF("  new edges on : " cRST "%-22s " bSTG bV "\n", tmp);
+
+  sprintf(tmp, "%s (%s%s unique)", DI(total_crashes), DI(unique_crashes),
+          (unique_crashes >= KEEP_UNIQUE_CRASH) ? "+" : "");
+
+  if (crash_mode) {
+
+    SAYF(bV bSTOP " total execs : " cRST "%-21s " bSTG bV bSTOP
+         "   new crashes : %s%-22s " bSTG bV "\n", DI(total_execs),
+         unique_crashes ? cLRD : cRST, tmp);
+
+  } else {
+
+    SAYF(bV bSTOP " total execs : " cRST "%-21s " bSTG bV bSTOP
+         " total crashes : %s%-22s " bSTG bV "\n", DI(total_execs),
+         unique_crashes ? cLRD : cRST, tmp);
+
+  }
+
+  /* Show a warning about slow execution. */
+
+  if (avg_exec < 100) {
+
+    sprintf(tmp, "%s/sec (%s)", DF(avg_exec), avg_exec < 20 ?
+            "zzzz..." : "slow!");
+
+    SAYF(bV bSTOP "  exec speed : " cLRD "%-21s ", tmp);
+
+  } else {
+
+    sprintf(tmp, "%s/sec", DF(avg_exec));
+    SAYF(bV bSTOP "  exec speed : " cRST "%-21s ", tmp);
+
+  }
+
+  sprintf(tmp, "%s (%s%s unique)", DI(total_tmouts), DI(unique_tmouts),
+          (unique_hangs >= KEEP_UNIQUE_HANG) ? "+" : "");
+
+  SAYF (bSTG bV bSTOP "  total tmouts : " cRST "%-22s " bSTG bV "\n", tmp);
+
+  /* Aaaalmost there... hold on! */
+
+  SAYF(bVR bH cCYA bSTOP " fuzzing strategy yields " bSTG bH10 bH bHT bH10
+       bH5 bHB bH bSTOP cCYA " path geometry " bSTG bH5 bH2 bH bVL "\n");
+
+  if (skip_deterministic) {
+
+    strcpy(tmp, "n/a, n/a, n/a");
+
+  } else {
+
+    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+            DI(stage_finds[STAGE_FLIP1]), DI(stage_cycles[STAGE_FLIP1]),
+            DI(stage_finds[STAGE_FLIP2]), DI(stage_cycles[STAGE_FLIP2]),
+            DI(stage_finds[STAGE_FLIP4]), DI(stage_cycles[STAGE_FLIP4]));
+
+  }
+
+  SAYF(bV bSTOP "   bit flips : " cRST "%-37s " bSTG bV bSTOP "    levels : "
+       cRST "%-10s " bSTG bV "\n", tmp, DI(max_depth));
+
+  if (!skip_deterministic)
+    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+            DI(stage_finds[STAGE_FLIP8]), DI(stage_cycles[STAGE_FLIP8]),
+            DI(stage_finds[STAGE_FLIP16]), DI(stage_cycles[STAGE_FLIP16]),
+            DI(stage_finds[STAGE_FLIP32]), DI(stage_cycles[STAGE_FLIP32]));
+
+  SAYF(bV bSTOP "  byte flips : " cRST "%-37s " bSTG bV bSTOP "   pending : "
+       cRST "%-10s " bSTG bV "\n", tmp, DI(pending_not_fuzzed));
+
+  if (!skip_deterministic)
+    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+            DI(stage_finds[STAGE_ARITH8]), DI(stage_cycles[STAGE_ARITH8]),
+            DI(stage_finds[STAGE_ARITH16]), DI(stage_cycles[STAGE_ARITH16]),
+            DI(stage_finds[STAGE_ARITH32]), DI(stage_cycles[STAGE_ARITH32]));
+
+  SAYF(bV bSTOP " arithmetics : " cRST "%-37s " bSTG bV bSTOP "  pend fav : "
+       cRST "%-10s " bSTG bV "\n", tmp, DI(pending_favored));
+
+  if (!skip_deterministic)
+    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+            DI(stage_finds[STAGE_INTEREST8]), DI(stage_cycles[STAGE_INTEREST8]),
+            DI(stage_finds[STAGE_INTEREST16]), DI(stage_cycles[STAGE_INTEREST16]),
+            DI(stage_finds[STAGE_INTEREST32]), DI(stage_cycles[STAGE_INTEREST32]));
+
+  SAYF(bV bSTOP "  known ints : " cRST "%-37s " bSTG bV bSTOP " own finds : "
+       cRST "%-10s " bSTG bV "\n", tmp, DI(queued_discovered));
+
+  if (!skip_deterministic)
+    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+            DI(stage_finds[STAGE_EXTRAS_UO]), DI(stage_cycles[STAGE_EXTRAS_UO]),
+            DI(stage_finds[STAGE_EXTRAS_UI]), DI(stage_cycles[STAGE_EXTRAS_UI]),
+            DI(stage_finds[STAGE_EXTRAS_AO]), DI(stage_cycles[STAGE_EXTRAS_AO]));
+
+  SAYF(bV bSTOP "  dictionary : " cRST "%-37s " bSTG bV bSTOP
+       "  imported : " cRST "%-10s " bSTG bV "\n", tmp,
+       sync_id ? DI(queued_imported) : (u8*)"n/a");
+
+  sprintf(tmp, "%s/%s, %s/%s",
+          DI(stage_finds[STAGE_HAVOC]), DI(stage_cycles[STAGE_HAVOC]),
+          DI(stage_finds[STAGE_SPLICE]), DI(stage_cycles[STAGE_SPLICE]));
+
+  SAYF(bV bSTOP "       havoc : " cRST "%-37s " bSTG bV bSTOP, tmp);
+
+  if (t_bytes) sprintf(tmp, "%0.02f%%", stab_ratio);
+    else strcpy(tmp, "n/a");
+
+  SAYF(" stability : %s%-10s " bSTG bV "\n", (stab_ratio < 85 && var_byte_count > 40)
+       ? cLRD : ((queued_variable && (!persistent_mode || var_byte_count > 20))
+       ? cMGN : cRST), tmp);
+
+  if (!bytes_trim_out) {
+
+    sprintf(tmp, "n/a, ");
+
+  } else {
+
+    sprintf(tmp, "%0.02f%%/%s, ",
+            ((double)(bytes_trim_in - bytes_trim_out)) * 100 / bytes_trim_in,
+            DI(trim_execs));
+
+  }
+
+  if (!blocks_eff_total) {
+
+    u8 tmp2[128];
+
+    sprintf(tmp2, "n/a");
+    strcat(tmp, tmp2);
+
+  } else {
+
+    u8 tmp2[128];
+
+    sprintf(tmp2, "%0.02f%%",
+            ((double)(blocks_eff_total - blocks_eff_select)) * 100 /
+            blocks_eff_total);
+
+    strcat(tmp, tmp2);
+
+  }
+
+  SAYF(bV bSTOP "        trim : " cRST "%-37s " bSTG bVR bH20 bH2 bH2 bRB "\n"
+       bLB bH30 bH20 bH2 bH bRB bSTOP cRST RESET_G1, tmp);
+
+  /* Provide some CPU utilization stats. */
+
+  if (cpu_core_count) {
+
+    double cur_runnable = get_runnable_processes();
+    u32 cur_utilization = cur_runnable * 100 / cpu_core_count;
+
+    u8* cpu_color = cCYA;
+
+    /* If we could still run one or more processes, use green. */
+
+    if (cpu_core_count > 1 && cur_runnable + 1 <= cpu_core_count)
+      cpu_color = cLGN;
+
+    /* If we're clearly oversubscribed, use red. */
+
+    if (!no_cpu_meter_red && cur_utilization >= 150) cpu_color = cLRD;
+
+#ifdef HAVE_AFFINITY
+
+    if (cpu_aff >= 0) {
+
+      SAYF(SP10 cGRA "[cpu%03u:%s%3u%%" cGRA "]\r" cRST,
+           MIN(cpu_aff, 999), cpu_color,
+           MIN(cur_utilization, 999));
+
+    } else {
+
+      SAYF(SP10 cGRA "   [cpu:%s%3u%%" cGRA "]\r" cRST,
+           cpu_color, MIN(cur_utilization, 999));
+
+   }
+
+#else
+
+    SAYF(SP10 cGRA "   [cpu:%s%3u%%" cGRA "]\r" cRST,
+         cpu_color, MIN(cur_utilization, 999));
+
+#endif /* ^HAVE_AFFINITY */
+
+  } else SAYF("\r");
+
+  /* Hallelujah! */
+
+  fflush(0);
+
+}
+
+
+/* Display quick statistics at the end of processing the input directory,
+   plus a bunch of warnings. Some calibration stuff also ended up here,
+   along with several hardcoded constants. Maybe clean up eventually. */
+
+static void show_init_stats(void) {
+
+  struct queue_entry* q = queue;
+  u32 min_bits = 0, max_bits = 0;
+  u64 min_us = 0, max_us = 0;
+  u64 avg_us = 0;
+  u32 max_len = 0;
+
+  if (total_cal_cycles) avg_us = total_cal_us / total_cal_cycles;
+
+  while (q) {
+
+    if (!min_us || q->exec_us < min_us) min_us = q->exec_us;
+    if (q->exec_us > max_us) max_us = q->exec_us;
+
+    if (!min_bits || q->bitmap_size < min_bits) min_bits = q->bitmap_size;
+    if (q->bitmap_size > max_bits) max_bits = q->bitmap_size;
+
+    if (q->len > max_len) max_len = q->len;
+
+    q = q->next;
+
+  }
+
+  SAYF("\n");
+
+  if (avg_us > (qemu_mode ? 50000 : 10000))
+    WARNF(cLRD "The target binary is pretty slow! See %s/perf_tips.txt.",
+          doc_path);
+
+  /* Let's keep things moving with slow binaries. */
+
+  if (avg_us > 50000) havoc_div = 10;     /* 0-19 execs/sec   */
+  else if (avg_us > 20000) havoc_div = 5; /* 20-49 execs/sec  */
+  else if (avg_us > 10000) havoc_div = 2; /* 50-100 execs/sec */
+
+  if (!resuming_fuzz) {
+
+    if (max_len > 50 * 1024)
+      WARNF(cLRD "Some test cases are huge (%s) - see %s/perf_tips.txt!",
+            DMS(max_len), doc_path);
+    else if (max_len > 10 * 1024)
+      WARNF("Some test cases are big (%s) - see %s/perf_tips.txt.",
+            DMS(max_len), doc_path);
+
+    if (useless_at_start && !in_bitmap)
+      WARNF(cLRD "Some test cases look useless. Consider using a smaller set.");
+
+    if (queued_paths > 100)
+      WARNF(cLRD "You probably have far too many input files! Consider trimming down.");
+    else if (queued_paths > 20)
+      WARNF("You have lots of input files; try starting small.");
+
+  }
+
+  OKF("Here are some useful stats:\n\n"
+
+      cGRA "    Test case count : " cRST "%u favored, %u variable, %u total\n"
+      cGRA "       Bitmap range : " cRST "%u to %u bits (average: %0.02f bits)\n"
+      cGRA "        Exec timing : " cRST "%s to %s us (average: %s us)\n",
+      queued_favored, queued_variable, queued_paths, min_bits, max_bits,
+      ((double)total_bitmap_size) / (total_bitmap_entries ? total_bitmap_entries : 1),
+      DI(min_us), DI(max_us), DI(avg_us));
+
+  if (!timeout_given) {
+
+    /* Figure out the appropriate timeout. The basic idea is: 5x average or
+       1x max, rounded up to EXEC_TM_ROUND ms and capped at 1 second.
+
+       If the program is slow, the multiplier is lowered to 2x or 3x, because
+       random scheduler jitter is less likely to have any impact, and because
+       our patience is wearing thin =) */
+
+    if (avg_us > 50000) exec_tmout = avg_us * 2 / 1000;
+    else if (avg_us > 10000) exec_tmout = avg_us * 3 / 1000;
+    else exec_tmout = avg_us * 5 / 1000;
+
+    exec_tmout = MAX(exec_tmout, max_us / 1000);
+    exec_tmout = (exec_tmout + EXEC_TM_ROUND) / EXEC_TM_ROUND * EXEC_TM_ROUND;
+
+    if (exec_tmout > EXEC_TIMEOUT) exec_tmout = EXEC_TIMEOUT;
+
+    ACTF("No -t option specified, so I'll use exec timeout of %u ms.",
+         exec_tmout);
+
+    timeout_given = 1;
+
+  } else if (timeout_given == 3) {
+
+    ACTF("Applying timeout settings from resumed session (%u ms).", exec_tmout);
+
+  }
+
+  /* In dumb mode, re-running every timing out test case with a generous time
+     limit is very expensive, so let's select a more conservative default. */
+
+  if (dumb_mode && !getenv("AFL_HANG_TMOUT"))
+    hang_tmout = MIN(EXEC_TIMEOUT, exec_tmout * 2 + 100);
+
+  OKF("All set and ready to roll!");
+
+}
+
+
+/* Find first power of two greater or equal to val (assuming val under
+   2^31). */
+
+static u32 next_p2(u32 val) {
+
+  u32 ret = 1;
+  while (val > ret) ret <<= 1;
+  return ret;
+
+}
+
+
+/* Trim all new test cases to save cycles when doing deterministic checks. The
+   trimmer uses power-of-two increments somewhere between 1/16 and 1/1024 of
+   file size, to keep the stage short and sweet. */
+
+static u8 trim_case(char** argv, struct queue_entry* q, u8* in_buf) {
+
+  static u8 tmp[64];
+  static u8 clean_trace[MAP_SIZE];
+
+  u8  needs_write = 0, fault = 0;
+  u32 trim_exec = 0;
+  u32 remove_len;
+  u32 len_p2;
+
+  /* Although the trimmer will be less useful when variable behavior is
+     detected, it will still work to some extent, so we don't check for
+     this. */
+
+  if (q->len < 5) return 0;
+
+  stage_name = tmp;
+  bytes_trim_in += q->len;
+
+  /* Select initial chunk len, starting with large steps. */
+
+  len_p2 = next_p2(q->len);
+
+  remove_len = MAX(len_p2 / TRIM_START_STEPS, TRIM_MIN_BYTES);
+
+  /* Continue until the number of steps gets too high or the stepover
+     gets too small. */
+
+  while (remove_len >= MAX(len_p2 / TRIM_END_STEPS, TRIM_MIN_BYTES)) {
+
+    u32 remove_pos = remove_len;
+
+    sprintf(tmp, "trim %s/%s", DI(remove_len), DI(remove_len));
+
+    stage_cur = 0;
+    stage_max = q->len / remove_len;
+
+    while (remove_pos < q->len) {
+
+      u32 trim_avail = MIN(remove_len, q->len - remove_pos);
+      u32 cksum;
+
+      write_with_gap(in_buf, q->len, remove_pos, trim_avail);
+
+      fault = run_target(argv, exec_tmout, "USELESS=0", 0);
+      trim_execs++;
+
+      if (stop_soon || fault == FAULT_ERROR) goto abort_trimming;
+
+      /* Note that we don't keep track of crashes or hangs here; maybe TODO? */
+
+      cksum = hash32(trace_bits, map_size, HASH_CONST);
+
+      /* If the deletion had no impact on the trace, make it permanent. This
+         isn't perfect for variable-path inputs, but we're just making a
+         best-effort pass, so it's not a big deal if we end up with false
+         negatives every now and then. */
+
+      if (cksum == q->exec_cksum) {
+
+        u32 move_tail = q->len - remove_pos - trim_avail;
+
+        q->len -= trim_avail;
+        len_p2  = next_p2(q->len);
+
+        memmove(in_buf + remove_pos, in_buf + remove_pos + trim_avail,
+                move_tail);
+
+        /* Let's save a clean trace, which will be needed by
+           update_bitmap_score once we're done with the trimming stuff. */
+
+        if (!needs_write) {
+
+          needs_write = 1;
+          memcpy(clean_trace, trace_bits, map_size);
+
+        }
+
+      } else remove_pos += remove_len;
+
+      /* Since this can be slow, update the screen every now and then. */
+
+      if (!(trim_exec++ % stats_update_freq)) show_stats();
+      stage_cur++;
+
+    }
+
+    remove_len >>= 1;
+
+  }
+
+  /* If we have made changes to in_buf, we also need to update the on-disk
+     version of the test case. */
+
+  if (needs_write) {
+
+    write_queue_entry(q, in_buf, q->len);
+
+    memcpy(trace_bits, clean_trace, map_size);
+    invalidate_trace_idx();
+    update_bitmap_score(q);
+
+    /* The trimmed input has the same trace, so its record only needs the
+       new contents. */
+
+    cal_cache_save(q, in_buf);
+
+  }
+
+abort_trimming:
+
+  /* Bailed out with in_buf already edited: the cached contents no longer
+     match the disk. */
+
+  if (needs_write && q->cache_ent) seed_cache_drop(q);
+
+  bytes_trim_out += q->len;
+  return fault;
+
+}
+
+
+/* The part of common_fuzz_stuff() that deals with the outcome of an exec:
+   trace_bits and friends hold its results, not yet classified. */
+
+static u8 common_fuzz_result(char** argv, u8* out_buf, u32 len, u8 fault) {
+
+  if (fault == FAULT_TMOUT) {
+
+    if (subseq_tmouts++ > TMOUT_LIMIT) {
+      cur_skipped_paths++;
+      return 1;
+    }
+
+  } else subseq_tmouts = 0;
+
+  /* SIGUSR2 asks for a scheduler dump. */
+
+  if (dump_requested) {
+
+     dump_requested = 0;
+     dump_scheduler_state();
+
+  }
+
+  /* Users can hit us with SIGUSR1 to request the current input
+     to be abandoned. */
+
+  if (skip_requested) {
+
+     skip_requested = 0;
+     cur_skipped_paths++;
+     return 1;
+
+  }
+
+  /* This handles FAULT_ERROR for us: */
+
+  queued_discovered += save_if_interesting(argv, out_buf, len, fault);
+
+  if (!(stage_cur % stats_update_freq) || stage_cur + 1 == stage_max)
+    show_stats();
+
+  return 0;
+
+}
+
+
+/* Write a modified test case, run program, process results. Handle
+   error conditions, returning 1 if it's time to bail out. This is
+   a helper function for fuzz_one(). */
+
+EXP_ST u8 common_fuzz_stuff(char** argv, u8* out_buf, u32 len) {
+
+  u8 fault;
+
+  if (post_handler) {
+
+    out_buf = post_handler(out_buf, &len);
+    if (!out_buf || !len) return 0;
+
+  }
+
+  write_to_testcase(out_buf, len);
+
+  defer_classify = 1;
+  fault = run_target(argv, exec_tmout, "USELESS=0", 0);
+  defer_classify = 0;
+
+  if (stop_soon) return 1;
+
+  return common_fuzz_result(argv, out_buf, len, fault);
+
+}
+
+
+/* Helper to choose random block len for block operations in fuzz_one().
+   Doesn't return zero, provided that max_len is > 0. */
+
+static u32 choose_block_len(u32 limit) {
+
+  u32 min_value, max_value;
+  u32 rlim = MIN(queue_cycle, 3);
+
+  if (!run_over10m) rlim = 1;
+
+  switch (UR(rlim)) {
+
+    case 0:  min_value = 1;
+             max_value = HAVOC_BLK_SMALL;
+             break;
+
+    case 1:  min_value = HAVOC_BLK_SMALL;
+             max_value = HAVOC_BLK_MEDIUM;
+             break;
+
+    default:
+
+             if (UR(10)) {
+
+               min_value = HAVOC_BLK_MEDIUM;
+               max_value = HAVOC_BLK_LARGE;
+
+             } else {
+
+               min_value = HAVOC_BLK_LARGE;
+               max_value = HAVOC_BLK_XL;
+
+             }
+
+  }
+
+  if (min_value >= limit) min_value = 1;
+
+  return min_value + UR(MIN(max_value, limit) - min_value + 1);
+
+}
+
+/* Calculate the factor to multiply to the performance score. This is derived
+ * from the proximity scores of the DFG nodes covered by the test case. */
+static double calculate_factor(double prox_score) {
+
+  double factor;
+  double normalized_prox_score, progress_to_tx, T, p;
+  u64 cur_ms, t;
+
+  if (t_x) { // AFLGo's seed scheduling strategy.
+    // min_prox_score == max_prox_score
+    if (compare_proximity_score(&min_prox_score, &max_prox_score) == 0) normalized_prox_score = 0.5;
+    else normalized_prox_score = (double) (prox_score - min_prox_score.adjusted) /
+                                 (double) (max_prox_score.adjusted - min_prox_score.adjusted);
+    cur_ms = get_cur_time();
+    t = (cur_ms - start_time) / 1000;
+    progress_to_tx = ((double) t) / ((double) t_x * 60.0);
+    T = 1.0 / pow(20.0, progress_to_tx);
+    p = normalized_prox_score * (1.0 - T) + 0.5 * T;
+    factor = pow(2.0, 5.0 * 2.0 * (p - 0.5)); // Note log2(MAX_FACTOR) = 5.0
+  }
+  else if (no_dfg_schedule || !total_prox_cnt) factor = 1.0; // No factor.
+  else factor = (prox_score) / ((double) total_prox_original / (double) total_prox_cnt); // Default.
+
+  if (factor < 1 / 16) factor = 1 / 16;
+  if (factor > 16) factor = 16.0;
+
+  /* Reported in fuzzer_stats with AFL_DEBUG_STATS and in scheduler_dump. */
+
+  last_factor_prox = prox_score;
+  last_factor      = factor;
+  factor_calls++;
+
+  return factor;
+
+}
+
+/* Calculate case desirability score to adjust the length of havoc fuzzing.
+   A helper function for fuzz_one(). Maybe some of these constants should
+   go into config.h. */
+
+static u32 calculate_score(struct queue_entry* q) {
+
+  u32 avg_exec_us = total_cal_us / total_cal_cycles;
+  u32 avg_bitmap_size = total_bitmap_size / total_bitmap_entries;
+  u32 perf_score = 100;
+
+  /* Adjust score based on execution speed of this path, compared to the
+     global average. Multiplier ranges from 0.1x to 3x. Fast inputs are
+     less expensive to fuzz, so we're giving them more air time. */
+
+  if (q->exec_us * 0.1 > avg_exec_us) perf_score = 10;
+  else if (q->exec_us * 0.25 > avg_exec_us) perf_score = 25;
+  else if (q->exec_us * 0.5 > avg_exec_us) perf_score = 50;
+  else if (q->exec_us * 0.75 > avg_exec_us) perf_score = 75;
+  else if (q->exec_us * 4 < avg_exec_us) perf_score = 300;
+  else if (q->exec_us * 3 < avg_exec_us) perf_score = 200;
+  else if (q->exec_us * 2 < avg_exec_us) perf_score = 150;
+
+  /* Adjust score based on bitmap size. The working theory is that better
+     coverage translates to better targets. Multiplier from 0.25x to 3x. */
+
+  if (q->bitmap_size * 0.3 > avg_bitmap_size) perf_score *= 3;
+  else if (q->bitmap_size * 0.5 > avg_bitmap_size) perf_score *= 2;
+  else if (q->bitmap_size * 0.75 > avg_bitmap_size) perf_score *= 1.5;
+  else if (q->bitmap_size * 3 < avg_bitmap_size) perf_score *= 0.25;
+  else if (q->bitmap_size * 2 < avg_bitmap_size) perf_score *= 0.5;
+  else if (q->bitmap_size * 1.5 < avg_bitmap_size) perf_score *= 0.75;
+
+  /* Adjust score based on handicap. Handicap is proportional to how late
+     in the game we learned about this path. Latecomers are allowed to run
+     for a bit longer until they catch up with the rest. */
+
+  if (q->handicap >= 4) {
+
+    perf_score *= 4;
+    q->handicap -= 4;
+
+  } else if (q->handicap) {
+
+    perf_score *= 2;
+    q->handicap--;
+
+  }
+
+  /* Final adjustment based on input depth, under the assumption that fuzzing
+     deeper test cases is more likely to reveal stuff that can't be
+     discovered with traditional fuzzers. */
+
+  switch (q->depth) {
+
+    case 0 ... 3:   break;
+    case 4 ... 7:   perf_score *= 2; break;
+    case 8 ... 13:  perf_score *= 3; break;
+    case 14 ... 25: perf_score *= 4; break;
+    default:        perf_score *= 5;
+
+  }
+
+  /* Make sure that we don't go over limit. */
+
+  if (perf_score > HAVOC_MAX_MULT * 100) perf_score = HAVOC_MAX_MULT * 100;
+
+  return perf_score;
+
+}
+
+
+/* Helper function to see if a particular change (xor_val = old ^ new) could
+   be a product of deterministic bit flips with the lengths and stepovers
+   attempted by afl-fuzz. This is used to avoid dupes in some of the
+   deterministic fuzzing operations that follow bit flips. We also
+   return 1 if xor_val is zero, which implies that the old and attempted new
+   values are identical and the exec would be a waste of time. */
+
+static u8 could_be_bitflip(u32 xor_val) {
+
+  u32 sh = 0;
+
+  if (!xor_val) return 1;
+
+  /* Shift left until first bit set. */
+
+  while (!(xor_val & 1)) { sh++; xor_val >>= 1; }
+
+  /* 1-, 2-, and 4-bit patterns are OK anywhere. */
+
+  if (xor_val == 1 || xor_val == 3 || xor_val == 15) return 1;
+
+  /* 8-, 16-, and 32-bit patterns are OK only if shift factor is
+     divisible by 8, since that's the stepover for these ops. */
+
+  if (sh & 7) return 0;
+
+  if (xor_val == 0xff || xor_val == 0xffff || xor_val == 0xffffffff)
+    return 1;
+
+  return 0;
 
-  fn = alloc_printf("%s/queue/.state/variable_behavior", out_dir);
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+}
 
-  /* Then, get rid of the .state subdirectory itself (should be empty by now)
-     and everything matching <out_dir>/queue/id:*. */
 
-  fn = alloc_printf("%s/queue/.state", out_dir);
-  if (rmdir(fn) && errno != ENOENT) goto dir_cleanup_failed;
-  ck_free(fn);
+/* Helper function to see if a particular value is reachable through
+   arithmetic operations. Used for similar purposes. */
 
-  fn = alloc_printf("%s/queue", out_dir);
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+static u8 could_be_arith(u32 old_val, u32 new_val, u8 blen) {
 
-  /* All right, let's do <out_dir>/crashes/id:* and <out_dir>/hangs/id:*. */
+  u32 i, ov = 0, nv = 0, diffs = 0;
 
-  if (!in_place_resume) {
+  if (old_val == new_val) return 1;
 
-    fn = alloc_printf("%s/crashes/README.txt", out_dir);
-    unlink(fn); /* Ignore errors */
-    ck_free(fn);
+  /* See if one-byte adjustments to any byte could produce this result. */
+
+  for (i = 0; i < blen; i++) {
+
+    u8 a = old_val >> (8 * i),
+       b = new_val >> (8 * i);
+
+    if (a != b) { diffs++; ov = a; nv = b; }
 
   }
 
-  fn = alloc_printf("%s/crashes", out_dir);
+  /* If only one byte differs and the values are within range, return 1. */
+
+  if (diffs == 1) {
+
+    if ((u8)(ov - nv) <= ARITH_MAX ||
+        (u8)(nv - ov) <= ARITH_MAX) return 1;
+
+  }
+
+  if (blen == 1) return 0;
+
+  /* See if two-byte adjustments to any byte would produce this result. */
+
+  diffs = 0;
+
+  for (i = 0; i < blen / 2; i++) {
+
+    u16 a = old_val >> (16 * i),
+        b = new_val >> (16 * i);
+
+    if (a != b) { diffs++; ov = a; nv = b; }
+
+  }
+
+  /* If only one word differs and the values are within range, return 1. */
+
+  if (diffs == 1) {
+
+    if ((u16)(ov - nv) <= ARITH_MAX ||
+        (u16)(nv - ov) <= ARITH_MAX) return 1;
+
+    ov = SWAP16(ov); nv = SWAP16(nv);
+
+    if ((u16)(ov - nv) <= ARITH_MAX ||
+        (u16)(nv - ov) <= ARITH_MAX) return 1;
+
+  }
+
+  /* Finally, let's do the same thing for dwords. */
+
+  if (blen == 4) {
+
+    if ((u32)(old_val - new_val) <= ARITH_MAX ||
+        (u32)(new_val - old_val) <= ARITH_MAX) return 1;
+
+    new_val = SWAP32(new_val);
+    old_val = SWAP32(old_val);
+
+    if ((u32)(old_val - new_val) <= ARITH_MAX ||
+        (u32)(new_val - old_val) <= ARITH_MAX) return 1;
+
+  }
+
+  return 0;
+
+}
+
+
+/* Last but not least, a similar helper to see if insertion of an
+   interesting integer is redundant given the insertions done for
+   shorter blen. The last param (check_le) is set if the caller
+   already executed LE insertion for current blen and wants to see
+   if BE variant passed in new_val is unique. */
+
+static u8 could_be_interest(u32 old_val, u32 new_val, u8 blen, u8 check_le) {
+
+  u32 i, j;
+
+  if (old_val == new_val) return 1;
+
+  /* See if one-byte insertions from interesting_8 over old_val could
+     produce new_val. */
+
+  for (i = 0; i < blen; i++) {
+
+    for (j = 0; j < sizeof(interesting_8); j++) {
+
+      u32 tval = (old_val & ~(0xff << (i * 8))) |
+                 (((u8)interesting_8[j]) << (i * 8));
+
+      if (new_val == tval) return 1;
+
+    }
+
+  }
+
+  /* Bail out unless we're also asked to examine two-byte LE insertions
+     as a preparation for BE attempts. */
+
+  if (blen == 2 && !check_le) return 0;
+
+  /* See if two-byte insertions over old_val could give us new_val. */
+
+  for (i = 0; i < blen - 1; i++) {
+
+    for (j = 0; j < sizeof(interesting_16) / 2; j++) {
+
+      u32 tval = (old_val & ~(0xffff << (i * 8))) |
+                 (((u16)interesting_16[j]) << (i * 8));
+
+      if (new_val == tval) return 1;
+
+      /* Continue here only if blen > 2. */
+
+      if (blen > 2) {
+
+        tval = (old_val & ~(0xffff << (i * 8))) |
+               (SWAP16(interesting_16[j]) << (i * 8));
+
+        if (new_val == tval) return 1;
+
+      }
+
+    }
+
+  }
+
+  if (blen == 4 && check_le) {
+
+    /* See if four-byte insertions could produce the same result
+       (LE only). */
+
+    for (j = 0; j < sizeof(interesting_32) / 4; j++)
+      if (new_val == (u32)interesting_32[j]) return 1;
+
+  }
+
+  return 0;
+
+}
+
+u32 select_mutator_vertical(u32 extras) {
+  u32 max = 15 + (extras ? 2 : 0);
+  u32 mutator = UR(max);
+  return mutator;
+}
+
+u32 convert_to_actual_location(u32 max, u32 sel) {
+  u32 min_error = ((max / INTERVAL_SIZE) + 1) / 2;
+  min_error = MAX(min_error, 1);
+  double ratio = (double)sel / (double)INTERVAL_SIZE;
+  double loc = ratio * (double)max;
+  u32 loc_u32 = (u32)loc;
+  // Select +- min_error location
+  u32 minus = min_error;
+  u32 plus = UR(2 * min_error + 1);
+  u32 loc_final = loc_u32;
+  if (loc_u32 < min_error) loc_final = loc_u32 + plus - 1;
+  else loc_final = loc_u32 - minus + plus;
+  if (loc_final > max - 1) loc_final = max - 1;
+  return loc_final;
+}
+
+u32 select_location_vertical(u32 max, double *rel) {
+  u32 result = 0;
+  if (max) {
+    if (use_vertical_navigation || vertical_manager_get_mode(vertical_manager) == M_VER)
+      result = convert_to_actual_location(max, interval_tree_select(vertical_manager->tree));
+    else
+      result = UR(max);
+    *rel = (double) result / (double) max;
+  }
+  return result;
+}
+
+void init_mutation_vertical(void) {
+  vertical_is_persistent = 0;
+  vertical_is_interesting = 0;
+  vertical_is_new_valuation = 0;
+}
+
+/* Runs on the writer thread, so errors are not fatal here: exit() would
+   run the atexit handlers under the main thread's feet. Returns 0 and sets
+   vlog_errno on failure; the main thread reports it. */
+
+static u8 vlog_write_range(u64 from, u64 to) {
+
+  while (from < to) {
+
+    u32 start = from & (VLOG_RING_SIZE - 1);
+    u32 cnt   = MIN(to - from, VLOG_RING_SIZE - start);
+    u8* buf   = (u8*)(vlog_ring + start);
+    u32 len   = cnt * sizeof(struct vlog_record);
+
+    while (len) {
+
+      ssize_t res = write(vlog_fd, buf, len);
+
+      if (res < 0 && errno == EINTR) continue;
+
+      if (res <= 0) {
+        __atomic_store_n(&vlog_errno, res ? errno : EIO, __ATOMIC_RELEASE);
+        return 0;
+      }
+
+      buf += res;
+      len -= res;
+
+    }
+
+    from += cnt;
+
+  }
+
+  return 1;
+
+}
+
+/* Writer thread: wait for a full block (or a quiet period), then write out
+   everything pending in one go. */
+
+static void* vlog_writer(void* arg) {
+
+  u32 idle = 0;
+
+  while (1) {
+
+    u64 head = __atomic_load_n(&vlog_head, __ATOMIC_ACQUIRE);
+    u8  stop = __atomic_load_n(&vlog_stop, __ATOMIC_ACQUIRE);
+
+    if (!stop && (head == vlog_tail ||
+        (head - vlog_tail < VLOG_FLUSH_RECORDS && idle++ < 10))) {
+      usleep(VLOG_POLL_USEC);
+      continue;
+    }
+
+    idle = 0;
+
+    if (head != vlog_tail) {
+      if (!vlog_write_range(vlog_tail, head)) break;
+      __atomic_store_n(&vlog_tail, head, __ATOMIC_RELEASE);
+    } else if (stop) break;
+
+  }
+
+  return NULL;
+
+}
+
+/* The writer gave up: reap it and bail out from the main thread. */
+
+static void vlog_fail(void) {
+
+  pthread_join(vlog_thread, NULL);
+
+  close(vlog_fd);
+  vlog_fd = -1;
+
+  errno = vlog_errno;
+  PFATAL("Short write to vertical.bin");
+
+}
+
+static void vlog_push(u8 kind, u32 mutator, double location) {
+
+  struct vlog_record* r;
+
+  if (vlog_fd < 0) return;
+
+  if (__atomic_load_n(&vlog_errno, __ATOMIC_ACQUIRE)) vlog_fail();
+
+  /* Full ring: the writer is behind, let it catch up. */
+
+  while (vlog_head - __atomic_load_n(&vlog_tail, __ATOMIC_ACQUIRE) >=
+         VLOG_RING_SIZE) {
+    if (__atomic_load_n(&vlog_errno, __ATOMIC_ACQUIRE)) vlog_fail();
+    vlog_stalls++;
+    usleep(100);
+  }
 
-  /* Make backup of the crashes directory if it's not empty and if we're
-     doing in-place resume. */
+  r = &vlog_ring[vlog_head & (VLOG_RING_SIZE - 1)];
 
-  if (in_place_resume && rmdir(fn)) {
+  r->kind          = kind;
+  r->persistent    = vertical_is_persistent;
+  r->interesting   = vertical_is_interesting;
+  r->new_valuation = vertical_is_new_valuation;
+  r->mutator       = mutator;
+  r->location      = location;
 
-    time_t cur_t = time(0);
-    struct tm* t = localtime(&cur_t);
+  __atomic_store_n(&vlog_head, vlog_head + 1, __ATOMIC_RELEASE);
 
-#ifndef SIMPLE_FILES
+}
 
-    u8* nfn = alloc_printf("%s.%04u-%02u-%02u-%02u:%02u:%02u", fn,
-                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-                           t->tm_hour, t->tm_min, t->tm_sec);
+/* Flush and stop the writer (atexit handler). Children forked for the
+   target inherit the handler but not the thread, so they skip this. We are
+   already exiting, so a failed flush is reported but cannot be fatal. */
 
-#else
+static void vlog_close(void) {
 
-    u8* nfn = alloc_printf("%s_%04u%02u%02u%02u%02u%02u", fn,
-                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-                           t->tm_hour, t->tm_min, t->tm_sec);
+  if (vlog_fd < 0 || getpid() != vlog_owner) return;
 
-#endif /* ^!SIMPLE_FILES */
+  __atomic_store_n(&vlog_stop, 1, __ATOMIC_RELEASE);
+  pthread_join(vlog_thread, NULL);
 
-    rename(fn, nfn); /* Ignore errors. */
-    ck_free(nfn);
+  close(vlog_fd);
+  vlog_fd = -1;
 
-  }
+  if (vlog_errno)
+    WARNF("Short write to vertical.bin (%s), the log is truncated",
+          strerror(vlog_errno));
 
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+}
 
-  fn = alloc_printf("%s/hangs", out_dir);
+static void vlog_open(u8* fn) {
 
-  /* Backup hangs, too. */
+  struct vlog_header hdr;
 
-  if (in_place_resume && rmdir(fn)) {
+  vlog_fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (vlog_fd < 0) PFATAL("Unable to create '%s'", fn);
 
-    time_t cur_t = time(0);
-    struct tm* t = localtime(&cur_t);
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, VLOG_MAGIC, sizeof(hdr.magic));
+  hdr.version     = VLOG_VERSION;
+  hdr.record_size = sizeof(struct vlog_record);
 
-#ifndef SIMPLE_FILES
+  ck_write(vlog_fd, &hdr, sizeof(hdr), fn);
 
-    u8* nfn = alloc_printf("%s.%04u-%02u-%02u-%02u:%02u:%02u", fn,
-                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-                           t->tm_hour, t->tm_min, t->tm_sec);
+  vlog_owner = getpid();
 
-#else
+  if (pthread_create(&vlog_thread, NULL, vlog_writer, NULL))
+    FATAL("Unable to start the mutation log writer");
 
-    u8* nfn = alloc_printf("%s_%04u%02u%02u%02u%02u%02u", fn,
-                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-                           t->tm_hour, t->tm_min, t->tm_sec);
+  atexit(vlog_close);
 
-#endif /* ^!SIMPLE_FILES */
+}
 
-    rename(fn, nfn); /* Ignore errors. */
-    ck_free(nfn);
+void log_single_mutator_selection(u32 mutator, double location) {
+  u32 score = vertical_is_persistent + 16 * vertical_is_new_valuation;
+  vlog_push('d', mutator, location);
+  interval_tree_insert(vertical_manager->tree, quantize_location(location), score);
+}
 
+void log_mutator_selection(u32* mutator, double* location, u32 stacking) {
+  // 4 * vertical_is_interesting
+  if (!use_moo_scheduler && !use_vertical_navigation && !vertical_experiment && !vertical_use_dynamic)
+    return;
+  u32 score = vertical_is_persistent + 16 * vertical_is_new_valuation;
+  u32 mut_cnt[OPERATOR_NUM];
+  memset(mut_cnt, 0, sizeof(mut_cnt));
+  for (u32 i = 0; i < stacking; i++) {
+    vlog_push('v', mutator[i], location[i]);
+    // Update score for mutator
+    u32 mut = mutator[i];
+    if (!mut_cnt[mut]) {
+      mut_cnt[mut] = 1;
+    }
+    // Update score for location
+    interval_tree_insert(vertical_manager->tree, quantize_location(location[i]), score);
   }
+}
 
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+/* Havoc pipeline: the mutant whose exec is in flight while fuzz_one_vertical()
+   generates the next one. */
 
-  fn = alloc_printf("%s/normals", out_dir);
-  if (in_place_resume && rmdir(fn)) {
+static u8  no_pipeline,               /* AFL_NO_PIPELINE set?             */
+           pipeline_busy;             /* A test case is executing         */
 
-    time_t cur_t = time(0);
-    struct tm* t = localtime(&cur_t);
-#ifndef SIMPLE_FILES
-    u8* nfn = alloc_printf("%s.%04u-%02u-%02u-%02u:%02u:%02u", fn,
-                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-                           t->tm_hour, t->tm_min, t->tm_sec);
-#else
-    u8* nfn = alloc_printf("%s_%04u%02u%02u%02u%02u%02u", fn,
-                           t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-                           t->tm_hour, t->tm_min, t->tm_sec);
-#endif /* ^!SIMPLE_FILES */
-    rename(fn, nfn); /* Ignore errors. */
-    ck_free(nfn);
-  }
-  if (delete_files(fn, CASE_PREFIX)) goto dir_cleanup_failed;
-  ck_free(fn);
+static u8* pipeline_mem;              /* Test case being executed         */
 
-  fn = alloc_printf("%s/memory/neg", out_dir);
-  if (delete_files(fn, NULL)) goto dir_cleanup_failed;
-  ck_free(fn);
+static u32 pipeline_len,              /* Its length                       */
+           pipeline_stage_cur_val,    /* stage_cur_val it was made with   */
+           pipeline_loc_count;        /* Stacked mutations                */
 
-  fn = alloc_printf("%s/memory/pos", out_dir);
-  if (delete_files(fn, NULL)) goto dir_cleanup_failed;
-  ck_free(fn);
+static s32 pipeline_stage_cur;        /* stage_cur it was made with       */
 
-  fn = alloc_printf("%s/memory", out_dir);
-  if (delete_files(fn, NULL)) goto dir_cleanup_failed;
-  ck_free(fn);
+static u32    pipeline_mut[1 << HAVOC_STACK_POW2];  /* Mutators used      */
+static double pipeline_loc[1 << HAVOC_STACK_POW2];  /* Relative locations */
 
-  /* And now, for some finishing touches. */
 
-  fn = alloc_printf("%s/.cur_input", out_dir);
-  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
-  ck_free(fn);
+/* Write a test case and start the target on it, without waiting for the
+   result. The caller must leave mem alone until pipeline_finish(). */
 
-  fn = alloc_printf("%s/fuzz_bitmap", out_dir);
-  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
-  ck_free(fn);
+static void pipeline_start(char** argv, u8* mem, u32 len, u32* mut_cnt,
+                           double* loc_cnt, u32 loc_count) {
+
+  if (post_handler) {
+
+    mem = post_handler(mem, &len);
+    if (!mem || !len) return;
 
-  if (!in_place_resume) {
-    fn  = alloc_printf("%s/fuzzer_stats", out_dir);
-    if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
-    ck_free(fn);
   }
 
-  fn = alloc_printf("%s/plot_data", out_dir);
-  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
-  ck_free(fn);
+  write_to_testcase(mem, len);
 
-  fn = alloc_printf("%s/unique_dafl.log", out_dir);
-  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
-  ck_free(fn);
+  if (!run_target_start(argv, exec_tmout, "USELESS=0", 0)) return;
 
-  fn = alloc_printf("%s/vertical.log", out_dir);
-  if (unlink(fn) && errno != ENOENT) goto dir_cleanup_failed;
-  ck_free(fn);
+  pipeline_busy          = 1;
+  pipeline_mem           = mem;
+  pipeline_len           = len;
+  pipeline_stage_cur     = stage_cur;
+  pipeline_stage_cur_val = stage_cur_val;
+  pipeline_loc_count     = loc_count;
 
-  OKF("Output dir cleanup successful.");
+  memcpy(pipeline_mut, mut_cnt, loc_count * sizeof(u32));
+  memcpy(pipeline_loc, loc_cnt, loc_count * sizeof(double));
 
-  /* Wow... is that all? If yes, celebrate! */
+}
 
-  return;
 
-dir_cleanup_failed:
+/* Collect the test case started by pipeline_start(), if any, and process
+   it the way common_fuzz_stuff() would. Returns 1 if it's time to bail
+   out. */
 
-  SAYF("\n" cLRD "[-] " cRST
-       "Whoops, the fuzzer tried to reuse your output directory, but bumped into\n"
-       "    some files that shouldn't be there or that couldn't be removed - so it\n"
-       "    decided to abort! This happened while processing this path:\n\n"
+static u8 pipeline_finish(char** argv) {
 
-       "    %s\n\n"
-       "    Please examine and manually delete the files, or specify a different\n"
-       "    output location for the tool.\n", fn);
+  s32 cur     = stage_cur;
+  u32 cur_val = stage_cur_val;
+  u8  fault, ret;
 
-  FATAL("Output directory cleanup failed");
+  if (!pipeline_busy) return 0;
 
-}
+  pipeline_busy = 0;
 
+  defer_classify = 1;
+  fault = run_target_wait(exec_tmout, 0);
+  defer_classify = 0;
 
-static void check_term_size(void);
+  if (stop_soon) return 1;
 
+  /* Describe the test case as of when it was generated. */
 
-/* A spiffy retro stats screen! This is called every stats_update_freq
-   execve() calls, plus in several other circumstances. */
+  stage_cur     = pipeline_stage_cur;
+  stage_cur_val = pipeline_stage_cur_val;
 
-static void show_stats(void) {
+  init_mutation_vertical();
 
-  static u64 last_stats_ms, last_plot_ms, last_ms, last_execs;
-  static double avg_exec;
-  double t_byte_ratio, stab_ratio;
+  ret = common_fuzz_result(argv, pipeline_mem, pipeline_len, fault);
 
-  u64 cur_ms;
-  u32 t_bytes, t_bits;
+  stage_cur     = cur;
+  stage_cur_val = cur_val;
 
-  u32 banner_len, banner_pad;
-  u8  tmp[256];
+  if (!ret)
+    log_mutator_selection(pipeline_mut, pipeline_loc, pipeline_loc_count);
 
-  cur_ms = get_cur_time();
+  return ret;
 
-  /* If not enough time has passed since last UI update, bail out. */
+}
 
-  if (cur_ms - last_ms < 1000 / UI_TARGET_HZ) return;
 
-  /* Check if we're past the 10 minute mark. */
+/* Executor pool (AFL_EXEC_POOL=n): n extra fork servers, each with its own
+   SHM maps and input file and driven by its own thread, run the havoc stage
+   round-robin. Each mutant starts as soon as it is generated; before an
+   executor takes the next one, the main thread merges its previous result
+   through the usual common_fuzz_result() path, with the globals of the
+   executor swapped in (so that calibrating a new find uses the executor's
+   fork server and maps, which are idle at that point). Results are thus
+   merged in the order the mutants were made, while the other executors
+   keep running. All other state stays single-threaded. */
+
+struct executor {
+
+  s32 shm_id, shm_id_dfg, shm_id_dfg_last;
+  u8*  trace_bits;                    /* Per-executor SHM maps            */
+  u32* dfg_bits;
+  u32* last_location;
+
+  s32 fsrv_ctl_fd, fsrv_st_fd,        /* Fork server pipes                */
+      forksrv_pid,
+      child_pid,                      /* Target being run, or 0           */
+      out_fd;                         /* Input file, unless out_file      */
+  u8* out_file;                       /* Input file for @@ targets        */
+  u32 prev_timed_out;
+  char** argv;                        /* argv naming out_file             */
+
+  pthread_t thread;
+  pthread_cond_t cond;                /* Signals a job started / done     */
+  u32 started, done;                  /* Jobs handed to the worker, run   */
+
+  /* The current job. */
+
+  u8* mem;                            /* Input                            */
+  u32 len, size;                      /* Input length, size of mem        */
+  u32 mut_cnt[1 << HAVOC_STACK_POW2]; /* Havoc mutators, for the mutation */
+  double loc_cnt[1 << HAVOC_STACK_POW2]; /* log                           */
+  u32 loc_count;
+  s32 stage_cur;                      /* stage_cur it was made with       */
+  u32 stage_cur_val;                  /* stage_cur_val it was made with   */
+  u8  pending;                        /* Started, result not merged yet   */
+
+  u8  fault, timed_out, kill_signal;  /* Outcome                          */
+  u64 exec_ms;
+
+  const char* err_msg;                /* Why the exec failed, or NULL     */
+  s32 err_no;                         /* errno for err_msg, or 0          */
 
-  if (cur_ms - start_time > 10 * 60 * 1000) run_over10m = 1;
+};
 
-  /* Calculate smoothed exec speed stats. */
+static struct executor* pool;         /* Executors                        */
+static u32 pool_next;                 /* Executor for the next mutant     */
 
-  if (!last_execs) {
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
-    avg_exec = ((double)total_execs) * 1000 / (cur_ms - start_time);
 
-  } else {
+/* Swap the execution globals with those of ex. Calling it twice restores
+   them. */
 
-    double cur_avg = ((double)(total_execs - last_execs)) * 1000 /
-                     (cur_ms - last_ms);
+static void pool_switch(struct executor* ex) {
 
-    /* If there is a dramatic (5x+) jump in speed, reset the indicator
-       more quickly. */
+#define POOL_SWAP(_t, _g, _f) do { \
+    _t _tmp = _g; _g = ex->_f; ex->_f = _tmp; \
+  } while (0)
 
-    if (cur_avg * 5 < avg_exec || cur_avg / 5 > avg_exec)
-      avg_exec = cur_avg;
+  POOL_SWAP(u8*,  trace_bits,     trace_bits);
+  POOL_SWAP(u32*, dfg_bits,       dfg_bits);
+  POOL_SWAP(u32*, last_location,  last_location);
+  POOL_SWAP(s32,  fsrv_ctl_fd,    fsrv_ctl_fd);
+  POOL_SWAP(s32,  fsrv_st_fd,     fsrv_st_fd);
+  POOL_SWAP(s32,  forksrv_pid,    forksrv_pid);
+  POOL_SWAP(s32,  out_fd,         out_fd);
+  POOL_SWAP(u8*,  out_file,       out_file);
+  POOL_SWAP(u32,  prev_timed_out, prev_timed_out);
 
-    avg_exec = avg_exec * (1.0 - 1.0 / AVG_SMOOTHING) +
-               cur_avg * (1.0 / AVG_SMOOTHING);
+#undef POOL_SWAP
 
-  }
+  invalidate_trace_idx();
 
-  last_ms = cur_ms;
-  last_execs = total_execs;
+}
 
-  /* Tell the callers when to contact us (as measured in execs). */
 
-  stats_update_freq = avg_exec / (UI_TARGET_HZ * 10);
-  if (!stats_update_freq) stats_update_freq = 1;
+/* One exec on ex, from its worker thread. This is run_target() for a fork
+   server, except that the timeout is enforced with poll() rather than
+   SIGALRM, and nothing but ex is touched. Errors are left in ex for
+   pool_merge() to report: exit() from here would run the atexit handlers
+   while the main thread waits for the job. */
 
-  /* Do some bitmap stats. */
+#define POOL_FAIL(_err, _msg) do { \
+    ex->err_no  = (_err); \
+    ex->err_msg = (_msg); \
+    return; \
+  } while (0)
 
-  t_bytes = count_non_255_bytes(virgin_bits);
-  t_byte_ratio = ((double)t_bytes * 100) / MAP_SIZE;
+static void pool_exec(struct executor* ex) {
 
-  if (t_bytes)
-    stab_ratio = 100 - ((double)var_byte_count) * 100 / t_bytes;
-  else
-    stab_ratio = 100;
+  struct pollfd pfd;
+  u64 start_ms;
+  s32 child, status = 0, res;
 
-  /* Roughly every minute, update fuzzer stats and save auto tokens. */
+  ex->err_msg = NULL;
 
-  if (cur_ms - last_stats_ms > STATS_UPDATE_SEC * 1000) {
+  if (ex->out_file) {
 
-    last_stats_ms = cur_ms;
-    write_stats_file(t_byte_ratio, stab_ratio, avg_exec);
-    save_auto();
-    write_bitmap();
+    s32 fd;
 
-  }
+    unlink(ex->out_file); /* Ignore errors. */
 
-  /* Every now and then, write plot data. */
+    fd = open(ex->out_file, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) POOL_FAIL(errno, "Unable to create the input file");
 
-  if (cur_ms - last_plot_ms > PLOT_UPDATE_SEC * 1000) {
+    res = write(fd, ex->mem, ex->len);
+    close(fd);
 
-    last_plot_ms = cur_ms;
-    maybe_update_plot_file(t_byte_ratio, avg_exec);
+    if (res != ex->len)
+      POOL_FAIL(res < 0 ? errno : 0, "Short write to the input file");
 
-  }
+  } else {
 
-  /* Honor AFL_EXIT_WHEN_DONE and AFL_BENCH_UNTIL_CRASH. */
+    lseek(ex->out_fd, 0, SEEK_SET);
 
-  if (!dumb_mode && cycles_wo_finds > 100 && !pending_not_fuzzed &&
-      getenv("AFL_EXIT_WHEN_DONE")) stop_soon = 2;
+    res = write(ex->out_fd, ex->mem, ex->len);
+    if (res != ex->len)
+      POOL_FAIL(res < 0 ? errno : 0, "Short write to the input file");
 
-  if (total_crashes && getenv("AFL_BENCH_UNTIL_CRASH")) stop_soon = 2;
+    if (ftruncate(ex->out_fd, ex->len)) POOL_FAIL(errno, "ftruncate() failed");
+    lseek(ex->out_fd, 0, SEEK_SET);
 
-  /* If we're not on TTY, bail out. */
+  }
 
-  if (not_on_tty) return;
+  memset(ex->trace_bits, 0, map_size);
+  memset(ex->dfg_bits, 0, sizeof(u32) * DFG_MAP_SIZE);
+  *ex->last_location = MAP_SIZE + 1;
+  MEM_BARRIER();
 
-  /* Compute some mildly useful bitmap stats. */
+  if ((res = write(ex->fsrv_ctl_fd, &ex->prev_timed_out, 4)) != 4 ||
+      (res = read(ex->fsrv_st_fd, &child, 4)) != 4) {
 
-  t_bits = (MAP_SIZE << 3) - count_bits(virgin_bits);
+    if (stop_soon) return;
+    POOL_FAIL(res < 0 ? errno : 0,
+              "Unable to request new process from fork server (OOM?)");
 
-  /* Now, for the visuals... */
+  }
 
-  if (clear_screen) {
+  if (child <= 0) POOL_FAIL(0, "Fork server is misbehaving (OOM?)");
 
-    SAYF(TERM_CLEAR CURSOR_HIDE);
-    clear_screen = 0;
+  ex->child_pid = child;
 
-    check_term_size();
+  start_ms = get_cur_time();
 
-  }
+  pfd.fd     = ex->fsrv_st_fd;
+  pfd.events = POLLIN;
 
-  SAYF(TERM_HOME);
+  ex->timed_out = 0;
 
-  if (term_too_small) {
+  if (!poll(&pfd, 1, exec_tmout)) {
+    kill(child, SIGKILL);
+    ex->timed_out = 1;
+  }
 
-    SAYF(cBRI "Your terminal is too small to display the UI.\n"
-         "Please resize terminal window to at least 80x25.\n" cRST);
+  if ((res = read(ex->fsrv_st_fd, &status, 4)) != 4) {
 
-    return;
+    if (stop_soon) return;
+    POOL_FAIL(res < 0 ? errno : 0,
+              "Unable to communicate with fork server (OOM?)");
 
   }
 
-  /* Let's start by drawing a centered banner. */
+  ex->child_pid      = 0;
+  ex->exec_ms        = get_cur_time() - start_ms;
+  ex->prev_timed_out = ex->timed_out;
 
-  banner_len = (crash_mode ? 24 : 22) + strlen(VERSION) + strlen(use_banner);
-  banner_pad = (80 - banner_len) / 2;
-  memset(tmp, ' ', banner_pad);
+  MEM_BARRIER();
 
-  sprintf(tmp + banner_pad, "%s " cLCY VERSION cLGN
-          " (%s)",  crash_mode ? cPIN "peruvian were-rabbit" :
-          cYEL "american fuzzy lop", use_banner);
+  ex->fault       = FAULT_NONE;
+  ex->kill_signal = 0;
 
-  SAYF("\n%s\n\n", tmp);
+  if (WIFSIGNALED(status)) {
 
-  /* "Handy" shortcuts for drawing boxes... */
+    ex->kill_signal = WTERMSIG(status);
+    ex->fault = (ex->timed_out && ex->kill_signal == SIGKILL) ?
+                FAULT_TMOUT : FAULT_CRASH;
 
-#define bSTG    bSTART cGRA
-#define bH2     bH bH
-#define bH5     bH2 bH2 bH
-#define bH10    bH5 bH5
-#define bH20    bH10 bH10
-#define bH30    bH20 bH10
-#define SP5     "     "
-#define SP10    SP5 SP5
-#define SP20    SP10 SP10
+  } else if (uses_asan && WEXITSTATUS(status) == MSAN_ERROR) {
 
-  /* Lord, forgive me this. */
+    ex->fault = FAULT_CRASH;
 
-  SAYF(SET_G1 bSTG bLT bH bSTOP cCYA " process timing " bSTG bH30 bH5 bH2 bHB
-       bH bSTOP cCYA " overall results " bSTG bH5 bRT "\n");
+  }
 
-  if (dumb_mode) {
+}
 
-    strcpy(tmp, cRST);
+#undef POOL_FAIL
 
-  } else {
 
-    u64 min_wo_finds = (cur_ms - last_path_time) / 1000 / 60;
+static void* pool_worker(void* arg) {
 
-    /* First queue cycle: don't stop now! */
-    if (queue_cycle == 1 || min_wo_finds < 15) strcpy(tmp, cMGN); else
+  struct executor* ex = arg;
+  sigset_t set;
+  u32 seen = 0;
 
-    /* Subsequent cycles, but we're still making finds. */
-    if (cycles_wo_finds < 25 || min_wo_finds < 30) strcpy(tmp, cYEL); else
+  /* Signals are for the main thread. */
 
-    /* No finds for a long time and no test cases to try. */
-    if (cycles_wo_finds > 100 && !pending_not_fuzzed && min_wo_finds > 120)
-      strcpy(tmp, cLGN);
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
 
-    /* Default: cautiously OK to stop? */
-    else strcpy(tmp, cLBL);
+  while (1) {
 
-  }
+    pthread_mutex_lock(&pool_lock);
+    while (ex->started == seen) pthread_cond_wait(&ex->cond, &pool_lock);
+    seen = ex->started;
+    pthread_mutex_unlock(&pool_lock);
 
-  SAYF(bV bSTOP "        run time : " cRST "%-34s " bSTG bV bSTOP
-       "  cycles done : %s%-5s  " bSTG bV "\n",
-       DTD(cur_ms, start_time), tmp, DI(queue_cycle - 1));
+    pool_exec(ex);
 
-  /* We want to warn people about not seeing new paths after a full cycle,
-     except when resuming fuzzing or running in non-instrumented mode. */
+    pthread_mutex_lock(&pool_lock);
+    ex->done = seen;
+    pthread_cond_signal(&ex->cond);
+    pthread_mutex_unlock(&pool_lock);
+
+  }
+
+  return NULL;
 
-  if (!dumb_mode && (last_path_time || resuming_fuzz || queue_cycle == 1 ||
-      in_bitmap || crash_mode)) {
+}
 
-    SAYF(bV bSTOP "   last new path : " cRST "%-34s ",
-         DTD(cur_ms, last_path_time));
 
-  } else {
+static void pool_shutdown(void) {
 
-    if (dumb_mode)
+  u32 i;
 
-      SAYF(bV bSTOP "   last new path : " cPIN "n/a" cRST
-           " (non-instrumented mode)        ");
+  for (i = 0; i < pool_size; i++) {
 
-     else
+    if (pool[i].forksrv_pid > 0) kill(pool[i].forksrv_pid, SIGKILL);
 
-      SAYF(bV bSTOP "   last new path : " cRST "none yet " cLRD
-           "(odd, check syntax!)      ");
+    shmctl(pool[i].shm_id, IPC_RMID, NULL);
+    shmctl(pool[i].shm_id_dfg, IPC_RMID, NULL);
+    shmctl(pool[i].shm_id_dfg_last, IPC_RMID, NULL);
 
   }
 
-  SAYF(bSTG bV bSTOP "  total paths : " cRST "%-5s  " bSTG bV "\n",
-       DI(queued_paths));
+}
 
-  /* Highlight crashes in red if found, denote going over the KEEP_UNIQUE_CRASH
-     limit with a '+' appended to the count. */
 
-  sprintf(tmp, "%s%s", DI(unique_crashes),
-          (unique_crashes >= KEEP_UNIQUE_CRASH) ? "+" : "");
+/* Copy argv, pointing every mention of from to to instead. */
 
-  SAYF(bV bSTOP " last uniq crash : " cRST "%-34s " bSTG bV bSTOP
-       " uniq crashes : %s%-6s " bSTG bV "\n",
-       DTD(cur_ms, last_crash_time), unique_crashes ? cLRD : cRST,
-       tmp);
+static char** pool_argv(char** argv, u8* from, u8* to) {
 
-  sprintf(tmp, "%s%s", DI(unique_hangs),
-         (unique_hangs >= KEEP_UNIQUE_HANG) ? "+" : "");
+  u32 i, argc = 0;
+  char** ret;
 
-  SAYF(bV bSTOP "  last uniq hang : " cRST "%-34s " bSTG bV bSTOP
-       "   uniq hangs : " cRST "%-6s " bSTG bV "\n",
-       DTD(cur_ms, last_hang_time), tmp);
+  while (argv[argc]) argc++;
 
-  SAYF(bVR bH bSTOP cCYA " cycle progress " bSTG bH20 bHB bH bSTOP cCYA
-       " map coverage " bSTG bH bHT bH20 bH2 bH bVL "\n");
+  ret = ck_alloc(sizeof(char*) * (argc + 1));
 
-  /* This gets funny because we want to print several variable-length variables
-     together, but then cram them into a fixed-width field - so we need to
-     put them in a temporary buffer first. */
+  for (i = 0; i < argc; i++) {
 
-  sprintf(tmp, "%s%s (%0.02f%%)", DI(current_entry),
-          queue_cur->favored ? "" : "*",
-          ((double)current_entry * 100) / queued_paths);
+    u8* at = from ? (u8*)strstr(argv[i], from) : NULL;
 
-  SAYF(bV bSTOP "  now processing : " cRST "%-17s " bSTG bV bSTOP, tmp);
+    if (at) {
+      *at = 0;
+      ret[i] = alloc_printf("%s%s%s", argv[i], to, at + strlen(from));
+      *at = *from;
+    } else ret[i] = argv[i];
 
-  sprintf(tmp, "%0.02f%% / %0.02f%%", ((double)queue_cur->bitmap_size) *
-          100 / MAP_SIZE, t_byte_ratio);
+  }
 
-  SAYF("    map density : %s%-21s " bSTG bV "\n", t_byte_ratio > 70 ? cLRD :
-       ((t_bytes < 200 && !dumb_mode) ? cPIN : cRST), tmp);
+  return ret;
 
-  sprintf(tmp, "%s (%0.02f%%)", DI(cur_skipped_paths),
-          ((double)cur_skipped_paths * 100) / queued_paths);
+}
 
-  SAYF(bV bSTOP " paths timed out : " cRST "%-17s " bSTG bV, tmp);
 
-  sprintf(tmp, "%0.02f bits/tuple",
-          t_bytes ? (((double)t_bits) / t_bytes) : 0);
+/* Spin up the executors. */
 
-  SAYF(bSTOP " count coverage : " cRST "%-21s " bSTG bV "\n", tmp);
+static void pool_init(char** argv) {
 
-  SAYF(bVR bH bSTOP cCYA " stage progress " bSTG bH20 bX bH bSTOP cCYA
-       " findings in depth " bSTG bH20 bVL "\n");
+  u8 *abs_out = NULL, *cwd = getcwd(NULL, 0), *tmp;
+  u32 i;
 
-  sprintf(tmp, "%s (%0.02f%%)", DI(queued_favored),
-          ((double)queued_favored) * 100 / queued_paths);
+  if (!cwd) PFATAL("getcwd() failed");
 
-  /* Yeah... it's still going on... halp? */
+  if (out_file)
+    abs_out = out_file[0] == '/' ? ck_strdup(out_file) :
+              alloc_printf("%s/%s", cwd, out_file);
 
-  SAYF(bV bSTOP "  now trying : " cRST "%-21s " bSTG bV bSTOP
-       " favored paths : " cRST "%-22s " bSTG bV "\n", stage_name, tmp);
+  pool = ck_alloc(sizeof(struct executor) * pool_size);
+  atexit(pool_shutdown);
 
-  if (!stage_max) {
+  ACTF("Starting %u executors...", pool_size);
 
-    sprintf(tmp, "%s/-", DI(stage_cur));
+  for (i = 0; i < pool_size; i++) {
 
-  } else {
+    struct executor* ex = &pool[i];
 
-    sprintf(tmp, "%s/%s (%0.02f%%)", DI(stage_cur), DI(stage_max),
-            ((double)stage_cur) * 100 / stage_max);
+    ex->shm_id = shmget(IPC_PRIVATE, MAP_SIZE, IPC_CREAT | IPC_EXCL | 0600);
+    ex->shm_id_dfg = shmget(IPC_PRIVATE, sizeof(u32) * DFG_MAP_SIZE,
+                            IPC_CREAT | IPC_EXCL | 0600);
+    ex->shm_id_dfg_last = shmget(IPC_PRIVATE, sizeof(u64),
+                                 IPC_CREAT | IPC_EXCL | 0600);
 
-  }
+    if (ex->shm_id < 0 || ex->shm_id_dfg < 0 || ex->shm_id_dfg_last < 0)
+      PFATAL("shmget() failed");
 
-  SAYF(bV bSTOP " stage execs : " cRST "%-21s " bSTG bV bSTOP, tmp);
+    ex->trace_bits    = shmat(ex->shm_id, NULL, 0);
+    ex->dfg_bits      = shmat(ex->shm_id_dfg, NULL, 0);
+    ex->last_location = shmat(ex->shm_id_dfg_last, NULL, 0);
 
-  sprintf(tmp, "%s (%0.02f%%)", DI(queued_with_cov),
-          ((double)queued_with_cov) * 100 / queued_paths);
+    if (ex->trace_bits == (void*)-1 || ex->dfg_bits == (void*)-1 ||
+        ex->last_location == (void*)-1) PFATAL("shmat() failed");
 
-  SAYF("  new edges on : " cRST "%-22s " bSTG bV "\n", tmp);
+#ifdef HAVE_AFFINITY
 
-  sprintf(tmp, "%s (%s%s unique)", DI(total_crashes), DI(unique_crashes),
-          (unique_crashes >= KEEP_UNIQUE_CRASH) ? "+" : "");
+    /* With AFL_CPU_LIST, the fork server and the worker thread of the
+       executor inherit its CPU from us. */
 
-  if (crash_mode) {
+    if (cpu_list_len) {
 
-    SAYF(bV bSTOP " total execs : " cRST "%-21s " bSTG bV bSTOP
-         "   new crashes : %s%-22s " bSTG bV "\n", DI(total_execs),
-         unique_crashes ? cLRD : cRST, tmp);
+      s32 node = get_cpu_node(cpu_list[i % cpu_list_len]);
 
-  } else {
+      bind_cpu_slot(i);
+      shm_prefer_node(ex->trace_bits, MAP_SIZE, node);
+      shm_prefer_node(ex->dfg_bits, sizeof(u32) * DFG_MAP_SIZE, node);
 
-    SAYF(bV bSTOP " total execs : " cRST "%-21s " bSTG bV bSTOP
-         " total crashes : %s%-22s " bSTG bV "\n", DI(total_execs),
-         unique_crashes ? cLRD : cRST, tmp);
+    }
 
-  }
+#endif /* HAVE_AFFINITY */
 
-  /* Show a warning about slow execution. */
+    /* The fork server picks its maps up from the environment. */
 
-  if (avg_exec < 100) {
+    tmp = alloc_printf("%d", ex->shm_id);
+    setenv(SHM_ENV_VAR, tmp, 1);
+    ck_free(tmp);
 
-    sprintf(tmp, "%s/sec (%s)", DF(avg_exec), avg_exec < 20 ?
-            "zzzz..." : "slow!");
+    tmp = alloc_printf("%d", ex->shm_id_dfg);
+    setenv(SHM_ENV_VAR_DFG, tmp, 1);
+    ck_free(tmp);
 
-    SAYF(bV bSTOP "  exec speed : " cLRD "%-21s ", tmp);
+    tmp = alloc_printf("%d", ex->shm_id_dfg_last);
+    setenv(SHM_ENV_VAR_DFG_LAST, tmp, 1);
+    ck_free(tmp);
 
-  } else {
+    if (out_file) {
 
-    sprintf(tmp, "%s/sec", DF(avg_exec));
-    SAYF(bV bSTOP "  exec speed : " cRST "%-21s ", tmp);
+      ex->out_file = alloc_printf("%s.%u", abs_out, i + 1);
+      ex->argv     = pool_argv(argv, abs_out, ex->out_file);
+      ex->out_fd   = -1;
 
-  }
+    } else {
 
-  sprintf(tmp, "%s (%s%s unique)", DI(total_tmouts), DI(unique_tmouts),
-          (unique_hangs >= KEEP_UNIQUE_HANG) ? "+" : "");
+      tmp = alloc_printf("%s/.cur_input.%u", out_dir, i + 1);
 
-  SAYF (bSTG bV bSTOP "  total tmouts : " cRST "%-22s " bSTG bV "\n", tmp);
+      unlink(tmp); /* Ignore errors */
 
-  /* Aaaalmost there... hold on! */
+      ex->out_fd = open(tmp, O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (ex->out_fd < 0) PFATAL("Unable to create '%s'", tmp);
 
-  SAYF(bVR bH cCYA bSTOP " fuzzing strategy yields " bSTG bH10 bH bHT bH10
-       bH5 bHB bH bSTOP cCYA " path geometry " bSTG bH5 bH2 bH bVL "\n");
+      ck_free(tmp);
 
-  if (skip_deterministic) {
+      ex->argv = argv;
 
-    strcpy(tmp, "n/a, n/a, n/a");
+    }
 
-  } else {
+    pool_switch(ex);
+    init_forkserver(ex->argv);
+    pool_switch(ex);
 
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            DI(stage_finds[STAGE_FLIP1]), DI(stage_cycles[STAGE_FLIP1]),
-            DI(stage_finds[STAGE_FLIP2]), DI(stage_cycles[STAGE_FLIP2]),
-            DI(stage_finds[STAGE_FLIP4]), DI(stage_cycles[STAGE_FLIP4]));
+    /* Keep the other fork servers from inheriting our end of things. */
+
+    fcntl(ex->fsrv_ctl_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(ex->fsrv_st_fd, F_SETFD, FD_CLOEXEC);
+    if (ex->out_fd >= 0) fcntl(ex->out_fd, F_SETFD, FD_CLOEXEC);
+
+    pthread_cond_init(&ex->cond, NULL);
+
+    if (pthread_create(&ex->thread, NULL, pool_worker, ex))
+      PFATAL("pthread_create() failed");
 
   }
 
-  SAYF(bV bSTOP "   bit flips : " cRST "%-37s " bSTG bV bSTOP "    levels : "
-       cRST "%-10s " bSTG bV "\n", tmp, DI(max_depth));
+#ifdef HAVE_AFFINITY
+  if (cpu_list_len) bind_cpu_slot(-1);
+#endif /* HAVE_AFFINITY */
 
-  if (!skip_deterministic)
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            DI(stage_finds[STAGE_FLIP8]), DI(stage_cycles[STAGE_FLIP8]),
-            DI(stage_finds[STAGE_FLIP16]), DI(stage_cycles[STAGE_FLIP16]),
-            DI(stage_finds[STAGE_FLIP32]), DI(stage_cycles[STAGE_FLIP32]));
+  /* Back to the main maps, for fork servers started later on. */
 
-  SAYF(bV bSTOP "  byte flips : " cRST "%-37s " bSTG bV bSTOP "   pending : "
-       cRST "%-10s " bSTG bV "\n", tmp, DI(pending_not_fuzzed));
+  tmp = alloc_printf("%d", shm_id);
+  setenv(SHM_ENV_VAR, tmp, 1);
+  ck_free(tmp);
 
-  if (!skip_deterministic)
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            DI(stage_finds[STAGE_ARITH8]), DI(stage_cycles[STAGE_ARITH8]),
-            DI(stage_finds[STAGE_ARITH16]), DI(stage_cycles[STAGE_ARITH16]),
-            DI(stage_finds[STAGE_ARITH32]), DI(stage_cycles[STAGE_ARITH32]));
+  tmp = alloc_printf("%d", shm_id_dfg);
+  setenv(SHM_ENV_VAR_DFG, tmp, 1);
+  ck_free(tmp);
 
-  SAYF(bV bSTOP " arithmetics : " cRST "%-37s " bSTG bV bSTOP "  pend fav : "
-       cRST "%-10s " bSTG bV "\n", tmp, DI(pending_favored));
+  tmp = alloc_printf("%d", shm_id_dfg_last);
+  setenv(SHM_ENV_VAR_DFG_LAST, tmp, 1);
+  ck_free(tmp);
 
-  if (!skip_deterministic)
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            DI(stage_finds[STAGE_INTEREST8]), DI(stage_cycles[STAGE_INTEREST8]),
-            DI(stage_finds[STAGE_INTEREST16]), DI(stage_cycles[STAGE_INTEREST16]),
-            DI(stage_finds[STAGE_INTEREST32]), DI(stage_cycles[STAGE_INTEREST32]));
+  ck_free(abs_out);
+  free(cwd); /* not tracked */
 
-  SAYF(bV bSTOP "  known ints : " cRST "%-37s " bSTG bV bSTOP " own finds : "
-       cRST "%-10s " bSTG bV "\n", tmp, DI(queued_discovered));
+  OKF("Executor pool is up.");
 
-  if (!skip_deterministic)
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            DI(stage_finds[STAGE_EXTRAS_UO]), DI(stage_cycles[STAGE_EXTRAS_UO]),
-            DI(stage_finds[STAGE_EXTRAS_UI]), DI(stage_cycles[STAGE_EXTRAS_UI]),
-            DI(stage_finds[STAGE_EXTRAS_AO]), DI(stage_cycles[STAGE_EXTRAS_AO]));
+}
 
-  SAYF(bV bSTOP "  dictionary : " cRST "%-37s " bSTG bV bSTOP
-       "  imported : " cRST "%-10s " bSTG bV "\n", tmp,
-       sync_id ? DI(queued_imported) : (u8*)"n/a");
 
-  sprintf(tmp, "%s/%s, %s/%s",
-          DI(stage_finds[STAGE_HAVOC]), DI(stage_cycles[STAGE_HAVOC]),
-          DI(stage_finds[STAGE_SPLICE]), DI(stage_cycles[STAGE_SPLICE]));
+/* Wait for the job running on ex, if any. */
 
-  SAYF(bV bSTOP "       havoc : " cRST "%-37s " bSTG bV bSTOP, tmp);
+static void pool_wait(struct executor* ex) {
 
-  if (t_bytes) sprintf(tmp, "%0.02f%%", stab_ratio);
-    else strcpy(tmp, "n/a");
+  pthread_mutex_lock(&pool_lock);
+  while (ex->done != ex->started) pthread_cond_wait(&ex->cond, &pool_lock);
+  pthread_mutex_unlock(&pool_lock);
 
-  SAYF(" stability : %s%-10s " bSTG bV "\n", (stab_ratio < 85 && var_byte_count > 40)
-       ? cLRD : ((queued_variable && (!persistent_mode || var_byte_count > 20))
-       ? cMGN : cRST), tmp);
+}
 
-  if (!bytes_trim_out) {
 
-    sprintf(tmp, "n/a, ");
+/* Wait for every job and drop the results, when bailing out of a stage. */
 
-  } else {
+static void pool_drain(void) {
 
-    sprintf(tmp, "%0.02f%%/%s, ",
-            ((double)(bytes_trim_in - bytes_trim_out)) * 100 / bytes_trim_in,
-            DI(trim_execs));
+  u32 i;
 
+  for (i = 0; i < pool_size; i++) {
+    pool_wait(&pool[i]);
+    pool[i].pending = 0;
   }
 
-  if (!blocks_eff_total) {
+  pool_next = 0;
 
-    u8 tmp2[128];
+}
 
-    sprintf(tmp2, "n/a");
-    strcat(tmp, tmp2);
 
-  } else {
+/* Merge the result of the job that ran on ex, describing it as of when it
+   was generated. Returns 1 if the current entry should be abandoned, like
+   common_fuzz_stuff(). */
 
-    u8 tmp2[128];
+static u8 pool_merge(char** argv, struct executor* ex) {
 
-    sprintf(tmp2, "%0.02f%%",
-            ((double)(blocks_eff_total - blocks_eff_select)) * 100 /
-            blocks_eff_total);
+  s32 cur     = stage_cur;
+  u32 cur_val = stage_cur_val;
+  u8  ret;
 
-    strcat(tmp, tmp2);
+  pool_wait(ex);
+  ex->pending = 0;
 
-  }
+  if (stop_soon) return 1;
 
-  SAYF(bV bSTOP "        trim : " cRST "%-37s " bSTG bVR bH20 bH2 bH2 bRB "\n"
-       bLB bH30 bH20 bH2 bH bRB bSTOP cRST RESET_G1, tmp);
+  /* Let the other workers finish before reporting a failed exec: exit()
+     runs the atexit handlers. */
 
-  /* Provide some CPU utilization stats. */
+  if (ex->err_msg) {
 
-  if (cpu_core_count) {
+    pool_drain();
 
-    double cur_runnable = get_runnable_processes();
-    u32 cur_utilization = cur_runnable * 100 / cpu_core_count;
+    if (!ex->err_no) FATAL("Executor %u: %s", (u32)(ex - pool), ex->err_msg);
 
-    u8* cpu_color = cCYA;
+    errno = ex->err_no;
+    PFATAL("Executor %u: %s", (u32)(ex - pool), ex->err_msg);
 
-    /* If we could still run one or more processes, use green. */
+  }
 
-    if (cpu_core_count > 1 && cur_runnable + 1 <= cpu_core_count)
-      cpu_color = cLGN;
+  stage_cur     = ex->stage_cur;
+  stage_cur_val = ex->stage_cur_val;
 
-    /* If we're clearly oversubscribed, use red. */
+  init_mutation_vertical();
 
-    if (!no_cpu_meter_red && cur_utilization >= 150) cpu_color = cLRD;
+  pool_switch(ex);
 
-#ifdef HAVE_AFFINITY
+  total_execs++;
+  child_timed_out = ex->timed_out;
+  kill_signal     = ex->kill_signal;
+  trace_raw       = 1;
 
-    if (cpu_aff >= 0) {
+  if (!ex->timed_out && slowest_exec_ms < ex->exec_ms)
+    slowest_exec_ms = ex->exec_ms;
 
-      SAYF(SP10 cGRA "[cpu%03u:%s%3u%%" cGRA "]\r" cRST,
-           MIN(cpu_aff, 999), cpu_color,
-           MIN(cur_utilization, 999));
+  ret = common_fuzz_result(argv, ex->mem, ex->len, ex->fault);
 
-    } else {
+  pool_switch(ex);
 
-      SAYF(SP10 cGRA "   [cpu:%s%3u%%" cGRA "]\r" cRST,
-           cpu_color, MIN(cur_utilization, 999));
+  stage_cur     = cur;
+  stage_cur_val = cur_val;
 
-   }
+  if (!ret) log_mutator_selection(ex->mut_cnt, ex->loc_cnt, ex->loc_count);
 
-#else
+  return ret;
 
-    SAYF(SP10 cGRA "   [cpu:%s%3u%%" cGRA "]\r" cRST,
-         cpu_color, MIN(cur_utilization, 999));
+}
 
-#endif /* ^HAVE_AFFINITY */
 
-  } else SAYF("\r");
+/* Hand a havoc mutant to the next executor, merging the result of its
+   previous job first. Returns 1 if the current entry should be abandoned,
+   like common_fuzz_stuff(). */
 
-  /* Hallelujah! */
+static u8 pool_run(char** argv, u8* mem, u32 len, u32* mut_cnt,
+                   double* loc_cnt, u32 loc_count) {
 
-  fflush(0);
+  struct executor* ex = &pool[pool_next];
 
-}
+  if (ex->pending && pool_merge(argv, ex)) {
+    pool_drain();
+    return 1;
+  }
 
+  pool_next = (pool_next + 1) % pool_size;
 
-/* Display quick statistics at the end of processing the input directory,
-   plus a bunch of warnings. Some calibration stuff also ended up here,
-   along with several hardcoded constants. Maybe clean up eventually. */
+  if (post_handler) {
 
-static void show_init_stats(void) {
+    mem = post_handler(mem, &len);
+    if (!mem || !len) return 0;
 
-  struct queue_entry* q = queue;
-  u32 min_bits = 0, max_bits = 0;
-  u64 min_us = 0, max_us = 0;
-  u64 avg_us = 0;
-  u32 max_len = 0;
+  }
 
-  if (total_cal_cycles) avg_us = total_cal_us / total_cal_cycles;
+  if (len > ex->size) {
+    ex->mem  = ck_realloc(ex->mem, len);
+    ex->size = len;
+  }
 
-  while (q) {
+  memcpy(ex->mem, mem, len);
+  ex->len = len;
 
-    if (!min_us || q->exec_us < min_us) min_us = q->exec_us;
-    if (q->exec_us > max_us) max_us = q->exec_us;
+  memcpy(ex->mut_cnt, mut_cnt, sizeof(u32) * loc_count);
+  memcpy(ex->loc_cnt, loc_cnt, sizeof(double) * loc_count);
+  ex->loc_count = loc_count;
 
-    if (!min_bits || q->bitmap_size < min_bits) min_bits = q->bitmap_size;
-    if (q->bitmap_size > max_bits) max_bits = q->bitmap_size;
+  ex->stage_cur     = stage_cur;
+  ex->stage_cur_val = stage_cur_val;
+  ex->pending       = 1;
 
-    if (q->len > max_len) max_len = q->len;
+  pthread_mutex_lock(&pool_lock);
+  ex->started++;
+  pthread_cond_signal(&ex->cond);
+  pthread_mutex_unlock(&pool_lock);
 
-    q = q->next;
+  return 0;
 
-  }
+}
 
-  SAYF("\n");
 
-  if (avg_us > (qemu_mode ? 50000 : 10000))
-    WARNF(cLRD "The target binary is pretty slow! See %s/perf_tips.txt.",
-          doc_path);
+/* Merge the jobs still out, oldest first, at the end of a stage. Returns 1
+   if the current entry should be abandoned. */
 
-  /* Let's keep things moving with slow binaries. */
+static u8 pool_flush(char** argv) {
 
-  if (avg_us > 50000) havoc_div = 10;     /* 0-19 execs/sec   */
-  else if (avg_us > 20000) havoc_div = 5; /* 20-49 execs/sec  */
-  else if (avg_us > 10000) havoc_div = 2; /* 50-100 execs/sec */
+  u32 i;
+
+  for (i = 0; i < pool_size; i++) {
+
+    struct executor* ex = &pool[(pool_next + i) % pool_size];
+
+    if (ex->pending && pool_merge(argv, ex)) {
+      pool_drain();
+      return 1;
+    }
 
-  if (!resuming_fuzz) {
+  }
 
-    if (max_len > 50 * 1024)
-      WARNF(cLRD "Some test cases are huge (%s) - see %s/perf_tips.txt!",
-            DMS(max_len), doc_path);
-    else if (max_len > 10 * 1024)
-      WARNF("Some test cases are big (%s) - see %s/perf_tips.txt.",
-            DMS(max_len), doc_path);
+  pool_next = 0;
 
-    if (useless_at_start && !in_bitmap)
-      WARNF(cLRD "Some test cases look useless. Consider using a smaller set.");
+  return 0;
 
-    if (queued_paths > 100)
-      WARNF(cLRD "You probably have far too many input files! Consider trimming down.");
-    else if (queued_paths > 20)
-      WARNF("You have lots of input files; try starting small.");
+}
 
-  }
 
-  OKF("Here are some useful stats:\n\n"
+/* Take the current entry from the queue, fuzz it for a while. This
+   function is a tad too long... returns 0 if fuzzed successfully, 1 if
+   skipped or bailed out. */
 
-      cGRA "    Test case count : " cRST "%u favored, %u variable, %u total\n"
-      cGRA "       Bitmap range : " cRST "%u to %u bits (average: %0.02f bits)\n"
-      cGRA "        Exec timing : " cRST "%s to %s us (average: %s us)\n",
-      queued_favored, queued_variable, queued_paths, min_bits, max_bits,
-      ((double)total_bitmap_size) / (total_bitmap_entries ? total_bitmap_entries : 1),
-      DI(min_us), DI(max_us), DI(avg_us));
+static u8 fuzz_one_vertical(char** argv) {
 
-  if (!timeout_given) {
+  s32 len, temp_len, i, j;
+  u8  *in_buf, *out_buf, *orig_in, *ex_tmp, *eff_map = 0, *spare_buf = 0;
+  u64 havoc_queued,  orig_hit_cnt, new_hit_cnt;
+  u32 splice_cycle = 0, perf_score = 100, orig_perf, prev_cksum, eff_cnt = 1;
+  double factor;                      /* Proximity factor of this stage   */
 
-    /* Figure out the appropriate timeout. The basic idea is: 5x average or
-       1x max, rounded up to EXEC_TM_ROUND ms and capped at 1 second.
+  struct queue_entry* target; // Target test case to splice with.
 
-       If the program is slow, the multiplier is lowered to 2x or 3x, because
-       random scheduler jitter is less likely to have any impact, and because
-       our patience is wearing thin =) */
+  u8  ret_val = 1, doing_det = 0;
 
-    if (avg_us > 50000) exec_tmout = avg_us * 2 / 1000;
-    else if (avg_us > 10000) exec_tmout = avg_us * 3 / 1000;
-    else exec_tmout = avg_us * 5 / 1000;
+  u8  a_collect[MAX_AUTO_EXTRA];
+  u32 a_len = 0;
 
-    exec_tmout = MAX(exec_tmout, max_us / 1000);
-    exec_tmout = (exec_tmout + EXEC_TM_ROUND) / EXEC_TM_ROUND * EXEC_TM_ROUND;
+#ifdef IGNORE_FINDS
 
-    if (exec_tmout > EXEC_TIMEOUT) exec_tmout = EXEC_TIMEOUT;
+  /* In IGNORE_FINDS mode, skip any entries that weren't in the
+     initial data set. */
 
-    ACTF("No -t option specified, so I'll use exec timeout of %u ms.",
-         exec_tmout);
+  if (queue_cur->depth > 1) return 1;
 
-    timeout_given = 1;
+#else
 
-  } else if (timeout_given == 3) {
+  if (pending_favored) {
 
-    ACTF("Applying timeout settings from resumed session (%u ms).", exec_tmout);
+    /* If we have any favored, non-fuzzed new arrivals in the queue,
+       possibly skip to them at the expense of already-fuzzed or non-favored
+       cases. */
 
-  }
+    if ((queue_cur->was_fuzzed || !queue_cur->favored) &&
+        UR(100) < SKIP_TO_NEW_PROB) return 1;
 
-  /* In dumb mode, re-running every timing out test case with a generous time
-     limit is very expensive, so let's select a more conservative default. */
+  } else if (!dumb_mode && !queue_cur->favored && queued_paths > 10) {
 
-  if (dumb_mode && !getenv("AFL_HANG_TMOUT"))
-    hang_tmout = MIN(EXEC_TIMEOUT, exec_tmout * 2 + 100);
+    /* Otherwise, still possibly skip non-favored cases, albeit less often.
+       The odds of skipping stuff are higher for already-fuzzed inputs and
+       lower for never-fuzzed entries. */
 
-  OKF("All set and ready to roll!");
+    if (queue_cycle > 1 && !queue_cur->was_fuzzed) {
 
-}
+      if (UR(100) < SKIP_NFAV_NEW_PROB) return 1;
 
+    } else {
 
-/* Find first power of two greater or equal to val (assuming val under
-   2^31). */
+      if (UR(100) < SKIP_NFAV_OLD_PROB) return 1;
 
-static u32 next_p2(u32 val) {
+    }
 
-  u32 ret = 1;
-  while (val > ret) ret <<= 1;
-  return ret;
+  }
 
-}
+#endif /* ^IGNORE_FINDS */
 
+  if (not_on_tty) {
+    ACTF("Fuzzing test case #%u (%u total, %llu uniq crashes found)...",
+         current_entry, queued_paths, unique_crashes);
+    fflush(stdout);
+  }
 
-/* Trim all new test cases to save cycles when doing deterministic checks. The
-   trimmer uses power-of-two increments somewhere between 1/16 and 1/1024 of
-   file size, to keep the stage short and sweet. */
+  /* Map the test case into memory. */
 
-static u8 trim_case(char** argv, struct queue_entry* q, u8* in_buf) {
+  len = queue_cur->len;
 
-  static u8 tmp[64];
-  static u8 clean_trace[MAP_SIZE];
+  orig_in = in_buf = seed_cache_get(queue_cur);
 
-  u8  needs_write = 0, fault = 0;
-  u32 trim_exec = 0;
-  u32 remove_len;
-  u32 len_p2;
+  /* We could mmap() out_buf as MAP_PRIVATE, but we end up clobbering every
+     single byte anyway, so it wouldn't give us any performance or memory usage
+     benefits. */
 
-  /* Although the trimmer will be less useful when variable behavior is
-     detected, it will still work to some extent, so we don't check for
-     this. */
+  out_buf = ck_alloc_nozero(len);
 
-  if (q->len < 5) return 0;
+  subseq_tmouts = 0;
 
-  stage_name = tmp;
-  bytes_trim_in += q->len;
+  cur_depth = queue_cur->depth;
 
-  /* Select initial chunk len, starting with large steps. */
+  /*******************************************
+   * CALIBRATION (only if failed earlier on) *
+   *******************************************/
 
-  len_p2 = next_p2(q->len);
+  if (queue_cur->cal_failed) {
 
-  remove_len = MAX(len_p2 / TRIM_START_STEPS, TRIM_MIN_BYTES);
+    u8 res = FAULT_TMOUT;
 
-  /* Continue until the number of steps gets too high or the stepover
-     gets too small. */
+    if (queue_cur->cal_failed < CAL_CHANCES) {
 
-  while (remove_len >= MAX(len_p2 / TRIM_END_STEPS, TRIM_MIN_BYTES)) {
+      /* Reset exec_cksum to tell calibrate_case to re-execute the testcase
+         avoiding the usage of an invalid trace_bits.
+         For more info: https://github.com/AFLplusplus/AFLplusplus/pull/425 */
 
-    u32 remove_pos = remove_len;
+      queue_cur->exec_cksum = 0;
 
-    sprintf(tmp, "trim %s/%s", DI(remove_len), DI(remove_len));
+      res = calibrate_case(argv, queue_cur, in_buf, queue_cycle - 1, 0);
 
-    stage_cur = 0;
-    stage_max = q->len / remove_len;
+      if (res == FAULT_ERROR)
+        FATAL("Unable to execute target application");
 
-    while (remove_pos < q->len) {
+    }
 
-      u32 trim_avail = MIN(remove_len, q->len - remove_pos);
-      u32 cksum;
+    if (stop_soon || check_res(res)) {
+      cur_skipped_paths++;
+      goto abandon_entry;
+    }
 
-      write_with_gap(in_buf, q->len, remove_pos, trim_avail);
+  }
 
-      fault = run_target(argv, exec_tmout, "USELESS=0", 0);
-      trim_execs++;
+  /************
+   * TRIMMING *
+   ************/
 
-      if (stop_soon || fault == FAULT_ERROR) goto abort_trimming;
+  if (!dumb_mode && !queue_cur->trim_done) {
 
-      /* Note that we don't keep track of crashes or hangs here; maybe TODO? */
+    u8 res = trim_case(argv, queue_cur, in_buf);
 
-      cksum = hash32(trace_bits, MAP_SIZE, HASH_CONST);
+    if (res == FAULT_ERROR)
+      FATAL("Unable to execute target application");
 
-      /* If the deletion had no impact on the trace, make it permanent. This
-         isn't perfect for variable-path inputs, but we're just making a
-         best-effort pass, so it's not a big deal if we end up with false
-         negatives every now and then. */
+    if (stop_soon) {
+      cur_skipped_paths++;
+      goto abandon_entry;
+    }
 
-      if (cksum == q->exec_cksum) {
+    /* Don't retry trimming, even if it failed. */
 
-        u32 move_tail = q->len - remove_pos - trim_avail;
+    queue_cur->trim_done = 1;
 
-        q->len -= trim_avail;
-        len_p2  = next_p2(q->len);
+    if (len != queue_cur->len) len = queue_cur->len;
 
-        memmove(in_buf + remove_pos, in_buf + remove_pos + trim_avail,
-                move_tail);
+  }
 
-        /* Let's save a clean trace, which will be needed by
-           update_bitmap_score once we're done with the trimming stuff. */
+  memcpy(out_buf, in_buf, len);
 
-        if (!needs_write) {
+  /*********************
+   * PERFORMANCE SCORE *
+   *********************/
 
-          needs_write = 1;
-          memcpy(clean_trace, trace_bits, MAP_SIZE);
+  orig_perf = perf_score = calculate_score(queue_cur);
 
-        }
+  /* Skip right away if -d is given, if we have done deterministic fuzzing on
+     this entry ourselves (was_fuzzed), or if it has gone through deterministic
+     testing in earlier, resumed runs (passed_det). */
 
-      } else remove_pos += remove_len;
+  if (skip_deterministic || queue_cur->was_fuzzed || queue_cur->passed_det)
+    goto havoc_stage;
 
-      /* Since this can be slow, update the screen every now and then. */
+  /* Skip deterministic fuzzing if exec path checksum puts this out of scope
+     for this master instance. */
 
-      if (!(trim_exec++ % stats_update_freq)) show_stats();
-      stage_cur++;
+  if (master_max && (queue_cur->exec_cksum % master_max) != master_id - 1)
+    goto havoc_stage;
 
-    }
+  doing_det = 1;
 
-    remove_len >>= 1;
+  /*********************************************
+   * SIMPLE BITFLIP (+dictionary construction) *
+   *********************************************/
 
-  }
+#define FLIP_BIT(_ar, _b) do { \
+    u8* _arf = (u8*)(_ar); \
+    u32 _bf = (_b); \
+    _arf[(_bf) >> 3] ^= (128 >> ((_bf) & 7)); \
+  } while (0)
 
-  /* If we have made changes to in_buf, we also need to update the on-disk
-     version of the test case. */
+  /* Single walking bit. */
 
-  if (needs_write) {
+  stage_short = "flip1";
+  stage_max   = len << 3;
+  stage_name  = "bitflip 1/1";
 
-    s32 fd;
+  stage_val_type = STAGE_VAL_NONE;
 
-    unlink(q->fname); /* ignore errors */
+  orig_hit_cnt = queued_paths + unique_crashes;
 
-    fd = open(q->fname, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  prev_cksum = queue_cur->exec_cksum;
 
-    if (fd < 0) PFATAL("Unable to create '%s'", q->fname);
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-    ck_write(fd, in_buf, q->len, q->fname);
-    close(fd);
+    stage_cur_byte = stage_cur >> 3;
 
-    memcpy(trace_bits, clean_trace, MAP_SIZE);
-    update_bitmap_score(q);
+    FLIP_BIT(out_buf, stage_cur);
+    init_mutation_vertical();
 
-  }
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-abort_trimming:
+    log_single_mutator_selection(0, (double)stage_cur / (double)stage_max);
+    FLIP_BIT(out_buf, stage_cur);
 
-  bytes_trim_out += q->len;
-  return fault;
+    /* While flipping the least significant bit in every byte, pull of an extra
+       trick to detect possible syntax tokens. In essence, the idea is that if
+       you have a binary blob like this:
 
-}
+       xxxxxxxxIHDRxxxxxxxx
+
+       ...and changing the leading and trailing bytes causes variable or no
+       changes in program flow, but touching any character in the "IHDR" string
+       always produces the same, distinctive path, it's highly likely that
+       "IHDR" is an atomically-checked magic value of special significance to
+       the fuzzed format.
 
+       We do this here, rather than as a separate stage, because it's a nice
+       way to keep the operation approximately "free" (i.e., no extra execs).
 
-/* Write a modified test case, run program, process results. Handle
-   error conditions, returning 1 if it's time to bail out. This is
-   a helper function for fuzz_one(). */
+       Empirically, performing the check when flipping the least significant bit
+       is advantageous, compared to doing it at the time of more disruptive
+       changes, where the program flow may be affected in more violent ways.
 
-EXP_ST u8 common_fuzz_stuff(char** argv, u8* out_buf, u32 len) {
+       The caveat is that we won't generate dictionaries in the -d mode or -S
+       mode - but that's probably a fair trade-off.
 
-  u8 fault;
+       This won't work particularly well with paths that exhibit variable
+       behavior, but fails gracefully, so we'll carry out the checks anyway.
 
-  if (post_handler) {
+      */
 
-    out_buf = post_handler(out_buf, &len);
-    if (!out_buf || !len) return 0;
+    if (!dumb_mode && (stage_cur & 7) == 7) {
 
-  }
+      u32 cksum = hash32(trace_bits, map_size, HASH_CONST);
 
-  write_to_testcase(out_buf, len);
+      if (stage_cur == stage_max - 1 && cksum == prev_cksum) {
 
-  fault = run_target(argv, exec_tmout, "USELESS=0", 0);
+        /* If at end of file and we are still collecting a string, grab the
+           final character and force output. */
 
-  if (stop_soon) return 1;
+        if (a_len < MAX_AUTO_EXTRA) a_collect[a_len] = out_buf[stage_cur >> 3];
+        a_len++;
 
-  if (fault == FAULT_TMOUT) {
+        if (a_len >= MIN_AUTO_EXTRA && a_len <= MAX_AUTO_EXTRA)
+          maybe_add_auto(a_collect, a_len);
 
-    if (subseq_tmouts++ > TMOUT_LIMIT) {
-      cur_skipped_paths++;
-      return 1;
-    }
+      } else if (cksum != prev_cksum) {
 
-  } else subseq_tmouts = 0;
+        /* Otherwise, if the checksum has changed, see if we have something
+           worthwhile queued up, and collect that if the answer is yes. */
 
-  /* Users can hit us with SIGUSR1 to request the current input
-     to be abandoned. */
+        if (a_len >= MIN_AUTO_EXTRA && a_len <= MAX_AUTO_EXTRA)
+          maybe_add_auto(a_collect, a_len);
 
-  if (skip_requested) {
+        a_len = 0;
+        prev_cksum = cksum;
 
-     skip_requested = 0;
-     cur_skipped_paths++;
-     return 1;
+      }
 
-  }
+      /* Continue collecting string, but only if the bit flip actually made
+         any difference - we don't want no-op tokens. */
 
-  /* This handles FAULT_ERROR for us: */
+      if (cksum != queue_cur->exec_cksum) {
 
-  queued_discovered += save_if_interesting(argv, out_buf, len, fault);
+        if (a_len < MAX_AUTO_EXTRA) a_collect[a_len] = out_buf[stage_cur >> 3];
+        a_len++;
 
-  if (!(stage_cur % stats_update_freq) || stage_cur + 1 == stage_max)
-    show_stats();
+      }
 
-  return 0;
+    }
 
-}
+  }
 
+  new_hit_cnt = queued_paths + unique_crashes;
 
-/* Helper to choose random block len for block operations in fuzz_one().
-   Doesn't return zero, provided that max_len is > 0. */
+  stage_finds[STAGE_FLIP1]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP1] += stage_max;
 
-static u32 choose_block_len(u32 limit) {
+  /* Two walking bits. */
 
-  u32 min_value, max_value;
-  u32 rlim = MIN(queue_cycle, 3);
+  stage_name  = "bitflip 2/1";
+  stage_short = "flip2";
+  stage_max   = (len << 3) - 1;
 
-  if (!run_over10m) rlim = 1;
+  orig_hit_cnt = new_hit_cnt;
 
-  switch (UR(rlim)) {
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-    case 0:  min_value = 1;
-             max_value = HAVOC_BLK_SMALL;
-             break;
+    stage_cur_byte = stage_cur >> 3;
 
-    case 1:  min_value = HAVOC_BLK_SMALL;
-             max_value = HAVOC_BLK_MEDIUM;
-             break;
+    FLIP_BIT(out_buf, stage_cur);
+    FLIP_BIT(out_buf, stage_cur + 1);
+    init_mutation_vertical();
 
-    default:
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-             if (UR(10)) {
+    log_single_mutator_selection(1, (double)stage_cur / (double)stage_max);
+    FLIP_BIT(out_buf, stage_cur);
+    FLIP_BIT(out_buf, stage_cur + 1);
 
-               min_value = HAVOC_BLK_MEDIUM;
-               max_value = HAVOC_BLK_LARGE;
+  }
 
-             } else {
+  new_hit_cnt = queued_paths + unique_crashes;
 
-               min_value = HAVOC_BLK_LARGE;
-               max_value = HAVOC_BLK_XL;
+  stage_finds[STAGE_FLIP2]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP2] += stage_max;
 
-             }
+  /* Four walking bits. */
 
-  }
+  stage_name  = "bitflip 4/1";
+  stage_short = "flip4";
+  stage_max   = (len << 3) - 3;
 
-  if (min_value >= limit) min_value = 1;
+  orig_hit_cnt = new_hit_cnt;
 
-  return min_value + UR(MIN(max_value, limit) - min_value + 1);
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-}
+    stage_cur_byte = stage_cur >> 3;
 
-/* Calculate the factor to multiply to the performance score. This is derived
- * from the proximity scores of the DFG nodes covered by the test case. */
-static double calculate_factor(double prox_score) {
+    FLIP_BIT(out_buf, stage_cur);
+    FLIP_BIT(out_buf, stage_cur + 1);
+    FLIP_BIT(out_buf, stage_cur + 2);
+    FLIP_BIT(out_buf, stage_cur + 3);
+    init_mutation_vertical();
 
-  SAYF("[cal-factor] [prox %lf] [avg %lf] [min %lf] [max %lf]\n",
-       prox_score, avg_prox_score.adjusted, min_prox_score.adjusted, max_prox_score.adjusted);
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-  double factor;
-  double normalized_prox_score, progress_to_tx, T, p;
-  u64 cur_ms, t;
+    log_single_mutator_selection(2, (double)stage_cur / (double)stage_max);
+    FLIP_BIT(out_buf, stage_cur);
+    FLIP_BIT(out_buf, stage_cur + 1);
+    FLIP_BIT(out_buf, stage_cur + 2);
+    FLIP_BIT(out_buf, stage_cur + 3);
 
-  if (t_x) { // AFLGo's seed scheduling strategy.
-    // min_prox_score == max_prox_score
-    if (compare_proximity_score(&min_prox_score, &max_prox_score) == 0) normalized_prox_score = 0.5;
-    else normalized_prox_score = (double) (prox_score - min_prox_score.adjusted) /
-                                 (double) (max_prox_score.adjusted - min_prox_score.adjusted);
-    cur_ms = get_cur_time();
-    t = (cur_ms - start_time) / 1000;
-    progress_to_tx = ((double) t) / ((double) t_x * 60.0);
-    T = 1.0 / pow(20.0, progress_to_tx);
-    p = normalized_prox_score * (1.0 - T) + 0.5 * T;
-    factor = pow(2.0, 5.0 * 2.0 * (p - 0.5)); // Note log2(MAX_FACTOR) = 5.0
   }
-  else if (no_dfg_schedule || !total_prox_cnt) factor = 1.0; // No factor.
-  else factor = (prox_score) / ((double) total_prox_original / (double) total_prox_cnt); // Default.
 
-  if (factor < 1 / 16) factor = 1 / 16;
-  if (factor > 16) factor = 16.0;
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  return factor;
+  stage_finds[STAGE_FLIP4]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP4] += stage_max;
 
-}
+  /* Effector map setup. These macros calculate:
 
-/* Calculate case desirability score to adjust the length of havoc fuzzing.
-   A helper function for fuzz_one(). Maybe some of these constants should
-   go into config.h. */
+     EFF_APOS      - position of a particular file offset in the map.
+     EFF_ALEN      - length of a map with a particular number of bytes.
+     EFF_SPAN_ALEN - map span for a sequence of bytes.
 
-static u32 calculate_score(struct queue_entry* q) {
+   */
 
-  u32 avg_exec_us = total_cal_us / total_cal_cycles;
-  u32 avg_bitmap_size = total_bitmap_size / total_bitmap_entries;
-  u32 perf_score = 100;
+#define EFF_APOS(_p)          ((_p) >> EFF_MAP_SCALE2)
+#define EFF_REM(_x)           ((_x) & ((1 << EFF_MAP_SCALE2) - 1))
+#define EFF_ALEN(_l)          (EFF_APOS(_l) + !!EFF_REM(_l))
+#define EFF_SPAN_ALEN(_p, _l) (EFF_APOS((_p) + (_l) - 1) - EFF_APOS(_p) + 1)
 
-  /* Adjust score based on execution speed of this path, compared to the
-     global average. Multiplier ranges from 0.1x to 3x. Fast inputs are
-     less expensive to fuzz, so we're giving them more air time. */
+  /* Initialize effector map for the next step (see comments below). Always
+     flag first and last byte as doing something. */
 
-  if (q->exec_us * 0.1 > avg_exec_us) perf_score = 10;
-  else if (q->exec_us * 0.25 > avg_exec_us) perf_score = 25;
-  else if (q->exec_us * 0.5 > avg_exec_us) perf_score = 50;
-  else if (q->exec_us * 0.75 > avg_exec_us) perf_score = 75;
-  else if (q->exec_us * 4 < avg_exec_us) perf_score = 300;
-  else if (q->exec_us * 3 < avg_exec_us) perf_score = 200;
-  else if (q->exec_us * 2 < avg_exec_us) perf_score = 150;
+  eff_map    = ck_alloc(EFF_ALEN(len));
+  eff_map[0] = 1;
 
-  /* Adjust score based on bitmap size. The working theory is that better
-     coverage translates to better targets. Multiplier from 0.25x to 3x. */
+  if (EFF_APOS(len - 1) != 0) {
+    eff_map[EFF_APOS(len - 1)] = 1;
+    eff_cnt++;
+  }
 
-  if (q->bitmap_size * 0.3 > avg_bitmap_size) perf_score *= 3;
-  else if (q->bitmap_size * 0.5 > avg_bitmap_size) perf_score *= 2;
-  else if (q->bitmap_size * 0.75 > avg_bitmap_size) perf_score *= 1.5;
-  else if (q->bitmap_size * 3 < avg_bitmap_size) perf_score *= 0.25;
-  else if (q->bitmap_size * 2 < avg_bitmap_size) perf_score *= 0.5;
-  else if (q->bitmap_size * 1.5 < avg_bitmap_size) perf_score *= 0.75;
+  /* Walking byte. */
 
-  /* Adjust score based on handicap. Handicap is proportional to how late
-     in the game we learned about this path. Latecomers are allowed to run
-     for a bit longer until they catch up with the rest. */
+  stage_name  = "bitflip 8/8";
+  stage_short = "flip8";
+  stage_max   = len;
 
-  if (q->handicap >= 4) {
+  orig_hit_cnt = new_hit_cnt;
 
-    perf_score *= 4;
-    q->handicap -= 4;
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-  } else if (q->handicap) {
+    stage_cur_byte = stage_cur;
 
-    perf_score *= 2;
-    q->handicap--;
+    out_buf[stage_cur] ^= 0xFF;
+    init_mutation_vertical();
 
-  }
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    log_single_mutator_selection(3, (double)stage_cur / (double)stage_max);
 
-  /* Final adjustment based on input depth, under the assumption that fuzzing
-     deeper test cases is more likely to reveal stuff that can't be
-     discovered with traditional fuzzers. */
+    /* We also use this stage to pull off a simple trick: we identify
+       bytes that seem to have no effect on the current execution path
+       even when fully flipped - and we skip them during more expensive
+       deterministic stages, such as arithmetics or known ints. */
 
-  switch (q->depth) {
+    if (!eff_map[EFF_APOS(stage_cur)]) {
 
-    case 0 ... 3:   break;
-    case 4 ... 7:   perf_score *= 2; break;
-    case 8 ... 13:  perf_score *= 3; break;
-    case 14 ... 25: perf_score *= 4; break;
-    default:        perf_score *= 5;
+      u32 cksum;
 
-  }
+      /* If in dumb mode or if the file is very short, just flag everything
+         without wasting time on checksums. */
 
-  /* Make sure that we don't go over limit. */
+      if (!dumb_mode && len >= EFF_MIN_LEN)
+        cksum = hash32(trace_bits, map_size, HASH_CONST);
+      else
+        cksum = ~queue_cur->exec_cksum;
 
-  if (perf_score > HAVOC_MAX_MULT * 100) perf_score = HAVOC_MAX_MULT * 100;
+      if (cksum != queue_cur->exec_cksum) {
+        eff_map[EFF_APOS(stage_cur)] = 1;
+        eff_cnt++;
+      }
 
-  return perf_score;
+    }
 
-}
+    out_buf[stage_cur] ^= 0xFF;
 
+  }
 
-/* Helper function to see if a particular change (xor_val = old ^ new) could
-   be a product of deterministic bit flips with the lengths and stepovers
-   attempted by afl-fuzz. This is used to avoid dupes in some of the
-   deterministic fuzzing operations that follow bit flips. We also
-   return 1 if xor_val is zero, which implies that the old and attempted new
-   values are identical and the exec would be a waste of time. */
+  /* If the effector map is more than EFF_MAX_PERC dense, just flag the
+     whole thing as worth fuzzing, since we wouldn't be saving much time
+     anyway. */
+
+  if (eff_cnt != EFF_ALEN(len) &&
+      eff_cnt * 100 / EFF_ALEN(len) > EFF_MAX_PERC) {
 
-static u8 could_be_bitflip(u32 xor_val) {
+    memset(eff_map, 1, EFF_ALEN(len));
 
-  u32 sh = 0;
+    blocks_eff_select += EFF_ALEN(len);
 
-  if (!xor_val) return 1;
+  } else {
 
-  /* Shift left until first bit set. */
+    blocks_eff_select += eff_cnt;
 
-  while (!(xor_val & 1)) { sh++; xor_val >>= 1; }
+  }
 
-  /* 1-, 2-, and 4-bit patterns are OK anywhere. */
+  blocks_eff_total += EFF_ALEN(len);
 
-  if (xor_val == 1 || xor_val == 3 || xor_val == 15) return 1;
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  /* 8-, 16-, and 32-bit patterns are OK only if shift factor is
-     divisible by 8, since that's the stepover for these ops. */
+  stage_finds[STAGE_FLIP8]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP8] += stage_max;
 
-  if (sh & 7) return 0;
+  /* Two walking bytes. */
 
-  if (xor_val == 0xff || xor_val == 0xffff || xor_val == 0xffffffff)
-    return 1;
+  if (len < 2) goto skip_bitflip;
 
-  return 0;
+  stage_name  = "bitflip 16/8";
+  stage_short = "flip16";
+  stage_cur   = 0;
+  stage_max   = len - 1;
 
-}
+  orig_hit_cnt = new_hit_cnt;
 
+  for (i = 0; i < len - 1; i++) {
 
-/* Helper function to see if a particular value is reachable through
-   arithmetic operations. Used for similar purposes. */
+    /* Let's consult the effector map... */
 
-static u8 could_be_arith(u32 old_val, u32 new_val, u8 blen) {
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
+      stage_max--;
+      continue;
+    }
 
-  u32 i, ov = 0, nv = 0, diffs = 0;
+    stage_cur_byte = i;
 
-  if (old_val == new_val) return 1;
+    *(u16*)(out_buf + i) ^= 0xFFFF;
+    init_mutation_vertical();
 
-  /* See if one-byte adjustments to any byte could produce this result. */
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-  for (i = 0; i < blen; i++) {
+    log_single_mutator_selection(4, (double)i / (double)(len - 1));
+    stage_cur++;
 
-    u8 a = old_val >> (8 * i),
-       b = new_val >> (8 * i);
+    *(u16*)(out_buf + i) ^= 0xFFFF;
 
-    if (a != b) { diffs++; ov = a; nv = b; }
 
   }
 
-  /* If only one byte differs and the values are within range, return 1. */
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  if (diffs == 1) {
+  stage_finds[STAGE_FLIP16]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP16] += stage_max;
 
-    if ((u8)(ov - nv) <= ARITH_MAX ||
-        (u8)(nv - ov) <= ARITH_MAX) return 1;
+  if (len < 4) goto skip_bitflip;
 
-  }
+  /* Four walking bytes. */
 
-  if (blen == 1) return 0;
+  stage_name  = "bitflip 32/8";
+  stage_short = "flip32";
+  stage_cur   = 0;
+  stage_max   = len - 3;
 
-  /* See if two-byte adjustments to any byte would produce this result. */
+  orig_hit_cnt = new_hit_cnt;
 
-  diffs = 0;
+  for (i = 0; i < len - 3; i++) {
 
-  for (i = 0; i < blen / 2; i++) {
+    /* Let's consult the effector map... */
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
+        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
+      stage_max--;
+      continue;
+    }
 
-    u16 a = old_val >> (16 * i),
-        b = new_val >> (16 * i);
+    stage_cur_byte = i;
 
-    if (a != b) { diffs++; ov = a; nv = b; }
+    *(u32*)(out_buf + i) ^= 0xFFFFFFFF;
+    init_mutation_vertical();
+
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    log_single_mutator_selection(5, (double)i / (double)(len - 3));
+    stage_cur++;
+
+    *(u32*)(out_buf + i) ^= 0xFFFFFFFF;
 
   }
 
-  /* If only one word differs and the values are within range, return 1. */
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  if (diffs == 1) {
+  stage_finds[STAGE_FLIP32]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP32] += stage_max;
 
-    if ((u16)(ov - nv) <= ARITH_MAX ||
-        (u16)(nv - ov) <= ARITH_MAX) return 1;
+skip_bitflip:
 
-    ov = SWAP16(ov); nv = SWAP16(nv);
+  if (no_arith) goto skip_arith;
 
-    if ((u16)(ov - nv) <= ARITH_MAX ||
-        (u16)(nv - ov) <= ARITH_MAX) return 1;
+  /**********************
+   * ARITHMETIC INC/DEC *
+   **********************/
 
-  }
+  /* 8-bit arithmetics. */
 
-  /* Finally, let's do the same thing for dwords. */
+  stage_name  = "arith 8/8";
+  stage_short = "arith8";
+  stage_cur   = 0;
+  stage_max   = 2 * len * ARITH_MAX;
 
-  if (blen == 4) {
+  stage_val_type = STAGE_VAL_LE;
 
-    if ((u32)(old_val - new_val) <= ARITH_MAX ||
-        (u32)(new_val - old_val) <= ARITH_MAX) return 1;
+  orig_hit_cnt = new_hit_cnt;
 
-    new_val = SWAP32(new_val);
-    old_val = SWAP32(old_val);
+  for (i = 0; i < len; i++) {
 
-    if ((u32)(old_val - new_val) <= ARITH_MAX ||
-        (u32)(new_val - old_val) <= ARITH_MAX) return 1;
+    u8 orig = out_buf[i];
 
-  }
+    /* Let's consult the effector map... */
 
-  return 0;
+    if (!eff_map[EFF_APOS(i)]) {
+      stage_max -= 2 * ARITH_MAX;
+      continue;
+    }
 
-}
+    stage_cur_byte = i;
 
+    for (j = 1; j <= ARITH_MAX; j++) {
 
-/* Last but not least, a similar helper to see if insertion of an
-   interesting integer is redundant given the insertions done for
-   shorter blen. The last param (check_le) is set if the caller
-   already executed LE insertion for current blen and wants to see
-   if BE variant passed in new_val is unique. */
+      u8 r = orig ^ (orig + j);
 
-static u8 could_be_interest(u32 old_val, u32 new_val, u8 blen, u8 check_le) {
+      /* Do arithmetic operations only if the result couldn't be a product
+         of a bitflip. */
 
-  u32 i, j;
+      if (!could_be_bitflip(r)) {
 
-  if (old_val == new_val) return 1;
+        stage_cur_val = j;
+        out_buf[i] = orig + j;
+        init_mutation_vertical();
 
-  /* See if one-byte insertions from interesting_8 over old_val could
-     produce new_val. */
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(6, (double)i / (double)len);
+        stage_cur++;
 
-  for (i = 0; i < blen; i++) {
+      } else stage_max--;
 
-    for (j = 0; j < sizeof(interesting_8); j++) {
+      r =  orig ^ (orig - j);
 
-      u32 tval = (old_val & ~(0xff << (i * 8))) |
-                 (((u8)interesting_8[j]) << (i * 8));
+      if (!could_be_bitflip(r)) {
 
-      if (new_val == tval) return 1;
+        stage_cur_val = -j;
+        out_buf[i] = orig - j;
+        init_mutation_vertical();
 
-    }
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(6, (double)i / (double)len);
+        stage_cur++;
 
-  }
+      } else stage_max--;
 
-  /* Bail out unless we're also asked to examine two-byte LE insertions
-     as a preparation for BE attempts. */
+      out_buf[i] = orig;
 
-  if (blen == 2 && !check_le) return 0;
+    }
 
-  /* See if two-byte insertions over old_val could give us new_val. */
+  }
 
-  for (i = 0; i < blen - 1; i++) {
+  new_hit_cnt = queued_paths + unique_crashes;
 
-    for (j = 0; j < sizeof(interesting_16) / 2; j++) {
+  stage_finds[STAGE_ARITH8]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_ARITH8] += stage_max;
 
-      u32 tval = (old_val & ~(0xffff << (i * 8))) |
-                 (((u16)interesting_16[j]) << (i * 8));
+  /* 16-bit arithmetics, both endians. */
 
-      if (new_val == tval) return 1;
+  if (len < 2) goto skip_arith;
 
-      /* Continue here only if blen > 2. */
+  stage_name  = "arith 16/8";
+  stage_short = "arith16";
+  stage_cur   = 0;
+  stage_max   = 4 * (len - 1) * ARITH_MAX;
 
-      if (blen > 2) {
+  orig_hit_cnt = new_hit_cnt;
 
-        tval = (old_val & ~(0xffff << (i * 8))) |
-               (SWAP16(interesting_16[j]) << (i * 8));
+  for (i = 0; i < len - 1; i++) {
 
-        if (new_val == tval) return 1;
+    u16 orig = *(u16*)(out_buf + i);
 
-      }
+    /* Let's consult the effector map... */
 
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
+      stage_max -= 4 * ARITH_MAX;
+      continue;
     }
 
-  }
+    stage_cur_byte = i;
 
-  if (blen == 4 && check_le) {
+    for (j = 1; j <= ARITH_MAX; j++) {
 
-    /* See if four-byte insertions could produce the same result
-       (LE only). */
+      u16 r1 = orig ^ (orig + j),
+          r2 = orig ^ (orig - j),
+          r3 = orig ^ SWAP16(SWAP16(orig) + j),
+          r4 = orig ^ SWAP16(SWAP16(orig) - j);
 
-    for (j = 0; j < sizeof(interesting_32) / 4; j++)
-      if (new_val == (u32)interesting_32[j]) return 1;
+      /* Try little endian addition and subtraction first. Do it only
+         if the operation would affect more than one byte (hence the
+         & 0xff overflow checks) and if it couldn't be a product of
+         a bitflip. */
 
-  }
+      stage_val_type = STAGE_VAL_LE;
 
-  return 0;
+      if ((orig & 0xff) + j > 0xff && !could_be_bitflip(r1)) {
 
-}
+        stage_cur_val = j;
+        *(u16*)(out_buf + i) = orig + j;
+        init_mutation_vertical();
 
-u32 select_mutator_vertical(u32 extras) {
-  u32 max = 15 + (extras ? 2 : 0);
-  u32 mutator = UR(max);
-  return mutator;
-}
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(7, (double)i / (double)(len-1));
+        stage_cur++;
 
-u32 convert_to_actual_location(u32 max, u32 sel) {
-  u32 min_error = ((max / INTERVAL_SIZE) + 1) / 2;
-  min_error = MAX(min_error, 1);
-  double ratio = (double)sel / (double)INTERVAL_SIZE;
-  double loc = ratio * (double)max;
-  u32 loc_u32 = (u32)loc;
-  // Select +- min_error location
-  u32 minus = min_error;
-  u32 plus = UR(2 * min_error + 1);
-  u32 loc_final = loc_u32;
-  if (loc_u32 < min_error) loc_final = loc_u32 + plus - 1;
-  else loc_final = loc_u32 - minus + plus;
-  if (loc_final > max - 1) loc_final = max - 1;
-  return loc_final;
-}
+      } else stage_max--;
+
+      if ((orig & 0xff) < j && !could_be_bitflip(r2)) {
 
-u32 select_location_vertical(u32 max, double *rel) {
-  u32 result = 0;
-  if (max) {
-    if (use_vertical_navigation || vertical_manager_get_mode(vertical_manager) == M_VER)
-      result = convert_to_actual_location(max, interval_tree_select(vertical_manager->tree));
-    else
-      result = UR(max);
-    *rel = (double) result / (double) max;
-  }
-  return result;
-}
+        stage_cur_val = -j;
+        *(u16*)(out_buf + i) = orig - j;
+        init_mutation_vertical();
 
-void init_mutation_vertical(void) {
-  vertical_is_persistent = 0;
-  vertical_is_interesting = 0;
-  vertical_is_new_valuation = 0;
-}
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(7, (double)i / (double)(len-1));
+        stage_cur++;
 
-void log_single_mutator_selection(u32 mutator, double location) {
-  u32 score = vertical_is_persistent + 16 * vertical_is_new_valuation;
-  fprintf(moo_vertical_log_file, "d,%u,%u,%u,%u,%.6f\n",
-          vertical_is_persistent, vertical_is_interesting, vertical_is_new_valuation, mutator, location);
-  interval_tree_insert(vertical_manager->tree, quantize_location(location), score);
-}
+      } else stage_max--;
 
-void log_mutator_selection(u32* mutator, double* location, u32 stacking) {
-  // 4 * vertical_is_interesting
-  if (!use_moo_scheduler && !use_vertical_navigation && !vertical_experiment && !vertical_use_dynamic)
-    return;
-  u32 score = vertical_is_persistent + 16 * vertical_is_new_valuation;
-  u32 mut_cnt[OPERATOR_NUM];
-  memset(mut_cnt, 0, sizeof(mut_cnt));
-  for (u32 i = 0; i < stacking; i++) {
-    fprintf(moo_vertical_log_file, "v,%u,%u,%u,%u,%.6f\n",
-            vertical_is_persistent, vertical_is_interesting, vertical_is_new_valuation, mutator[i], location[i]);
-    // Update score for mutator
-    u32 mut = mutator[i];
-    if (!mut_cnt[mut]) {
-      mut_cnt[mut] = 1;
-    }
-    // Update score for location
-    interval_tree_insert(vertical_manager->tree, quantize_location(location[i]), score);
-  }
-}
+      /* Big endian comes next. Same deal. */
 
-/* Take the current entry from the queue, fuzz it for a while. This
-   function is a tad too long... returns 0 if fuzzed successfully, 1 if
-   skipped or bailed out. */
+      stage_val_type = STAGE_VAL_BE;
 
-static u8 fuzz_one_vertical(char** argv) {
 
-  s32 len, fd, temp_len, i, j;
-  u8  *in_buf, *out_buf, *orig_in, *ex_tmp, *eff_map = 0;
-  u64 havoc_queued,  orig_hit_cnt, new_hit_cnt;
-  u32 splice_cycle = 0, perf_score = 100, orig_perf, prev_cksum, eff_cnt = 1;
+      if ((orig >> 8) + j > 0xff && !could_be_bitflip(r3)) {
 
-  struct queue_entry* target; // Target test case to splice with.
+        stage_cur_val = j;
+        *(u16*)(out_buf + i) = SWAP16(SWAP16(orig) + j);
+        init_mutation_vertical();
 
-  u8  ret_val = 1, doing_det = 0;
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(7, (double)i / (double)(len-1));
+        stage_cur++;
 
-  u8  a_collect[MAX_AUTO_EXTRA];
-  u32 a_len = 0;
+      } else stage_max--;
 
-#ifdef IGNORE_FINDS
+      if ((orig >> 8) < j && !could_be_bitflip(r4)) {
 
-  /* In IGNORE_FINDS mode, skip any entries that weren't in the
-     initial data set. */
+        stage_cur_val = -j;
+        *(u16*)(out_buf + i) = SWAP16(SWAP16(orig) - j);
+        init_mutation_vertical();
 
-  if (queue_cur->depth > 1) return 1;
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(7, (double)i / (double)(len-1));
+        stage_cur++;
 
-#else
+      } else stage_max--;
 
-  if (pending_favored) {
+      *(u16*)(out_buf + i) = orig;
 
-    /* If we have any favored, non-fuzzed new arrivals in the queue,
-       possibly skip to them at the expense of already-fuzzed or non-favored
-       cases. */
+    }
 
-    if ((queue_cur->was_fuzzed || !queue_cur->favored) &&
-        UR(100) < SKIP_TO_NEW_PROB) return 1;
+  }
 
-  } else if (!dumb_mode && !queue_cur->favored && queued_paths > 10) {
+  new_hit_cnt = queued_paths + unique_crashes;
 
-    /* Otherwise, still possibly skip non-favored cases, albeit less often.
-       The odds of skipping stuff are higher for already-fuzzed inputs and
-       lower for never-fuzzed entries. */
+  stage_finds[STAGE_ARITH16]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_ARITH16] += stage_max;
 
-    if (queue_cycle > 1 && !queue_cur->was_fuzzed) {
+  /* 32-bit arithmetics, both endians. */
 
-      if (UR(100) < SKIP_NFAV_NEW_PROB) return 1;
+  if (len < 4) goto skip_arith;
 
-    } else {
+  stage_name  = "arith 32/8";
+  stage_short = "arith32";
+  stage_cur   = 0;
+  stage_max   = 4 * (len - 3) * ARITH_MAX;
 
-      if (UR(100) < SKIP_NFAV_OLD_PROB) return 1;
+  orig_hit_cnt = new_hit_cnt;
+
+  for (i = 0; i < len - 3; i++) {
+
+    u32 orig = *(u32*)(out_buf + i);
+
+    /* Let's consult the effector map... */
 
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
+        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
+      stage_max -= 4 * ARITH_MAX;
+      continue;
     }
 
-  }
+    stage_cur_byte = i;
 
-#endif /* ^IGNORE_FINDS */
+    for (j = 1; j <= ARITH_MAX; j++) {
 
-  if (not_on_tty) {
-    ACTF("Fuzzing test case #%u (%u total, %llu uniq crashes found)...",
-         current_entry, queued_paths, unique_crashes);
-    fflush(stdout);
-  }
+      u32 r1 = orig ^ (orig + j),
+          r2 = orig ^ (orig - j),
+          r3 = orig ^ SWAP32(SWAP32(orig) + j),
+          r4 = orig ^ SWAP32(SWAP32(orig) - j);
 
-  /* Map the test case into memory. */
+      /* Little endian first. Same deal as with 16-bit: we only want to
+         try if the operation would have effect on more than two bytes. */
 
-  fd = open(queue_cur->fname, O_RDONLY);
+      stage_val_type = STAGE_VAL_LE;
 
-  if (fd < 0) PFATAL("Unable to open '%s'", queue_cur->fname);
+      if ((orig & 0xffff) + j > 0xffff && !could_be_bitflip(r1)) {
 
-  len = queue_cur->len;
+        stage_cur_val = j;
+        *(u32*)(out_buf + i) = orig + j;
+        init_mutation_vertical();
 
-  orig_in = in_buf = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(8, (double)i / (double)(len-3));
+        stage_cur++;
 
-  if (orig_in == MAP_FAILED) PFATAL("Unable to mmap '%s'", queue_cur->fname);
+      } else stage_max--;
 
-  close(fd);
+      if ((orig & 0xffff) < j && !could_be_bitflip(r2)) {
 
-  /* We could mmap() out_buf as MAP_PRIVATE, but we end up clobbering every
-     single byte anyway, so it wouldn't give us any performance or memory usage
-     benefits. */
+        stage_cur_val = -j;
+        *(u32*)(out_buf + i) = orig - j;
+        init_mutation_vertical();
 
-  out_buf = ck_alloc_nozero(len);
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(8, (double)i / (double)(len-3));
+        stage_cur++;
 
-  subseq_tmouts = 0;
+      } else stage_max--;
 
-  cur_depth = queue_cur->depth;
+      /* Big endian next. */
 
-  /*******************************************
-   * CALIBRATION (only if failed earlier on) *
-   *******************************************/
+      stage_val_type = STAGE_VAL_BE;
 
-  if (queue_cur->cal_failed) {
+      if ((SWAP32(orig) & 0xffff) + j > 0xffff && !could_be_bitflip(r3)) {
 
-    u8 res = FAULT_TMOUT;
+        stage_cur_val = j;
+        *(u32*)(out_buf + i) = SWAP32(SWAP32(orig) + j);
+        init_mutation_vertical();
 
-    if (queue_cur->cal_failed < CAL_CHANCES) {
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(8, (double)i / (double)(len-3));
+        stage_cur++;
 
-      /* Reset exec_cksum to tell calibrate_case to re-execute the testcase
-         avoiding the usage of an invalid trace_bits.
-         For more info: https://github.com/AFLplusplus/AFLplusplus/pull/425 */
+      } else stage_max--;
 
-      queue_cur->exec_cksum = 0;
+      if ((SWAP32(orig) & 0xffff) < j && !could_be_bitflip(r4)) {
 
-      res = calibrate_case(argv, queue_cur, in_buf, queue_cycle - 1, 0);
+        stage_cur_val = -j;
+        *(u32*)(out_buf + i) = SWAP32(SWAP32(orig) - j);
+        init_mutation_vertical();
 
-      if (res == FAULT_ERROR)
-        FATAL("Unable to execute target application");
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(8, (double)i / (double)(len-3));
+        stage_cur++;
 
-    }
+      } else stage_max--;
+
+      *(u32*)(out_buf + i) = orig;
 
-    if (stop_soon || check_res(res)) {
-      cur_skipped_paths++;
-      goto abandon_entry;
     }
 
   }
 
-  /************
-   * TRIMMING *
-   ************/
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  if (!dumb_mode && !queue_cur->trim_done) {
+  stage_finds[STAGE_ARITH32]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_ARITH32] += stage_max;
 
-    u8 res = trim_case(argv, queue_cur, in_buf);
+skip_arith:
 
-    if (res == FAULT_ERROR)
-      FATAL("Unable to execute target application");
+  /**********************
+   * INTERESTING VALUES *
+   **********************/
 
-    if (stop_soon) {
-      cur_skipped_paths++;
-      goto abandon_entry;
+  stage_name  = "interest 8/8";
+  stage_short = "int8";
+  stage_cur   = 0;
+  stage_max   = len * sizeof(interesting_8);
+
+  stage_val_type = STAGE_VAL_LE;
+
+  orig_hit_cnt = new_hit_cnt;
+
+  /* Setting 8-bit integers. */
+
+  for (i = 0; i < len; i++) {
+
+    u8 orig = out_buf[i];
+
+    /* Let's consult the effector map... */
+
+    if (!eff_map[EFF_APOS(i)]) {
+      stage_max -= sizeof(interesting_8);
+      continue;
     }
 
-    /* Don't retry trimming, even if it failed. */
+    stage_cur_byte = i;
 
-    queue_cur->trim_done = 1;
+    for (j = 0; j < sizeof(interesting_8); j++) {
 
-    if (len != queue_cur->len) len = queue_cur->len;
+      /* Skip if the value could be a product of bitflips or arithmetics. */
 
-  }
+      if (could_be_bitflip(orig ^ (u8)interesting_8[j]) ||
+          could_be_arith(orig, (u8)interesting_8[j], 1)) {
+        stage_max--;
+        continue;
+      }
 
-  memcpy(out_buf, in_buf, len);
+      stage_cur_val = interesting_8[j];
+      out_buf[i] = interesting_8[j];
+      init_mutation_vertical();
 
-  /*********************
-   * PERFORMANCE SCORE *
-   *********************/
+      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-  orig_perf = perf_score = calculate_score(queue_cur);
+      log_single_mutator_selection(9, (double)i / (double)len);
+      out_buf[i] = orig;
+      stage_cur++;
+
+    }
 
-  /* Skip right away if -d is given, if we have done deterministic fuzzing on
-     this entry ourselves (was_fuzzed), or if it has gone through deterministic
-     testing in earlier, resumed runs (passed_det). */
+  }
 
-  if (skip_deterministic || queue_cur->was_fuzzed || queue_cur->passed_det)
-    goto havoc_stage;
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  /* Skip deterministic fuzzing if exec path checksum puts this out of scope
-     for this master instance. */
+  stage_finds[STAGE_INTEREST8]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_INTEREST8] += stage_max;
 
-  if (master_max && (queue_cur->exec_cksum % master_max) != master_id - 1)
-    goto havoc_stage;
+  /* Setting 16-bit integers, both endians. */
 
-  doing_det = 1;
+  if (no_arith || len < 2) goto skip_interest;
 
-  /*********************************************
-   * SIMPLE BITFLIP (+dictionary construction) *
-   *********************************************/
+  stage_name  = "interest 16/8";
+  stage_short = "int16";
+  stage_cur   = 0;
+  stage_max   = 2 * (len - 1) * (sizeof(interesting_16) >> 1);
 
-#define FLIP_BIT(_ar, _b) do { \
-    u8* _arf = (u8*)(_ar); \
-    u32 _bf = (_b); \
-    _arf[(_bf) >> 3] ^= (128 >> ((_bf) & 7)); \
-  } while (0)
+  orig_hit_cnt = new_hit_cnt;
 
-  /* Single walking bit. */
+  for (i = 0; i < len - 1; i++) {
 
-  stage_short = "flip1";
-  stage_max   = len << 3;
-  stage_name  = "bitflip 1/1";
+    u16 orig = *(u16*)(out_buf + i);
 
-  stage_val_type = STAGE_VAL_NONE;
+    /* Let's consult the effector map... */
 
-  orig_hit_cnt = queued_paths + unique_crashes;
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
+      stage_max -= sizeof(interesting_16);
+      continue;
+    }
 
-  prev_cksum = queue_cur->exec_cksum;
+    stage_cur_byte = i;
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+    for (j = 0; j < sizeof(interesting_16) / 2; j++) {
 
-    stage_cur_byte = stage_cur >> 3;
+      stage_cur_val = interesting_16[j];
 
-    FLIP_BIT(out_buf, stage_cur);
-    init_mutation_vertical();
+      /* Skip if this could be a product of a bitflip, arithmetics,
+         or single-byte interesting value insertion. */
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+      if (!could_be_bitflip(orig ^ (u16)interesting_16[j]) &&
+          !could_be_arith(orig, (u16)interesting_16[j], 2) &&
+          !could_be_interest(orig, (u16)interesting_16[j], 2, 0)) {
 
-    log_single_mutator_selection(0, (double)stage_cur / (double)stage_max);
-    FLIP_BIT(out_buf, stage_cur);
+        stage_val_type = STAGE_VAL_LE;
 
-    /* While flipping the least significant bit in every byte, pull of an extra
-       trick to detect possible syntax tokens. In essence, the idea is that if
-       you have a binary blob like this:
+        *(u16*)(out_buf + i) = interesting_16[j];
+        init_mutation_vertical();
 
-       xxxxxxxxIHDRxxxxxxxx
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(10, (double)i / (double)(len-1));
+        stage_cur++;
 
-       ...and changing the leading and trailing bytes causes variable or no
-       changes in program flow, but touching any character in the "IHDR" string
-       always produces the same, distinctive path, it's highly likely that
-       "IHDR" is an atomically-checked magic value of special significance to
-       the fuzzed format.
+      } else stage_max--;
 
-       We do this here, rather than as a separate stage, because it's a nice
-       way to keep the operation approximately "free" (i.e., no extra execs).
+      if ((u16)interesting_16[j] != SWAP16(interesting_16[j]) &&
+          !could_be_bitflip(orig ^ SWAP16(interesting_16[j])) &&
+          !could_be_arith(orig, SWAP16(interesting_16[j]), 2) &&
+          !could_be_interest(orig, SWAP16(interesting_16[j]), 2, 1)) {
 
-       Empirically, performing the check when flipping the least significant bit
-       is advantageous, compared to doing it at the time of more disruptive
-       changes, where the program flow may be affected in more violent ways.
+        stage_val_type = STAGE_VAL_BE;
 
-       The caveat is that we won't generate dictionaries in the -d mode or -S
-       mode - but that's probably a fair trade-off.
+        *(u16*)(out_buf + i) = SWAP16(interesting_16[j]);
+        init_mutation_vertical();
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(10, (double)i / (double)(len-1));
+        stage_cur++;
 
-       This won't work particularly well with paths that exhibit variable
-       behavior, but fails gracefully, so we'll carry out the checks anyway.
+      } else stage_max--;
 
-      */
+    }
 
-    if (!dumb_mode && (stage_cur & 7) == 7) {
+    *(u16*)(out_buf + i) = orig;
 
-      u32 cksum = hash32(trace_bits, MAP_SIZE, HASH_CONST);
+  }
 
-      if (stage_cur == stage_max - 1 && cksum == prev_cksum) {
+  new_hit_cnt = queued_paths + unique_crashes;
 
-        /* If at end of file and we are still collecting a string, grab the
-           final character and force output. */
+  stage_finds[STAGE_INTEREST16]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_INTEREST16] += stage_max;
 
-        if (a_len < MAX_AUTO_EXTRA) a_collect[a_len] = out_buf[stage_cur >> 3];
-        a_len++;
+  if (len < 4) goto skip_interest;
 
-        if (a_len >= MIN_AUTO_EXTRA && a_len <= MAX_AUTO_EXTRA)
-          maybe_add_auto(a_collect, a_len);
+  /* Setting 32-bit integers, both endians. */
 
-      } else if (cksum != prev_cksum) {
+  stage_name  = "interest 32/8";
+  stage_short = "int32";
+  stage_cur   = 0;
+  stage_max   = 2 * (len - 3) * (sizeof(interesting_32) >> 2);
 
-        /* Otherwise, if the checksum has changed, see if we have something
-           worthwhile queued up, and collect that if the answer is yes. */
+  orig_hit_cnt = new_hit_cnt;
 
-        if (a_len >= MIN_AUTO_EXTRA && a_len <= MAX_AUTO_EXTRA)
-          maybe_add_auto(a_collect, a_len);
+  for (i = 0; i < len - 3; i++) {
 
-        a_len = 0;
-        prev_cksum = cksum;
+    u32 orig = *(u32*)(out_buf + i);
 
-      }
+    /* Let's consult the effector map... */
 
-      /* Continue collecting string, but only if the bit flip actually made
-         any difference - we don't want no-op tokens. */
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
+        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
+      stage_max -= sizeof(interesting_32) >> 1;
+      continue;
+    }
 
-      if (cksum != queue_cur->exec_cksum) {
+    stage_cur_byte = i;
 
-        if (a_len < MAX_AUTO_EXTRA) a_collect[a_len] = out_buf[stage_cur >> 3];
-        a_len++;
+    for (j = 0; j < sizeof(interesting_32) / 4; j++) {
 
-      }
+      stage_cur_val = interesting_32[j];
 
-    }
+      /* Skip if this could be a product of a bitflip, arithmetics,
+         or word interesting value insertion. */
 
-  }
+      if (!could_be_bitflip(orig ^ (u32)interesting_32[j]) &&
+          !could_be_arith(orig, interesting_32[j], 4) &&
+          !could_be_interest(orig, interesting_32[j], 4, 0)) {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+        stage_val_type = STAGE_VAL_LE;
 
-  stage_finds[STAGE_FLIP1]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP1] += stage_max;
+        *(u32*)(out_buf + i) = interesting_32[j];
+        init_mutation_vertical();
 
-  /* Two walking bits. */
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(11, (double)i / (double)(len-3));
+        stage_cur++;
 
-  stage_name  = "bitflip 2/1";
-  stage_short = "flip2";
-  stage_max   = (len << 3) - 1;
+      } else stage_max--;
 
-  orig_hit_cnt = new_hit_cnt;
+      if ((u32)interesting_32[j] != SWAP32(interesting_32[j]) &&
+          !could_be_bitflip(orig ^ SWAP32(interesting_32[j])) &&
+          !could_be_arith(orig, SWAP32(interesting_32[j]), 4) &&
+          !could_be_interest(orig, SWAP32(interesting_32[j]), 4, 1)) {
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+        stage_val_type = STAGE_VAL_BE;
 
-    stage_cur_byte = stage_cur >> 3;
+        *(u32*)(out_buf + i) = SWAP32(interesting_32[j]);
+        init_mutation_vertical();
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        log_single_mutator_selection(11, (double)i / (double)(len-3));
+        stage_cur++;
 
-    FLIP_BIT(out_buf, stage_cur);
-    FLIP_BIT(out_buf, stage_cur + 1);
-    init_mutation_vertical();
+      } else stage_max--;
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    }
 
-    log_single_mutator_selection(1, (double)stage_cur / (double)stage_max);
-    FLIP_BIT(out_buf, stage_cur);
-    FLIP_BIT(out_buf, stage_cur + 1);
+    *(u32*)(out_buf + i) = orig;
 
   }
 
   new_hit_cnt = queued_paths + unique_crashes;
 
-  stage_finds[STAGE_FLIP2]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP2] += stage_max;
-
-  /* Four walking bits. */
+  stage_finds[STAGE_INTEREST32]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_INTEREST32] += stage_max;
 
-  stage_name  = "bitflip 4/1";
-  stage_short = "flip4";
-  stage_max   = (len << 3) - 3;
+skip_interest:
 
-  orig_hit_cnt = new_hit_cnt;
+  /********************
+   * DICTIONARY STUFF *
+   ********************/
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+  if (!extras_cnt) goto skip_user_extras;
 
-    stage_cur_byte = stage_cur >> 3;
+  /* Overwrite with user-supplied extras. */
 
-    FLIP_BIT(out_buf, stage_cur);
-    FLIP_BIT(out_buf, stage_cur + 1);
-    FLIP_BIT(out_buf, stage_cur + 2);
-    FLIP_BIT(out_buf, stage_cur + 3);
-    init_mutation_vertical();
+  stage_name  = "user extras (over)";
+  stage_short = "ext_UO";
+  stage_cur   = 0;
+  stage_max   = extras_cnt * len;
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+  stage_val_type = STAGE_VAL_NONE;
 
-    log_single_mutator_selection(2, (double)stage_cur / (double)stage_max);
-    FLIP_BIT(out_buf, stage_cur);
-    FLIP_BIT(out_buf, stage_cur + 1);
-    FLIP_BIT(out_buf, stage_cur + 2);
-    FLIP_BIT(out_buf, stage_cur + 3);
+  orig_hit_cnt = new_hit_cnt;
 
-  }
+  for (i = 0; i < len; i++) {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+    u32 last_len = 0;
 
-  stage_finds[STAGE_FLIP4]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP4] += stage_max;
+    stage_cur_byte = i;
 
-  /* Effector map setup. These macros calculate:
+    /* Extras are sorted by size, from smallest to largest. This means
+       that we don't have to worry about restoring the buffer in
+       between writes at a particular offset determined by the outer
+       loop. */
 
-     EFF_APOS      - position of a particular file offset in the map.
-     EFF_ALEN      - length of a map with a particular number of bytes.
-     EFF_SPAN_ALEN - map span for a sequence of bytes.
+    for (j = 0; j < extras_cnt; j++) {
 
-   */
+      /* Skip extras probabilistically if extras_cnt > MAX_DET_EXTRAS. Also
+         skip them if there's no room to insert the payload, if the token
+         is redundant, or if its entire span has no bytes set in the effector
+         map. */
 
-#define EFF_APOS(_p)          ((_p) >> EFF_MAP_SCALE2)
-#define EFF_REM(_x)           ((_x) & ((1 << EFF_MAP_SCALE2) - 1))
-#define EFF_ALEN(_l)          (EFF_APOS(_l) + !!EFF_REM(_l))
-#define EFF_SPAN_ALEN(_p, _l) (EFF_APOS((_p) + (_l) - 1) - EFF_APOS(_p) + 1)
+      if ((extras_cnt > MAX_DET_EXTRAS && UR(extras_cnt) >= MAX_DET_EXTRAS) ||
+          extras[j].len > len - i ||
+          !memcmp(extras[j].data, out_buf + i, extras[j].len) ||
+          !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, extras[j].len))) {
 
-  /* Initialize effector map for the next step (see comments below). Always
-     flag first and last byte as doing something. */
+        stage_max--;
+        continue;
 
-  eff_map    = ck_alloc(EFF_ALEN(len));
-  eff_map[0] = 1;
+      }
 
-  if (EFF_APOS(len - 1) != 0) {
-    eff_map[EFF_APOS(len - 1)] = 1;
-    eff_cnt++;
-  }
+      last_len = extras[j].len;
+      memcpy(out_buf + i, extras[j].data, last_len);
+      init_mutation_vertical();
 
-  /* Walking byte. */
+      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-  stage_name  = "bitflip 8/8";
-  stage_short = "flip8";
-  stage_max   = len;
+      log_single_mutator_selection(12, (double)i / (double)len);
 
-  orig_hit_cnt = new_hit_cnt;
+      stage_cur++;
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+    }
 
-    stage_cur_byte = stage_cur;
+    /* Restore all the clobbered memory. */
+    memcpy(out_buf + i, in_buf + i, last_len);
 
-    out_buf[stage_cur] ^= 0xFF;
-    init_mutation_vertical();
+  }
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-    log_single_mutator_selection(3, (double)stage_cur / (double)stage_max);
+  new_hit_cnt = queued_paths + unique_crashes;
 
-    /* We also use this stage to pull off a simple trick: we identify
-       bytes that seem to have no effect on the current execution path
-       even when fully flipped - and we skip them during more expensive
-       deterministic stages, such as arithmetics or known ints. */
+  stage_finds[STAGE_EXTRAS_UO]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_EXTRAS_UO] += stage_max;
 
-    if (!eff_map[EFF_APOS(stage_cur)]) {
+  /* Insertion of user-supplied extras. */
 
-      u32 cksum;
+  stage_name  = "user extras (insert)";
+  stage_short = "ext_UI";
+  stage_cur   = 0;
+  stage_max   = extras_cnt * len;
 
-      /* If in dumb mode or if the file is very short, just flag everything
-         without wasting time on checksums. */
+  orig_hit_cnt = new_hit_cnt;
 
-      if (!dumb_mode && len >= EFF_MIN_LEN)
-        cksum = hash32(trace_bits, MAP_SIZE, HASH_CONST);
-      else
-        cksum = ~queue_cur->exec_cksum;
+  ex_tmp = ck_alloc(len + MAX_DICT_FILE);
 
-      if (cksum != queue_cur->exec_cksum) {
-        eff_map[EFF_APOS(stage_cur)] = 1;
-        eff_cnt++;
-      }
+  for (i = 0; i <= len; i++) {
 
-    }
+    stage_cur_byte = i;
 
-    out_buf[stage_cur] ^= 0xFF;
+    for (j = 0; j < extras_cnt; j++) {
 
-  }
+      if (len + extras[j].len > MAX_FILE) {
+        stage_max--;
+        continue;
+      }
 
-  /* If the effector map is more than EFF_MAX_PERC dense, just flag the
-     whole thing as worth fuzzing, since we wouldn't be saving much time
-     anyway. */
+      /* Insert token */
+      memcpy(ex_tmp + i, extras[j].data, extras[j].len);
 
-  if (eff_cnt != EFF_ALEN(len) &&
-      eff_cnt * 100 / EFF_ALEN(len) > EFF_MAX_PERC) {
+      /* Copy tail */
+      memcpy(ex_tmp + i + extras[j].len, out_buf + i, len - i);
+      init_mutation_vertical();
 
-    memset(eff_map, 1, EFF_ALEN(len));
+      if (common_fuzz_stuff(argv, ex_tmp, len + extras[j].len)) {
+        ck_free(ex_tmp);
+        goto abandon_entry;
+      }
+      log_single_mutator_selection(13, (double)i / (double)len);
 
-    blocks_eff_select += EFF_ALEN(len);
+      stage_cur++;
 
-  } else {
+    }
 
-    blocks_eff_select += eff_cnt;
+    /* Copy head */
+    ex_tmp[i] = out_buf[i];
 
   }
 
-  blocks_eff_total += EFF_ALEN(len);
+  ck_free(ex_tmp);
 
   new_hit_cnt = queued_paths + unique_crashes;
 
-  stage_finds[STAGE_FLIP8]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP8] += stage_max;
+  stage_finds[STAGE_EXTRAS_UI]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_EXTRAS_UI] += stage_max;
 
-  /* Two walking bytes. */
+skip_user_extras:
 
-  if (len < 2) goto skip_bitflip;
+  if (!a_extras_cnt) goto skip_extras;
 
-  stage_name  = "bitflip 16/8";
-  stage_short = "flip16";
+  stage_name  = "auto extras (over)";
+  stage_short = "ext_AO";
   stage_cur   = 0;
-  stage_max   = len - 1;
+  stage_max   = MIN(a_extras_cnt, USE_AUTO_EXTRAS) * len;
 
-  orig_hit_cnt = new_hit_cnt;
+  stage_val_type = STAGE_VAL_NONE;
 
-  for (i = 0; i < len - 1; i++) {
+  orig_hit_cnt = new_hit_cnt;
 
-    /* Let's consult the effector map... */
+  for (i = 0; i < len; i++) {
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
-      stage_max--;
-      continue;
-    }
+    u32 last_len = 0;
 
     stage_cur_byte = i;
 
-    *(u16*)(out_buf + i) ^= 0xFFFF;
-    init_mutation_vertical();
+    for (j = 0; j < MIN(a_extras_cnt, USE_AUTO_EXTRAS); j++) {
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+      /* See the comment in the earlier code; extras are sorted by size. */
 
-    log_single_mutator_selection(4, (double)i / (double)(len - 1));
-    stage_cur++;
+      if (a_extras[j].len > len - i ||
+          !memcmp(a_extras[j].data, out_buf + i, a_extras[j].len) ||
+          !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, a_extras[j].len))) {
 
-    *(u16*)(out_buf + i) ^= 0xFFFF;
+        stage_max--;
+        continue;
 
+      }
 
-  }
+      last_len = a_extras[j].len;
+      memcpy(out_buf + i, a_extras[j].data, last_len);
+      init_mutation_vertical();
 
-  new_hit_cnt = queued_paths + unique_crashes;
+      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-  stage_finds[STAGE_FLIP16]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP16] += stage_max;
+      log_single_mutator_selection(14, (double)i / (double)len);
+      stage_cur++;
 
-  if (len < 4) goto skip_bitflip;
+    }
 
-  /* Four walking bytes. */
+    /* Restore all the clobbered memory. */
+    memcpy(out_buf + i, in_buf + i, last_len);
 
-  stage_name  = "bitflip 32/8";
-  stage_short = "flip32";
-  stage_cur   = 0;
-  stage_max   = len - 3;
+  }
 
-  orig_hit_cnt = new_hit_cnt;
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  for (i = 0; i < len - 3; i++) {
+  stage_finds[STAGE_EXTRAS_AO]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_EXTRAS_AO] += stage_max;
 
-    /* Let's consult the effector map... */
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
-        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
-      stage_max--;
-      continue;
-    }
+skip_extras:
 
-    stage_cur_byte = i;
+  /* If we made this to here without jumping to havoc_stage or abandon_entry,
+     we're properly done with deterministic steps and can mark it as such
+     in the .state/ directory. */
 
-    *(u32*)(out_buf + i) ^= 0xFFFFFFFF;
-    init_mutation_vertical();
+  if (!queue_cur->passed_det) mark_as_det_done(queue_cur);
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-    log_single_mutator_selection(5, (double)i / (double)(len - 3));
-    stage_cur++;
+  /****************
+   * RANDOM HAVOC *
+   ****************/
 
-    *(u32*)(out_buf + i) ^= 0xFFFFFFFF;
+havoc_stage:
 
-  }
+  stage_cur_byte = -1;
 
-  new_hit_cnt = queued_paths + unique_crashes;
+  /* The havoc stage mutation code is also invoked when splicing files; if the
+     splice_cycle variable is set, generate different descriptions and such. */
 
-  stage_finds[STAGE_FLIP32]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP32] += stage_max;
+  if (!splice_cycle) {
 
-skip_bitflip:
+    /* Adjust perf_score with the factor derived from the proximity score */
+    double prox_score = (double)queue_cur->prox_score.original;
+    factor = queue_cur->perf_factor = calculate_factor(prox_score);
+    perf_score = (u32) (factor * (double) perf_score);
 
-  if (no_arith) goto skip_arith;
+    stage_name  = "havoc-vertical";
+    stage_short = "havoc-vert";
+    stage_max   = (doing_det ? HAVOC_CYCLES_INIT : HAVOC_CYCLES) *
+                  perf_score / havoc_div / 100;
 
-  /**********************
-   * ARITHMETIC INC/DEC *
-   **********************/
 
-  /* 8-bit arithmetics. */
+  } else {
 
-  stage_name  = "arith 8/8";
-  stage_short = "arith8";
-  stage_cur   = 0;
-  stage_max   = 2 * len * ARITH_MAX;
+    static u8 tmp[32];
 
-  stage_val_type = STAGE_VAL_LE;
+    perf_score = orig_perf;
 
-  orig_hit_cnt = new_hit_cnt;
+    /* Adjust perf_score with the factor derived from the proximity score */
+    double prox_score = (queue_cur->prox_score.original + target->prox_score.original) / 2;
+    factor = calculate_factor(prox_score);
+    perf_score = (u32) (factor * (double) perf_score);
 
-  for (i = 0; i < len; i++) {
+    sprintf(tmp, "splice-vertical-%u", splice_cycle);
+    stage_name  = tmp;
+    stage_short = "splice-vert";
+    stage_max   = SPLICE_HAVOC * perf_score / havoc_div / 100;
 
-    u8 orig = out_buf[i];
+  }
 
-    /* Let's consult the effector map... */
+  EVLOG(EV_POW, orig_perf, factor, perf_score, queue_cur->entry_id);
 
-    if (!eff_map[EFF_APOS(i)]) {
-      stage_max -= 2 * ARITH_MAX;
-      continue;
-    }
+  if (stage_max < HAVOC_MIN) stage_max = HAVOC_MIN;
 
-    stage_cur_byte = i;
+  temp_len = len;
 
-    for (j = 1; j <= ARITH_MAX; j++) {
+  orig_hit_cnt = queued_paths + unique_crashes;
 
-      u8 r = orig ^ (orig + j);
+  havoc_queued = queued_paths;
 
-      /* Do arithmetic operations only if the result couldn't be a product
-         of a bitflip. */
+  /* We essentially just do several thousand runs (depending on perf_score)
+     where we take the input file and make random stacked tweaks. */
 
-      if (!could_be_bitflip(r)) {
+  u32 mut_cnt[1<<HAVOC_STACK_POW2];
+  double loc_cnt[1<<HAVOC_STACK_POW2];
 
-        stage_cur_val = j;
-        out_buf[i] = orig + j;
-        init_mutation_vertical();
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(6, (double)i / (double)len);
-        stage_cur++;
+    u32 use_stacking = 1 << (1 + UR(HAVOC_STACK_POW2));
+    u32 loc_count = 0;
 
-      } else stage_max--;
+    stage_cur_val = use_stacking;
 
-      r =  orig ^ (orig - j);
+    memset(mut_cnt, 0, sizeof(mut_cnt));
+    memset(loc_cnt, 0, sizeof(loc_cnt));
 
-      if (!could_be_bitflip(r)) {
+    for (i = 0; i < use_stacking; i++) {
 
-        stage_cur_val = -j;
-        out_buf[i] = orig - j;
-        init_mutation_vertical();
+      u32 location = 0;
+      u32 mutator = select_mutator_vertical(extras_cnt + a_extras_cnt);
+      double rel_loc = 0.0;
+      u8 is_used = 1;
+
+      switch (mutator) {
+
+        case 0:
+
+          /* Flip a single bit somewhere. Spooky! */
+          location = select_location_vertical(temp_len << 3, &rel_loc);
+          FLIP_BIT(out_buf, location);
+          break;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(6, (double)i / (double)len);
-        stage_cur++;
+        case 1:
 
-      } else stage_max--;
+          /* Set byte to interesting value. */
+          location = select_location_vertical(temp_len, &rel_loc);
+          out_buf[location] = interesting_8[UR(sizeof(interesting_8))];
+          break;
 
-      out_buf[i] = orig;
+        case 2:
 
-    }
+          /* Set word to interesting value, randomly choosing endian. */
 
-  }
+          if (temp_len < 2) {
+            is_used = 0;
+            break;
+          }
 
-  new_hit_cnt = queued_paths + unique_crashes;
+          location = select_location_vertical(temp_len - 1, &rel_loc);
 
-  stage_finds[STAGE_ARITH8]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_ARITH8] += stage_max;
+          if (UR(2)) {
 
-  /* 16-bit arithmetics, both endians. */
+            *(u16*)(out_buf + location) =
+                interesting_16[UR(sizeof(interesting_16) >> 1)];
 
-  if (len < 2) goto skip_arith;
+          } else {
 
-  stage_name  = "arith 16/8";
-  stage_short = "arith16";
-  stage_cur   = 0;
-  stage_max   = 4 * (len - 1) * ARITH_MAX;
+            *(u16*)(out_buf + location) = SWAP16(
+                interesting_16[UR(sizeof(interesting_16) >> 1)]);
 
-  orig_hit_cnt = new_hit_cnt;
+          }
 
-  for (i = 0; i < len - 1; i++) {
+          break;
 
-    u16 orig = *(u16*)(out_buf + i);
+        case 3:
 
-    /* Let's consult the effector map... */
+          /* Set dword to interesting value, randomly choosing endian. */
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
-      stage_max -= 4 * ARITH_MAX;
-      continue;
-    }
+          if (temp_len < 4) {
+            is_used = 0;
+            break;
+          }
 
-    stage_cur_byte = i;
+          location = select_location_vertical(temp_len - 3, &rel_loc);
 
-    for (j = 1; j <= ARITH_MAX; j++) {
+          if (UR(2)) {
 
-      u16 r1 = orig ^ (orig + j),
-          r2 = orig ^ (orig - j),
-          r3 = orig ^ SWAP16(SWAP16(orig) + j),
-          r4 = orig ^ SWAP16(SWAP16(orig) - j);
+            *(u32*)(out_buf + location) =
+                interesting_32[UR(sizeof(interesting_32) >> 2)];
 
-      /* Try little endian addition and subtraction first. Do it only
-         if the operation would affect more than one byte (hence the
-         & 0xff overflow checks) and if it couldn't be a product of
-         a bitflip. */
+          } else {
 
-      stage_val_type = STAGE_VAL_LE;
+            *(u32*)(out_buf + location) = SWAP32(
+                interesting_32[UR(sizeof(interesting_32) >> 2)]);
 
-      if ((orig & 0xff) + j > 0xff && !could_be_bitflip(r1)) {
+          }
 
-        stage_cur_val = j;
-        *(u16*)(out_buf + i) = orig + j;
-        init_mutation_vertical();
+          break;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(7, (double)i / (double)(len-1));
-        stage_cur++;
+        case 4:
 
-      } else stage_max--;
+          /* Randomly subtract from byte. */
+          location = select_location_vertical(temp_len, &rel_loc);
+          out_buf[location] -= 1 + UR(ARITH_MAX);
+          break;
 
-      if ((orig & 0xff) < j && !could_be_bitflip(r2)) {
+        case 5:
 
-        stage_cur_val = -j;
-        *(u16*)(out_buf + i) = orig - j;
-        init_mutation_vertical();
+          /* Randomly add to byte. */
+          location = select_location_vertical(temp_len, &rel_loc);
+          out_buf[location] += 1 + UR(ARITH_MAX);
+          break;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(7, (double)i / (double)(len-1));
-        stage_cur++;
+        case 6:
 
-      } else stage_max--;
+          /* Randomly subtract from word, random endian. */
 
-      /* Big endian comes next. Same deal. */
+          if (temp_len < 2) {
+            is_used = 0;
+            break;
+          }
 
-      stage_val_type = STAGE_VAL_BE;
+          location = select_location_vertical(temp_len - 1, &rel_loc);
 
+          if (UR(2)) {
 
-      if ((orig >> 8) + j > 0xff && !could_be_bitflip(r3)) {
+            *(u16*)(out_buf + location) -= 1 + UR(ARITH_MAX);
 
-        stage_cur_val = j;
-        *(u16*)(out_buf + i) = SWAP16(SWAP16(orig) + j);
-        init_mutation_vertical();
+          } else {
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(7, (double)i / (double)(len-1));
-        stage_cur++;
+            u16 num = 1 + UR(ARITH_MAX);
 
-      } else stage_max--;
+            *(u16*)(out_buf + location) =
+                SWAP16(SWAP16(*(u16*)(out_buf + location)) - num);
 
-      if ((orig >> 8) < j && !could_be_bitflip(r4)) {
+          }
 
-        stage_cur_val = -j;
-        *(u16*)(out_buf + i) = SWAP16(SWAP16(orig) - j);
-        init_mutation_vertical();
+          break;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(7, (double)i / (double)(len-1));
-        stage_cur++;
+        case 7:
 
-      } else stage_max--;
+          /* Randomly add to word, random endian. */
 
-      *(u16*)(out_buf + i) = orig;
+          if (temp_len < 2) {
+            is_used = 0;
+            break;
+          }
 
-    }
+          location = select_location_vertical(temp_len - 1, &rel_loc);
 
-  }
+          if (UR(2)) {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+            u32 pos = location;
 
-  stage_finds[STAGE_ARITH16]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_ARITH16] += stage_max;
+            *(u16*)(out_buf + pos) += 1 + UR(ARITH_MAX);
 
-  /* 32-bit arithmetics, both endians. */
+          } else {
 
-  if (len < 4) goto skip_arith;
+            u32 pos = location;
+            u16 num = 1 + UR(ARITH_MAX);
 
-  stage_name  = "arith 32/8";
-  stage_short = "arith32";
-  stage_cur   = 0;
-  stage_max   = 4 * (len - 3) * ARITH_MAX;
+            *(u16*)(out_buf + pos) =
+                SWAP16(SWAP16(*(u16*)(out_buf + pos)) + num);
 
-  orig_hit_cnt = new_hit_cnt;
+          }
 
-  for (i = 0; i < len - 3; i++) {
+          break;
 
-    u32 orig = *(u32*)(out_buf + i);
+        case 8:
 
-    /* Let's consult the effector map... */
+          /* Randomly subtract from dword, random endian. */
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
-        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
-      stage_max -= 4 * ARITH_MAX;
-      continue;
-    }
+          if (temp_len < 4) {
+            is_used = 0;
+            break;
+          }
 
-    stage_cur_byte = i;
+          location = select_location_vertical(temp_len - 3, &rel_loc);
 
-    for (j = 1; j <= ARITH_MAX; j++) {
+          if (UR(2)) {
 
-      u32 r1 = orig ^ (orig + j),
-          r2 = orig ^ (orig - j),
-          r3 = orig ^ SWAP32(SWAP32(orig) + j),
-          r4 = orig ^ SWAP32(SWAP32(orig) - j);
+            u32 pos = location;
 
-      /* Little endian first. Same deal as with 16-bit: we only want to
-         try if the operation would have effect on more than two bytes. */
+            *(u32*)(out_buf + pos) -= 1 + UR(ARITH_MAX);
 
-      stage_val_type = STAGE_VAL_LE;
+          } else {
 
-      if ((orig & 0xffff) + j > 0xffff && !could_be_bitflip(r1)) {
+            u32 pos = location;
+            u32 num = 1 + UR(ARITH_MAX);
 
-        stage_cur_val = j;
-        *(u32*)(out_buf + i) = orig + j;
-        init_mutation_vertical();
+            *(u32*)(out_buf + pos) =
+                SWAP32(SWAP32(*(u32*)(out_buf + pos)) - num);
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(8, (double)i / (double)(len-3));
-        stage_cur++;
+          }
 
-      } else stage_max--;
+          break;
 
-      if ((orig & 0xffff) < j && !could_be_bitflip(r2)) {
+        case 9:
 
-        stage_cur_val = -j;
-        *(u32*)(out_buf + i) = orig - j;
-        init_mutation_vertical();
+          /* Randomly add to dword, random endian. */
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(8, (double)i / (double)(len-3));
-        stage_cur++;
+          if (temp_len < 4) {
+            is_used = 0;
+            break;
+          }
 
-      } else stage_max--;
+          location = select_location_vertical(temp_len - 3, &rel_loc);
 
-      /* Big endian next. */
+          if (UR(2)) {
 
-      stage_val_type = STAGE_VAL_BE;
+            u32 pos = location;
 
-      if ((SWAP32(orig) & 0xffff) + j > 0xffff && !could_be_bitflip(r3)) {
+            *(u32*)(out_buf + pos) += 1 + UR(ARITH_MAX);
 
-        stage_cur_val = j;
-        *(u32*)(out_buf + i) = SWAP32(SWAP32(orig) + j);
-        init_mutation_vertical();
+          } else {
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(8, (double)i / (double)(len-3));
-        stage_cur++;
+            u32 pos = location;
+            u32 num = 1 + UR(ARITH_MAX);
 
-      } else stage_max--;
+            *(u32*)(out_buf + pos) =
+                SWAP32(SWAP32(*(u32*)(out_buf + pos)) + num);
 
-      if ((SWAP32(orig) & 0xffff) < j && !could_be_bitflip(r4)) {
+          }
 
-        stage_cur_val = -j;
-        *(u32*)(out_buf + i) = SWAP32(SWAP32(orig) - j);
-        init_mutation_vertical();
+          break;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(8, (double)i / (double)(len-3));
-        stage_cur++;
+        case 10:
 
-      } else stage_max--;
+          /* Just set a random byte to a random value. Because,
+             why not. We use XOR with 1-255 to eliminate the
+             possibility of a no-op. */
+          location = select_location_vertical(temp_len, &rel_loc);
+          out_buf[location] ^= 1 + UR(255);
+          break;
 
-      *(u32*)(out_buf + i) = orig;
+        case 11 ... 12: {
 
-    }
+          /* Delete bytes. We're making this a bit more likely
+             than insertion (the next option) in hopes of keeping
+             files reasonably small. */
 
-  }
+          u32 del_from, del_len;
 
-  new_hit_cnt = queued_paths + unique_crashes;
+          if (temp_len < 2) {
+            is_used = 0;
+            break;
+          }
 
-  stage_finds[STAGE_ARITH32]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_ARITH32] += stage_max;
+          /* Don't delete too much. */
 
-skip_arith:
+          del_len = choose_block_len(temp_len - 1);
 
-  /**********************
-   * INTERESTING VALUES *
-   **********************/
+          del_from = location = select_location_vertical(temp_len - del_len + 1, &rel_loc);
 
-  stage_name  = "interest 8/8";
-  stage_short = "int8";
-  stage_cur   = 0;
-  stage_max   = len * sizeof(interesting_8);
+          memmove(out_buf + del_from, out_buf + del_from + del_len,
+                  temp_len - del_from - del_len);
 
-  stage_val_type = STAGE_VAL_LE;
+          temp_len -= del_len;
 
-  orig_hit_cnt = new_hit_cnt;
+          break;
 
-  /* Setting 8-bit integers. */
+        }
 
-  for (i = 0; i < len; i++) {
+        case 13:
 
-    u8 orig = out_buf[i];
+          if (temp_len + HAVOC_BLK_XL < MAX_FILE) {
 
-    /* Let's consult the effector map... */
+            /* Clone bytes (75%) or insert a block of constant bytes (25%). */
 
-    if (!eff_map[EFF_APOS(i)]) {
-      stage_max -= sizeof(interesting_8);
-      continue;
-    }
+            u8  actually_clone = UR(4);
+            u32 clone_from, clone_to, clone_len;
+            u8* new_buf;
 
-    stage_cur_byte = i;
+            if (actually_clone) {
 
-    for (j = 0; j < sizeof(interesting_8); j++) {
+              clone_len  = choose_block_len(temp_len);
+              clone_from = UR(temp_len - clone_len + 1);
 
-      /* Skip if the value could be a product of bitflips or arithmetics. */
+            } else {
 
-      if (could_be_bitflip(orig ^ (u8)interesting_8[j]) ||
-          could_be_arith(orig, (u8)interesting_8[j], 1)) {
-        stage_max--;
-        continue;
-      }
+              clone_len = choose_block_len(HAVOC_BLK_XL);
+              clone_from = 0;
 
-      stage_cur_val = interesting_8[j];
-      out_buf[i] = interesting_8[j];
-      init_mutation_vertical();
+            }
 
-      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+            clone_to = location = select_location_vertical(temp_len, &rel_loc);
 
-      log_single_mutator_selection(9, (double)i / (double)len);
-      out_buf[i] = orig;
-      stage_cur++;
+            new_buf = ck_alloc_nozero(temp_len + clone_len);
 
-    }
+            /* Head */
 
-  }
+            memcpy(new_buf, out_buf, clone_to);
 
-  new_hit_cnt = queued_paths + unique_crashes;
+            /* Inserted part */
 
-  stage_finds[STAGE_INTEREST8]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_INTEREST8] += stage_max;
+            if (actually_clone)
+              memcpy(new_buf + clone_to, out_buf + clone_from, clone_len);
+            else
+              memset(new_buf + clone_to,
+                     UR(2) ? UR(256) : out_buf[UR(temp_len)], clone_len);
 
-  /* Setting 16-bit integers, both endians. */
+            /* Tail */
+            memcpy(new_buf + clone_to + clone_len, out_buf + clone_to,
+                   temp_len - clone_to);
 
-  if (no_arith || len < 2) goto skip_interest;
+            ck_free(out_buf);
+            out_buf = new_buf;
+            temp_len += clone_len;
 
-  stage_name  = "interest 16/8";
-  stage_short = "int16";
-  stage_cur   = 0;
-  stage_max   = 2 * (len - 1) * (sizeof(interesting_16) >> 1);
+          }
 
-  orig_hit_cnt = new_hit_cnt;
+          break;
 
-  for (i = 0; i < len - 1; i++) {
+        case 14: {
 
-    u16 orig = *(u16*)(out_buf + i);
+          /* Overwrite bytes with a randomly selected chunk (75%) or fixed
+             bytes (25%). */
 
-    /* Let's consult the effector map... */
+          u32 copy_from, copy_to, copy_len;
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
-      stage_max -= sizeof(interesting_16);
-      continue;
-    }
+          if (temp_len < 2) {
+            is_used = 0;
+            break;
+          }
 
-    stage_cur_byte = i;
+          copy_len  = choose_block_len(temp_len - 1);
 
-    for (j = 0; j < sizeof(interesting_16) / 2; j++) {
+          copy_from = UR(temp_len - copy_len + 1);
+          copy_to = location = select_location_vertical(temp_len - copy_len + 1, &rel_loc);
 
-      stage_cur_val = interesting_16[j];
+          if (UR(4)) {
 
-      /* Skip if this could be a product of a bitflip, arithmetics,
-         or single-byte interesting value insertion. */
+            if (copy_from != copy_to)
+              memmove(out_buf + copy_to, out_buf + copy_from, copy_len);
 
-      if (!could_be_bitflip(orig ^ (u16)interesting_16[j]) &&
-          !could_be_arith(orig, (u16)interesting_16[j], 2) &&
-          !could_be_interest(orig, (u16)interesting_16[j], 2, 0)) {
+          } else memset(out_buf + copy_to,
+                        UR(2) ? UR(256) : out_buf[UR(temp_len)], copy_len);
 
-        stage_val_type = STAGE_VAL_LE;
+          break;
 
-        *(u16*)(out_buf + i) = interesting_16[j];
-        init_mutation_vertical();
+        }
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(10, (double)i / (double)(len-1));
-        stage_cur++;
+          /* Values 15 and 16 can be selected only if there are any extras
+             present in the dictionaries. */
 
-      } else stage_max--;
+        case 15: {
 
-      if ((u16)interesting_16[j] != SWAP16(interesting_16[j]) &&
-          !could_be_bitflip(orig ^ SWAP16(interesting_16[j])) &&
-          !could_be_arith(orig, SWAP16(interesting_16[j]), 2) &&
-          !could_be_interest(orig, SWAP16(interesting_16[j]), 2, 1)) {
+          /* Overwrite bytes with an extra. */
 
-        stage_val_type = STAGE_VAL_BE;
+          if (!extras_cnt || (a_extras_cnt && UR(2))) {
 
-        *(u16*)(out_buf + i) = SWAP16(interesting_16[j]);
-        init_mutation_vertical();
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(10, (double)i / (double)(len-1));
-        stage_cur++;
+            /* No user-specified extras or odds in our favor. Let's use an
+               auto-detected one. */
 
-      } else stage_max--;
+            u32 use_extra = UR(a_extras_cnt);
+            u32 extra_len = a_extras[use_extra].len;
+            u32 insert_at;
 
-    }
+            if (extra_len > temp_len) {
+              is_used = 0;
+              break;
+            }
 
-    *(u16*)(out_buf + i) = orig;
+            insert_at = UR(temp_len - extra_len + 1);
+            memcpy(out_buf + insert_at, a_extras[use_extra].data, extra_len);
 
-  }
+          } else {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+            /* No auto extras or odds in our favor. Use the dictionary. */
 
-  stage_finds[STAGE_INTEREST16]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_INTEREST16] += stage_max;
+            u32 use_extra = UR(extras_cnt);
+            u32 extra_len = extras[use_extra].len;
+            u32 insert_at;
 
-  if (len < 4) goto skip_interest;
+            if (extra_len > temp_len) {
+              is_used = 0;
+              break;
+            }
 
-  /* Setting 32-bit integers, both endians. */
+            insert_at = location = select_location_vertical(temp_len - extra_len + 1, &rel_loc);
+            memcpy(out_buf + insert_at, extras[use_extra].data, extra_len);
 
-  stage_name  = "interest 32/8";
-  stage_short = "int32";
-  stage_cur   = 0;
-  stage_max   = 2 * (len - 3) * (sizeof(interesting_32) >> 2);
+          }
 
-  orig_hit_cnt = new_hit_cnt;
+          break;
 
-  for (i = 0; i < len - 3; i++) {
+        }
 
-    u32 orig = *(u32*)(out_buf + i);
+        case 16: {
 
-    /* Let's consult the effector map... */
+          u32 use_extra, extra_len, insert_at = location = select_location_vertical(temp_len + 1, &rel_loc);
+          u8* new_buf;
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
-        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
-      stage_max -= sizeof(interesting_32) >> 1;
-      continue;
-    }
+          /* Insert an extra. Do the same dice-rolling stuff as for the
+             previous case. */
 
-    stage_cur_byte = i;
+          if (!extras_cnt || (a_extras_cnt && UR(2))) {
 
-    for (j = 0; j < sizeof(interesting_32) / 4; j++) {
+            use_extra = UR(a_extras_cnt);
+            extra_len = a_extras[use_extra].len;
 
-      stage_cur_val = interesting_32[j];
+            if (temp_len + extra_len >= MAX_FILE) {
+              is_used = 0;
+              break;
+            }
 
-      /* Skip if this could be a product of a bitflip, arithmetics,
-         or word interesting value insertion. */
+            new_buf = ck_alloc_nozero(temp_len + extra_len);
 
-      if (!could_be_bitflip(orig ^ (u32)interesting_32[j]) &&
-          !could_be_arith(orig, interesting_32[j], 4) &&
-          !could_be_interest(orig, interesting_32[j], 4, 0)) {
+            /* Head */
+            memcpy(new_buf, out_buf, insert_at);
 
-        stage_val_type = STAGE_VAL_LE;
+            /* Inserted part */
+            memcpy(new_buf + insert_at, a_extras[use_extra].data, extra_len);
 
-        *(u32*)(out_buf + i) = interesting_32[j];
-        init_mutation_vertical();
+          } else {
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(11, (double)i / (double)(len-3));
-        stage_cur++;
+            use_extra = UR(extras_cnt);
+            extra_len = extras[use_extra].len;
 
-      } else stage_max--;
+            if (temp_len + extra_len >= MAX_FILE) {
+              is_used = 0;
+              break;
+            }
 
-      if ((u32)interesting_32[j] != SWAP32(interesting_32[j]) &&
-          !could_be_bitflip(orig ^ SWAP32(interesting_32[j])) &&
-          !could_be_arith(orig, SWAP32(interesting_32[j]), 4) &&
-          !could_be_interest(orig, SWAP32(interesting_32[j]), 4, 1)) {
+            new_buf = ck_alloc_nozero(temp_len + extra_len);
 
-        stage_val_type = STAGE_VAL_BE;
+            /* Head */
+            memcpy(new_buf, out_buf, insert_at);
 
-        *(u32*)(out_buf + i) = SWAP32(interesting_32[j]);
-        init_mutation_vertical();
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        log_single_mutator_selection(11, (double)i / (double)(len-3));
-        stage_cur++;
+            /* Inserted part */
+            memcpy(new_buf + insert_at, extras[use_extra].data, extra_len);
 
-      } else stage_max--;
+          }
 
-    }
+          /* Tail */
+          memcpy(new_buf + insert_at + extra_len, out_buf + insert_at,
+                 temp_len - insert_at);
 
-    *(u32*)(out_buf + i) = orig;
+          ck_free(out_buf);
+          out_buf   = new_buf;
+          temp_len += extra_len;
 
-  }
+          break;
 
-  new_hit_cnt = queued_paths + unique_crashes;
+        }
 
-  stage_finds[STAGE_INTEREST32]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_INTEREST32] += stage_max;
+      }
 
-skip_interest:
+      // Log this mutation selection
+      if (is_used) {
+        mut_cnt[loc_count] = mutator;
+        loc_cnt[loc_count] = rel_loc;
+        loc_count++;
+      }
 
-  /********************
-   * DICTIONARY STUFF *
-   ********************/
+    }
 
-  if (!extras_cnt) goto skip_user_extras;
+    if (pool_size) {
 
-  /* Overwrite with user-supplied extras. */
+      /* Started on the next executor; its result is merged when that
+         executor comes round again, or at the end of the stage. */
 
-  stage_name  = "user extras (over)";
-  stage_short = "ext_UO";
-  stage_cur   = 0;
-  stage_max   = extras_cnt * len;
+      if (pool_run(argv, out_buf, temp_len, mut_cnt, loc_cnt, loc_count))
+        goto abandon_entry;
 
-  stage_val_type = STAGE_VAL_NONE;
+    } else if (!no_pipeline) {
 
-  orig_hit_cnt = new_hit_cnt;
+      /* Collect the previous mutant, which ran while this one was being
+         generated, then start this one and build the next one in the
+         spare buffer. */
 
-  for (i = 0; i < len; i++) {
+      if (pipeline_finish(argv)) goto abandon_entry;
 
-    u32 last_len = 0;
+      pipeline_start(argv, out_buf, temp_len, mut_cnt, loc_cnt, loc_count);
 
-    stage_cur_byte = i;
+      ex_tmp    = spare_buf;
+      spare_buf = out_buf;
+      out_buf   = ex_tmp ? ex_tmp : ck_alloc_nozero(len);
 
-    /* Extras are sorted by size, from smallest to largest. This means
-       that we don't have to worry about restoring the buffer in
-       between writes at a particular offset determined by the outer
-       loop. */
+    } else {
 
-    for (j = 0; j < extras_cnt; j++) {
+      init_mutation_vertical();
 
-      /* Skip extras probabilistically if extras_cnt > MAX_DET_EXTRAS. Also
-         skip them if there's no room to insert the payload, if the token
-         is redundant, or if its entire span has no bytes set in the effector
-         map. */
+      if (common_fuzz_stuff(argv, out_buf, temp_len))
+        goto abandon_entry;
 
-      if ((extras_cnt > MAX_DET_EXTRAS && UR(extras_cnt) >= MAX_DET_EXTRAS) ||
-          extras[j].len > len - i ||
-          !memcmp(extras[j].data, out_buf + i, extras[j].len) ||
-          !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, extras[j].len))) {
+      log_mutator_selection(mut_cnt, loc_cnt, loc_count);
 
-        stage_max--;
-        continue;
+    }
 
-      }
+    /* out_buf might have been mangled a bit, so let's restore it to its
+       original size and shape. Buffers only ever grow, so this is
+       normally just the copy. */
+    if (ALLOC_S(out_buf) < len) out_buf = ck_realloc(out_buf, len);
+    temp_len = len;
+    memcpy(out_buf, in_buf, len);
 
-      last_len = extras[j].len;
-      memcpy(out_buf + i, extras[j].data, last_len);
-      init_mutation_vertical();
+    /* If we're finding new stuff, let's run for a bit longer, limits
+       permitting. */
 
-      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    if (queued_paths != havoc_queued) {
 
-      log_single_mutator_selection(12, (double)i / (double)len);
+      if (perf_score <= HAVOC_MAX_MULT * 100) {
+        stage_max  *= 2;
+        perf_score *= 2;
+      }
 
-      stage_cur++;
+      havoc_queued = queued_paths;
 
     }
 
-    /* Restore all the clobbered memory. */
-    memcpy(out_buf + i, in_buf + i, last_len);
-
   }
 
-  new_hit_cnt = queued_paths + unique_crashes;
+  if (pipeline_finish(argv)) goto abandon_entry;
 
-  stage_finds[STAGE_EXTRAS_UO]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_EXTRAS_UO] += stage_max;
+  if (pool_size && pool_flush(argv)) goto abandon_entry;
 
-  /* Insertion of user-supplied extras. */
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  stage_name  = "user extras (insert)";
-  stage_short = "ext_UI";
-  stage_cur   = 0;
-  stage_max   = extras_cnt * len;
+  if (!splice_cycle) {
+    stage_finds[STAGE_HAVOC]  += new_hit_cnt - orig_hit_cnt;
+    stage_cycles[STAGE_HAVOC] += stage_max;
+  } else {
+    stage_finds[STAGE_SPLICE]  += new_hit_cnt - orig_hit_cnt;
+    stage_cycles[STAGE_SPLICE] += stage_max;
+  }
 
-  orig_hit_cnt = new_hit_cnt;
+#ifndef IGNORE_FINDS
 
-  ex_tmp = ck_alloc(len + MAX_DICT_FILE);
+  /************
+   * SPLICING *
+   ************/
 
-  for (i = 0; i <= len; i++) {
+  /* This is a last-resort strategy triggered by a full round with no findings.
+     It takes the current input file, randomly selects another input, and
+     splices them together at some offset, then relies on the havoc
+     code to mutate that blob. */
 
-    stage_cur_byte = i;
+retry_splicing:
 
-    for (j = 0; j < extras_cnt; j++) {
+  if (use_splicing && splice_cycle++ < SPLICE_CYCLES &&
+      queued_paths > 1 && queue_cur->len > 1) {
 
-      if (len + extras[j].len > MAX_FILE) {
-        stage_max--;
-        continue;
-      }
+    u32 idx, idx_div, split_at;
+    u8 *new_buf, *tmp_buf;
+    s32 f_diff, l_diff;
 
-      /* Insert token */
-      memcpy(ex_tmp + i, extras[j].data, extras[j].len);
+    /* First of all, if we've modified in_buf for havoc, let's clean that
+       up... */
 
-      /* Copy tail */
-      memcpy(ex_tmp + i + extras[j].len, out_buf + i, len - i);
-      init_mutation_vertical();
+    if (in_buf != orig_in) {
+      ck_free(in_buf);
+      in_buf = orig_in;
+      len = queue_cur->len;
+    }
 
-      if (common_fuzz_stuff(argv, ex_tmp, len + extras[j].len)) {
-        ck_free(ex_tmp);
-        goto abandon_entry;
-      }
-      log_single_mutator_selection(13, (double)i / (double)len);
+    /* Pick a random queue entry and find it. */
 
-      stage_cur++;
+    idx = UR(queued_paths_cur);
 
+    idx_div = idx / 100;
+    if (idx_div < 1024) {
+      target = shortcut_per_100[idx_div];
+      idx -= idx_div * 100;
+    } else {
+      target = shortcut_per_100[1023];
+      idx -= idx_div * 1024;
     }
 
-    /* Copy head */
-    ex_tmp[i] = out_buf[i];
+    while (idx--) target = target->next;
 
-  }
+    /* Make sure that the target has a reasonable length and isn't yourself. */
 
-  ck_free(ex_tmp);
+    while (target && (target->len < 2 || target == queue_cur)) {
+      target = target->next;
+    }
 
-  new_hit_cnt = queued_paths + unique_crashes;
+    if (!target) goto retry_splicing;
 
-  stage_finds[STAGE_EXTRAS_UI]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_EXTRAS_UI] += stage_max;
+    splicing_with = target->entry_id;
 
-skip_user_extras:
+    /* Read the testcase into a new buffer. */
 
-  if (!a_extras_cnt) goto skip_extras;
+    /* Take a private copy, since the head of the current input is about
+       to be written over it. */
 
-  stage_name  = "auto extras (over)";
-  stage_short = "ext_AO";
-  stage_cur   = 0;
-  stage_max   = MIN(a_extras_cnt, USE_AUTO_EXTRAS) * len;
+    new_buf = ck_alloc_nozero(target->len);
+    tmp_buf = seed_cache_get(target);
+    memcpy(new_buf, tmp_buf, target->len);
+    seed_cache_put(target, tmp_buf);
 
-  stage_val_type = STAGE_VAL_NONE;
+    /* Find a suitable splicing location, somewhere between the first and
+       the last differing byte. Bail out if the difference is just a single
+       byte or so. */
 
-  orig_hit_cnt = new_hit_cnt;
+    locate_diffs(in_buf, new_buf, MIN(len, target->len), &f_diff, &l_diff);
 
-  for (i = 0; i < len; i++) {
+    if (f_diff < 0 || l_diff < 2 || f_diff == l_diff) {
+      ck_free(new_buf);
+      goto retry_splicing;
+    }
 
-    u32 last_len = 0;
+    /* Split somewhere between the first and last differing byte. */
 
-    stage_cur_byte = i;
+    split_at = f_diff + UR(l_diff - f_diff);
 
-    for (j = 0; j < MIN(a_extras_cnt, USE_AUTO_EXTRAS); j++) {
+    /* Do the thing. */
 
-      /* See the comment in the earlier code; extras are sorted by size. */
+    len = target->len;
+    memcpy(new_buf, in_buf, split_at);
+    in_buf = new_buf;
 
-      if (a_extras[j].len > len - i ||
-          !memcmp(a_extras[j].data, out_buf + i, a_extras[j].len) ||
-          !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, a_extras[j].len))) {
+    ck_free(out_buf);
+    out_buf = ck_alloc_nozero(len);
+    memcpy(out_buf, in_buf, len);
 
-        stage_max--;
-        continue;
+    goto havoc_stage;
 
-      }
+  }
 
-      last_len = a_extras[j].len;
-      memcpy(out_buf + i, a_extras[j].data, last_len);
-      init_mutation_vertical();
+#endif /* !IGNORE_FINDS */
 
-      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+  ret_val = 0;
 
-      log_single_mutator_selection(14, (double)i / (double)len);
-      stage_cur++;
+abandon_entry:
 
-    }
+  queue_cur->selection_count++;
 
-    /* Restore all the clobbered memory. */
-    memcpy(out_buf + i, in_buf + i, last_len);
+  splicing_with = -1;
 
-  }
+  /* Update pending_not_fuzzed count if we made it through the calibration
+     cycle and have not seen this entry before. */
 
-  new_hit_cnt = queued_paths + unique_crashes;
+  if (!stop_soon && !queue_cur->cal_failed && !queue_cur->was_fuzzed) {
+    queue_cur->was_fuzzed = 1;
+    pending_not_fuzzed--;
+    if (queue_cur->favored) pending_favored--;
+  }
 
-  stage_finds[STAGE_EXTRAS_AO]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_EXTRAS_AO] += stage_max;
+  seed_cache_put(queue_cur, orig_in);
 
-skip_extras:
+  if (in_buf != orig_in) ck_free(in_buf);
+  ck_free(out_buf);
+  ck_free(spare_buf);
+  ck_free(eff_map);
 
-  /* If we made this to here without jumping to havoc_stage or abandon_entry,
-     we're properly done with deterministic steps and can mark it as such
-     in the .state/ directory. */
+  return ret_val;
 
-  if (!queue_cur->passed_det) mark_as_det_done(queue_cur);
+#undef FLIP_BIT
 
-  /****************
-   * RANDOM HAVOC *
-   ****************/
+}
 
-havoc_stage:
 
-  stage_cur_byte = -1;
+/* Take the current entry from the queue, fuzz it for a while. This
+   function is a tad too long... returns 0 if fuzzed successfully, 1 if
+   skipped or bailed out. */
 
-  /* The havoc stage mutation code is also invoked when splicing files; if the
-     splice_cycle variable is set, generate different descriptions and such. */
+static u8 fuzz_one_original(char** argv) {
 
-  if (!splice_cycle) {
+  s32 len, temp_len, i, j;
+  u8  *in_buf, *out_buf, *orig_in, *ex_tmp, *eff_map = 0;
+  u64 havoc_queued,  orig_hit_cnt, new_hit_cnt;
+  u32 splice_cycle = 0, perf_score = 100, orig_perf, prev_cksum, eff_cnt = 1;
 
-    /* Adjust perf_score with the factor derived from the proximity score */
-    double prox_score = (double)queue_cur->prox_score.original;
-    perf_score = (u32) (calculate_factor(prox_score) * (double) perf_score);
+ struct queue_entry* target; // Target test case to splice with.
 
-    stage_name  = "havoc-vertical";
-    stage_short = "havoc-vert";
-    stage_max   = (doing_det ? HAVOC_CYCLES_INIT : HAVOC_CYCLES) *
-                  perf_score / havoc_div / 100;
+  u8  ret_val = 1, doing_det = 0;
 
+  u8  a_collect[MAX_AUTO_EXTRA];
+  u32 a_len = 0;
 
-  } else {
+#ifdef IGNORE_FINDS
 
-    static u8 tmp[32];
+  /* In IGNORE_FINDS mode, skip any entries that weren't in the
+     initial data set. */
 
-    perf_score = orig_perf;
+  if (queue_cur->depth > 1) return 1;
 
-    /* Adjust perf_score with the factor derived from the proximity score */
-    double prox_score = (queue_cur->prox_score.original + target->prox_score.original) / 2;
-    perf_score = (u32) (calculate_factor(prox_score) * (double) perf_score);
+#else
 
-    sprintf(tmp, "splice-vertical-%u", splice_cycle);
-    stage_name  = tmp;
-    stage_short = "splice-vert";
-    stage_max   = SPLICE_HAVOC * perf_score / havoc_div / 100;
+  if (pending_favored) {
 
-  }
+    /* If we have any favored, non-fuzzed new arrivals in the queue,
+       possibly skip to them at the expense of already-fuzzed or non-favored
+       cases. */
 
-  LOGF("[pow] [orig %u] [factor %f] [perf %u] [id %d]\n", orig_perf, calculate_factor(queue_cur->prox_score.original), perf_score, queue_cur->entry_id);
+    if ((queue_cur->was_fuzzed || !queue_cur->favored) &&
+        UR(100) < SKIP_TO_NEW_PROB) return 1;
 
-  if (stage_max < HAVOC_MIN) stage_max = HAVOC_MIN;
+  } else if (!dumb_mode && !queue_cur->favored && queued_paths > 10) {
 
-  temp_len = len;
+    /* Otherwise, still possibly skip non-favored cases, albeit less often.
+       The odds of skipping stuff are higher for already-fuzzed inputs and
+       lower for never-fuzzed entries. */
 
-  orig_hit_cnt = queued_paths + unique_crashes;
+    if (queue_cycle > 1 && !queue_cur->was_fuzzed) {
 
-  havoc_queued = queued_paths;
+      if (UR(100) < SKIP_NFAV_NEW_PROB) return 1;
 
-  /* We essentially just do several thousand runs (depending on perf_score)
-     where we take the input file and make random stacked tweaks. */
+    } else {
 
-  u32 mut_cnt[1<<HAVOC_STACK_POW2];
-  double loc_cnt[1<<HAVOC_STACK_POW2];
+      if (UR(100) < SKIP_NFAV_OLD_PROB) return 1;
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+    }
 
-    u32 use_stacking = 1 << (1 + UR(HAVOC_STACK_POW2));
-    u32 loc_count = 0;
+  }
 
-    stage_cur_val = use_stacking;
+#endif /* ^IGNORE_FINDS */
 
-    memset(mut_cnt, 0, sizeof(mut_cnt));
-    memset(loc_cnt, 0, sizeof(loc_cnt));
+  if (not_on_tty) {
+    ACTF("Fuzzing test case #%u (%u total, %llu uniq crashes found)...",
+         current_entry, queued_paths, unique_crashes);
+    fflush(stdout);
+  }
 
-    for (i = 0; i < use_stacking; i++) {
+  /* Map the test case into memory. */
 
-      u32 location = 0;
-      u32 mutator = select_mutator_vertical(extras_cnt + a_extras_cnt);
-      double rel_loc = 0.0;
-      u8 is_used = 1;
+  len = queue_cur->len;
 
-      switch (mutator) {
+  orig_in = in_buf = seed_cache_get(queue_cur);
 
-        case 0:
+  /* We could mmap() out_buf as MAP_PRIVATE, but we end up clobbering every
+     single byte anyway, so it wouldn't give us any performance or memory usage
+     benefits. */
 
-          /* Flip a single bit somewhere. Spooky! */
-          location = select_location_vertical(temp_len << 3, &rel_loc);
-          FLIP_BIT(out_buf, location);
-          break;
+  out_buf = ck_alloc_nozero(len);
 
-        case 1:
+  subseq_tmouts = 0;
 
-          /* Set byte to interesting value. */
-          location = select_location_vertical(temp_len, &rel_loc);
-          out_buf[location] = interesting_8[UR(sizeof(interesting_8))];
-          break;
+  cur_depth = queue_cur->depth;
 
-        case 2:
+  /*******************************************
+   * CALIBRATION (only if failed earlier on) *
+   *******************************************/
 
-          /* Set word to interesting value, randomly choosing endian. */
+  if (queue_cur->cal_failed) {
 
-          if (temp_len < 2) {
-            is_used = 0;
-            break;
-          }
+    u8 res = FAULT_TMOUT;
 
-          location = select_location_vertical(temp_len - 1, &rel_loc);
+    if (queue_cur->cal_failed < CAL_CHANCES) {
 
-          if (UR(2)) {
+      /* Reset exec_cksum to tell calibrate_case to re-execute the testcase
+         avoiding the usage of an invalid trace_bits.
+         For more info: https://github.com/AFLplusplus/AFLplusplus/pull/425 */
 
-            *(u16*)(out_buf + location) =
-                interesting_16[UR(sizeof(interesting_16) >> 1)];
+      queue_cur->exec_cksum = 0;
 
-          } else {
+      res = calibrate_case(argv, queue_cur, in_buf, queue_cycle - 1, 0);
 
-            *(u16*)(out_buf + location) = SWAP16(
-                interesting_16[UR(sizeof(interesting_16) >> 1)]);
+      if (res == FAULT_ERROR)
+        FATAL("Unable to execute target application");
 
-          }
+    }
 
-          break;
+    if (stop_soon || check_res(res)) {
+      cur_skipped_paths++;
+      goto abandon_entry;
+    }
 
-        case 3:
+  }
 
-          /* Set dword to interesting value, randomly choosing endian. */
+  /************
+   * TRIMMING *
+   ************/
 
-          if (temp_len < 4) {
-            is_used = 0;
-            break;
-          }
+  if (!dumb_mode && !queue_cur->trim_done) {
 
-          location = select_location_vertical(temp_len - 3, &rel_loc);
+    u8 res = trim_case(argv, queue_cur, in_buf);
 
-          if (UR(2)) {
+    if (res == FAULT_ERROR)
+      FATAL("Unable to execute target application");
 
-            *(u32*)(out_buf + location) =
-                interesting_32[UR(sizeof(interesting_32) >> 2)];
+    if (stop_soon) {
+      cur_skipped_paths++;
+      goto abandon_entry;
+    }
 
-          } else {
+    /* Don't retry trimming, even if it failed. */
 
-            *(u32*)(out_buf + location) = SWAP32(
-                interesting_32[UR(sizeof(interesting_32) >> 2)]);
+    queue_cur->trim_done = 1;
 
-          }
+    if (len != queue_cur->len) len = queue_cur->len;
 
-          break;
+  }
 
-        case 4:
+  memcpy(out_buf, in_buf, len);
 
-          /* Randomly subtract from byte. */
-          location = select_location_vertical(temp_len, &rel_loc);
-          out_buf[location] -= 1 + UR(ARITH_MAX);
-          break;
+  /*********************
+   * PERFORMANCE SCORE *
+   *********************/
 
-        case 5:
+  orig_perf = perf_score = calculate_score(queue_cur);
 
-          /* Randomly add to byte. */
-          location = select_location_vertical(temp_len, &rel_loc);
-          out_buf[location] += 1 + UR(ARITH_MAX);
-          break;
+  /* Skip right away if -d is given, if we have done deterministic fuzzing on
+     this entry ourselves (was_fuzzed), or if it has gone through deterministic
+     testing in earlier, resumed runs (passed_det). */
 
-        case 6:
+  if (skip_deterministic || queue_cur->was_fuzzed || queue_cur->passed_det)
+    goto havoc_stage;
 
-          /* Randomly subtract from word, random endian. */
+  /* Skip deterministic fuzzing if exec path checksum puts this out of scope
+     for this master instance. */
 
-          if (temp_len < 2) {
-            is_used = 0;
-            break;
-          }
+  if (master_max && (queue_cur->exec_cksum % master_max) != master_id - 1)
+    goto havoc_stage;
 
-          location = select_location_vertical(temp_len - 1, &rel_loc);
+  doing_det = 1;
 
-          if (UR(2)) {
+  /*********************************************
+   * SIMPLE BITFLIP (+dictionary construction) *
+   *********************************************/
 
-            *(u16*)(out_buf + location) -= 1 + UR(ARITH_MAX);
+#define FLIP_BIT(_ar, _b) do { \
+    u8* _arf = (u8*)(_ar); \
+    u32 _bf = (_b); \
+    _arf[(_bf) >> 3] ^= (128 >> ((_bf) & 7)); \
+  } while (0)
 
-          } else {
+  /* Single walking bit. */
 
-            u16 num = 1 + UR(ARITH_MAX);
+  stage_short = "flip1";
+  stage_max   = len << 3;
+  stage_name  = "bitflip 1/1";
 
-            *(u16*)(out_buf + location) =
-                SWAP16(SWAP16(*(u16*)(out_buf + location)) - num);
+  stage_val_type = STAGE_VAL_NONE;
 
-          }
+  orig_hit_cnt = queued_paths + unique_crashes;
 
-          break;
+  prev_cksum = queue_cur->exec_cksum;
 
-        case 7:
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-          /* Randomly add to word, random endian. */
+    stage_cur_byte = stage_cur >> 3;
 
-          if (temp_len < 2) {
-            is_used = 0;
-            break;
-          }
+    FLIP_BIT(out_buf, stage_cur);
 
-          location = select_location_vertical(temp_len - 1, &rel_loc);
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-          if (UR(2)) {
+    FLIP_BIT(out_buf, stage_cur);
 
-            u32 pos = location;
+    /* While flipping the least significant bit in every byte, pull of an extra
+       trick to detect possible syntax tokens. In essence, the idea is that if
+       you have a binary blob like this:
 
-            *(u16*)(out_buf + pos) += 1 + UR(ARITH_MAX);
+       xxxxxxxxIHDRxxxxxxxx
 
-          } else {
+       ...and changing the leading and trailing bytes causes variable or no
+       changes in program flow, but touching any character in the "IHDR" string
+       always produces the same, distinctive path, it's highly likely that
+       "IHDR" is an atomically-checked magic value of special significance to
+       the fuzzed format.
 
-            u32 pos = location;
-            u16 num = 1 + UR(ARITH_MAX);
+       We do this here, rather than as a separate stage, because it's a nice
+       way to keep the operation approximately "free" (i.e., no extra execs).
 
-            *(u16*)(out_buf + pos) =
-                SWAP16(SWAP16(*(u16*)(out_buf + pos)) + num);
+       Empirically, performing the check when flipping the least significant bit
+       is advantageous, compared to doing it at the time of more disruptive
+       changes, where the program flow may be affected in more violent ways.
 
-          }
+       The caveat is that we won't generate dictionaries in the -d mode or -S
+       mode - but that's probably a fair trade-off.
 
-          break;
+       This won't work particularly well with paths that exhibit variable
+       behavior, but fails gracefully, so we'll carry out the checks anyway.
 
-        case 8:
+      */
 
-          /* Randomly subtract from dword, random endian. */
+    if (!dumb_mode && (stage_cur & 7) == 7) {
 
-          if (temp_len < 4) {
-            is_used = 0;
-            break;
-          }
+      u32 cksum = hash32(trace_bits, map_size, HASH_CONST);
 
-          location = select_location_vertical(temp_len - 3, &rel_loc);
+      if (stage_cur == stage_max - 1 && cksum == prev_cksum) {
 
-          if (UR(2)) {
+        /* If at end of file and we are still collecting a string, grab the
+           final character and force output. */
 
-            u32 pos = location;
+        if (a_len < MAX_AUTO_EXTRA) a_collect[a_len] = out_buf[stage_cur >> 3];
+        a_len++;
 
-            *(u32*)(out_buf + pos) -= 1 + UR(ARITH_MAX);
+        if (a_len >= MIN_AUTO_EXTRA && a_len <= MAX_AUTO_EXTRA)
+          maybe_add_auto(a_collect, a_len);
 
-          } else {
+      } else if (cksum != prev_cksum) {
 
-            u32 pos = location;
-            u32 num = 1 + UR(ARITH_MAX);
+        /* Otherwise, if the checksum has changed, see if we have something
+           worthwhile queued up, and collect that if the answer is yes. */
 
-            *(u32*)(out_buf + pos) =
-                SWAP32(SWAP32(*(u32*)(out_buf + pos)) - num);
+        if (a_len >= MIN_AUTO_EXTRA && a_len <= MAX_AUTO_EXTRA)
+          maybe_add_auto(a_collect, a_len);
 
-          }
+        a_len = 0;
+        prev_cksum = cksum;
 
-          break;
+      }
 
-        case 9:
+      /* Continue collecting string, but only if the bit flip actually made
+         any difference - we don't want no-op tokens. */
 
-          /* Randomly add to dword, random endian. */
+      if (cksum != queue_cur->exec_cksum) {
 
-          if (temp_len < 4) {
-            is_used = 0;
-            break;
-          }
+        if (a_len < MAX_AUTO_EXTRA) a_collect[a_len] = out_buf[stage_cur >> 3];
+        a_len++;
 
-          location = select_location_vertical(temp_len - 3, &rel_loc);
+      }
 
-          if (UR(2)) {
+    }
 
-            u32 pos = location;
+  }
 
-            *(u32*)(out_buf + pos) += 1 + UR(ARITH_MAX);
+  new_hit_cnt = queued_paths + unique_crashes;
 
-          } else {
+  stage_finds[STAGE_FLIP1]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP1] += stage_max;
 
-            u32 pos = location;
-            u32 num = 1 + UR(ARITH_MAX);
+  /* Two walking bits. */
 
-            *(u32*)(out_buf + pos) =
-                SWAP32(SWAP32(*(u32*)(out_buf + pos)) + num);
+  stage_name  = "bitflip 2/1";
+  stage_short = "flip2";
+  stage_max   = (len << 3) - 1;
 
-          }
+  orig_hit_cnt = new_hit_cnt;
 
-          break;
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-        case 10:
+    stage_cur_byte = stage_cur >> 3;
 
-          /* Just set a random byte to a random value. Because,
-             why not. We use XOR with 1-255 to eliminate the
-             possibility of a no-op. */
-          location = select_location_vertical(temp_len, &rel_loc);
-          out_buf[location] ^= 1 + UR(255);
-          break;
+    FLIP_BIT(out_buf, stage_cur);
+    FLIP_BIT(out_buf, stage_cur + 1);
 
-        case 11 ... 12: {
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-          /* Delete bytes. We're making this a bit more likely
-             than insertion (the next option) in hopes of keeping
-             files reasonably small. */
+    FLIP_BIT(out_buf, stage_cur);
+    FLIP_BIT(out_buf, stage_cur + 1);
 
-          u32 del_from, del_len;
+  }
 
-          if (temp_len < 2) {
-            is_used = 0;
-            break;
-          }
+  new_hit_cnt = queued_paths + unique_crashes;
 
-          /* Don't delete too much. */
+  stage_finds[STAGE_FLIP2]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP2] += stage_max;
 
-          del_len = choose_block_len(temp_len - 1);
+  /* Four walking bits. */
 
-          del_from = location = select_location_vertical(temp_len - del_len + 1, &rel_loc);
+  stage_name  = "bitflip 4/1";
+  stage_short = "flip4";
+  stage_max   = (len << 3) - 3;
 
-          memmove(out_buf + del_from, out_buf + del_from + del_len,
-                  temp_len - del_from - del_len);
+  orig_hit_cnt = new_hit_cnt;
 
-          temp_len -= del_len;
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-          break;
+    stage_cur_byte = stage_cur >> 3;
 
-        }
+    FLIP_BIT(out_buf, stage_cur);
+    FLIP_BIT(out_buf, stage_cur + 1);
+    FLIP_BIT(out_buf, stage_cur + 2);
+    FLIP_BIT(out_buf, stage_cur + 3);
 
-        case 13:
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-          if (temp_len + HAVOC_BLK_XL < MAX_FILE) {
+    FLIP_BIT(out_buf, stage_cur);
+    FLIP_BIT(out_buf, stage_cur + 1);
+    FLIP_BIT(out_buf, stage_cur + 2);
+    FLIP_BIT(out_buf, stage_cur + 3);
 
-            /* Clone bytes (75%) or insert a block of constant bytes (25%). */
+  }
 
-            u8  actually_clone = UR(4);
-            u32 clone_from, clone_to, clone_len;
-            u8* new_buf;
+  new_hit_cnt = queued_paths + unique_crashes;
 
-            if (actually_clone) {
+  stage_finds[STAGE_FLIP4]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP4] += stage_max;
 
-              clone_len  = choose_block_len(temp_len);
-              clone_from = UR(temp_len - clone_len + 1);
+  /* Effector map setup. These macros calculate:
 
-            } else {
+     EFF_APOS      - position of a particular file offset in the map.
+     EFF_ALEN      - length of a map with a particular number of bytes.
+     EFF_SPAN_ALEN - map span for a sequence of bytes.
 
-              clone_len = choose_block_len(HAVOC_BLK_XL);
-              clone_from = 0;
+   */
 
-            }
+#define EFF_APOS(_p)          ((_p) >> EFF_MAP_SCALE2)
+#define EFF_REM(_x)           ((_x) & ((1 << EFF_MAP_SCALE2) - 1))
+#define EFF_ALEN(_l)          (EFF_APOS(_l) + !!EFF_REM(_l))
+#define EFF_SPAN_ALEN(_p, _l) (EFF_APOS((_p) + (_l) - 1) - EFF_APOS(_p) + 1)
 
-            clone_to = location = select_location_vertical(temp_len, &rel_loc);
+  /* Initialize effector map for the next step (see comments below). Always
+     flag first and last byte as doing something. */
 
-            new_buf = ck_alloc_nozero(temp_len + clone_len);
+  eff_map    = ck_alloc(EFF_ALEN(len));
+  eff_map[0] = 1;
 
-            /* Head */
+  if (EFF_APOS(len - 1) != 0) {
+    eff_map[EFF_APOS(len - 1)] = 1;
+    eff_cnt++;
+  }
 
-            memcpy(new_buf, out_buf, clone_to);
+  /* Walking byte. */
 
-            /* Inserted part */
+  stage_name  = "bitflip 8/8";
+  stage_short = "flip8";
+  stage_max   = len;
 
-            if (actually_clone)
-              memcpy(new_buf + clone_to, out_buf + clone_from, clone_len);
-            else
-              memset(new_buf + clone_to,
-                     UR(2) ? UR(256) : out_buf[UR(temp_len)], clone_len);
+  orig_hit_cnt = new_hit_cnt;
 
-            /* Tail */
-            memcpy(new_buf + clone_to + clone_len, out_buf + clone_to,
-                   temp_len - clone_to);
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-            ck_free(out_buf);
-            out_buf = new_buf;
-            temp_len += clone_len;
+    stage_cur_byte = stage_cur;
 
-          }
+    out_buf[stage_cur] ^= 0xFF;
 
-          break;
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-        case 14: {
+    /* We also use this stage to pull off a simple trick: we identify
+       bytes that seem to have no effect on the current execution path
+       even when fully flipped - and we skip them during more expensive
+       deterministic stages, such as arithmetics or known ints. */
 
-          /* Overwrite bytes with a randomly selected chunk (75%) or fixed
-             bytes (25%). */
+    if (!eff_map[EFF_APOS(stage_cur)]) {
 
-          u32 copy_from, copy_to, copy_len;
+      u32 cksum;
 
-          if (temp_len < 2) {
-            is_used = 0;
-            break;
-          }
+      /* If in dumb mode or if the file is very short, just flag everything
+         without wasting time on checksums. */
 
-          copy_len  = choose_block_len(temp_len - 1);
+      if (!dumb_mode && len >= EFF_MIN_LEN)
+        cksum = hash32(trace_bits, map_size, HASH_CONST);
+      else
+        cksum = ~queue_cur->exec_cksum;
 
-          copy_from = UR(temp_len - copy_len + 1);
-          copy_to = location = select_location_vertical(temp_len - copy_len + 1, &rel_loc);
+      if (cksum != queue_cur->exec_cksum) {
+        eff_map[EFF_APOS(stage_cur)] = 1;
+        eff_cnt++;
+      }
 
-          if (UR(4)) {
+    }
 
-            if (copy_from != copy_to)
-              memmove(out_buf + copy_to, out_buf + copy_from, copy_len);
+    out_buf[stage_cur] ^= 0xFF;
 
-          } else memset(out_buf + copy_to,
-                        UR(2) ? UR(256) : out_buf[UR(temp_len)], copy_len);
+  }
 
-          break;
+  /* If the effector map is more than EFF_MAX_PERC dense, just flag the
+     whole thing as worth fuzzing, since we wouldn't be saving much time
+     anyway. */
 
-        }
+  if (eff_cnt != EFF_ALEN(len) &&
+      eff_cnt * 100 / EFF_ALEN(len) > EFF_MAX_PERC) {
 
-          /* Values 15 and 16 can be selected only if there are any extras
-             present in the dictionaries. */
+    memset(eff_map, 1, EFF_ALEN(len));
 
-        case 15: {
+    blocks_eff_select += EFF_ALEN(len);
 
-          /* Overwrite bytes with an extra. */
+  } else {
 
-          if (!extras_cnt || (a_extras_cnt && UR(2))) {
+    blocks_eff_select += eff_cnt;
 
-            /* No user-specified extras or odds in our favor. Let's use an
-               auto-detected one. */
+  }
 
-            u32 use_extra = UR(a_extras_cnt);
-            u32 extra_len = a_extras[use_extra].len;
-            u32 insert_at;
+  blocks_eff_total += EFF_ALEN(len);
 
-            if (extra_len > temp_len) {
-              is_used = 0;
-              break;
-            }
+  new_hit_cnt = queued_paths + unique_crashes;
 
-            insert_at = UR(temp_len - extra_len + 1);
-            memcpy(out_buf + insert_at, a_extras[use_extra].data, extra_len);
+  stage_finds[STAGE_FLIP8]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP8] += stage_max;
 
-          } else {
+  /* Two walking bytes. */
 
-            /* No auto extras or odds in our favor. Use the dictionary. */
+  if (len < 2) goto skip_bitflip;
 
-            u32 use_extra = UR(extras_cnt);
-            u32 extra_len = extras[use_extra].len;
-            u32 insert_at;
+  stage_name  = "bitflip 16/8";
+  stage_short = "flip16";
+  stage_cur   = 0;
+  stage_max   = len - 1;
 
-            if (extra_len > temp_len) {
-              is_used = 0;
-              break;
-            }
+  orig_hit_cnt = new_hit_cnt;
 
-            insert_at = location = select_location_vertical(temp_len - extra_len + 1, &rel_loc);
-            memcpy(out_buf + insert_at, extras[use_extra].data, extra_len);
+  for (i = 0; i < len - 1; i++) {
 
-          }
+    /* Let's consult the effector map... */
 
-          break;
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
+      stage_max--;
+      continue;
+    }
 
-        }
+    stage_cur_byte = i;
 
-        case 16: {
+    *(u16*)(out_buf + i) ^= 0xFFFF;
 
-          u32 use_extra, extra_len, insert_at = location = select_location_vertical(temp_len + 1, &rel_loc);
-          u8* new_buf;
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    stage_cur++;
 
-          /* Insert an extra. Do the same dice-rolling stuff as for the
-             previous case. */
+    *(u16*)(out_buf + i) ^= 0xFFFF;
 
-          if (!extras_cnt || (a_extras_cnt && UR(2))) {
 
-            use_extra = UR(a_extras_cnt);
-            extra_len = a_extras[use_extra].len;
+  }
 
-            if (temp_len + extra_len >= MAX_FILE) {
-              is_used = 0;
-              break;
-            }
+  new_hit_cnt = queued_paths + unique_crashes;
 
-            new_buf = ck_alloc_nozero(temp_len + extra_len);
+  stage_finds[STAGE_FLIP16]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP16] += stage_max;
 
-            /* Head */
-            memcpy(new_buf, out_buf, insert_at);
+  if (len < 4) goto skip_bitflip;
 
-            /* Inserted part */
-            memcpy(new_buf + insert_at, a_extras[use_extra].data, extra_len);
+  /* Four walking bytes. */
 
-          } else {
+  stage_name  = "bitflip 32/8";
+  stage_short = "flip32";
+  stage_cur   = 0;
+  stage_max   = len - 3;
 
-            use_extra = UR(extras_cnt);
-            extra_len = extras[use_extra].len;
+  orig_hit_cnt = new_hit_cnt;
 
-            if (temp_len + extra_len >= MAX_FILE) {
-              is_used = 0;
-              break;
-            }
+  for (i = 0; i < len - 3; i++) {
 
-            new_buf = ck_alloc_nozero(temp_len + extra_len);
+    /* Let's consult the effector map... */
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
+        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
+      stage_max--;
+      continue;
+    }
 
-            /* Head */
-            memcpy(new_buf, out_buf, insert_at);
+    stage_cur_byte = i;
 
-            /* Inserted part */
-            memcpy(new_buf + insert_at, extras[use_extra].data, extra_len);
+    *(u32*)(out_buf + i) ^= 0xFFFFFFFF;
 
-          }
+    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    stage_cur++;
 
-          /* Tail */
-          memcpy(new_buf + insert_at + extra_len, out_buf + insert_at,
-                 temp_len - insert_at);
+    *(u32*)(out_buf + i) ^= 0xFFFFFFFF;
 
-          ck_free(out_buf);
-          out_buf   = new_buf;
-          temp_len += extra_len;
+  }
 
-          break;
+  new_hit_cnt = queued_paths + unique_crashes;
 
-        }
+  stage_finds[STAGE_FLIP32]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_FLIP32] += stage_max;
 
-      }
+skip_bitflip:
 
-      // Log this mutation selection
-      if (is_used) {
-        mut_cnt[loc_count] = mutator;
-        loc_cnt[loc_count] = rel_loc;
-        loc_count++;
-      }
+  if (no_arith) goto skip_arith;
 
-    }
+  /**********************
+   * ARITHMETIC INC/DEC *
+   **********************/
 
-    init_mutation_vertical();
+  /* 8-bit arithmetics. */
 
-    if (common_fuzz_stuff(argv, out_buf, temp_len))
-      goto abandon_entry;
+  stage_name  = "arith 8/8";
+  stage_short = "arith8";
+  stage_cur   = 0;
+  stage_max   = 2 * len * ARITH_MAX;
 
-    log_mutator_selection(mut_cnt, loc_cnt, loc_count);
-    /* out_buf might have been mangled a bit, so let's restore it to its
-       original size and shape. */
-    if (temp_len < len) out_buf = ck_realloc(out_buf, len);
-    temp_len = len;
-    memcpy(out_buf, in_buf, len);
+  stage_val_type = STAGE_VAL_LE;
 
-    /* If we're finding new stuff, let's run for a bit longer, limits
-       permitting. */
+  orig_hit_cnt = new_hit_cnt;
 
-    if (queued_paths != havoc_queued) {
+  for (i = 0; i < len; i++) {
 
-      if (perf_score <= HAVOC_MAX_MULT * 100) {
-        stage_max  *= 2;
-        perf_score *= 2;
-      }
+    u8 orig = out_buf[i];
 
-      havoc_queued = queued_paths;
+    /* Let's consult the effector map... */
 
+    if (!eff_map[EFF_APOS(i)]) {
+      stage_max -= 2 * ARITH_MAX;
+      continue;
     }
 
-  }
+    stage_cur_byte = i;
 
-  new_hit_cnt = queued_paths + unique_crashes;
+    for (j = 1; j <= ARITH_MAX; j++) {
 
-  if (!splice_cycle) {
-    stage_finds[STAGE_HAVOC]  += new_hit_cnt - orig_hit_cnt;
-    stage_cycles[STAGE_HAVOC] += stage_max;
-  } else {
-    stage_finds[STAGE_SPLICE]  += new_hit_cnt - orig_hit_cnt;
-    stage_cycles[STAGE_SPLICE] += stage_max;
-  }
+      u8 r = orig ^ (orig + j);
 
-#ifndef IGNORE_FINDS
+      /* Do arithmetic operations only if the result couldn't be a product
+         of a bitflip. */
 
-  /************
-   * SPLICING *
-   ************/
+      if (!could_be_bitflip(r)) {
 
-  /* This is a last-resort strategy triggered by a full round with no findings.
-     It takes the current input file, randomly selects another input, and
-     splices them together at some offset, then relies on the havoc
-     code to mutate that blob. */
+        stage_cur_val = j;
+        out_buf[i] = orig + j;
 
-retry_splicing:
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-  if (use_splicing && splice_cycle++ < SPLICE_CYCLES &&
-      queued_paths > 1 && queue_cur->len > 1) {
+      } else stage_max--;
 
-    u32 idx, idx_div, split_at;
-    u8* new_buf;
-    s32 f_diff, l_diff;
+      r =  orig ^ (orig - j);
 
-    /* First of all, if we've modified in_buf for havoc, let's clean that
-       up... */
+      if (!could_be_bitflip(r)) {
 
-    if (in_buf != orig_in) {
-      ck_free(in_buf);
-      in_buf = orig_in;
-      len = queue_cur->len;
-    }
+        stage_cur_val = -j;
+        out_buf[i] = orig - j;
 
-    /* Pick a random queue entry and find it. */
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-    idx = UR(queued_paths_cur);
+      } else stage_max--;
+
+      out_buf[i] = orig;
 
-    idx_div = idx / 100;
-    if (idx_div < 1024) {
-      target = shortcut_per_100[idx_div];
-      idx -= idx_div * 100;
-    } else {
-      target = shortcut_per_100[1023];
-      idx -= idx_div * 1024;
     }
 
-    while (idx--) target = target->next;
+  }
 
-    /* Make sure that the target has a reasonable length and isn't yourself. */
+  new_hit_cnt = queued_paths + unique_crashes;
 
-    while (target && (target->len < 2 || target == queue_cur)) {
-      target = target->next;
-    }
+  stage_finds[STAGE_ARITH8]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_ARITH8] += stage_max;
 
-    if (!target) goto retry_splicing;
+  /* 16-bit arithmetics, both endians. */
 
-    splicing_with = target->entry_id;
+  if (len < 2) goto skip_arith;
 
-    /* Read the testcase into a new buffer. */
+  stage_name  = "arith 16/8";
+  stage_short = "arith16";
+  stage_cur   = 0;
+  stage_max   = 4 * (len - 1) * ARITH_MAX;
 
-    fd = open(target->fname, O_RDONLY);
+  orig_hit_cnt = new_hit_cnt;
 
-    if (fd < 0) PFATAL("Unable to open '%s'", target->fname);
+  for (i = 0; i < len - 1; i++) {
 
-    new_buf = ck_alloc_nozero(target->len);
+    u16 orig = *(u16*)(out_buf + i);
 
-    ck_read(fd, new_buf, target->len, target->fname);
+    /* Let's consult the effector map... */
 
-    close(fd);
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
+      stage_max -= 4 * ARITH_MAX;
+      continue;
+    }
 
-    /* Find a suitable splicing location, somewhere between the first and
-       the last differing byte. Bail out if the difference is just a single
-       byte or so. */
+    stage_cur_byte = i;
 
-    locate_diffs(in_buf, new_buf, MIN(len, target->len), &f_diff, &l_diff);
+    for (j = 1; j <= ARITH_MAX; j++) {
 
-    if (f_diff < 0 || l_diff < 2 || f_diff == l_diff) {
-      ck_free(new_buf);
-      goto retry_splicing;
-    }
+      u16 r1 = orig ^ (orig + j),
+          r2 = orig ^ (orig - j),
+          r3 = orig ^ SWAP16(SWAP16(orig) + j),
+          r4 = orig ^ SWAP16(SWAP16(orig) - j);
 
-    /* Split somewhere between the first and last differing byte. */
+      /* Try little endian addition and subtraction first. Do it only
+         if the operation would affect more than one byte (hence the
+         & 0xff overflow checks) and if it couldn't be a product of
+         a bitflip. */
 
-    split_at = f_diff + UR(l_diff - f_diff);
+      stage_val_type = STAGE_VAL_LE;
 
-    /* Do the thing. */
+      if ((orig & 0xff) + j > 0xff && !could_be_bitflip(r1)) {
 
-    len = target->len;
-    memcpy(new_buf, in_buf, split_at);
-    in_buf = new_buf;
+        stage_cur_val = j;
+        *(u16*)(out_buf + i) = orig + j;
 
-    ck_free(out_buf);
-    out_buf = ck_alloc_nozero(len);
-    memcpy(out_buf, in_buf, len);
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-    goto havoc_stage;
+      } else stage_max--;
 
-  }
+      if ((orig & 0xff) < j && !could_be_bitflip(r2)) {
 
-#endif /* !IGNORE_FINDS */
+        stage_cur_val = -j;
+        *(u16*)(out_buf + i) = orig - j;
 
-  ret_val = 0;
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-abandon_entry:
+      } else stage_max--;
 
-  queue_cur->selection_count++;
+      /* Big endian comes next. Same deal. */
 
-  splicing_with = -1;
+      stage_val_type = STAGE_VAL_BE;
 
-  /* Update pending_not_fuzzed count if we made it through the calibration
-     cycle and have not seen this entry before. */
 
-  if (!stop_soon && !queue_cur->cal_failed && !queue_cur->was_fuzzed) {
-    queue_cur->was_fuzzed = 1;
-    pending_not_fuzzed--;
-    if (queue_cur->favored) pending_favored--;
-  }
+      if ((orig >> 8) + j > 0xff && !could_be_bitflip(r3)) {
+
+        stage_cur_val = j;
+        *(u16*)(out_buf + i) = SWAP16(SWAP16(orig) + j);
 
-  munmap(orig_in, queue_cur->len);
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-  if (in_buf != orig_in) ck_free(in_buf);
-  ck_free(out_buf);
-  ck_free(eff_map);
+      } else stage_max--;
 
-  return ret_val;
+      if ((orig >> 8) < j && !could_be_bitflip(r4)) {
 
-#undef FLIP_BIT
+        stage_cur_val = -j;
+        *(u16*)(out_buf + i) = SWAP16(SWAP16(orig) - j);
 
-}
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
+      } else stage_max--;
 
-/* Take the current entry from the queue, fuzz it for a while. This
-   function is a tad too long... returns 0 if fuzzed successfully, 1 if
-   skipped or bailed out. */
+      *(u16*)(out_buf + i) = orig;
 
-static u8 fuzz_one_original(char** argv) {
+    }
 
-  s32 len, fd, temp_len, i, j;
-  u8  *in_buf, *out_buf, *orig_in, *ex_tmp, *eff_map = 0;
-  u64 havoc_queued,  orig_hit_cnt, new_hit_cnt;
-  u32 splice_cycle = 0, perf_score = 100, orig_perf, prev_cksum, eff_cnt = 1;
+  }
 
- struct queue_entry* target; // Target test case to splice with.
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  u8  ret_val = 1, doing_det = 0;
+  stage_finds[STAGE_ARITH16]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_ARITH16] += stage_max;
 
-  u8  a_collect[MAX_AUTO_EXTRA];
-  u32 a_len = 0;
+  /* 32-bit arithmetics, both endians. */
 
-#ifdef IGNORE_FINDS
+  if (len < 4) goto skip_arith;
 
-  /* In IGNORE_FINDS mode, skip any entries that weren't in the
-     initial data set. */
+  stage_name  = "arith 32/8";
+  stage_short = "arith32";
+  stage_cur   = 0;
+  stage_max   = 4 * (len - 3) * ARITH_MAX;
 
-  if (queue_cur->depth > 1) return 1;
+  orig_hit_cnt = new_hit_cnt;
 
-#else
+  for (i = 0; i < len - 3; i++) {
 
-  if (pending_favored) {
+    u32 orig = *(u32*)(out_buf + i);
 
-    /* If we have any favored, non-fuzzed new arrivals in the queue,
-       possibly skip to them at the expense of already-fuzzed or non-favored
-       cases. */
+    /* Let's consult the effector map... */
 
-    if ((queue_cur->was_fuzzed || !queue_cur->favored) &&
-        UR(100) < SKIP_TO_NEW_PROB) return 1;
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
+        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
+      stage_max -= 4 * ARITH_MAX;
+      continue;
+    }
 
-  } else if (!dumb_mode && !queue_cur->favored && queued_paths > 10) {
+    stage_cur_byte = i;
 
-    /* Otherwise, still possibly skip non-favored cases, albeit less often.
-       The odds of skipping stuff are higher for already-fuzzed inputs and
-       lower for never-fuzzed entries. */
+    for (j = 1; j <= ARITH_MAX; j++) {
 
-    if (queue_cycle > 1 && !queue_cur->was_fuzzed) {
+      u32 r1 = orig ^ (orig + j),
+          r2 = orig ^ (orig - j),
+          r3 = orig ^ SWAP32(SWAP32(orig) + j),
+          r4 = orig ^ SWAP32(SWAP32(orig) - j);
 
-      if (UR(100) < SKIP_NFAV_NEW_PROB) return 1;
+      /* Little endian first. Same deal as with 16-bit: we only want to
+         try if the operation would have effect on more than two bytes. */
 
-    } else {
+      stage_val_type = STAGE_VAL_LE;
 
-      if (UR(100) < SKIP_NFAV_OLD_PROB) return 1;
+      if ((orig & 0xffff) + j > 0xffff && !could_be_bitflip(r1)) {
 
-    }
+        stage_cur_val = j;
+        *(u32*)(out_buf + i) = orig + j;
 
-  }
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-#endif /* ^IGNORE_FINDS */
+      } else stage_max--;
 
-  if (not_on_tty) {
-    ACTF("Fuzzing test case #%u (%u total, %llu uniq crashes found)...",
-         current_entry, queued_paths, unique_crashes);
-    fflush(stdout);
-  }
+      if ((orig & 0xffff) < j && !could_be_bitflip(r2)) {
 
-  /* Map the test case into memory. */
+        stage_cur_val = -j;
+        *(u32*)(out_buf + i) = orig - j;
 
-  fd = open(queue_cur->fname, O_RDONLY);
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-  if (fd < 0) PFATAL("Unable to open '%s'", queue_cur->fname);
+      } else stage_max--;
 
-  len = queue_cur->len;
+      /* Big endian next. */
 
-  orig_in = in_buf = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      stage_val_type = STAGE_VAL_BE;
 
-  if (orig_in == MAP_FAILED) PFATAL("Unable to mmap '%s'", queue_cur->fname);
+      if ((SWAP32(orig) & 0xffff) + j > 0xffff && !could_be_bitflip(r3)) {
 
-  close(fd);
+        stage_cur_val = j;
+        *(u32*)(out_buf + i) = SWAP32(SWAP32(orig) + j);
 
-  /* We could mmap() out_buf as MAP_PRIVATE, but we end up clobbering every
-     single byte anyway, so it wouldn't give us any performance or memory usage
-     benefits. */
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-  out_buf = ck_alloc_nozero(len);
+      } else stage_max--;
 
-  subseq_tmouts = 0;
+      if ((SWAP32(orig) & 0xffff) < j && !could_be_bitflip(r4)) {
 
-  cur_depth = queue_cur->depth;
+        stage_cur_val = -j;
+        *(u32*)(out_buf + i) = SWAP32(SWAP32(orig) - j);
 
-  /*******************************************
-   * CALIBRATION (only if failed earlier on) *
-   *******************************************/
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-  if (queue_cur->cal_failed) {
+      } else stage_max--;
 
-    u8 res = FAULT_TMOUT;
+      *(u32*)(out_buf + i) = orig;
 
-    if (queue_cur->cal_failed < CAL_CHANCES) {
+    }
 
-      /* Reset exec_cksum to tell calibrate_case to re-execute the testcase
-         avoiding the usage of an invalid trace_bits.
-         For more info: https://github.com/AFLplusplus/AFLplusplus/pull/425 */
+  }
 
-      queue_cur->exec_cksum = 0;
+  new_hit_cnt = queued_paths + unique_crashes;
 
-      res = calibrate_case(argv, queue_cur, in_buf, queue_cycle - 1, 0);
+  stage_finds[STAGE_ARITH32]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_ARITH32] += stage_max;
 
-      if (res == FAULT_ERROR)
-        FATAL("Unable to execute target application");
+skip_arith:
 
-    }
+  /**********************
+   * INTERESTING VALUES *
+   **********************/
 
-    if (stop_soon || check_res(res)) {
-      cur_skipped_paths++;
-      goto abandon_entry;
-    }
+  stage_name  = "interest 8/8";
+  stage_short = "int8";
+  stage_cur   = 0;
+  stage_max   = len * sizeof(interesting_8);
 
-  }
+  stage_val_type = STAGE_VAL_LE;
 
-  /************
-   * TRIMMING *
-   ************/
+  orig_hit_cnt = new_hit_cnt;
 
-  if (!dumb_mode && !queue_cur->trim_done) {
+  /* Setting 8-bit integers. */
 
-    u8 res = trim_case(argv, queue_cur, in_buf);
+  for (i = 0; i < len; i++) {
 
-    if (res == FAULT_ERROR)
-      FATAL("Unable to execute target application");
+    u8 orig = out_buf[i];
 
-    if (stop_soon) {
-      cur_skipped_paths++;
-      goto abandon_entry;
+    /* Let's consult the effector map... */
+
+    if (!eff_map[EFF_APOS(i)]) {
+      stage_max -= sizeof(interesting_8);
+      continue;
     }
 
-    /* Don't retry trimming, even if it failed. */
+    stage_cur_byte = i;
 
-    queue_cur->trim_done = 1;
+    for (j = 0; j < sizeof(interesting_8); j++) {
 
-    if (len != queue_cur->len) len = queue_cur->len;
+      /* Skip if the value could be a product of bitflips or arithmetics. */
 
-  }
+      if (could_be_bitflip(orig ^ (u8)interesting_8[j]) ||
+          could_be_arith(orig, (u8)interesting_8[j], 1)) {
+        stage_max--;
+        continue;
+      }
 
-  memcpy(out_buf, in_buf, len);
+      stage_cur_val = interesting_8[j];
+      out_buf[i] = interesting_8[j];
 
-  /*********************
-   * PERFORMANCE SCORE *
-   *********************/
+      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-  orig_perf = perf_score = calculate_score(queue_cur);
+      out_buf[i] = orig;
+      stage_cur++;
 
-  /* Skip right away if -d is given, if we have done deterministic fuzzing on
-     this entry ourselves (was_fuzzed), or if it has gone through deterministic
-     testing in earlier, resumed runs (passed_det). */
+    }
 
-  if (skip_deterministic || queue_cur->was_fuzzed || queue_cur->passed_det)
-    goto havoc_stage;
+  }
 
-  /* Skip deterministic fuzzing if exec path checksum puts this out of scope
-     for this master instance. */
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  if (master_max && (queue_cur->exec_cksum % master_max) != master_id - 1)
-    goto havoc_stage;
+  stage_finds[STAGE_INTEREST8]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_INTEREST8] += stage_max;
 
-  doing_det = 1;
+  /* Setting 16-bit integers, both endians. */
 
-  /*********************************************
-   * SIMPLE BITFLIP (+dictionary construction) *
-   *********************************************/
+  if (no_arith || len < 2) goto skip_interest;
 
-#define FLIP_BIT(_ar, _b) do { \
-    u8* _arf = (u8*)(_ar); \
-    u32 _bf = (_b); \
-    _arf[(_bf) >> 3] ^= (128 >> ((_bf) & 7)); \
-  } while (0)
+  stage_name  = "interest 16/8";
+  stage_short = "int16";
+  stage_cur   = 0;
+  stage_max   = 2 * (len - 1) * (sizeof(interesting_16) >> 1);
 
-  /* Single walking bit. */
+  orig_hit_cnt = new_hit_cnt;
 
-  stage_short = "flip1";
-  stage_max   = len << 3;
-  stage_name  = "bitflip 1/1";
+  for (i = 0; i < len - 1; i++) {
 
-  stage_val_type = STAGE_VAL_NONE;
+    u16 orig = *(u16*)(out_buf + i);
 
-  orig_hit_cnt = queued_paths + unique_crashes;
+    /* Let's consult the effector map... */
 
-  prev_cksum = queue_cur->exec_cksum;
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
+      stage_max -= sizeof(interesting_16);
+      continue;
+    }
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+    stage_cur_byte = i;
 
-    stage_cur_byte = stage_cur >> 3;
+    for (j = 0; j < sizeof(interesting_16) / 2; j++) {
 
-    FLIP_BIT(out_buf, stage_cur);
+      stage_cur_val = interesting_16[j];
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+      /* Skip if this could be a product of a bitflip, arithmetics,
+         or single-byte interesting value insertion. */
 
-    FLIP_BIT(out_buf, stage_cur);
+      if (!could_be_bitflip(orig ^ (u16)interesting_16[j]) &&
+          !could_be_arith(orig, (u16)interesting_16[j], 2) &&
+          !could_be_interest(orig, (u16)interesting_16[j], 2, 0)) {
 
-    /* While flipping the least significant bit in every byte, pull of an extra
-       trick to detect possible syntax tokens. In essence, the idea is that if
-       you have a binary blob like this:
+        stage_val_type = STAGE_VAL_LE;
+
+        *(u16*)(out_buf + i) = interesting_16[j];
 
-       xxxxxxxxIHDRxxxxxxxx
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-       ...and changing the leading and trailing bytes causes variable or no
-       changes in program flow, but touching any character in the "IHDR" string
-       always produces the same, distinctive path, it's highly likely that
-       "IHDR" is an atomically-checked magic value of special significance to
-       the fuzzed format.
+      } else stage_max--;
 
-       We do this here, rather than as a separate stage, because it's a nice
-       way to keep the operation approximately "free" (i.e., no extra execs).
+      if ((u16)interesting_16[j] != SWAP16(interesting_16[j]) &&
+          !could_be_bitflip(orig ^ SWAP16(interesting_16[j])) &&
+          !could_be_arith(orig, SWAP16(interesting_16[j]), 2) &&
+          !could_be_interest(orig, SWAP16(interesting_16[j]), 2, 1)) {
 
-       Empirically, performing the check when flipping the least significant bit
-       is advantageous, compared to doing it at the time of more disruptive
-       changes, where the program flow may be affected in more violent ways.
+        stage_val_type = STAGE_VAL_BE;
 
-       The caveat is that we won't generate dictionaries in the -d mode or -S
-       mode - but that's probably a fair trade-off.
+        *(u16*)(out_buf + i) = SWAP16(interesting_16[j]);
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-       This won't work particularly well with paths that exhibit variable
-       behavior, but fails gracefully, so we'll carry out the checks anyway.
+      } else stage_max--;
 
-      */
+    }
 
-    if (!dumb_mode && (stage_cur & 7) == 7) {
+    *(u16*)(out_buf + i) = orig;
 
-      u32 cksum = hash32(trace_bits, MAP_SIZE, HASH_CONST);
+  }
 
-      if (stage_cur == stage_max - 1 && cksum == prev_cksum) {
+  new_hit_cnt = queued_paths + unique_crashes;
 
-        /* If at end of file and we are still collecting a string, grab the
-           final character and force output. */
+  stage_finds[STAGE_INTEREST16]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_INTEREST16] += stage_max;
 
-        if (a_len < MAX_AUTO_EXTRA) a_collect[a_len] = out_buf[stage_cur >> 3];
-        a_len++;
+  if (len < 4) goto skip_interest;
 
-        if (a_len >= MIN_AUTO_EXTRA && a_len <= MAX_AUTO_EXTRA)
-          maybe_add_auto(a_collect, a_len);
+  /* Setting 32-bit integers, both endians. */
 
-      } else if (cksum != prev_cksum) {
+  stage_name  = "interest 32/8";
+  stage_short = "int32";
+  stage_cur   = 0;
+  stage_max   = 2 * (len - 3) * (sizeof(interesting_32) >> 2);
 
-        /* Otherwise, if the checksum has changed, see if we have something
-           worthwhile queued up, and collect that if the answer is yes. */
+  orig_hit_cnt = new_hit_cnt;
 
-        if (a_len >= MIN_AUTO_EXTRA && a_len <= MAX_AUTO_EXTRA)
-          maybe_add_auto(a_collect, a_len);
+  for (i = 0; i < len - 3; i++) {
 
-        a_len = 0;
-        prev_cksum = cksum;
+    u32 orig = *(u32*)(out_buf + i);
 
-      }
+    /* Let's consult the effector map... */
 
-      /* Continue collecting string, but only if the bit flip actually made
-         any difference - we don't want no-op tokens. */
+    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
+        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
+      stage_max -= sizeof(interesting_32) >> 1;
+      continue;
+    }
 
-      if (cksum != queue_cur->exec_cksum) {
+    stage_cur_byte = i;
 
-        if (a_len < MAX_AUTO_EXTRA) a_collect[a_len] = out_buf[stage_cur >> 3];
-        a_len++;
+    for (j = 0; j < sizeof(interesting_32) / 4; j++) {
 
-      }
+      stage_cur_val = interesting_32[j];
 
-    }
+      /* Skip if this could be a product of a bitflip, arithmetics,
+         or word interesting value insertion. */
 
-  }
+      if (!could_be_bitflip(orig ^ (u32)interesting_32[j]) &&
+          !could_be_arith(orig, interesting_32[j], 4) &&
+          !could_be_interest(orig, interesting_32[j], 4, 0)) {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+        stage_val_type = STAGE_VAL_LE;
 
-  stage_finds[STAGE_FLIP1]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP1] += stage_max;
+        *(u32*)(out_buf + i) = interesting_32[j];
 
-  /* Two walking bits. */
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-  stage_name  = "bitflip 2/1";
-  stage_short = "flip2";
-  stage_max   = (len << 3) - 1;
+      } else stage_max--;
 
-  orig_hit_cnt = new_hit_cnt;
+      if ((u32)interesting_32[j] != SWAP32(interesting_32[j]) &&
+          !could_be_bitflip(orig ^ SWAP32(interesting_32[j])) &&
+          !could_be_arith(orig, SWAP32(interesting_32[j]), 4) &&
+          !could_be_interest(orig, SWAP32(interesting_32[j]), 4, 1)) {
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+        stage_val_type = STAGE_VAL_BE;
 
-    stage_cur_byte = stage_cur >> 3;
+        *(u32*)(out_buf + i) = SWAP32(interesting_32[j]);
+        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+        stage_cur++;
 
-    FLIP_BIT(out_buf, stage_cur);
-    FLIP_BIT(out_buf, stage_cur + 1);
+      } else stage_max--;
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    }
 
-    FLIP_BIT(out_buf, stage_cur);
-    FLIP_BIT(out_buf, stage_cur + 1);
+    *(u32*)(out_buf + i) = orig;
 
   }
 
   new_hit_cnt = queued_paths + unique_crashes;
 
-  stage_finds[STAGE_FLIP2]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP2] += stage_max;
+  stage_finds[STAGE_INTEREST32]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_INTEREST32] += stage_max;
 
-  /* Four walking bits. */
+skip_interest:
 
-  stage_name  = "bitflip 4/1";
-  stage_short = "flip4";
-  stage_max   = (len << 3) - 3;
+  /********************
+   * DICTIONARY STUFF *
+   ********************/
+
+  if (!extras_cnt) goto skip_user_extras;
+
+  /* Overwrite with user-supplied extras. */
+
+  stage_name  = "user extras (over)";
+  stage_short = "ext_UO";
+  stage_cur   = 0;
+  stage_max   = extras_cnt * len;
+
+  stage_val_type = STAGE_VAL_NONE;
 
   orig_hit_cnt = new_hit_cnt;
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+  for (i = 0; i < len; i++) {
 
-    stage_cur_byte = stage_cur >> 3;
+    u32 last_len = 0;
 
-    FLIP_BIT(out_buf, stage_cur);
-    FLIP_BIT(out_buf, stage_cur + 1);
-    FLIP_BIT(out_buf, stage_cur + 2);
-    FLIP_BIT(out_buf, stage_cur + 3);
+    stage_cur_byte = i;
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    /* Extras are sorted by size, from smallest to largest. This means
+       that we don't have to worry about restoring the buffer in
+       between writes at a particular offset determined by the outer
+       loop. */
 
-    FLIP_BIT(out_buf, stage_cur);
-    FLIP_BIT(out_buf, stage_cur + 1);
-    FLIP_BIT(out_buf, stage_cur + 2);
-    FLIP_BIT(out_buf, stage_cur + 3);
+    for (j = 0; j < extras_cnt; j++) {
 
-  }
+      /* Skip extras probabilistically if extras_cnt > MAX_DET_EXTRAS. Also
+         skip them if there's no room to insert the payload, if the token
+         is redundant, or if its entire span has no bytes set in the effector
+         map. */
 
-  new_hit_cnt = queued_paths + unique_crashes;
+      if ((extras_cnt > MAX_DET_EXTRAS && UR(extras_cnt) >= MAX_DET_EXTRAS) ||
+          extras[j].len > len - i ||
+          !memcmp(extras[j].data, out_buf + i, extras[j].len) ||
+          !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, extras[j].len))) {
 
-  stage_finds[STAGE_FLIP4]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP4] += stage_max;
+        stage_max--;
+        continue;
 
-  /* Effector map setup. These macros calculate:
+      }
 
-     EFF_APOS      - position of a particular file offset in the map.
-     EFF_ALEN      - length of a map with a particular number of bytes.
-     EFF_SPAN_ALEN - map span for a sequence of bytes.
+      last_len = extras[j].len;
+      memcpy(out_buf + i, extras[j].data, last_len);
 
-   */
+      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
 
-#define EFF_APOS(_p)          ((_p) >> EFF_MAP_SCALE2)
-#define EFF_REM(_x)           ((_x) & ((1 << EFF_MAP_SCALE2) - 1))
-#define EFF_ALEN(_l)          (EFF_APOS(_l) + !!EFF_REM(_l))
-#define EFF_SPAN_ALEN(_p, _l) (EFF_APOS((_p) + (_l) - 1) - EFF_APOS(_p) + 1)
+      stage_cur++;
 
-  /* Initialize effector map for the next step (see comments below). Always
-     flag first and last byte as doing something. */
+    }
 
-  eff_map    = ck_alloc(EFF_ALEN(len));
-  eff_map[0] = 1;
+    /* Restore all the clobbered memory. */
+    memcpy(out_buf + i, in_buf + i, last_len);
 
-  if (EFF_APOS(len - 1) != 0) {
-    eff_map[EFF_APOS(len - 1)] = 1;
-    eff_cnt++;
   }
 
-  /* Walking byte. */
+  new_hit_cnt = queued_paths + unique_crashes;
 
-  stage_name  = "bitflip 8/8";
-  stage_short = "flip8";
-  stage_max   = len;
+  stage_finds[STAGE_EXTRAS_UO]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_EXTRAS_UO] += stage_max;
 
-  orig_hit_cnt = new_hit_cnt;
+  /* Insertion of user-supplied extras. */
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+  stage_name  = "user extras (insert)";
+  stage_short = "ext_UI";
+  stage_cur   = 0;
+  stage_max   = extras_cnt * len;
 
-    stage_cur_byte = stage_cur;
+  orig_hit_cnt = new_hit_cnt;
 
-    out_buf[stage_cur] ^= 0xFF;
+  ex_tmp = ck_alloc(len + MAX_DICT_FILE);
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+  for (i = 0; i <= len; i++) {
 
-    /* We also use this stage to pull off a simple trick: we identify
-       bytes that seem to have no effect on the current execution path
-       even when fully flipped - and we skip them during more expensive
-       deterministic stages, such as arithmetics or known ints. */
+    stage_cur_byte = i;
 
-    if (!eff_map[EFF_APOS(stage_cur)]) {
+    for (j = 0; j < extras_cnt; j++) {
 
-      u32 cksum;
+      if (len + extras[j].len > MAX_FILE) {
+        stage_max--;
+        continue;
+      }
 
-      /* If in dumb mode or if the file is very short, just flag everything
-         without wasting time on checksums. */
+      /* Insert token */
+      memcpy(ex_tmp + i, extras[j].data, extras[j].len);
 
-      if (!dumb_mode && len >= EFF_MIN_LEN)
-        cksum = hash32(trace_bits, MAP_SIZE, HASH_CONST);
-      else
-        cksum = ~queue_cur->exec_cksum;
+      /* Copy tail */
+      memcpy(ex_tmp + i + extras[j].len, out_buf + i, len - i);
 
-      if (cksum != queue_cur->exec_cksum) {
-        eff_map[EFF_APOS(stage_cur)] = 1;
-        eff_cnt++;
+      if (common_fuzz_stuff(argv, ex_tmp, len + extras[j].len)) {
+        ck_free(ex_tmp);
+        goto abandon_entry;
       }
 
+      stage_cur++;
+
     }
 
-    out_buf[stage_cur] ^= 0xFF;
+    /* Copy head */
+    ex_tmp[i] = out_buf[i];
 
   }
 
-  /* If the effector map is more than EFF_MAX_PERC dense, just flag the
-     whole thing as worth fuzzing, since we wouldn't be saving much time
-     anyway. */
+  ck_free(ex_tmp);
 
-  if (eff_cnt != EFF_ALEN(len) &&
-      eff_cnt * 100 / EFF_ALEN(len) > EFF_MAX_PERC) {
+  new_hit_cnt = queued_paths + unique_crashes;
+
+  stage_finds[STAGE_EXTRAS_UI]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_EXTRAS_UI] += stage_max;
+
+skip_user_extras:
 
-    memset(eff_map, 1, EFF_ALEN(len));
+  if (!a_extras_cnt) goto skip_extras;
 
-    blocks_eff_select += EFF_ALEN(len);
+  stage_name  = "auto extras (over)";
+  stage_short = "ext_AO";
+  stage_cur   = 0;
+  stage_max   = MIN(a_extras_cnt, USE_AUTO_EXTRAS) * len;
 
-  } else {
+  stage_val_type = STAGE_VAL_NONE;
 
-    blocks_eff_select += eff_cnt;
+  orig_hit_cnt = new_hit_cnt;
 
-  }
+  for (i = 0; i < len; i++) {
 
-  blocks_eff_total += EFF_ALEN(len);
+    u32 last_len = 0;
 
-  new_hit_cnt = queued_paths + unique_crashes;
+    stage_cur_byte = i;
 
-  stage_finds[STAGE_FLIP8]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP8] += stage_max;
+    for (j = 0; j < MIN(a_extras_cnt, USE_AUTO_EXTRAS); j++) {
 
-  /* Two walking bytes. */
+      /* See the comment in the earlier code; extras are sorted by size. */
 
-  if (len < 2) goto skip_bitflip;
+      if (a_extras[j].len > len - i ||
+          !memcmp(a_extras[j].data, out_buf + i, a_extras[j].len) ||
+          !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, a_extras[j].len))) {
 
-  stage_name  = "bitflip 16/8";
-  stage_short = "flip16";
-  stage_cur   = 0;
-  stage_max   = len - 1;
+        stage_max--;
+        continue;
 
-  orig_hit_cnt = new_hit_cnt;
+      }
 
-  for (i = 0; i < len - 1; i++) {
+      last_len = a_extras[j].len;
+      memcpy(out_buf + i, a_extras[j].data, last_len);
 
-    /* Let's consult the effector map... */
+      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+
+      stage_cur++;
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
-      stage_max--;
-      continue;
     }
 
-    stage_cur_byte = i;
+    /* Restore all the clobbered memory. */
+    memcpy(out_buf + i, in_buf + i, last_len);
 
-    *(u16*)(out_buf + i) ^= 0xFFFF;
+  }
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-    stage_cur++;
+  new_hit_cnt = queued_paths + unique_crashes;
 
-    *(u16*)(out_buf + i) ^= 0xFFFF;
+  stage_finds[STAGE_EXTRAS_AO]  += new_hit_cnt - orig_hit_cnt;
+  stage_cycles[STAGE_EXTRAS_AO] += stage_max;
 
+skip_extras:
 
-  }
+  /* If we made this to here without jumping to havoc_stage or abandon_entry,
+     we're properly done with deterministic steps and can mark it as such
+     in the .state/ directory. */
 
-  new_hit_cnt = queued_paths + unique_crashes;
+  if (!queue_cur->passed_det) mark_as_det_done(queue_cur);
 
-  stage_finds[STAGE_FLIP16]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP16] += stage_max;
+  /****************
+   * RANDOM HAVOC *
+   ****************/
 
-  if (len < 4) goto skip_bitflip;
+havoc_stage:
 
-  /* Four walking bytes. */
+  stage_cur_byte = -1;
 
-  stage_name  = "bitflip 32/8";
-  stage_short = "flip32";
-  stage_cur   = 0;
-  stage_max   = len - 3;
+  /* The havoc stage mutation code is also invoked when splicing files; if the
+     splice_cycle variable is set, generate different descriptions and such. */
 
-  orig_hit_cnt = new_hit_cnt;
+  if (!splice_cycle) {
 
-  for (i = 0; i < len - 3; i++) {
+    /* Adjust perf_score with the factor derived from the proximity score */
+    double prox_score = queue_cur->prox_score.adjusted;
+    queue_cur->perf_factor = calculate_factor(prox_score);
+    perf_score = (u32) (queue_cur->perf_factor * (double) perf_score);
 
-    /* Let's consult the effector map... */
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
-        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
-      stage_max--;
-      continue;
-    }
+    stage_name  = "havoc";
+    stage_short = "havoc";
+    stage_max   = (doing_det ? HAVOC_CYCLES_INIT : HAVOC_CYCLES) *
+                  perf_score / havoc_div / 100;
 
-    stage_cur_byte = i;
 
-    *(u32*)(out_buf + i) ^= 0xFFFFFFFF;
+  } else {
 
-    if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-    stage_cur++;
+    static u8 tmp[32];
+   
+    perf_score = orig_perf;
 
-    *(u32*)(out_buf + i) ^= 0xFFFFFFFF;
+     /* Adjust perf_score with the factor derived from the proximity score */
+    double prox_score = (queue_cur->prox_score.adjusted + target->prox_score.adjusted) / 2;
+    perf_score = (u32) (calculate_factor(prox_score) * (double) perf_score);
+
+    sprintf(tmp, "splice %u", splice_cycle);
+    stage_name  = tmp;
+    stage_short = "splice";
+    stage_max   = SPLICE_HAVOC * perf_score / havoc_div / 100;
 
   }
 
-  new_hit_cnt = queued_paths + unique_crashes;
+  if (stage_max < HAVOC_MIN) stage_max = HAVOC_MIN;
 
-  stage_finds[STAGE_FLIP32]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_FLIP32] += stage_max;
+  temp_len = len;
 
-skip_bitflip:
+  orig_hit_cnt = queued_paths + unique_crashes;
 
-  if (no_arith) goto skip_arith;
+  havoc_queued = queued_paths;
 
-  /**********************
-   * ARITHMETIC INC/DEC *
-   **********************/
+  /* We essentially just do several thousand runs (depending on perf_score)
+     where we take the input file and make random stacked tweaks. */
 
-  /* 8-bit arithmetics. */
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
 
-  stage_name  = "arith 8/8";
-  stage_short = "arith8";
-  stage_cur   = 0;
-  stage_max   = 2 * len * ARITH_MAX;
+    u32 use_stacking = 1 << (1 + UR(HAVOC_STACK_POW2));
 
-  stage_val_type = STAGE_VAL_LE;
+    stage_cur_val = use_stacking;
 
-  orig_hit_cnt = new_hit_cnt;
+    for (i = 0; i < use_stacking; i++) {
 
-  for (i = 0; i < len; i++) {
+      switch (UR(15 + ((extras_cnt + a_extras_cnt) ? 2 : 0))) {
 
-    u8 orig = out_buf[i];
+        case 0:
 
-    /* Let's consult the effector map... */
+          /* Flip a single bit somewhere. Spooky! */
 
-    if (!eff_map[EFF_APOS(i)]) {
-      stage_max -= 2 * ARITH_MAX;
-      continue;
-    }
+          FLIP_BIT(out_buf, UR(temp_len << 3));
+          break;
 
-    stage_cur_byte = i;
+        case 1:
 
-    for (j = 1; j <= ARITH_MAX; j++) {
+          /* Set byte to interesting value. */
 
-      u8 r = orig ^ (orig + j);
+          out_buf[UR(temp_len)] = interesting_8[UR(sizeof(interesting_8))];
+          break;
 
-      /* Do arithmetic operations only if the result couldn't be a product
-         of a bitflip. */
+        case 2:
 
-      if (!could_be_bitflip(r)) {
+          /* Set word to interesting value, randomly choosing endian. */
 
-        stage_cur_val = j;
-        out_buf[i] = orig + j;
+          if (temp_len < 2) break;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+          if (UR(2)) {
 
-      } else stage_max--;
+            *(u16*)(out_buf + UR(temp_len - 1)) =
+              interesting_16[UR(sizeof(interesting_16) >> 1)];
 
-      r =  orig ^ (orig - j);
+          } else {
 
-      if (!could_be_bitflip(r)) {
+            *(u16*)(out_buf + UR(temp_len - 1)) = SWAP16(
+              interesting_16[UR(sizeof(interesting_16) >> 1)]);
 
-        stage_cur_val = -j;
-        out_buf[i] = orig - j;
+          }
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+          break;
 
-      } else stage_max--;
+        case 3:
 
-      out_buf[i] = orig;
+          /* Set dword to interesting value, randomly choosing endian. */
 
-    }
+          if (temp_len < 4) break;
 
-  }
+          if (UR(2)) {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+            *(u32*)(out_buf + UR(temp_len - 3)) =
+              interesting_32[UR(sizeof(interesting_32) >> 2)];
 
-  stage_finds[STAGE_ARITH8]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_ARITH8] += stage_max;
+          } else {
 
-  /* 16-bit arithmetics, both endians. */
+            *(u32*)(out_buf + UR(temp_len - 3)) = SWAP32(
+              interesting_32[UR(sizeof(interesting_32) >> 2)]);
 
-  if (len < 2) goto skip_arith;
+          }
 
-  stage_name  = "arith 16/8";
-  stage_short = "arith16";
-  stage_cur   = 0;
-  stage_max   = 4 * (len - 1) * ARITH_MAX;
+          break;
 
-  orig_hit_cnt = new_hit_cnt;
+        case 4:
 
-  for (i = 0; i < len - 1; i++) {
+          /* Randomly subtract from byte. */
 
-    u16 orig = *(u16*)(out_buf + i);
+          out_buf[UR(temp_len)] -= 1 + UR(ARITH_MAX);
+          break;
 
-    /* Let's consult the effector map... */
+        case 5:
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
-      stage_max -= 4 * ARITH_MAX;
-      continue;
-    }
+          /* Randomly add to byte. */
 
-    stage_cur_byte = i;
+          out_buf[UR(temp_len)] += 1 + UR(ARITH_MAX);
+          break;
 
-    for (j = 1; j <= ARITH_MAX; j++) {
+        case 6:
 
-      u16 r1 = orig ^ (orig + j),
-          r2 = orig ^ (orig - j),
-          r3 = orig ^ SWAP16(SWAP16(orig) + j),
-          r4 = orig ^ SWAP16(SWAP16(orig) - j);
+          /* Randomly subtract from word, random endian. */
 
-      /* Try little endian addition and subtraction first. Do it only
-         if the operation would affect more than one byte (hence the
-         & 0xff overflow checks) and if it couldn't be a product of
-         a bitflip. */
+          if (temp_len < 2) break;
 
-      stage_val_type = STAGE_VAL_LE;
+          if (UR(2)) {
 
-      if ((orig & 0xff) + j > 0xff && !could_be_bitflip(r1)) {
+            u32 pos = UR(temp_len - 1);
 
-        stage_cur_val = j;
-        *(u16*)(out_buf + i) = orig + j;
+            *(u16*)(out_buf + pos) -= 1 + UR(ARITH_MAX);
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+          } else {
 
-      } else stage_max--;
+            u32 pos = UR(temp_len - 1);
+            u16 num = 1 + UR(ARITH_MAX);
 
-      if ((orig & 0xff) < j && !could_be_bitflip(r2)) {
+            *(u16*)(out_buf + pos) =
+              SWAP16(SWAP16(*(u16*)(out_buf + pos)) - num);
 
-        stage_cur_val = -j;
-        *(u16*)(out_buf + i) = orig - j;
+          }
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+          break;
 
-      } else stage_max--;
+        case 7:
+
+          /* Randomly add to word, random endian. */
 
-      /* Big endian comes next. Same deal. */
+          if (temp_len < 2) break;
 
-      stage_val_type = STAGE_VAL_BE;
+          if (UR(2)) {
 
+            u32 pos = UR(temp_len - 1);
 
-      if ((orig >> 8) + j > 0xff && !could_be_bitflip(r3)) {
+            *(u16*)(out_buf + pos) += 1 + UR(ARITH_MAX);
 
-        stage_cur_val = j;
-        *(u16*)(out_buf + i) = SWAP16(SWAP16(orig) + j);
+          } else {
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+            u32 pos = UR(temp_len - 1);
+            u16 num = 1 + UR(ARITH_MAX);
 
-      } else stage_max--;
+            *(u16*)(out_buf + pos) =
+              SWAP16(SWAP16(*(u16*)(out_buf + pos)) + num);
 
-      if ((orig >> 8) < j && !could_be_bitflip(r4)) {
+          }
 
-        stage_cur_val = -j;
-        *(u16*)(out_buf + i) = SWAP16(SWAP16(orig) - j);
+          break;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+        case 8:
 
-      } else stage_max--;
+          /* Randomly subtract from dword, random endian. */
 
-      *(u16*)(out_buf + i) = orig;
+          if (temp_len < 4) break;
 
-    }
+          if (UR(2)) {
 
-  }
+            u32 pos = UR(temp_len - 3);
 
-  new_hit_cnt = queued_paths + unique_crashes;
+            *(u32*)(out_buf + pos) -= 1 + UR(ARITH_MAX);
 
-  stage_finds[STAGE_ARITH16]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_ARITH16] += stage_max;
+          } else {
 
-  /* 32-bit arithmetics, both endians. */
+            u32 pos = UR(temp_len - 3);
+            u32 num = 1 + UR(ARITH_MAX);
 
-  if (len < 4) goto skip_arith;
+            *(u32*)(out_buf + pos) =
+              SWAP32(SWAP32(*(u32*)(out_buf + pos)) - num);
 
-  stage_name  = "arith 32/8";
-  stage_short = "arith32";
-  stage_cur   = 0;
-  stage_max   = 4 * (len - 3) * ARITH_MAX;
+          }
 
-  orig_hit_cnt = new_hit_cnt;
+          break;
 
-  for (i = 0; i < len - 3; i++) {
+        case 9:
 
-    u32 orig = *(u32*)(out_buf + i);
+          /* Randomly add to dword, random endian. */
 
-    /* Let's consult the effector map... */
+          if (temp_len < 4) break;
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
-        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
-      stage_max -= 4 * ARITH_MAX;
-      continue;
-    }
+          if (UR(2)) {
 
-    stage_cur_byte = i;
+            u32 pos = UR(temp_len - 3);
 
-    for (j = 1; j <= ARITH_MAX; j++) {
+            *(u32*)(out_buf + pos) += 1 + UR(ARITH_MAX);
 
-      u32 r1 = orig ^ (orig + j),
-          r2 = orig ^ (orig - j),
-          r3 = orig ^ SWAP32(SWAP32(orig) + j),
-          r4 = orig ^ SWAP32(SWAP32(orig) - j);
+          } else {
 
-      /* Little endian first. Same deal as with 16-bit: we only want to
-         try if the operation would have effect on more than two bytes. */
+            u32 pos = UR(temp_len - 3);
+            u32 num = 1 + UR(ARITH_MAX);
 
-      stage_val_type = STAGE_VAL_LE;
+            *(u32*)(out_buf + pos) =
+              SWAP32(SWAP32(*(u32*)(out_buf + pos)) + num);
 
-      if ((orig & 0xffff) + j > 0xffff && !could_be_bitflip(r1)) {
+          }
 
-        stage_cur_val = j;
-        *(u32*)(out_buf + i) = orig + j;
+          break;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+        case 10:
 
-      } else stage_max--;
+          /* Just set a random byte to a random value. Because,
+             why not. We use XOR with 1-255 to eliminate the
+             possibility of a no-op. */
 
-      if ((orig & 0xffff) < j && !could_be_bitflip(r2)) {
+          out_buf[UR(temp_len)] ^= 1 + UR(255);
+          break;
 
-        stage_cur_val = -j;
-        *(u32*)(out_buf + i) = orig - j;
+        case 11 ... 12: {
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+            /* Delete bytes. We're making this a bit more likely
+               than insertion (the next option) in hopes of keeping
+               files reasonably small. */
 
-      } else stage_max--;
+            u32 del_from, del_len;
 
-      /* Big endian next. */
+            if (temp_len < 2) break;
 
-      stage_val_type = STAGE_VAL_BE;
+            /* Don't delete too much. */
 
-      if ((SWAP32(orig) & 0xffff) + j > 0xffff && !could_be_bitflip(r3)) {
+            del_len = choose_block_len(temp_len - 1);
 
-        stage_cur_val = j;
-        *(u32*)(out_buf + i) = SWAP32(SWAP32(orig) + j);
+            del_from = UR(temp_len - del_len + 1);
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+            memmove(out_buf + del_from, out_buf + del_from + del_len,
+                    temp_len - del_from - del_len);
 
-      } else stage_max--;
+            temp_len -= del_len;
 
-      if ((SWAP32(orig) & 0xffff) < j && !could_be_bitflip(r4)) {
+            break;
 
-        stage_cur_val = -j;
-        *(u32*)(out_buf + i) = SWAP32(SWAP32(orig) - j);
+          }
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+        case 13:
 
-      } else stage_max--;
+          if (temp_len + HAVOC_BLK_XL < MAX_FILE) {
 
-      *(u32*)(out_buf + i) = orig;
+            /* Clone bytes (75%) or insert a block of constant bytes (25%). */
 
-    }
+            u8  actually_clone = UR(4);
+            u32 clone_from, clone_to, clone_len;
+            u8* new_buf;
 
-  }
+            if (actually_clone) {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+              clone_len  = choose_block_len(temp_len);
+              clone_from = UR(temp_len - clone_len + 1);
 
-  stage_finds[STAGE_ARITH32]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_ARITH32] += stage_max;
+            } else {
 
-skip_arith:
+              clone_len = choose_block_len(HAVOC_BLK_XL);
+              clone_from = 0;
 
-  /**********************
-   * INTERESTING VALUES *
-   **********************/
+            }
 
-  stage_name  = "interest 8/8";
-  stage_short = "int8";
-  stage_cur   = 0;
-  stage_max   = len * sizeof(interesting_8);
+            clone_to   = UR(temp_len);
 
-  stage_val_type = STAGE_VAL_LE;
+            new_buf = ck_alloc_nozero(temp_len + clone_len);
 
-  orig_hit_cnt = new_hit_cnt;
+            /* Head */
 
-  /* Setting 8-bit integers. */
+            memcpy(new_buf, out_buf, clone_to);
 
-  for (i = 0; i < len; i++) {
+            /* Inserted part */
 
-    u8 orig = out_buf[i];
+            if (actually_clone)
+              memcpy(new_buf + clone_to, out_buf + clone_from, clone_len);
+            else
+              memset(new_buf + clone_to,
+                     UR(2) ? UR(256) : out_buf[UR(temp_len)], clone_len);
 
-    /* Let's consult the effector map... */
+            /* Tail */
+            memcpy(new_buf + clone_to + clone_len, out_buf + clone_to,
+                   temp_len - clone_to);
 
-    if (!eff_map[EFF_APOS(i)]) {
-      stage_max -= sizeof(interesting_8);
-      continue;
-    }
+            ck_free(out_buf);
+            out_buf = new_buf;
+            temp_len += clone_len;
 
-    stage_cur_byte = i;
+          }
 
-    for (j = 0; j < sizeof(interesting_8); j++) {
+          break;
 
-      /* Skip if the value could be a product of bitflips or arithmetics. */
+        case 14: {
 
-      if (could_be_bitflip(orig ^ (u8)interesting_8[j]) ||
-          could_be_arith(orig, (u8)interesting_8[j], 1)) {
-        stage_max--;
-        continue;
-      }
+            /* Overwrite bytes with a randomly selected chunk (75%) or fixed
+               bytes (25%). */
 
-      stage_cur_val = interesting_8[j];
-      out_buf[i] = interesting_8[j];
+            u32 copy_from, copy_to, copy_len;
 
-      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+            if (temp_len < 2) break;
 
-      out_buf[i] = orig;
-      stage_cur++;
+            copy_len  = choose_block_len(temp_len - 1);
 
-    }
+            copy_from = UR(temp_len - copy_len + 1);
+            copy_to   = UR(temp_len - copy_len + 1);
 
-  }
+            if (UR(4)) {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+              if (copy_from != copy_to)
+                memmove(out_buf + copy_to, out_buf + copy_from, copy_len);
 
-  stage_finds[STAGE_INTEREST8]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_INTEREST8] += stage_max;
+            } else memset(out_buf + copy_to,
+                          UR(2) ? UR(256) : out_buf[UR(temp_len)], copy_len);
 
-  /* Setting 16-bit integers, both endians. */
+            break;
 
-  if (no_arith || len < 2) goto skip_interest;
+          }
 
-  stage_name  = "interest 16/8";
-  stage_short = "int16";
-  stage_cur   = 0;
-  stage_max   = 2 * (len - 1) * (sizeof(interesting_16) >> 1);
+        /* Values 15 and 16 can be selected only if there are any extras
+           present in the dictionaries. */
 
-  orig_hit_cnt = new_hit_cnt;
+        case 15: {
 
-  for (i = 0; i < len - 1; i++) {
+            /* Overwrite bytes with an extra. */
 
-    u16 orig = *(u16*)(out_buf + i);
+            if (!extras_cnt || (a_extras_cnt && UR(2))) {
 
-    /* Let's consult the effector map... */
+              /* No user-specified extras or odds in our favor. Let's use an
+                 auto-detected one. */
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)]) {
-      stage_max -= sizeof(interesting_16);
-      continue;
-    }
+              u32 use_extra = UR(a_extras_cnt);
+              u32 extra_len = a_extras[use_extra].len;
+              u32 insert_at;
 
-    stage_cur_byte = i;
+              if (extra_len > temp_len) break;
 
-    for (j = 0; j < sizeof(interesting_16) / 2; j++) {
+              insert_at = UR(temp_len - extra_len + 1);
+              memcpy(out_buf + insert_at, a_extras[use_extra].data, extra_len);
 
-      stage_cur_val = interesting_16[j];
+            } else {
 
-      /* Skip if this could be a product of a bitflip, arithmetics,
-         or single-byte interesting value insertion. */
+              /* No auto extras or odds in our favor. Use the dictionary. */
 
-      if (!could_be_bitflip(orig ^ (u16)interesting_16[j]) &&
-          !could_be_arith(orig, (u16)interesting_16[j], 2) &&
-          !could_be_interest(orig, (u16)interesting_16[j], 2, 0)) {
+              u32 use_extra = UR(extras_cnt);
+              u32 extra_len = extras[use_extra].len;
+              u32 insert_at;
 
-        stage_val_type = STAGE_VAL_LE;
+              if (extra_len > temp_len) break;
 
-        *(u16*)(out_buf + i) = interesting_16[j];
+              insert_at = UR(temp_len - extra_len + 1);
+              memcpy(out_buf + insert_at, extras[use_extra].data, extra_len);
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+            }
 
-      } else stage_max--;
+            break;
 
-      if ((u16)interesting_16[j] != SWAP16(interesting_16[j]) &&
-          !could_be_bitflip(orig ^ SWAP16(interesting_16[j])) &&
-          !could_be_arith(orig, SWAP16(interesting_16[j]), 2) &&
-          !could_be_interest(orig, SWAP16(interesting_16[j]), 2, 1)) {
+          }
 
-        stage_val_type = STAGE_VAL_BE;
+        case 16: {
 
-        *(u16*)(out_buf + i) = SWAP16(interesting_16[j]);
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+            u32 use_extra, extra_len, insert_at = UR(temp_len + 1);
+            u8* new_buf;
 
-      } else stage_max--;
+            /* Insert an extra. Do the same dice-rolling stuff as for the
+               previous case. */
 
-    }
+            if (!extras_cnt || (a_extras_cnt && UR(2))) {
 
-    *(u16*)(out_buf + i) = orig;
+              use_extra = UR(a_extras_cnt);
+              extra_len = a_extras[use_extra].len;
 
-  }
+              if (temp_len + extra_len >= MAX_FILE) break;
 
-  new_hit_cnt = queued_paths + unique_crashes;
+              new_buf = ck_alloc_nozero(temp_len + extra_len);
 
-  stage_finds[STAGE_INTEREST16]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_INTEREST16] += stage_max;
+              /* Head */
+              memcpy(new_buf, out_buf, insert_at);
 
-  if (len < 4) goto skip_interest;
+              /* Inserted part */
+              memcpy(new_buf + insert_at, a_extras[use_extra].data, extra_len);
 
-  /* Setting 32-bit integers, both endians. */
+            } else {
 
-  stage_name  = "interest 32/8";
-  stage_short = "int32";
-  stage_cur   = 0;
-  stage_max   = 2 * (len - 3) * (sizeof(interesting_32) >> 2);
+              use_extra = UR(extras_cnt);
+              extra_len = extras[use_extra].len;
 
-  orig_hit_cnt = new_hit_cnt;
+              if (temp_len + extra_len >= MAX_FILE) break;
 
-  for (i = 0; i < len - 3; i++) {
+              new_buf = ck_alloc_nozero(temp_len + extra_len);
 
-    u32 orig = *(u32*)(out_buf + i);
+              /* Head */
+              memcpy(new_buf, out_buf, insert_at);
 
-    /* Let's consult the effector map... */
+              /* Inserted part */
+              memcpy(new_buf + insert_at, extras[use_extra].data, extra_len);
 
-    if (!eff_map[EFF_APOS(i)] && !eff_map[EFF_APOS(i + 1)] &&
-        !eff_map[EFF_APOS(i + 2)] && !eff_map[EFF_APOS(i + 3)]) {
-      stage_max -= sizeof(interesting_32) >> 1;
-      continue;
-    }
+            }
 
-    stage_cur_byte = i;
+            /* Tail */
+            memcpy(new_buf + insert_at + extra_len, out_buf + insert_at,
+                   temp_len - insert_at);
 
-    for (j = 0; j < sizeof(interesting_32) / 4; j++) {
+            ck_free(out_buf);
+            out_buf   = new_buf;
+            temp_len += extra_len;
 
-      stage_cur_val = interesting_32[j];
+            break;
 
-      /* Skip if this could be a product of a bitflip, arithmetics,
-         or word interesting value insertion. */
+          }
 
-      if (!could_be_bitflip(orig ^ (u32)interesting_32[j]) &&
-          !could_be_arith(orig, interesting_32[j], 4) &&
-          !could_be_interest(orig, interesting_32[j], 4, 0)) {
+      }
 
-        stage_val_type = STAGE_VAL_LE;
+    }
 
-        *(u32*)(out_buf + i) = interesting_32[j];
+    if (common_fuzz_stuff(argv, out_buf, temp_len))
+      goto abandon_entry;
 
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+    /* out_buf might have been mangled a bit, so let's restore it to its
+       original size and shape. */
 
-      } else stage_max--;
+    if (temp_len < len) out_buf = ck_realloc(out_buf, len);
+    temp_len = len;
+    memcpy(out_buf, in_buf, len);
 
-      if ((u32)interesting_32[j] != SWAP32(interesting_32[j]) &&
-          !could_be_bitflip(orig ^ SWAP32(interesting_32[j])) &&
-          !could_be_arith(orig, SWAP32(interesting_32[j]), 4) &&
-          !could_be_interest(orig, SWAP32(interesting_32[j]), 4, 1)) {
+    /* If we're finding new stuff, let's run for a bit longer, limits
+       permitting. */
 
-        stage_val_type = STAGE_VAL_BE;
+    if (queued_paths != havoc_queued) {
 
-        *(u32*)(out_buf + i) = SWAP32(interesting_32[j]);
-        if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
-        stage_cur++;
+      if (perf_score <= HAVOC_MAX_MULT * 100) {
+        stage_max  *= 2;
+        perf_score *= 2;
+      }
 
-      } else stage_max--;
+      havoc_queued = queued_paths;
 
     }
 
-    *(u32*)(out_buf + i) = orig;
-
   }
 
   new_hit_cnt = queued_paths + unique_crashes;
 
-  stage_finds[STAGE_INTEREST32]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_INTEREST32] += stage_max;
+  if (!splice_cycle) {
+    stage_finds[STAGE_HAVOC]  += new_hit_cnt - orig_hit_cnt;
+    stage_cycles[STAGE_HAVOC] += stage_max;
+  } else {
+    stage_finds[STAGE_SPLICE]  += new_hit_cnt - orig_hit_cnt;
+    stage_cycles[STAGE_SPLICE] += stage_max;
+  }
 
-skip_interest:
+#ifndef IGNORE_FINDS
 
-  /********************
-   * DICTIONARY STUFF *
-   ********************/
+  /************
+   * SPLICING *
+   ************/
 
-  if (!extras_cnt) goto skip_user_extras;
+  /* This is a last-resort strategy triggered by a full round with no findings.
+     It takes the current input file, randomly selects another input, and
+     splices them together at some offset, then relies on the havoc
+     code to mutate that blob. */
 
-  /* Overwrite with user-supplied extras. */
+retry_splicing:
 
-  stage_name  = "user extras (over)";
-  stage_short = "ext_UO";
-  stage_cur   = 0;
-  stage_max   = extras_cnt * len;
+  if (use_splicing && splice_cycle++ < SPLICE_CYCLES &&
+      queued_paths > 1 && queue_cur->len > 1) {
 
-  stage_val_type = STAGE_VAL_NONE;
+    u32 idx, idx_div, split_at;
+    u8 *new_buf, *tmp_buf;
+    s32 f_diff, l_diff;
 
-  orig_hit_cnt = new_hit_cnt;
+    /* First of all, if we've modified in_buf for havoc, let's clean that
+       up... */
 
-  for (i = 0; i < len; i++) {
+    if (in_buf != orig_in) {
+      ck_free(in_buf);
+      in_buf = orig_in;
+      len = queue_cur->len;
+    }
 
-    u32 last_len = 0;
+    /* Pick a random queue entry and find it. */
 
-    stage_cur_byte = i;
+    idx = UR(queued_paths_cur);
 
-    /* Extras are sorted by size, from smallest to largest. This means
-       that we don't have to worry about restoring the buffer in
-       between writes at a particular offset determined by the outer
-       loop. */
+    idx_div = idx / 100;
+    if (idx_div < 1024) {
+      target = shortcut_per_100[idx_div];
+      idx -= idx_div * 100;
+    } else {
+      target = shortcut_per_100[1023];
+      idx -= idx_div * 1024;
+    }
 
-    for (j = 0; j < extras_cnt; j++) {
+    while (idx--) target = target->next;
 
-      /* Skip extras probabilistically if extras_cnt > MAX_DET_EXTRAS. Also
-         skip them if there's no room to insert the payload, if the token
-         is redundant, or if its entire span has no bytes set in the effector
-         map. */
+    /* Make sure that the target has a reasonable length and isn't yourself. */
 
-      if ((extras_cnt > MAX_DET_EXTRAS && UR(extras_cnt) >= MAX_DET_EXTRAS) ||
-          extras[j].len > len - i ||
-          !memcmp(extras[j].data, out_buf + i, extras[j].len) ||
-          !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, extras[j].len))) {
+    while (target && (target->len < 2 || target == queue_cur)) {
+      target = target->next;
+    }
 
-        stage_max--;
-        continue;
+    if (!target) goto retry_splicing;
 
-      }
+    splicing_with = target->entry_id;
 
-      last_len = extras[j].len;
-      memcpy(out_buf + i, extras[j].data, last_len);
+    /* Read the testcase into a new buffer. */
 
-      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+    /* Take a private copy, since the head of the current input is about
+       to be written over it. */
 
-      stage_cur++;
+    new_buf = ck_alloc_nozero(target->len);
+    tmp_buf = seed_cache_get(target);
+    memcpy(new_buf, tmp_buf, target->len);
+    seed_cache_put(target, tmp_buf);
+
+    /* Find a suitable splicing location, somewhere between the first and
+       the last differing byte. Bail out if the difference is just a single
+       byte or so. */
+
+    locate_diffs(in_buf, new_buf, MIN(len, target->len), &f_diff, &l_diff);
 
+    if (f_diff < 0 || l_diff < 2 || f_diff == l_diff) {
+      ck_free(new_buf);
+      goto retry_splicing;
     }
 
-    /* Restore all the clobbered memory. */
-    memcpy(out_buf + i, in_buf + i, last_len);
+    /* Split somewhere between the first and last differing byte. */
 
-  }
+    split_at = f_diff + UR(l_diff - f_diff);
 
-  new_hit_cnt = queued_paths + unique_crashes;
+    /* Do the thing. */
 
-  stage_finds[STAGE_EXTRAS_UO]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_EXTRAS_UO] += stage_max;
+    len = target->len;
+    memcpy(new_buf, in_buf, split_at);
+    in_buf = new_buf;
 
-  /* Insertion of user-supplied extras. */
+    ck_free(out_buf);
+    out_buf = ck_alloc_nozero(len);
+    memcpy(out_buf, in_buf, len);
 
-  stage_name  = "user extras (insert)";
-  stage_short = "ext_UI";
-  stage_cur   = 0;
-  stage_max   = extras_cnt * len;
+    goto havoc_stage;
 
-  orig_hit_cnt = new_hit_cnt;
+  }
 
-  ex_tmp = ck_alloc(len + MAX_DICT_FILE);
+#endif /* !IGNORE_FINDS */
 
-  for (i = 0; i <= len; i++) {
+  ret_val = 0;
 
-    stage_cur_byte = i;
+abandon_entry:
 
-    for (j = 0; j < extras_cnt; j++) {
+  splicing_with = -1;
 
-      if (len + extras[j].len > MAX_FILE) {
-        stage_max--;
-        continue;
-      }
+  /* Update pending_not_fuzzed count if we made it through the calibration
+     cycle and have not seen this entry before. */
 
-      /* Insert token */
-      memcpy(ex_tmp + i, extras[j].data, extras[j].len);
+  if (!stop_soon && !queue_cur->cal_failed && !queue_cur->was_fuzzed) {
+    queue_cur->was_fuzzed = 1;
+    pending_not_fuzzed--;
+    if (queue_cur->favored) pending_favored--;
+  }
+
+  seed_cache_put(queue_cur, orig_in);
+
+  if (in_buf != orig_in) ck_free(in_buf);
+  ck_free(out_buf);
+  ck_free(eff_map);
+
+  return ret_val;
 
-      /* Copy tail */
-      memcpy(ex_tmp + i + extras[j].len, out_buf + i, len - i);
+#undef FLIP_BIT
 
-      if (common_fuzz_stuff(argv, ex_tmp, len + extras[j].len)) {
-        ck_free(ex_tmp);
-        goto abandon_entry;
-      }
+}
 
-      stage_cur++;
+static u8 fuzz_one(char **argv) {
+  int key_val_lv = 0;
+  key_val_lv = fuzz_one_vertical(argv);
+  return key_val_lv;
+}
 
-    }
 
-    /* Copy head */
-    ex_tmp[i] = out_buf[i];
+/* Grab interesting test cases from other fuzzers. */
 
-  }
+/* Decide from the calibration record a peer published with one of its
+   queue entries (see calcache.h) whether running the entry could teach us
+   anything. It cannot if it hits no new bits, takes a DFG path we know and,
+   in case it reaches the target, has a valuation we have seen on that path.
+   rec must have passed cal_record_check(). Returns 1 if the exec can be
+   skipped. */
 
-  ck_free(ex_tmp);
+static u8 sync_record_known(struct cal_record* rec) {
 
-  new_hit_cnt = queued_paths + unique_crashes;
+  struct key_value_pair* kvp;
+  u8 *vals, *p, *end;
+  u32 *idx, i, dfg_idx = 0, delta, count;
+  u8 covered = 0;
 
-  stage_finds[STAGE_EXTRAS_UI]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_EXTRAS_UI] += stage_max;
+  idx  = (u32*)(rec + 1);
+  vals = (u8*)(idx + rec->trace_len);
 
-skip_user_extras:
+  for (i = 0; i < rec->trace_len; i++)
+    if (vals[i] & virgin_bits[idx[i]]) return 0;
 
-  if (!a_extras_cnt) goto skip_extras;
+  p   = vals + rec->trace_len;
+  end = p + rec->packed_len;
 
-  stage_name  = "auto extras (over)";
-  stage_short = "ext_AO";
-  stage_cur   = 0;
-  stage_max   = MIN(a_extras_cnt, USE_AUTO_EXTRAS) * len;
+  while (p < end && dfg_idx < dfg_target_idx) {
 
-  stage_val_type = STAGE_VAL_NONE;
+    if (!varint_get_checked(&p, end, &delta) ||
+        !varint_get_checked(&p, end, &count)) return 0;
 
-  orig_hit_cnt = new_hit_cnt;
+    dfg_idx += delta;
+    if (dfg_idx == dfg_target_idx) covered = 1;
 
-  for (i = 0; i < len; i++) {
+  }
 
-    u32 last_len = 0;
+  /* Running the case is what records its DFG path (check_unique_path()),
+     so a path we have not seen has to be run, target or not. */
 
-    stage_cur_byte = i;
+  if (dfg_node_info_map && !hashmap_get(dfg_hashmap, rec->dfg_cksum))
+    return 0;
 
-    for (j = 0; j < MIN(a_extras_cnt, USE_AUTO_EXTRAS); j++) {
+  if (covered && dfg_node_info_map) {
 
-      /* See the comment in the earlier code; extras are sorted by size. */
+    if (getenv("PACFIX_VAL_EXE") && getenv("PACFIX_COV_DIR")) {
 
-      if (a_extras[j].len > len - i ||
-          !memcmp(a_extras[j].data, out_buf + i, a_extras[j].len) ||
-          !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, a_extras[j].len))) {
+      if (!rec->val_hash || !hashmap_get(unique_mem_hashmap, rec->val_hash))
+        return 0;
 
-        stage_max--;
-        continue;
+      kvp = hashmap_get(vertical_manager->map, rec->dfg_cksum);
 
-      }
+      if (!kvp || !hashmap_get(((struct vertical_entry*)kvp->value)->value_map,
+                               rec->val_hash)) return 0;
 
-      last_len = a_extras[j].len;
-      memcpy(out_buf + i, a_extras[j].data, last_len);
+    }
 
-      if (common_fuzz_stuff(argv, out_buf, len)) goto abandon_entry;
+  }
 
-      stage_cur++;
+  return 1;
 
-    }
+}
 
-    /* Restore all the clobbered memory. */
-    memcpy(out_buf + i, in_buf + i, last_len);
 
-  }
+/* Same, for a record of size bytes as found in a peer's queue pack or in
+   a message from afl-syncd. It may sit unaligned there; copy it out. */
 
-  new_hit_cnt = queued_paths + unique_crashes;
+static u8 sync_blob_known(u8* blob, u32 size, u8* mem, u32 len) {
 
-  stage_finds[STAGE_EXTRAS_AO]  += new_hit_cnt - orig_hit_cnt;
-  stage_cycles[STAGE_EXTRAS_AO] += stage_max;
+  struct cal_record* rec;
+  u8 known = 0;
 
-skip_extras:
+  if (no_cal_cache || dumb_mode || crash_mode ||
+      size < sizeof(struct cal_record)) return 0;
 
-  /* If we made this to here without jumping to havoc_stage or abandon_entry,
-     we're properly done with deterministic steps and can mark it as such
-     in the .state/ directory. */
+  rec = ck_alloc_nozero(size);
+  memcpy(rec, blob, size);
 
-  if (!queue_cur->passed_det) mark_as_det_done(queue_cur);
+  if (cal_record_check(rec, size, mem, len)) known = sync_record_known(rec);
 
-  /****************
-   * RANDOM HAVOC *
-   ****************/
+  ck_free(rec);
+  return known;
 
-havoc_stage:
+}
 
-  stage_cur_byte = -1;
 
-  /* The havoc stage mutation code is also invoked when splicing files; if the
-     splice_cycle variable is set, generate different descriptions and such. */
+/* Same, for the record a peer published in its records file. */
 
-  if (!splice_cycle) {
+static u8 sync_case_known(struct cal_index* idx, u8* name, u32 name_len,
+                          u8* mem, u32 len) {
 
-    /* Adjust perf_score with the factor derived from the proximity score */
-    double prox_score = queue_cur->prox_score.adjusted;
-    perf_score = (u32) (calculate_factor(prox_score) * (double) perf_score);
+  struct cal_record* rec;
+  u32 size;
+  u8  known = 0;
 
-    stage_name  = "havoc";
-    stage_short = "havoc";
-    stage_max   = (doing_det ? HAVOC_CYCLES_INIT : HAVOC_CYCLES) *
-                  perf_score / havoc_div / 100;
+  if (no_cal_cache || dumb_mode || crash_mode) return 0;
 
+  rec = cal_index_find(idx, name, name_len, &size);
+  if (!rec) return 0;
 
-  } else {
+  if (cal_record_check(rec, size, mem, len)) known = sync_record_known(rec);
 
-    static u8 tmp[32];
-   
-    perf_score = orig_perf;
+  ck_free(rec);
+  return known;
 
-     /* Adjust perf_score with the factor derived from the proximity score */
-    double prox_score = (queue_cur->prox_score.adjusted + target->prox_score.adjusted) / 2;
-    perf_score = (u32) (calculate_factor(prox_score) * (double) perf_score);
+}
 
-    sprintf(tmp, "splice %u", splice_cycle);
-    stage_name  = tmp;
-    stage_short = "splice";
-    stage_max   = SPLICE_HAVOC * perf_score / havoc_div / 100;
 
-  }
+/* Run a test case taken from another fuzzer, unless the record published
+   with it shows that this would be a waste (known). Returns 1 if it is
+   time to stop. */
 
-  if (stage_max < HAVOC_MIN) stage_max = HAVOC_MIN;
+static u8 sync_one_case(char** argv, u8 known, u8* mem, u32 len, u8* party) {
 
-  temp_len = len;
+  u8 fault;
 
-  orig_hit_cnt = queued_paths + unique_crashes;
+  if (known) {
 
-  havoc_queued = queued_paths;
+    sync_execs_saved++;
 
-  /* We essentially just do several thousand runs (depending on perf_score)
-     where we take the input file and make random stacked tweaks. */
+    if (!(stage_cur++ % stats_update_freq)) show_stats();
+    return 0;
 
-  for (stage_cur = 0; stage_cur < stage_max; stage_cur++) {
+  }
 
-    u32 use_stacking = 1 << (1 + UR(HAVOC_STACK_POW2));
+  /* See what happens. We rely on save_if_interesting() to catch major
+     errors and save the test case. */
 
-    stage_cur_val = use_stacking;
+  write_to_testcase(mem, len);
 
-    for (i = 0; i < use_stacking; i++) {
+  defer_classify = 1;
+  fault = run_target(argv, exec_tmout, "USELESS=0", 0);
+  defer_classify = 0;
 
-      switch (UR(15 + ((extras_cnt + a_extras_cnt) ? 2 : 0))) {
+  if (stop_soon) return 1;
 
-        case 0:
+  syncing_party = party;
+  queued_imported += save_if_interesting(argv, mem, len, fault);
+  syncing_party = 0;
 
-          /* Flip a single bit somewhere. Spooky! */
+  if (!(stage_cur++ % stats_update_freq)) show_stats();
 
-          FLIP_BIT(out_buf, UR(temp_len << 3));
-          break;
+  return 0;
 
-        case 1:
+}
 
-          /* Set byte to interesting value. */
 
-          out_buf[UR(temp_len)] = interesting_8[UR(sizeof(interesting_8))];
-          break;
+/* Sync the entries of another fuzzer's packed queue, starting at ID
+   min_accept. Stops at the first record not fully written yet, so that it
+   is picked up next time. Returns 0 if dir has no pack, 2 if it is time to
+   stop, 1 otherwise. */
 
-        case 2:
+static u8 sync_packed_queue(char** argv, u8* dir, u8* party, u32 min_accept,
+                            u32* next_min_accept) {
 
-          /* Set word to interesting value, randomly choosing endian. */
+  struct pack_entry* idx;
+  u64 idx_len, data_len, cnt;
+  u8 *fn, *data, ret = 1;
 
-          if (temp_len < 2) break;
+  fn = alloc_printf("%s/.state/pack/index", dir);
+  idx = (struct pack_entry*)pack_map_file(fn, PACK_INDEX_MAGIC, &idx_len);
+  ck_free(fn);
 
-          if (UR(2)) {
+  if (!idx) return 0;
 
-            *(u16*)(out_buf + UR(temp_len - 1)) =
-              interesting_16[UR(sizeof(interesting_16) >> 1)];
+  fn = alloc_printf("%s/.state/pack/data", dir);
+  data = pack_map_file(fn, PACK_DATA_MAGIC, &data_len);
+  ck_free(fn);
 
-          } else {
+  if (!data) {
+    munmap(idx, idx_len);
+    return 1;
+  }
 
-            *(u16*)(out_buf + UR(temp_len - 1)) = SWAP16(
-              interesting_16[UR(sizeof(interesting_16) >> 1)]);
+  cnt = (idx_len - sizeof(struct pack_header)) / sizeof(struct pack_entry);
 
-          }
+  for (syncing_case = min_accept; syncing_case < cnt; syncing_case++) {
 
-          break;
+    struct pack_entry* e = (struct pack_entry*)
+                           ((u8*)idx + sizeof(struct pack_header)) +
+                           syncing_case;
 
-        case 3:
+    u8* name = pack_entry_name(data, data_len, e);
+    u8* rec;
 
-          /* Set dword to interesting value, randomly choosing endian. */
+    if (!name) break;
 
-          if (temp_len < 4) break;
+    *next_min_accept = syncing_case + 1;
 
-          if (UR(2)) {
+    /* Ignore zero-sized or oversized entries. */
 
-            *(u32*)(out_buf + UR(temp_len - 3)) =
-              interesting_32[UR(sizeof(interesting_32) >> 2)];
+    if (!e->len || e->len > MAX_FILE) continue;
 
-          } else {
+    /* The calibration record, if any, is in the pack too. */
 
-            *(u32*)(out_buf + UR(temp_len - 3)) = SWAP32(
-              interesting_32[UR(sizeof(interesting_32) >> 2)]);
+    rec = pack_entry_cal(data, data_len, e);
 
-          }
+    if (sync_one_case(argv, rec && sync_blob_known(rec, e->cal_len,
+                                                   data + e->offset, e->len),
+                      data + e->offset, e->len, party)) {
+      ret = 2;
+      break;
+    }
 
-          break;
+  }
 
-        case 4:
+  munmap(data, data_len);
+  munmap(idx, idx_len);
 
-          /* Randomly subtract from byte. */
+  return ret;
 
-          out_buf[UR(temp_len)] -= 1 + UR(ARITH_MAX);
-          break;
+}
 
-        case 5:
 
-          /* Randomly add to byte. */
+/* Incremental sync. With inotify, the queue/ of every peer is watched from
+   its first full scan on, and the files completed there since (closed
+   after writing, renamed in, or linked in with link() or symlink(), which
+   raise nothing but IN_CREATE) are gathered in a pending list, so that a
+   sync only looks at new arrivals. Any other file created there gets the
+   peer's queue/ rescanned, as do peers that cannot be watched (no inotify,
+   AFL_NO_INOTIFY, out of watches) and all peers after an event queue
+   overflow. */
 
-          out_buf[UR(temp_len)] += 1 + UR(ARITH_MAX);
-          break;
+struct sync_pending {
 
-        case 6:
+  u32 id;                             /* Case ID parsed from the name     */
+  u8* name;                           /* File name in the peer's queue/   */
 
-          /* Randomly subtract from word, random endian. */
+};
 
-          if (temp_len < 2) break;
+struct sync_peer {
 
-          if (UR(2)) {
+  u8* name;                           /* Sync ID of the peer              */
+  s32 wd;                             /* Watch on its queue/, -1 if none  */
+  u8  rescan;                         /* Pending list incomplete?         */
+  u32 pending_cnt;                    /* Entries in pending[]             */
+  struct sync_pending* pending;       /* Arrivals since the last sync     */
+  struct cal_index cal;               /* Its calibration records          */
 
-            u32 pos = UR(temp_len - 1);
+};
 
-            *(u16*)(out_buf + pos) -= 1 + UR(ARITH_MAX);
+static struct sync_peer* sync_peers;  /* Peers seen in the sync dir       */
+static u32 sync_peer_cnt;             /* Number of sync_peers[]           */
+static s32 sync_watch_fd = -1;        /* inotify descriptor, if any       */
 
-          } else {
+static struct sync_peer* sync_get_peer(u8* name) {
 
-            u32 pos = UR(temp_len - 1);
-            u16 num = 1 + UR(ARITH_MAX);
+  struct sync_peer* p;
+  u32 i;
 
-            *(u16*)(out_buf + pos) =
-              SWAP16(SWAP16(*(u16*)(out_buf + pos)) - num);
+  for (i = 0; i < sync_peer_cnt; i++)
+    if (!strcmp(sync_peers[i].name, name)) return sync_peers + i;
 
-          }
+  sync_peers = ck_realloc_block(sync_peers, (sync_peer_cnt + 1) *
+                                sizeof(struct sync_peer));
 
-          break;
+  p = sync_peers + sync_peer_cnt++;
+  memset(p, 0, sizeof(struct sync_peer));
 
-        case 7:
+  p->name   = ck_strdup(name);
+  p->wd     = -1;
+  p->rescan = 1;
+  p->cal.fn = alloc_printf("%s/%s/queue/.state/calibration/records",
+                           sync_dir, name);
 
-          /* Randomly add to word, random endian. */
+  return p;
 
-          if (temp_len < 2) break;
+}
 
-          if (UR(2)) {
+static void sync_clear_pending(struct sync_peer* p) {
 
-            u32 pos = UR(temp_len - 1);
+  u32 i;
 
-            *(u16*)(out_buf + pos) += 1 + UR(ARITH_MAX);
+  for (i = 0; i < p->pending_cnt; i++) ck_free(p->pending[i].name);
 
-          } else {
+  ck_free(p->pending);
+  p->pending     = NULL;
+  p->pending_cnt = 0;
 
-            u32 pos = UR(temp_len - 1);
-            u16 num = 1 + UR(ARITH_MAX);
+}
 
-            *(u16*)(out_buf + pos) =
-              SWAP16(SWAP16(*(u16*)(out_buf + pos)) + num);
+/* Set up the watcher on the first sync. */
 
-          }
+static void sync_watch_init(void) {
 
-          break;
+#ifdef HAVE_INOTIFY
 
-        case 8:
+  if (getenv("AFL_NO_INOTIFY")) return;
 
-          /* Randomly subtract from dword, random endian. */
+  sync_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
 
-          if (temp_len < 4) break;
+  if (sync_watch_fd < 0)
+    WARNF("inotify_init1() failed, falling back to rescanning peer queues");
 
-          if (UR(2)) {
+#endif /* HAVE_INOTIFY */
 
-            u32 pos = UR(temp_len - 3);
+}
 
-            *(u32*)(out_buf + pos) -= 1 + UR(ARITH_MAX);
+/* Move the events queued by the kernel since the last sync to the pending
+   lists of the peers. */
 
-          } else {
+static void sync_watch_drain(void) {
 
-            u32 pos = UR(temp_len - 3);
-            u32 num = 1 + UR(ARITH_MAX);
+#ifdef HAVE_INOTIFY
 
-            *(u32*)(out_buf + pos) =
-              SWAP32(SWAP32(*(u32*)(out_buf + pos)) - num);
+  static u8 buf[64 * 1024]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
 
-          }
+  ssize_t len;
+  u32 i;
 
-          break;
+  if (sync_watch_fd < 0) return;
 
-        case 9:
+  while ((len = read(sync_watch_fd, buf, sizeof(buf))) > 0) {
 
-          /* Randomly add to dword, random endian. */
+    u8* p = buf;
 
-          if (temp_len < 4) break;
+    while (p < buf + len) {
 
-          if (UR(2)) {
+      struct inotify_event* ev = (struct inotify_event*)p;
+      struct sync_peer* peer = NULL;
+      u32 id;
 
-            u32 pos = UR(temp_len - 3);
+      p += sizeof(struct inotify_event) + ev->len;
 
-            *(u32*)(out_buf + pos) += 1 + UR(ARITH_MAX);
+      if (ev->mask & IN_Q_OVERFLOW) {
 
-          } else {
+        for (i = 0; i < sync_peer_cnt; i++) sync_peers[i].rescan = 1;
+        continue;
 
-            u32 pos = UR(temp_len - 3);
-            u32 num = 1 + UR(ARITH_MAX);
+      }
 
-            *(u32*)(out_buf + pos) =
-              SWAP32(SWAP32(*(u32*)(out_buf + pos)) + num);
+      for (i = 0; i < sync_peer_cnt; i++)
+        if (sync_peers[i].wd == ev->wd) peer = sync_peers + i;
 
-          }
+      if (!peer) continue;
 
-          break;
+      /* The peer's queue/ went away, e.g. when it was restarted. */
 
-        case 10:
+      if (ev->mask & IN_IGNORED) {
 
-          /* Just set a random byte to a random value. Because,
-             why not. We use XOR with 1-255 to eliminate the
-             possibility of a no-op. */
+        peer->wd     = -1;
+        peer->rescan = 1;
+        continue;
 
-          out_buf[UR(temp_len)] ^= 1 + UR(255);
-          break;
+      }
 
-        case 11 ... 12: {
+      if (!ev->len || (ev->mask & IN_ISDIR) || ev->name[0] == '.' ||
+          sscanf(ev->name, CASE_PREFIX "%06u", &id) != 1) continue;
 
-            /* Delete bytes. We're making this a bit more likely
-               than insertion (the next option) in hopes of keeping
-               files reasonably small. */
+      /* A new link is complete as it is. A new regular file may still be
+         half written; leave it to the rescan. */
 
-            u32 del_from, del_len;
+      if (ev->mask & IN_CREATE) {
 
-            if (temp_len < 2) break;
+        struct stat st;
+        u8* fn = alloc_printf("%s/%s/queue/%s", sync_dir, peer->name,
+                              ev->name);
+        s32 res = lstat(fn, &st);
 
-            /* Don't delete too much. */
+        ck_free(fn);
 
-            del_len = choose_block_len(temp_len - 1);
+        if (res || (!S_ISLNK(st.st_mode) && st.st_nlink < 2)) {
+          peer->rescan = 1;
+          continue;
+        }
 
-            del_from = UR(temp_len - del_len + 1);
+      }
 
-            memmove(out_buf + del_from, out_buf + del_from + del_len,
-                    temp_len - del_from - del_len);
+      peer->pending = ck_realloc_block(peer->pending, (peer->pending_cnt + 1) *
+                                       sizeof(struct sync_pending));
 
-            temp_len -= del_len;
+      peer->pending[peer->pending_cnt].id     = id;
+      peer->pending[peer->pending_cnt++].name = ck_strdup(ev->name);
 
-            break;
+    }
 
-          }
+  }
 
-        case 13:
+  if (len < 0 && errno != EAGAIN && errno != EINTR)
+    PFATAL("Unable to read inotify events");
 
-          if (temp_len + HAVOC_BLK_XL < MAX_FILE) {
+#endif /* HAVE_INOTIFY */
 
-            /* Clone bytes (75%) or insert a block of constant bytes (25%). */
+}
 
-            u8  actually_clone = UR(4);
-            u32 clone_from, clone_to, clone_len;
-            u8* new_buf;
+static int sync_pending_cmp(const void* a, const void* b) {
 
-            if (actually_clone) {
+  u32 x = ((struct sync_pending*)a)->id, y = ((struct sync_pending*)b)->id;
 
-              clone_len  = choose_block_len(temp_len);
-              clone_from = UR(temp_len - clone_len + 1);
+  return x < y ? -1 : x > y;
 
-            } else {
+}
 
-              clone_len = choose_block_len(HAVOC_BLK_XL);
-              clone_from = 0;
+/* Map one file from a peer's queue/ and run it. Returns 1 if it is time to
+   stop. */
 
-            }
+static u8 sync_queue_file(char** argv, u8* qd_path, u8* name, u8* party,
+                          struct cal_index* cal) {
 
-            clone_to   = UR(temp_len);
+  u8* path = alloc_printf("%s/%s", qd_path, name);
+  struct stat st;
+  u8 ret = 0;
+  s32 fd;
 
-            new_buf = ck_alloc_nozero(temp_len + clone_len);
+  /* Allow this to fail in case the other fuzzer is resuming or so... */
 
-            /* Head */
+  fd = open(path, O_RDONLY);
 
-            memcpy(new_buf, out_buf, clone_to);
+  if (fd < 0) {
+     ck_free(path);
+     return 0;
+  }
 
-            /* Inserted part */
+  if (fstat(fd, &st)) PFATAL("fstat() failed");
 
-            if (actually_clone)
-              memcpy(new_buf + clone_to, out_buf + clone_from, clone_len);
-            else
-              memset(new_buf + clone_to,
-                     UR(2) ? UR(256) : out_buf[UR(temp_len)], clone_len);
+  /* Ignore zero-sized or oversized files. */
 
-            /* Tail */
-            memcpy(new_buf + clone_to + clone_len, out_buf + clone_to,
-                   temp_len - clone_to);
+  if (st.st_size && st.st_size <= MAX_FILE) {
 
-            ck_free(out_buf);
-            out_buf = new_buf;
-            temp_len += clone_len;
+    u8* mem = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-          }
+    if (mem == MAP_FAILED) PFATAL("Unable to mmap '%s'", path);
 
-          break;
+    ret = sync_one_case(argv, sync_case_known(cal, name, strlen(name),
+                                              mem, st.st_size),
+                        mem, st.st_size, party);
 
-        case 14: {
+    munmap(mem, st.st_size);
 
-            /* Overwrite bytes with a randomly selected chunk (75%) or fixed
-               bytes (25%). */
+  }
 
-            u32 copy_from, copy_to, copy_len;
+  ck_free(path);
+  close(fd);
 
-            if (temp_len < 2) break;
+  return ret;
 
-            copy_len  = choose_block_len(temp_len - 1);
+}
 
-            copy_from = UR(temp_len - copy_len + 1);
-            copy_to   = UR(temp_len - copy_len + 1);
 
-            if (UR(4)) {
+/* Sync through afl-syncd (AFL_SYNCD, see syncd.h) instead of the sync dir.
+   New entries are pushed as they are saved, along with their calibration
+   records; the cases of the other instances are taken in at sync time, in
+   the order the daemon relays them. Pushes never wait on the socket: what
+   it does not take at once is queued and sent as it drains, and past
+   SYNCD_OUT_MAX queued bytes new entries are not pushed. If the daemon
+   goes away, we fall back to the sync dir. */
 
-              if (copy_from != copy_to)
-                memmove(out_buf + copy_to, out_buf + copy_from, copy_len);
+static void syncd_lost(u8* why) {
 
-            } else memset(out_buf + copy_to,
-                          UR(2) ? UR(256) : out_buf[UR(temp_len)], copy_len);
+  WARNF("Lost afl-syncd at '%s' (%s), syncing through the sync dir",
+        syncd_addr, why);
 
-            break;
+  close(syncd_fd);
+  syncd_fd = -1;
 
-          }
+  ck_free(syncd_out);
+  syncd_out     = NULL;
+  syncd_out_len = syncd_out_off = 0;
 
-        /* Values 15 and 16 can be selected only if there are any extras
-           present in the dictionaries. */
+}
 
-        case 15: {
+/* Send what is queued. Without wait, stop as soon as the socket is full. */
 
-            /* Overwrite bytes with an extra. */
+static void syncd_flush(u8 wait) {
 
-            if (!extras_cnt || (a_extras_cnt && UR(2))) {
+  while (syncd_fd >= 0 && syncd_out_off < syncd_out_len) {
 
-              /* No user-specified extras or odds in our favor. Let's use an
-                 auto-detected one. */
+    ssize_t r = send(syncd_fd, syncd_out + syncd_out_off,
+                     syncd_out_len - syncd_out_off,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
 
-              u32 use_extra = UR(a_extras_cnt);
-              u32 extra_len = a_extras[use_extra].len;
-              u32 insert_at;
+    if (r < 0 && errno == EINTR) continue;
 
-              if (extra_len > temp_len) break;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
 
-              insert_at = UR(temp_len - extra_len + 1);
-              memcpy(out_buf + insert_at, a_extras[use_extra].data, extra_len);
+      struct pollfd pfd;
 
-            } else {
+      if (!wait) return;
 
-              /* No auto extras or odds in our favor. Use the dictionary. */
+      pfd.fd     = syncd_fd;
+      pfd.events = POLLOUT;
+      poll(&pfd, 1, -1);
+      continue;
 
-              u32 use_extra = UR(extras_cnt);
-              u32 extra_len = extras[use_extra].len;
-              u32 insert_at;
+    }
 
-              if (extra_len > temp_len) break;
+    if (r <= 0) {
+      syncd_lost(r ? (u8*)strerror(errno) : (u8*)"connection closed");
+      return;
+    }
 
-              insert_at = UR(temp_len - extra_len + 1);
-              memcpy(out_buf + insert_at, extras[use_extra].data, extra_len);
+    syncd_out_off += r;
 
-            }
+  }
 
-            break;
+  syncd_out_len = syncd_out_off = 0;
 
-          }
+}
 
-        case 16: {
+/* Queue a message and send what the socket takes. Returns 0 if the queue
+   is full and the message was dropped. */
 
-            u32 use_extra, extra_len, insert_at = UR(temp_len + 1);
-            u8* new_buf;
+static u8 syncd_send(u8* buf, u32 len) {
 
-            /* Insert an extra. Do the same dice-rolling stuff as for the
-               previous case. */
+  if (syncd_out_len - syncd_out_off + (u64)len > SYNCD_OUT_MAX) return 0;
 
-            if (!extras_cnt || (a_extras_cnt && UR(2))) {
+  if (syncd_out_off) {
 
-              use_extra = UR(a_extras_cnt);
-              extra_len = a_extras[use_extra].len;
+    memmove(syncd_out, syncd_out + syncd_out_off,
+            syncd_out_len - syncd_out_off);
+    syncd_out_len -= syncd_out_off;
+    syncd_out_off  = 0;
 
-              if (temp_len + extra_len >= MAX_FILE) break;
+  }
 
-              new_buf = ck_alloc_nozero(temp_len + extra_len);
+  syncd_out = ck_realloc(syncd_out, syncd_out_len + len);
+  memcpy(syncd_out + syncd_out_len, buf, len);
+  syncd_out_len += len;
 
-              /* Head */
-              memcpy(new_buf, out_buf, insert_at);
+  syncd_flush(0);
+  return 1;
 
-              /* Inserted part */
-              memcpy(new_buf + insert_at, a_extras[use_extra].data, extra_len);
+}
 
-            } else {
+/* Push a new queue entry, with its calibration record if it has one. */
 
-              use_extra = UR(extras_cnt);
-              extra_len = extras[use_extra].len;
+static void syncd_push(struct queue_entry* q, u8* mem) {
 
-              if (temp_len + extra_len >= MAX_FILE) break;
+  u8* msg;
+  u32 meta_len = 0, msg_len;
 
-              new_buf = ck_alloc_nozero(temp_len + extra_len);
+  if (syncd_fd < 0) return;
 
-              /* Head */
-              memcpy(new_buf, out_buf, insert_at);
+  if (!no_cal_cache && q->cal_len && cal_fd >= 0) meta_len = q->cal_len;
 
-              /* Inserted part */
-              memcpy(new_buf + insert_at, extras[use_extra].data, extra_len);
+  msg_len = SYNCD_HDR_LEN + SYNCD_CASE_LEN + q->len + meta_len;
 
-            }
+  if (msg_len - SYNCD_HDR_LEN > SYNCD_MAX_MSG) return;
 
-            /* Tail */
-            memcpy(new_buf + insert_at + extra_len, out_buf + insert_at,
-                   temp_len - insert_at);
+  msg = ck_alloc_nozero(msg_len);
 
-            ck_free(out_buf);
-            out_buf   = new_buf;
-            temp_len += extra_len;
+  syncd_put_hdr(msg, SYNCD_PUSH, msg_len - SYNCD_HDR_LEN);
 
-            break;
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_ID * 4, q->entry_id);
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_HASH * 4,
+              cal_content_hash(mem, q->len));
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_EXEC_CKSUM * 4, q->exec_cksum);
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_DFG_CKSUM * 4, q->dfg_cksum);
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_VAL_HASH * 4, q->val_hash);
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_ORIGIN_LEN * 4, 0);
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_DATA_LEN * 4, q->len);
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_META_LEN * 4, meta_len);
 
-          }
+  memcpy(msg + SYNCD_HDR_LEN + SYNCD_CASE_LEN, mem, q->len);
 
-      }
+  if (meta_len && pread(cal_fd, msg + msg_len - meta_len, meta_len,
+                        q->cal_off) != meta_len) {
 
-    }
+    /* Could not read it back; send the case alone. */
 
-    if (common_fuzz_stuff(argv, out_buf, temp_len))
-      goto abandon_entry;
+    msg_len -= meta_len;
+    syncd_put_hdr(msg, SYNCD_PUSH, msg_len - SYNCD_HDR_LEN);
+    syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_META_LEN * 4, 0);
 
-    /* out_buf might have been mangled a bit, so let's restore it to its
-       original size and shape. */
+  }
 
-    if (temp_len < len) out_buf = ck_realloc(out_buf, len);
-    temp_len = len;
-    memcpy(out_buf, in_buf, len);
+  if (syncd_send(msg, msg_len) && syncd_fd >= 0) syncd_pushed++;
 
-    /* If we're finding new stuff, let's run for a bit longer, limits
-       permitting. */
+  ck_free(msg);
 
-    if (queued_paths != havoc_queued) {
+}
 
-      if (perf_score <= HAVOC_MAX_MULT * 100) {
-        stage_max  *= 2;
-        perf_score *= 2;
-      }
+/* Connect after the dry run and push what we have found so far (entries
+   we took from others excepted). */
 
-      havoc_queued = queued_paths;
+static void syncd_connect(void) {
 
-    }
+  struct queue_entry* q;
+  u8 hello[SYNCD_HDR_LEN + 4 + 256];
+  u32 id_len;
 
-  }
+  if (!sync_id) FATAL("AFL_SYNCD requires -M or -S");
 
-  new_hit_cnt = queued_paths + unique_crashes;
+  id_len = strlen(sync_id);
+  if (id_len > 256) FATAL("Sync ID too long for AFL_SYNCD");
 
-  if (!splice_cycle) {
-    stage_finds[STAGE_HAVOC]  += new_hit_cnt - orig_hit_cnt;
-    stage_cycles[STAGE_HAVOC] += stage_max;
-  } else {
-    stage_finds[STAGE_SPLICE]  += new_hit_cnt - orig_hit_cnt;
-    stage_cycles[STAGE_SPLICE] += stage_max;
-  }
+  syncd_fd = syncd_open(syncd_addr, 0);
+  if (syncd_fd < 0) PFATAL("Unable to connect to afl-syncd at '%s'", syncd_addr);
 
-#ifndef IGNORE_FINDS
+  fcntl(syncd_fd, F_SETFD, FD_CLOEXEC);
 
-  /************
-   * SPLICING *
-   ************/
+  syncd_put_hdr(hello, SYNCD_HELLO, 4 + id_len);
+  syncd_put32(hello + SYNCD_HDR_LEN, SYNCD_VERSION);
+  memcpy(hello + SYNCD_HDR_LEN + 4, sync_id, id_len);
 
-  /* This is a last-resort strategy triggered by a full round with no findings.
-     It takes the current input file, randomly selects another input, and
-     splices them together at some offset, then relies on the havoc
-     code to mutate that blob. */
+  syncd_send(hello, SYNCD_HDR_LEN + 4 + id_len);
 
-retry_splicing:
+  syncd_in = ck_alloc_nozero(SYNCD_HDR_LEN + SYNCD_MAX_MSG);
 
-  if (use_splicing && splice_cycle++ < SPLICE_CYCLES &&
-      queued_paths > 1 && queue_cur->len > 1) {
+  for (q = queue; q && syncd_fd >= 0; q = q->next) {
 
-    u32 idx, idx_div, split_at;
-    u8* new_buf;
-    s32 f_diff, l_diff;
+    u8* mem;
 
-    /* First of all, if we've modified in_buf for havoc, let's clean that
-       up... */
+    if (strstr(q->fname, ",sync:")) continue;
 
-    if (in_buf != orig_in) {
-      ck_free(in_buf);
-      in_buf = orig_in;
-      len = queue_cur->len;
-    }
+    mem = load_queue_entry(q);
+    syncd_push(q, mem);
+    ck_free(mem);
 
-    /* Pick a random queue entry and find it. */
+    /* The backlog may be bigger than the queue; we can afford to wait. */
 
-    idx = UR(queued_paths_cur);
+    syncd_flush(1);
 
-    idx_div = idx / 100;
-    if (idx_div < 1024) {
-      target = shortcut_per_100[idx_div];
-      idx -= idx_div * 100;
-    } else {
-      target = shortcut_per_100[1023];
-      idx -= idx_div * 1024;
-    }
+  }
 
-    while (idx--) target = target->next;
+  if (syncd_fd >= 0)
+    OKF("Connected to afl-syncd at '%s', pushed %llu entries.", syncd_addr,
+        syncd_pushed);
 
-    /* Make sure that the target has a reasonable length and isn't yourself. */
+}
 
-    while (target && (target->len < 2 || target == queue_cur)) {
-      target = target->next;
-    }
+/* Take in one CASE message. Returns 1 if it is time to stop. */
 
-    if (!target) goto retry_splicing;
+static u8 syncd_take_case(char** argv, u8* p, u32 len) {
 
-    splicing_with = target->entry_id;
+  u8 *origin, *data, known = 0, ret;
+  u32 origin_len, data_len, meta_len;
 
-    /* Read the testcase into a new buffer. */
+  if (!syncd_case_ok(p, len)) return 0;
 
-    fd = open(target->fname, O_RDONLY);
+  origin_len = syncd_get32(p + SYNCD_CASE_ORIGIN_LEN * 4);
+  data_len   = syncd_get32(p + SYNCD_CASE_DATA_LEN * 4);
+  meta_len   = syncd_get32(p + SYNCD_CASE_META_LEN * 4);
 
-    if (fd < 0) PFATAL("Unable to open '%s'", target->fname);
+  data = p + SYNCD_CASE_LEN + origin_len;
 
-    new_buf = ck_alloc_nozero(target->len);
+  /* Ignore zero-sized or oversized entries, and anything damaged on the
+     way. */
 
-    ck_read(fd, new_buf, target->len, target->fname);
+  if (!origin_len || !data_len || data_len > MAX_FILE ||
+      cal_content_hash(data, data_len) !=
+      syncd_get32(p + SYNCD_CASE_HASH * 4)) return 0;
 
-    close(fd);
+  origin = ck_alloc(origin_len + 1);
+  memcpy(origin, p + SYNCD_CASE_LEN, origin_len);
 
-    /* Find a suitable splicing location, somewhere between the first and
-       the last differing byte. Bail out if the difference is just a single
-       byte or so. */
+  if (meta_len) known = sync_blob_known(data + data_len, meta_len, data,
+                                        data_len);
 
-    locate_diffs(in_buf, new_buf, MIN(len, target->len), &f_diff, &l_diff);
+  syncd_pulled++;
+  syncing_case = syncd_get32(p + SYNCD_CASE_ID * 4);
 
-    if (f_diff < 0 || l_diff < 2 || f_diff == l_diff) {
-      ck_free(new_buf);
-      goto retry_splicing;
-    }
+  ret = sync_one_case(argv, known, data, data_len, origin);
 
-    /* Split somewhere between the first and last differing byte. */
+  ck_free(origin);
+  return ret;
 
-    split_at = f_diff + UR(l_diff - f_diff);
+}
 
-    /* Do the thing. */
+/* Take in everything the daemon has sent since the last sync, without
+   waiting for more. */
 
-    len = target->len;
-    memcpy(new_buf, in_buf, split_at);
-    in_buf = new_buf;
+static void syncd_pull(char** argv) {
 
-    ck_free(out_buf);
-    out_buf = ck_alloc_nozero(len);
-    memcpy(out_buf, in_buf, len);
+  stage_name = "syncd";
+  stage_cur  = 0;
+  stage_max  = 0;
+  cur_depth  = 0;
 
-    goto havoc_stage;
+  syncd_flush(0);
 
-  }
+  while (syncd_fd >= 0) {
 
-#endif /* !IGNORE_FINDS */
+    u32 need = SYNCD_HDR_LEN;
+    ssize_t r;
 
-  ret_val = 0;
+    if (syncd_in_have >= SYNCD_HDR_LEN) need += syncd_get32(syncd_in + 8);
 
-abandon_entry:
+    if (syncd_in_have < need) {
 
-  splicing_with = -1;
+      r = recv(syncd_fd, syncd_in + syncd_in_have, need - syncd_in_have,
+               MSG_DONTWAIT);
 
-  /* Update pending_not_fuzzed count if we made it through the calibration
-     cycle and have not seen this entry before. */
+      if (r < 0 && (errno == EAGAIN || errno == EINTR)) return;
 
-  if (!stop_soon && !queue_cur->cal_failed && !queue_cur->was_fuzzed) {
-    queue_cur->was_fuzzed = 1;
-    pending_not_fuzzed--;
-    if (queue_cur->favored) pending_favored--;
-  }
+      if (r <= 0) {
+        syncd_lost(r ? (u8*)strerror(errno) : (u8*)"connection closed");
+        return;
+      }
 
-  munmap(orig_in, queue_cur->len);
+      syncd_in_have += r;
 
-  if (in_buf != orig_in) ck_free(in_buf);
-  ck_free(out_buf);
-  ck_free(eff_map);
+      if (syncd_in_have == SYNCD_HDR_LEN &&
+          (syncd_get32(syncd_in) != SYNCD_MAGIC ||
+           syncd_get32(syncd_in + 4) != SYNCD_CASE ||
+           syncd_get32(syncd_in + 8) > SYNCD_MAX_MSG))
+        syncd_lost("bad message");
 
-  return ret_val;
+      continue;
 
-#undef FLIP_BIT
+    }
 
-}
+    syncd_in_have = 0;
 
-static u8 fuzz_one(char **argv) {
-  int key_val_lv = 0;
-  key_val_lv = fuzz_one_vertical(argv);
-  return key_val_lv;
-}
+    if (syncd_take_case(argv, syncd_in + SYNCD_HDR_LEN, need - SYNCD_HDR_LEN))
+      return;
 
+  }
+
+}
 
-/* Grab interesting test cases from other fuzzers. */
 
 static void sync_fuzzers(char** argv) {
 
+  static u8 watch_ready;
+
   DIR* sd;
   struct dirent* sd_ent;
   u32 sync_cnt = 0;
 
+  if (syncd_fd >= 0) {
+    syncd_pull(argv);
+    if (syncd_fd >= 0 || stop_soon) return;
+  }
+
+  if (!watch_ready) {
+    sync_watch_init();
+    watch_ready = 1;
+  }
+
+  sync_watch_drain();
+
   sd = opendir(sync_dir);
   if (!sd) PFATAL("Unable to open '%s'", sync_dir);
 
@@ -10445,24 +15266,45 @@ static void sync_fuzzers(char** argv) {
 
     static u8 stage_tmp[128];
 
-    DIR* qd;
+    struct sync_peer* peer;
+    DIR* qd = NULL;
     struct dirent* qd_ent;
     u8 *qd_path, *qd_synced_path;
-    u32 min_accept = 0, next_min_accept;
+    u32 min_accept = 0, next_min_accept, i;
 
     s32 id_fd;
 
-    /* Skip dot files and our own output directory. */
+    /* Skip dot files and our own output directory. */
+
+    if (sd_ent->d_name[0] == '.' || !strcmp(sync_id, sd_ent->d_name)) continue;
+
+    /* Skip anything that doesn't have a queue/ subdirectory. */
+
+    qd_path = alloc_printf("%s/%s/queue", sync_dir, sd_ent->d_name);
+    peer    = sync_get_peer(sd_ent->d_name);
+
+    if (peer->wd < 0 || peer->rescan) {
+
+      if (!(qd = opendir(qd_path))) {
+        ck_free(qd_path);
+        continue;
+      }
+
+      /* Start watching before the scan, so that nothing slips in between;
+         whatever the scan sees need not stay pending. */
+
+#ifdef HAVE_INOTIFY
 
-    if (sd_ent->d_name[0] == '.' || !strcmp(sync_id, sd_ent->d_name)) continue;
+      if (sync_watch_fd >= 0 && peer->wd < 0)
+        peer->wd = inotify_add_watch(sync_watch_fd, qd_path,
+                                     IN_CREATE | IN_CLOSE_WRITE |
+                                     IN_MOVED_TO | IN_ONLYDIR);
 
-    /* Skip anything that doesn't have a queue/ subdirectory. */
+#endif /* HAVE_INOTIFY */
 
-    qd_path = alloc_printf("%s/%s/queue", sync_dir, sd_ent->d_name);
+      sync_clear_pending(peer);
+      peer->rescan = 0;
 
-    if (!(qd = opendir(qd_path))) {
-      ck_free(qd_path);
-      continue;
     }
 
     /* Retrieve the ID of the last seen test case. */
@@ -10485,74 +15327,67 @@ static void sync_fuzzers(char** argv) {
     stage_cur  = 0;
     stage_max  = 0;
 
-    /* For every file queued by this fuzzer, parse ID and see if we have looked at
-       it before; exec a test case if not. */
-
-    while ((qd_ent = readdir(qd))) {
-
-      u8* path;
-      s32 fd;
-      struct stat st;
-
-      if (qd_ent->d_name[0] == '.' ||
-          sscanf(qd_ent->d_name, CASE_PREFIX "%06u", &syncing_case) != 1 ||
-          syncing_case < min_accept) continue;
+    /* A packed queue lists its entries by ID in the index. */
 
-      /* OK, sounds like a new one. Let's give it a try. */
+    switch (sync_packed_queue(argv, qd_path, sd_ent->d_name, min_accept,
+                              &next_min_accept)) {
 
-      if (syncing_case >= next_min_accept)
-        next_min_accept = syncing_case + 1;
+      case 1: sync_clear_pending(peer); goto sync_done;
+      case 2: return;
 
-      path = alloc_printf("%s/%s", qd_path, qd_ent->d_name);
+    }
 
-      /* Allow this to fail in case the other fuzzer is resuming or so... */
+    if (!qd) {
 
-      fd = open(path, O_RDONLY);
+      /* Watched: only look at what arrived since the last sync, in ID
+         order. A file may be reported more than once. */
 
-      if (fd < 0) {
-         ck_free(path);
-         continue;
-      }
+      qsort(peer->pending, peer->pending_cnt, sizeof(struct sync_pending),
+            sync_pending_cmp);
 
-      if (fstat(fd, &st)) PFATAL("fstat() failed");
+      for (i = 0; i < peer->pending_cnt; i++) {
 
-      /* Ignore zero-sized or oversized files. */
+        syncing_case = peer->pending[i].id;
 
-      if (st.st_size && st.st_size <= MAX_FILE) {
+        if (syncing_case < next_min_accept) continue;
 
-        u8  fault;
-        u8* mem = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        next_min_accept = syncing_case + 1;
 
-        if (mem == MAP_FAILED) PFATAL("Unable to mmap '%s'", path);
+        if (sync_queue_file(argv, qd_path, peer->pending[i].name,
+                            sd_ent->d_name, &peer->cal)) return;
 
-        /* See what happens. We rely on save_if_interesting() to catch major
-           errors and save the test case. */
+      }
 
-        write_to_testcase(mem, st.st_size);
+      sync_clear_pending(peer);
+      goto sync_done;
 
-        fault = run_target(argv, exec_tmout, "USELESS=0", 0);
+    }
 
-        if (stop_soon) return;
+    /* For every file queued by this fuzzer, parse ID and see if we have looked at
+       it before; exec a test case if not. */
 
-        syncing_party = sd_ent->d_name;
-        queued_imported += save_if_interesting(argv, mem, st.st_size, fault);
-        syncing_party = 0;
+    while ((qd_ent = readdir(qd))) {
 
-        munmap(mem, st.st_size);
+      if (qd_ent->d_name[0] == '.' ||
+          sscanf(qd_ent->d_name, CASE_PREFIX "%06u", &syncing_case) != 1 ||
+          syncing_case < min_accept) continue;
 
-        if (!(stage_cur++ % stats_update_freq)) show_stats();
+      /* OK, sounds like a new one. Let's give it a try. */
 
-      }
+      if (syncing_case >= next_min_accept)
+        next_min_accept = syncing_case + 1;
 
-      ck_free(path);
-      close(fd);
+      if (sync_queue_file(argv, qd_path, qd_ent->d_name, sd_ent->d_name,
+                          &peer->cal)) return;
 
     }
 
+sync_done:
+
     ck_write(id_fd, &next_min_accept, sizeof(u32), qd_synced_path);
 
     close(id_fd);
-    closedir(qd);
+    if (qd) closedir(qd);
     ck_free(qd_path);
     ck_free(qd_synced_path);
 
@@ -10567,11 +15402,20 @@ static void sync_fuzzers(char** argv) {
 
 static void handle_stop_sig(int sig) {
 
+  u32 i;
+
   stop_soon = 1;
 
   if (child_pid > 0) kill(child_pid, SIGKILL);
   if (forksrv_pid > 0) kill(forksrv_pid, SIGKILL);
 
+  /* The executors too, so that their workers don't wait out the target. */
+
+  if (pool) for (i = 0; i < pool_size; i++) {
+    if (pool[i].child_pid > 0) kill(pool[i].child_pid, SIGKILL);
+    if (pool[i].forksrv_pid > 0) kill(pool[i].forksrv_pid, SIGKILL);
+  }
+
 }
 
 
@@ -10583,6 +15427,14 @@ static void handle_skipreq(int sig) {
 
 }
 
+/* Handle scheduler dump request (SIGUSR2). */
+
+static void handle_dumpreq(int sig) {
+
+  dump_requested = 1;
+
+}
+
 /* Handle timeout (SIGALRM). */
 
 static void handle_timeout(int sig) {
@@ -10842,6 +15694,348 @@ static void check_term_size(void) {
 }
 
 
+#ifdef HAVE_AFFINITY
+
+/* Instance launcher: afl-fuzz launch N [ options ] -- /path/to/app [ ... ]
+   starts N instances on the -o sync dir, the first one with -M and the rest
+   with -S, and gives each of them its CPUs up front through AFL_CPU_LIST,
+   so that they need not race through bind_to_free_cpu(). With
+   AFL_EXEC_POOL, an instance gets one CPU per executor, from one NUMA node
+   where possible. One thread per physical core is handed out before SMT
+   siblings are. The placement goes to <sync dir>/.launch/manifest, where
+   afl-whatsup picks it up; the output of each instance goes to
+   <sync dir>/.launch/<id>.log. */
+
+struct launch_cpu {
+  u32 cpu;                            /* CPU number                       */
+  s32 node;                           /* NUMA node, -1 if unknown         */
+  u32 rank;                           /* 0 for the first thread of a core */
+  u8  taken;                          /* Given to an instance?            */
+};
+
+static volatile u8 launch_stop;       /* Stop signal received             */
+
+static void handle_launch_sig(int sig) {
+
+  launch_stop = 1;
+
+}
+
+
+/* Read a number from the sysfs topology of a CPU. Returns -1 if missing. */
+
+static s32 read_cpu_topology(u32 cpu, u8* what) {
+
+  u8* fn = alloc_printf("/sys/devices/system/cpu/cpu%u/topology/%s", cpu, what);
+  FILE* f = fopen(fn, "r");
+  s32 ret = -1;
+
+  ck_free(fn);
+  if (!f) return -1;
+
+  if (fscanf(f, "%d", &ret) != 1) ret = -1;
+
+  fclose(f);
+  return ret;
+
+}
+
+
+/* The CPUs we may run on, with their node and SMT rank. */
+
+static u32 launch_topology(struct launch_cpu** out) {
+
+  struct launch_cpu* lc = NULL;
+  s32 *core, *pkg;
+  cpu_set_t allowed;
+  u32 i, j, cnt = 0;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed))
+    PFATAL("sched_getaffinity failed");
+
+  core = ck_alloc(CPU_SETSIZE * sizeof(s32));
+  pkg  = ck_alloc(CPU_SETSIZE * sizeof(s32));
+
+  for (i = 0; i < CPU_SETSIZE; i++) {
+
+    if (!CPU_ISSET(i, &allowed)) continue;
+
+    lc = ck_realloc(lc, (cnt + 1) * sizeof(struct launch_cpu));
+
+    lc[cnt].cpu   = i;
+    lc[cnt].node  = get_cpu_node(i);
+    lc[cnt].rank  = 0;
+    lc[cnt].taken = 0;
+
+    core[cnt] = read_cpu_topology(i, "core_id");
+    pkg[cnt]  = read_cpu_topology(i, "physical_package_id");
+
+    /* Without topology, every CPU counts as a core of its own. */
+
+    if (core[cnt] >= 0)
+      for (j = 0; j < cnt; j++)
+        if (core[j] == core[cnt] && pkg[j] == pkg[cnt]) lc[cnt].rank++;
+
+    cnt++;
+
+  }
+
+  ck_free(core);
+  ck_free(pkg);
+
+  *out = lc;
+  return cnt;
+
+}
+
+
+/* Pick need CPUs for one instance. Returns the highest SMT rank used. */
+
+static u32 launch_place(struct launch_cpu* lc, u32 cnt, u32 need, u32* cpus) {
+
+  s32 node = -1;
+  u32 i, j, best_free = 0, best_first = 0, max_rank = 0;
+
+  /* The node with the most free cores, then with the most free CPUs. */
+
+  for (i = 0; i < cnt; i++) {
+
+    u32 n_free = 0, n_first = 0;
+
+    if (lc[i].taken) continue;
+
+    for (j = 0; j < cnt; j++)
+      if (!lc[j].taken && lc[j].node == lc[i].node) {
+        n_free++;
+        if (!lc[j].rank) n_first++;
+      }
+
+    if (node < 0 || n_first > best_first ||
+        (n_first == best_first && n_free > best_free)) {
+      node       = lc[i].node;
+      best_first = n_first;
+      best_free  = n_free;
+    }
+
+  }
+
+  /* Separate cores before SMT siblings, then that node before others. */
+
+  for (i = 0; i < need; i++) {
+
+    struct launch_cpu* pick = NULL;
+
+    for (j = 0; j < cnt; j++) {
+
+      if (lc[j].taken) continue;
+
+      if (!pick || lc[j].rank < pick->rank ||
+          (lc[j].rank == pick->rank && lc[j].node == node &&
+           pick->node != node)) pick = &lc[j];
+
+    }
+
+    pick->taken = 1;
+    cpus[i] = pick->cpu;
+    if (pick->rank > max_rank) max_rank = pick->rank;
+
+  }
+
+  return max_rank;
+
+}
+
+
+static int launch_fuzzers(int argc, char** argv) {
+
+  struct launch_cpu* lc;
+  u8 *sync_path = NULL, *launch_dir, *fn, *tmp;
+  u32 inst_cnt, per_inst = 1, cpu_cnt, i, j, alive = 0, smt = 0;
+  u32* cpus;
+  s32* pids;
+  u8** cpu_strs;
+  s32 fd;
+  FILE* f;
+  struct sigaction sa;
+
+  if (argc < 3 || (inst_cnt = atoi(argv[1])) < 1)
+    FATAL("Usage: afl-fuzz launch N [ options ] -- /path/to/fuzzed_app [ ... ]");
+
+  for (i = 2; i < argc && strcmp(argv[i], "--"); i++) {
+
+    if (!strcmp(argv[i], "-M") || !strcmp(argv[i], "-S") ||
+        !strncmp(argv[i], "-M", 2) || !strncmp(argv[i], "-S", 2))
+      FATAL("The launcher picks -M and -S itself");
+
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) sync_path = argv[i + 1];
+    else if (!strncmp(argv[i], "-o", 2) && argv[i][2]) sync_path = argv[i] + 2;
+
+  }
+
+  if (!sync_path) FATAL("The launcher needs the sync dir (-o)");
+
+  if (getenv("AFL_EXEC_POOL")) {
+    per_inst = atoi(getenv("AFL_EXEC_POOL"));
+    if (!per_inst || per_inst > EXEC_POOL_MAX)
+      FATAL("Invalid value of AFL_EXEC_POOL");
+  }
+
+  cpu_cnt = launch_topology(&lc);
+
+  if ((u64)inst_cnt * per_inst > cpu_cnt)
+    FATAL("%u instances need %u CPUs, but only %u are available",
+          inst_cnt, inst_cnt * per_inst, cpu_cnt);
+
+  if (mkdir(sync_path, 0700) && errno != EEXIST)
+    PFATAL("Unable to create '%s'", sync_path);
+
+  launch_dir = alloc_printf("%s/.launch", sync_path);
+
+  if (mkdir(launch_dir, 0700) && errno != EEXIST)
+    PFATAL("Unable to create '%s'", launch_dir);
+
+  cpus     = ck_alloc(per_inst * sizeof(u32));
+  pids     = ck_alloc(inst_cnt * sizeof(s32));
+  cpu_strs = ck_alloc(inst_cnt * sizeof(u8*));
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_launch_sig;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGHUP, &sa, NULL);
+
+  ACTF("Launching %u instances on %u CPUs...", inst_cnt, cpu_cnt);
+
+  for (i = 0; i < inst_cnt; i++) {
+
+    u8* id = alloc_printf("fuzzer%02u", i + 1);
+    char** child_argv = ck_alloc((argc + 3) * sizeof(char*));
+
+    if (launch_place(lc, cpu_cnt, per_inst, cpus)) smt = 1;
+
+    cpu_strs[i] = alloc_printf("%u", cpus[0]);
+
+    for (j = 1; j < per_inst; j++) {
+      tmp = alloc_printf("%s,%u", cpu_strs[i], cpus[j]);
+      ck_free(cpu_strs[i]);
+      cpu_strs[i] = tmp;
+    }
+
+    child_argv[0] = argv[-1];
+    child_argv[1] = i ? "-S" : "-M";
+    child_argv[2] = id;
+    for (j = 2; j < argc; j++) child_argv[j + 1] = argv[j];
+
+    fn = alloc_printf("%s/%s.log", launch_dir, id);
+
+    pids[i] = fork();
+
+    if (pids[i] < 0) PFATAL("fork() failed");
+
+    if (!pids[i]) {
+
+      fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+      if (fd < 0) PFATAL("Unable to create '%s'", fn);
+
+      dup2(fd, 1);
+      dup2(fd, 2);
+      close(fd);
+
+      fd = open("/dev/null", O_RDONLY);
+      if (fd >= 0) { dup2(fd, 0); close(fd); }
+
+      setenv("AFL_CPU_LIST", cpu_strs[i], 1);
+      setenv("AFL_NO_UI", "1", 1);
+
+      execv("/proc/self/exe", child_argv);
+      PFATAL("execv() failed");
+
+    }
+
+    OKF("Started %s (pid %d) on CPU%s %s, NUMA node %d.", id, pids[i],
+        per_inst > 1 ? "s" : "", cpu_strs[i], get_cpu_node(cpus[0]));
+
+    alive++;
+
+    ck_free(fn);
+    ck_free(child_argv);
+    ck_free(id);
+
+  }
+
+  if (smt) WARNF("Ran out of physical cores, some instances share SMT siblings.");
+
+  /* The manifest: one line per instance. */
+
+  tmp = alloc_printf("%s/manifest.tmp", launch_dir);
+  fn  = alloc_printf("%s/manifest", launch_dir);
+
+  f = fopen(tmp, "w");
+  if (!f) PFATAL("Unable to create '%s'", tmp);
+
+  fprintf(f, "# sync_id pid node cpus\n");
+
+  for (i = 0; i < inst_cnt; i++)
+    fprintf(f, "fuzzer%02u %d %d %s\n", i + 1, pids[i],
+            get_cpu_node(atoi(cpu_strs[i])), cpu_strs[i]);
+
+  fclose(f);
+
+  if (rename(tmp, fn)) PFATAL("Unable to rename '%s'", tmp);
+
+  ck_free(tmp);
+  ck_free(fn);
+
+  SAYF("\n" cGRA "    Use afl-whatsup %s to check on them, Ctrl-C to stop.\n\n" cRST,
+       sync_path);
+
+  /* Stay around to pass on stop signals and report exits. */
+
+  while (alive) {
+
+    s32 status, pid = waitpid(-1, &status, 0);
+
+    if (pid < 0) {
+
+      if (errno != EINTR) break;
+
+      if (launch_stop) {
+        for (i = 0; i < inst_cnt; i++) if (pids[i] > 0) kill(pids[i], SIGINT);
+        launch_stop = 0;
+      }
+
+      continue;
+
+    }
+
+    for (i = 0; i < inst_cnt; i++) if (pids[i] == pid) break;
+    if (i == inst_cnt) continue;
+
+    pids[i] = -1;
+    alive--;
+
+    if (WIFEXITED(status) && !WEXITSTATUS(status))
+      OKF("fuzzer%02u has stopped.", i + 1);
+    else
+      WARNF("fuzzer%02u has stopped abnormally, see %s/fuzzer%02u.log.",
+            i + 1, launch_dir, i + 1);
+
+  }
+
+  for (i = 0; i < inst_cnt; i++) ck_free(cpu_strs[i]);
+
+  ck_free(cpu_strs);
+  ck_free(pids);
+  ck_free(cpus);
+  ck_free(launch_dir);
+  ck_free(lc);
+
+  return 0;
+
+}
+
+#endif /* HAVE_AFFINITY */
+
 
 /* Display usage hints. */
 
@@ -10873,9 +16067,13 @@ static void usage(u8* argv0) {
        "  -M / -S id    - distributed mode (see parallel_fuzzing.txt)\n"
        "  -C            - crash exploration mode (the peruvian rabbit thing)\n\n"
 
+       "To start N -M / -S instances with CPUs assigned up front:\n\n"
+
+       "  %s launch N [ options ] -- /path/to/fuzzed_app [ ... ]\n\n"
+
        "For additional tips, please consult %s/README.\n\n",
 
-       argv0, EXEC_TIMEOUT, MEM_LIMIT, doc_path);
+       argv0, EXEC_TIMEOUT, MEM_LIMIT, argv0, doc_path);
 
   exit(1);
 
@@ -10954,6 +16152,17 @@ EXP_ST void setup_dirs_fds(void) {
   if (mkdir(tmp, 0700)) PFATAL("Unable to create '%s'", tmp);
   ck_free(tmp);
 
+  /* Calibration results, so that the dry run of a resumed session can
+     skip executing the inputs. */
+
+  tmp = alloc_printf("%s/queue/.state/calibration/", out_dir);
+  if (mkdir(tmp, 0700)) PFATAL("Unable to create '%s'", tmp);
+  ck_free(tmp);
+
+  /* Queue contents, if packed. */
+
+  if (queue_pack) pack_create();
+
   /* Sync directory for keeping track of cooperating fuzzers. */
 
   if (sync_id) {
@@ -10982,15 +16191,18 @@ EXP_ST void setup_dirs_fds(void) {
   /* All recorded memory valuations. */
 
   tmp = alloc_printf("%s/memory", out_dir);
-  if (mkdir(tmp, 0700)) PFATAL("Unable to create '%s'", tmp);
+  if (mkdir(tmp, 0700) && (errno != EEXIST || !ckpt_buf))
+    PFATAL("Unable to create '%s'", tmp);
   ck_free(tmp);
 
   tmp = alloc_printf("%s/memory/pos", out_dir);
-  if (mkdir(tmp, 0700)) PFATAL("Unable to create '%s'", tmp);
+  if (mkdir(tmp, 0700) && (errno != EEXIST || !ckpt_buf))
+    PFATAL("Unable to create '%s'", tmp);
   ck_free(tmp);
 
   tmp = alloc_printf("%s/memory/neg", out_dir);
-  if (mkdir(tmp, 0700)) PFATAL("Unable to create '%s'", tmp);
+  if (mkdir(tmp, 0700) && (errno != EEXIST || !ckpt_buf))
+    PFATAL("Unable to create '%s'", tmp);
   ck_free(tmp);
 
   /* All recorded hangs. */
@@ -11022,19 +16234,14 @@ EXP_ST void setup_dirs_fds(void) {
                      "unique_hangs, max_depth, execs_per_sec\n");
                      /* ignore errors */
 
-  tmp = alloc_printf("%s/unique_dafl.log", out_dir);
-  fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0600);
-  if (fd < 0) PFATAL("Unable to create '%s'", tmp);
+  tmp = alloc_printf("%s/unique_dafl.evlog", out_dir);
+  evlog_open(tmp);
   ck_free(tmp);
-  unique_dafl_log_file = fdopen(fd, "w");
-  if (!unique_dafl_log_file) PFATAL("fdopen() failed");
-  tmp = alloc_printf("%s/vertical.log", out_dir);
-  fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0600);
-  if (fd < 0) PFATAL("Unable to create '%s'", tmp);
-  moo_vertical_log_file = fdopen(fd, "w");
+
+  tmp = alloc_printf("%s/vertical.bin", out_dir);
+  vlog_open(tmp);
   ck_free(tmp);
-  LOGF("[options] [hor %d] [ver %d] [ve %d] [k %d] [r %f] [y %d] [v %d]\n", 
-      use_moo_scheduler, vertical_use_dynamic, vertical_experiment, proximity_score_allowance, proximity_score_reduction, 
+  EVLOG(EV_OPTIONS, use_moo_scheduler, vertical_use_dynamic, vertical_experiment, proximity_score_allowance, proximity_score_reduction, 
       vertical_experiment, use_vertical_navigation);
 
 }
@@ -11429,6 +16636,11 @@ EXP_ST void setup_signal_handlers(void) {
   sa.sa_handler = handle_skipreq;
   sigaction(SIGUSR1, &sa, NULL);
 
+  /* SIGUSR2: dump scheduler state */
+
+  sa.sa_handler = handle_dumpreq;
+  sigaction(SIGUSR2, &sa, NULL);
+
   /* Things we don't care about. */
 
   sa.sa_handler = SIG_IGN;
@@ -11572,6 +16784,11 @@ int main(int argc, char** argv) {
 
   doc_path = access(DOC_PATH, F_OK) ? "docs" : DOC_PATH;
 
+#ifdef HAVE_AFFINITY
+  if (argc > 1 && !strcmp(argv[1], "launch"))
+    return launch_fuzzers(argc - 1, argv + 1);
+#endif /* HAVE_AFFINITY */
+
   gettimeofday(&tv, &tz);
   srandom(tv.tv_sec ^ tv.tv_usec ^ getpid());
 
@@ -11925,12 +17142,47 @@ int main(int argc, char** argv) {
   if (getenv("AFL_NO_ARITH"))      no_arith         = 1;
   if (getenv("AFL_SHUFFLE_QUEUE")) shuffle_queue    = 1;
   if (getenv("AFL_FAST_CAL"))      fast_cal         = 1;
+  if (getenv("AFL_DEBUG_STATS"))   debug_stats      = 1;
+  if (getenv("AFL_NO_CHECKPOINT")) no_checkpoint    = 1;
+  if (getenv("AFL_NO_CAL_CACHE"))  no_cal_cache     = 1;
+  if (getenv("AFL_NO_PIPELINE"))   no_pipeline      = 1;
+  if (getenv("AFL_QUEUE_PACK"))    queue_pack       = 1;
 
   if (getenv("AFL_HANG_TMOUT")) {
     hang_tmout = atoi(getenv("AFL_HANG_TMOUT"));
     if (!hang_tmout) FATAL("Invalid value of AFL_HANG_TMOUT");
   }
 
+  seed_cache_limit = (u64)SEED_CACHE_MB << 20;
+
+  if (getenv("AFL_SEED_CACHE_MB"))
+    seed_cache_limit = (u64)atoi(getenv("AFL_SEED_CACHE_MB")) << 20;
+
+  if (getenv("AFL_EXEC_POOL")) {
+    pool_size = atoi(getenv("AFL_EXEC_POOL"));
+    if (!pool_size || pool_size > EXEC_POOL_MAX)
+      FATAL("Invalid value of AFL_EXEC_POOL");
+    if (dumb_mode || no_forkserver)
+      FATAL("AFL_EXEC_POOL needs the fork server");
+  }
+
+  if (getenv("AFL_CAL_SPOT_CHECK")) {
+    cal_spot_check = atoi(getenv("AFL_CAL_SPOT_CHECK"));
+    if (cal_spot_check > 100) FATAL("Invalid value of AFL_CAL_SPOT_CHECK");
+  }
+
+  if (getenv("AFL_EVLOG_LEVEL")) {
+    s32 lvl = evlog_parse_level(getenv("AFL_EVLOG_LEVEL"));
+    if (lvl < 0) FATAL("Invalid value of AFL_EVLOG_LEVEL");
+    evlog_level = lvl;
+  }
+
+  if (getenv("AFL_EVLOG_CONSOLE")) {
+    s32 lvl = evlog_parse_level(getenv("AFL_EVLOG_CONSOLE"));
+    if (lvl < 0) FATAL("Invalid value of AFL_EVLOG_CONSOLE");
+    evlog_console = lvl;
+  }
+
   if (dumb_mode == 2 && no_forkserver)
     FATAL("AFL_DUMB_FORKSRV and AFL_NO_FORKSRV are mutually exclusive");
 
@@ -11948,8 +17200,25 @@ int main(int argc, char** argv) {
 
   check_if_tty();
 
+  evlog_active = not_on_tty ? MIN(evlog_level, evlog_console) : evlog_level;
+
   get_core_count();
 
+  /* The main thread keeps generating and merging while the executors run;
+     without a core to spare for each, the pool only adds overhead. */
+
+  if (pool_size && cpu_core_count && pool_size >= cpu_core_count) {
+
+    pool_size = cpu_core_count - 1;
+
+    if (pool_size)
+      WARNF("Only %u CPU cores, capping AFL_EXEC_POOL at %u.",
+            cpu_core_count, pool_size);
+    else
+      WARNF("Only one CPU core, ignoring AFL_EXEC_POOL.");
+
+  }
+
 #ifdef HAVE_AFFINITY
   bind_to_free_cpu();
 #endif /* HAVE_AFFINITY */
@@ -11960,9 +17229,14 @@ int main(int argc, char** argv) {
   setup_post();
   setup_shm();
   init_count_class16();
+  fused_trace_scan = fused_trace_scan_init();
   init_global_prox_score();
   init_dfg(dfg_node_info_file);
 
+  /* The scheduler checkpoint holds the state of a single target. */
+
+  if (dafl_target_cnt > 1) no_checkpoint = 1;
+
   setup_dirs_fds();
   read_testcases();
   load_auto();
@@ -11971,7 +17245,7 @@ int main(int argc, char** argv) {
     strcat(tmp_arg_str, argv[i]);
     strcat(tmp_arg_str, " ");
   }
-  LOGF("[options] [cmd \"%s\"]\n", tmp_arg_str);
+  EVLOG(EV_OPTIONS_CMD, tmp_arg_str);
   ck_free(tmp_arg_str);
 
   pivot_inputs();
@@ -11993,7 +17267,13 @@ int main(int argc, char** argv) {
   else
     use_argv = argv + optind;
 
+  if (getenv("AFL_SHARED_DFG")) setup_dfg_shm();
+
+  restore_checkpoint();
+
+  dfg_shm_in_dry_run = 1;
   perform_dry_run(use_argv, base_crash_seed);
+  dfg_shm_in_dry_run = 0;
 
   cull_queue();
 
@@ -12006,6 +17286,12 @@ int main(int argc, char** argv) {
 
   if (stop_soon) goto stop_fuzzing;
 
+  if ((syncd_addr = getenv("AFL_SYNCD"))) syncd_connect();
+
+  if (getenv("AFL_DFG_PARTITION")) partition_init();
+
+  if (pool_size) pool_init(use_argv);
+
   /* Woop woop woop */
 
   if (!not_on_tty) {
@@ -12069,6 +17355,9 @@ int main(int argc, char** argv) {
 
     if (stop_soon) break;
 
+    if (get_cur_time() - last_ckpt_time > CKPT_INTERVAL * 1000)
+      write_checkpoint();
+
     queue_cur = select_next_entry();
 
   }
@@ -12089,6 +17378,7 @@ int main(int argc, char** argv) {
   write_bitmap();
   write_stats_file(0, 0, 0);
   save_auto();
+  write_checkpoint();
 
 stop_fuzzing:
 
@@ -12105,17 +17395,28 @@ stop_fuzzing:
 
   }
 
+  partition_leave();
+
   fclose(plot_file);
-  fclose(unique_dafl_log_file);
+  evlog_close();
   destroy_queue();
   destroy_extras();
   hashmap_free(dfg_hashmap);
   hashmap_free(unique_mem_hashmap);
-  vertical_manager_free(vertical_manager);
-  pareto_scheduler_free(pareto_scheduler);
+  if (dafl_target_cnt > 1) {
+    for (u32 i = 0; i < dafl_target_cnt; i++) {
+      vertical_manager_free(dafl_targets[i].vm);
+      pareto_scheduler_free(dafl_targets[i].ps);
+      ck_free(dafl_targets[i].ss);
+    }
+    ck_free(dafl_targets);
+  } else {
+    vertical_manager_free(vertical_manager);
+    pareto_scheduler_free(pareto_scheduler);
+  }
   ck_free(target_path);
+  if (!dfg_shm) ck_free(dfg_count_map);
   ck_free(sync_id);
-  ck_free(dfg_count_map);
 
   alloc_report();
 
@@ -16,8 +16,8 @@ struct proximity_score {
   u64 original;
   double adjusted;
   u32 covered;
-  u32 *dfg_count_map; // Sparse map: [count]
-  u32 *dfg_dense_map; // Dense map: [index, count]
+  u8 *dfg_packed_map; // Packed map: varint [index delta, count] pairs
+  u32 dfg_packed_len; // Size of dfg_packed_map in bytes
 };
 
 struct dfg_node_info {
@@ -54,10 +54,24 @@ void pareto_info_set(struct pareto_info *info, enum ParetoStatus status, u32 ind
   info->index = index;
 }
 
+/* A seed buffer in the seed cache, see seed_cache_get(). */
+
+struct seed_cache_ent {
+  struct queue_entry *q;              /* Owner                            */
+  u8 *mem;                            /* Contents (q->len bytes)          */
+  u32 len;                            /* Size of mem                      */
+  u32 pins;                           /* Callers holding mem              */
+  struct seed_cache_ent *prev, *next; /* LRU list, most recent first      */
+};
+
 struct queue_entry {
 
   u8* fname;                          /* File name for the test case      */
   u32 len;                            /* Input length                     */
+  u64 pack_off;                       /* Contents in the pack, if packed  */
+  u64 content_hash;                   /* hash64() of contents, 0 if unset */
+  u64 cal_off;                        /* Calibration record, if cal_len   */
+  u32 cal_len;                        /* Size of the calibration record   */
 
   u8  cal_failed,                     /* Calibration failed?              */
   trim_done,                      /* Trimmed?                         */
@@ -69,11 +83,14 @@ struct queue_entry {
   favored,                        /* Currently favored?               */
   fs_redundant,                   /* Marked as redundant in the fs?   */
   removed,                        /* Removed from queue?              */
+  restored,                       /* Restored from a checkpoint?      */
+  packed,                         /* In input (1) or queue (2) pack?  */
   base_crash_seed;                /* Part of the initial test case?   */
 
   u32 bitmap_size,                    /* Number of bits set in bitmap     */
   exec_cksum,                     /* Checksum of the execution trace  */
-  dfg_cksum;
+  dfg_cksum,
+  val_hash;                       /* Valuation hash, 0 if none        */
   s32 last_location;
 
   struct proximity_score prox_score;  /* Proximity score of the test case */
@@ -81,12 +98,14 @@ struct queue_entry {
   s32 rank_moo,                           /* Pareto rank of the test case     */
       rank_explore;                   /* Pareto rank for explore mode */
   u32 selection_count;                /* Number of times selected         */
+  double perf_factor;                 /* Last calculate_factor() result   */
 
   u64 exec_us,                        /* Execution time (us)              */
   handicap,                       /* Number of queue cycles behind    */
   depth;                          /* Path depth                       */
 
   u8* trace_mini;                     /* Trace bytes, if kept             */
+  struct seed_cache_ent *cache_ent;   /* Cached contents, if any          */
   u32 tc_ref;                         /* Trace bytes ref count            */
 
   struct queue_entry *next;           /* Next element, if any             */
@@ -94,6 +113,9 @@ struct queue_entry {
   struct pareto_info moo_info;        /* Pareto info for MOO mode */
   struct pareto_info explore_info;   /* Pareto info for explore mode */
 
+  u8 target_home,                     /* Target whose scheduler holds it  */
+     target_found;                    /* Target in focus when found       */
+
 };
 
 u32 quantize_location(double loc) {
@@ -136,46 +158,134 @@ u32 interval_node_select(struct interval_node *node);
 
 u32 interval_tree_select(struct interval_tree *tree);
 
-// Define the vector structure
+// Arena: bump allocator for data that lives as long as the campaign (queue
+// entries, packed DFG maps). Saves the per-allocation ck_alloc header and
+// canaries; nothing is freed until arena_free() releases everything.
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+struct arena_block {
+  struct arena_block *next;
+  u32 size;
+  u32 used;
+  u64 data[]; // 8-byte aligned payload
+};
+
+struct arena {
+  struct arena_block *head;
+  u64 allocated;  // Bytes handed out
+  u64 reserved;   // Bytes held in blocks
+};
+
+static struct arena_block *arena_new_block(struct arena *arena, u32 size) {
+  struct arena_block *block = ck_alloc(sizeof(struct arena_block) + size);
+  block->size = size;
+  block->used = 0;
+  arena->reserved += size;
+  return block;
+}
+
+// Returns zeroed, 8-byte aligned memory
+void *arena_alloc(struct arena *arena, u32 size) {
+  struct arena_block *block = arena->head;
+  size = (size + 7) & ~7U;
+  if (size > ARENA_BLOCK_SIZE / 4) {
+    // Large request: give it its own block, but keep filling the current one
+    struct arena_block *big = arena_new_block(arena, size);
+    if (block) {
+      big->next = block->next;
+      block->next = big;
+    } else {
+      arena->head = big;
+    }
+    big->used = size;
+    arena->allocated += size;
+    return big->data;
+  }
+  if (!block || block->size - block->used < size) {
+    block = arena_new_block(arena, ARENA_BLOCK_SIZE);
+    block->next = arena->head;
+    arena->head = block;
+  }
+  void *ptr = (u8*)block->data + block->used;
+  block->used += size;
+  arena->allocated += size;
+  return ptr;
+}
+
+void arena_free(struct arena *arena) {
+  struct arena_block *block = arena->head;
+  while (block) {
+    struct arena_block *next = block->next;
+    ck_free(block);
+    block = next;
+  }
+  arena->head = NULL;
+  arena->allocated = 0;
+  arena->reserved = 0;
+}
+
+// Define the vector structure: a ring buffer, so that pushes and pops are
+// O(1) at both ends and clearing does not touch the storage. Element i
+// lives at data[(head + i) & (capacity - 1)]; capacity is 0 or a power of 2.
 struct vector {
   struct queue_entry **data;
+  size_t head;     // Slot holding element 0
   size_t size;     // Number of elements currently in the vector
   size_t capacity; // Capacity of the vector (allocated memory size)
 };
 
+#define VECTOR_AT(_vec, _i) \
+  ((_vec)->data[((_vec)->head + (_i)) & ((_vec)->capacity - 1)])
+
 // Function to initialize a new vector
 struct vector* vector_create(void) {
   struct vector* vec = ck_alloc(sizeof(struct vector));
-  if (vec == NULL) {
-    printf("Memory allocation failed.\n");
-    exit(EXIT_FAILURE);
-  }
+  vec->head = 0;
   vec->size = 0;
   vec->capacity = 0;
   vec->data = NULL;
   return vec;
 }
 
+// Grow to at least min_capacity, unwrapping the elements to start at slot 0
+static void vector_reserve(struct vector *vec, size_t min_capacity) {
+  if (min_capacity <= vec->capacity) return;
+  size_t new_capacity = vec->capacity ? vec->capacity : 8;
+  while (new_capacity < min_capacity) new_capacity *= 2;
+  struct queue_entry **new_data = ck_alloc(new_capacity * sizeof(struct queue_entry*));
+  for (size_t i = 0; i < vec->size; i++) {
+    new_data[i] = VECTOR_AT(vec, i);
+  }
+  ck_free(vec->data);
+  vec->data = new_data;
+  vec->head = 0;
+  vec->capacity = new_capacity;
+}
+
 struct vector* vector_clone(struct vector *vec) {
   struct vector *new_vec = vector_create();
   if (vec->size == 0) return new_vec;
+  // Keep the same capacity so the next push does not reallocate
+  vector_reserve(new_vec, vec->capacity);
+  for (size_t i = 0; i < vec->size; i++) {
+    new_vec->data[i] = VECTOR_AT(vec, i);
+  }
   new_vec->size = vec->size;
-  new_vec->capacity = vec->size + 1;
-  new_vec->data = ck_alloc(new_vec->capacity * sizeof(struct queue_entry*));
-  memcpy(new_vec->data, vec->data, vec->size * sizeof(struct queue_entry*));
   return new_vec;
 }
 
 void vector_clear(struct vector *vec) {
+  vec->head = 0;
   vec->size = 0;
-  memset(vec->data, 0, vec->capacity * sizeof(struct queue_entry*));
 }
 
+// Drop NULL elements, keeping the order of the rest
 void vector_reduce(struct vector *vec) {
   size_t new_index = 0;
-  for (u32 i = 0; i < vec->size; i++) {
-    if (vec->data[i] != NULL) {
-      vec->data[new_index] = vec->data[i];
+  for (size_t i = 0; i < vec->size; i++) {
+    struct queue_entry *entry = VECTOR_AT(vec, i);
+    if (entry != NULL) {
+      VECTOR_AT(vec, new_index) = entry;
       new_index++;
     }
   }
@@ -184,49 +294,52 @@ void vector_reduce(struct vector *vec) {
 
 // Function to add an element to the end of the vector
 void push_back(struct vector* vec, struct queue_entry* element) {
-  if (vec->size >= vec->capacity) {
-    // Increase capacity by doubling it
-    vec->capacity = (vec->capacity == 0) ? 8 : vec->capacity * 2;
-    vec->data = (struct queue_entry**)ck_realloc(vec->data, vec->capacity * sizeof(struct queue_entry*));
-    if (vec->data == NULL) {
-      printf("Memory allocation failed.\n");
-      exit(EXIT_FAILURE);
-    }
-  }
-  vec->data[vec->size++] = element;
+  vector_reserve(vec, vec->size + 1);
+  VECTOR_AT(vec, vec->size) = element;
+  vec->size++;
 }
 
 void vector_push_front(struct vector *vec, struct queue_entry *element) {
-  push_back(vec, element);
-  for (u32 i = vec->size - 1; i > 0; i--) {
-    vec->data[i] = vec->data[i - 1];
-  }
-  vec->data[0] = element;
+  vector_reserve(vec, vec->size + 1);
+  vec->head = (vec->head - 1) & (vec->capacity - 1);
+  vec->data[vec->head] = element;
+  vec->size++;
 }
 
 struct queue_entry * vector_pop_back(struct vector *vec) {
   if (vec->size == 0) return NULL;
-  struct queue_entry *entry = vec->data[vec->size - 1];
   vec->size--;
-  vec->data[vec->size] = NULL;
+  return VECTOR_AT(vec, vec->size);
+}
+
+struct queue_entry * vector_pop_front(struct vector *vec) {
+  if (vec->size == 0) return NULL;
+  struct queue_entry *entry = vec->data[vec->head];
+  vec->head = (vec->head + 1) & (vec->capacity - 1);
+  vec->size--;
   return entry;
 }
 
+// Remove the element at index; only the shorter side of the ring is shifted
 struct queue_entry *vector_pop(struct vector *vec, u32 index) {
   if (index >= vec->size) return NULL;
+  if (index == 0) return vector_pop_front(vec);
   if (index == vec->size - 1) return vector_pop_back(vec);
-  struct queue_entry *entry = vec->data[index];
-  for (u32 i = index; i < vec->size - 1; i++) {
-    vec->data[i] = vec->data[i + 1];
+  struct queue_entry *entry = VECTOR_AT(vec, index);
+  if (index < vec->size / 2) {
+    for (u32 i = index; i > 0; i--) {
+      VECTOR_AT(vec, i) = VECTOR_AT(vec, i - 1);
+    }
+    vec->head = (vec->head + 1) & (vec->capacity - 1);
+  } else {
+    for (u32 i = index; i < vec->size - 1; i++) {
+      VECTOR_AT(vec, i) = VECTOR_AT(vec, i + 1);
+    }
   }
   vec->size--;
   return entry;
 }
 
-struct queue_entry * vector_pop_front(struct vector *vec) {
-  return vector_pop(vec, 0);
-}
-
 void vector_free(struct vector* vec) {
   ck_free(vec->data);
   ck_free(vec);
@@ -236,12 +349,12 @@ struct queue_entry* vector_get(struct vector* vec, u32 index) {
   if (index >= vec->size) {
     return NULL;
   }
-  return vec->data[index];
+  return VECTOR_AT(vec, index);
 }
 
 void vector_set(struct vector* vec, u32 index, struct queue_entry* element) {
   if (index < vec->size) {
-    vec->data[index] = element;
+    VECTOR_AT(vec, index) = element;
   }
 }
 
@@ -249,142 +362,143 @@ u32 vector_size(struct vector* vec) {
   return vec->size;
 }
 
-// Hashmap
+// Hashmap: open addressing with Robin Hood probing. Keys and values are
+// stored inline in the slot array, so inserts do not allocate. Tables of up
+// to HASHMAP_INLINE_SLOTS slots (e.g. the per-path value maps) live inside
+// the hashmap struct itself and only move to the heap once they grow.
+// A pointer returned by hashmap_get() stays valid only until the next
+// hashmap_insert() or hashmap_remove() on the same map.
+#define HASHMAP_INLINE_SLOTS 8
+
 struct key_value_pair {
   u32 key;
+  u32 dist;   // 0 if the slot is empty, otherwise probe distance + 1
   void* value;
-  struct key_value_pair* next;
 };
 
 struct hashmap {
   u32 size;
-  u32 table_size;
-  struct key_value_pair** table;
+  u32 table_size;  // always a power of 2
+  u32 shift;       // 32 - log2(table_size)
+  struct key_value_pair* table;
+  struct key_value_pair inline_table[HASHMAP_INLINE_SLOTS];
 };
 
 typedef void (*hashmap_iterate_fn)(u32 key, void* value);
 
 struct hashmap* hashmap_create(u32 table_size) {
   struct hashmap* map = ck_alloc(sizeof(struct hashmap));
-  if (map == NULL) {
-    printf("Memory allocation failed.\n");
-    exit(EXIT_FAILURE);
-  }
+  u32 size = HASHMAP_INLINE_SLOTS, shift = 32;
+  while (size < table_size) size <<= 1;
+  for (u32 i = size; i > 1; i >>= 1) shift--;
   map->size = 0;
-  map->table_size = table_size;
-  map->table = ck_alloc(table_size * sizeof(struct key_value_pair*));
-  if (map->table == NULL) {
-    printf("Memory allocation failed.\n");
-    exit(EXIT_FAILURE);
-  }
-  for (u32 i = 0; i < table_size; i++) {
-    map->table[i] = NULL;
-  }
+  map->table_size = size;
+  map->shift = shift;
+  if (size == HASHMAP_INLINE_SLOTS)
+    map->table = map->inline_table;
+  else
+    map->table = ck_alloc(size * sizeof(struct key_value_pair));
   return map;
 }
 
-static u32 hashmap_fit(u32 key, u32 table_size) {
-  return key % table_size;
+// Fibonacci hashing: keys are often small or sequential, so spread them
+// over the table using the top bits of the product.
+static u32 hashmap_fit(u32 key, u32 shift) {
+  return (key * 0x9E3779B1U) >> shift;
 }
 
-static void hashmap_resize(struct hashmap *map) {
-
-  u32 new_table_size = map->table_size * 2;
-  struct key_value_pair **new_table = ck_alloc(new_table_size * sizeof(struct key_value_pair*));
-  if (new_table == NULL) {
-    printf("Memory allocation failed.\n");
-    exit(EXIT_FAILURE);
-  }
-  for (int i = 0; i < map->table_size; i++) {
-    struct key_value_pair* pair = map->table[i];
-    while (pair != NULL) {
-      struct key_value_pair *next = pair->next;
-      u32 index = hashmap_fit(pair->key, new_table_size);
-      pair->next = new_table[index];
-      new_table[index] = pair;
-      pair = next;
+// Place an entry known not to be in the table yet.
+static void hashmap_place(struct hashmap *map, u32 key, void *value) {
+  u32 mask = map->table_size - 1;
+  u32 index = hashmap_fit(key, map->shift);
+  struct key_value_pair cur = { key, 1, value };
+  while (map->table[index].dist) {
+    struct key_value_pair *slot = &map->table[index];
+    if (slot->dist < cur.dist) {
+      struct key_value_pair tmp = *slot;
+      *slot = cur;
+      cur = tmp;
     }
+    cur.dist++;
+    index = (index + 1) & mask;
   }
-  ck_free(map->table);
-  map->table = new_table;
-  map->table_size = new_table_size;
+  map->table[index] = cur;
+  map->size++;
+}
 
+static void hashmap_resize(struct hashmap *map) {
+  struct key_value_pair *old_table = map->table;
+  u32 old_table_size = map->table_size;
+  map->table_size *= 2;
+  map->shift--;
+  map->table = ck_alloc(map->table_size * sizeof(struct key_value_pair));
+  map->size = 0;
+  for (u32 i = 0; i < old_table_size; i++) {
+    if (old_table[i].dist)
+      hashmap_place(map, old_table[i].key, old_table[i].value);
+  }
+  if (old_table != map->inline_table) ck_free(old_table);
 }
 
 u32 hashmap_size(struct hashmap* map) {
   return map->size;
 }
 
-// Function to insert a key-value pair into the hash map
+struct key_value_pair* hashmap_get(struct hashmap* map, u32 key) {
+  u32 mask = map->table_size - 1;
+  u32 index = hashmap_fit(key, map->shift);
+  u32 dist = 1;
+  while (1) {
+    struct key_value_pair* pair = &map->table[index];
+    // An empty slot, or one closer to its home than we would be: not found
+    if (pair->dist < dist) return NULL;
+    if (pair->key == key) return pair;
+    dist++;
+    index = (index + 1) & mask;
+  }
+}
+
+// Function to insert a key-value pair into the hash map; replaces the value
+// if the key is already present
 void hashmap_insert(struct hashmap* map, u32 key, void* value) {
-  u32 index = hashmap_fit(key, map->table_size);
-  struct key_value_pair* newPair = ck_alloc(sizeof(struct key_value_pair));
-  if (newPair == NULL) {
-    printf("Memory allocation failed.\n");
-    exit(EXIT_FAILURE);
+  struct key_value_pair* pair = hashmap_get(map, key);
+  if (pair) {
+    pair->value = value;
+    return;
   }
-  newPair->key = key;
-  newPair->value = value;
-  newPair->next = map->table[index];
-  map->table[index] = newPair;
-  map->size++;
-  if (map->size > map->table_size / 2) {
+  // Keep the load factor at or below 3/4
+  if ((map->size + 1) * 4 > map->table_size * 3) {
     hashmap_resize(map);
   }
+  hashmap_place(map, key, value);
 }
 
+// Backward-shift deletion: no tombstones are left behind
 void hashmap_remove(struct hashmap *map, u32 key) {
-  u32 index = hashmap_fit(key, map->table_size);
-  struct key_value_pair* pair = map->table[index];
-  struct key_value_pair* prev = NULL;
-  while (pair != NULL) {
-    if (pair->key == key) {
-      if (!prev) {
-        map->table[index] = pair->next;
-      } else {
-        prev->next = pair->next;
-      }
-      map->size--;
-      ck_free(pair);
-      return;
-    }
-    prev = pair;
-    pair = pair->next;
-  }
-}
-
-struct key_value_pair* hashmap_get(struct hashmap* map, u32 key) {
-  u32 index = hashmap_fit(key, map->table_size);
-  struct key_value_pair* pair = map->table[index];
-  while (pair != NULL) {
-    if (pair->key == key) {
-      return pair;
-    }
-    pair = pair->next;
+  struct key_value_pair* pair = hashmap_get(map, key);
+  if (!pair) return;
+  u32 mask = map->table_size - 1;
+  u32 index = pair - map->table;
+  u32 next = (index + 1) & mask;
+  while (map->table[next].dist > 1) {
+    map->table[index] = map->table[next];
+    map->table[index].dist--;
+    index = next;
+    next = (next + 1) & mask;
   }
-  return NULL;
+  map->table[index].dist = 0;
+  map->size--;
 }
 
 void hashmap_iterate(struct hashmap *map, hashmap_iterate_fn func) {
   for (u32 i = 0; i < map->table_size; i++) {
-    struct key_value_pair *pair = map->table[i];
-    while (pair != NULL) {
-      func(pair->key, pair->value);
-      pair = pair->next;
-    }
+    struct key_value_pair *pair = &map->table[i];
+    if (pair->dist) func(pair->key, pair->value);
   }
 }
 
 void hashmap_free(struct hashmap* map) {
-  for (u32 i = 0; i < map->table_size; i++) {
-    struct key_value_pair* pair = map->table[i];
-    while (pair != NULL) {
-      struct key_value_pair* next = pair->next;
-      ck_free(pair);
-      pair = next;
-    }
-  }
-  ck_free(map->table);
+  if (map->table != map->inline_table) ck_free(map->table);
   ck_free(map);
 }
 
@@ -564,6 +678,18 @@ struct pareto_scheduler {
   struct vector *explore_recycled;
 };
 
+// One target of a multi-target campaign
+struct dafl_target {
+  u32 base;                           // First DFG map index of the target
+  u32 nodes;                          // Number of DFG nodes
+  u32 idx;                            // Index of the target node
+  struct vertical_manager *vm;
+  struct pareto_scheduler *ps;
+  struct stride_scheduler *ss;        // Horizontal / vertical time sharing
+  u32 homed;                          // Entries scheduled for the target
+  u64 turns;                          // Times it had the focus
+};
+
 struct pareto_scheduler *pareto_scheduler_create();
 
 void pareto_scheduler_free(struct pareto_scheduler *scheduler);
@@ -0,0 +1,171 @@
+/*
+   DAFL - packed queue exporter
+   ----------------------------
+
+   Writes the entries of a queue packed with AFL_QUEUE_PACK (see pack.h)
+   out as regular files named like the entries of an unpacked queue/, for
+   afl-cmin, afl-tmin and other tools that expect one file per test case.
+
+   Usage: afl-queue-export queue_dir output_dir
+
+   queue_dir is the queue/ directory of a DAFL output directory (or the
+   output directory itself); output_dir is created if needed. Existing
+   files are left alone. The calibration records kept in the pack are
+   appended to output_dir/.state/calibration/records (see calcache.h), so
+   that output_dir can be given to afl-fuzz -i without recalibrating.
+*/
+
+#define AFL_MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "types.h"
+#include "debug.h"
+#include "alloc-inl.h"
+#include "pack.h"
+
+/* Map a pack file and check its header. */
+
+static u8* map_pack(u8* fn, u8* magic, u64* len) {
+
+  struct pack_header* hdr;
+  struct stat st;
+  u8* map;
+  s32 fd;
+
+  fd = open(fn, O_RDONLY);
+  if (fd < 0) PFATAL("Unable to open '%s'", fn);
+
+  if (fstat(fd, &st)) PFATAL("fstat() failed");
+
+  if (st.st_size < sizeof(struct pack_header))
+    FATAL("'%s' is too short to be a queue pack", fn);
+
+  map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) PFATAL("Unable to mmap '%s'", fn);
+
+  close(fd);
+
+  hdr = (struct pack_header*)map;
+
+  if (memcmp(hdr->magic, magic, sizeof(hdr->magic)))
+    FATAL("'%s' is not a queue pack (bad magic)", fn);
+
+  if (hdr->version != PACK_VERSION ||
+      hdr->record_size != sizeof(struct pack_entry))
+    FATAL("Unsupported queue pack version %u (record size %u)",
+          hdr->version, hdr->record_size);
+
+  *len = st.st_size;
+  return map;
+
+}
+
+
+int main(int argc, char** argv) {
+
+  struct pack_entry* idx;
+  u64 idx_len, data_len, cnt, i, done = 0, skipped = 0, cal_done = 0;
+  u8 *in_dir, *fn, *cal_fn, *data;
+  s32 cal_fd;
+
+  if (argc != 3) {
+
+    SAYF("Usage: %s queue_dir output_dir\n\n"
+         "Exports a queue packed with AFL_QUEUE_PACK as one file per entry.\n",
+         argv[0]);
+    exit(1);
+
+  }
+
+  /* Accept the output directory in place of its queue/. */
+
+  in_dir = alloc_printf("%s/queue/.state/pack", argv[1]);
+
+  if (access(in_dir, F_OK)) {
+    ck_free(in_dir);
+    in_dir = alloc_printf("%s/.state/pack", argv[1]);
+  }
+
+  fn = alloc_printf("%s/index", in_dir);
+  idx = (struct pack_entry*)map_pack(fn, PACK_INDEX_MAGIC, &idx_len);
+  ck_free(fn);
+
+  fn = alloc_printf("%s/data", in_dir);
+  data = map_pack(fn, PACK_DATA_MAGIC, &data_len);
+  ck_free(fn);
+
+  if (mkdir(argv[2], 0700) && errno != EEXIST)
+    PFATAL("Unable to create '%s'", argv[2]);
+
+  fn = alloc_printf("%s/.state", argv[2]);
+  if (mkdir(fn, 0700) && errno != EEXIST) PFATAL("Unable to create '%s'", fn);
+  ck_free(fn);
+
+  fn = alloc_printf("%s/.state/calibration", argv[2]);
+  if (mkdir(fn, 0700) && errno != EEXIST) PFATAL("Unable to create '%s'", fn);
+  ck_free(fn);
+
+  cal_fn = alloc_printf("%s/.state/calibration/records", argv[2]);
+
+  cal_fd = open(cal_fn, O_WRONLY | O_CREAT | O_APPEND, 0600);
+  if (cal_fd < 0) PFATAL("Unable to create '%s'", cal_fn);
+
+  cnt = (idx_len - sizeof(struct pack_header)) / sizeof(struct pack_entry);
+
+  for (i = 0; i < cnt; i++) {
+
+    struct pack_entry* e = (struct pack_entry*)
+                           ((u8*)idx + sizeof(struct pack_header)) + i;
+    u8* name = pack_entry_name(data, data_len, e);
+    u8* cal  = pack_entry_cal(data, data_len, e);
+    s32 fd;
+
+    if (!name) continue;
+
+    fn = alloc_printf("%s/%.*s", argv[2], e->name_len, name);
+
+    fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0) {
+
+      if (errno != EEXIST) PFATAL("Unable to create '%s'", fn);
+      skipped++;
+
+    } else {
+
+      ck_write(fd, data + e->offset, e->len, fn);
+      close(fd);
+      done++;
+
+      /* Records are named after their entry, which keeps its name. */
+
+      if (cal) {
+        ck_write(cal_fd, cal, e->cal_len, cal_fn);
+        cal_done++;
+      }
+
+    }
+
+    ck_free(fn);
+
+  }
+
+  close(cal_fd);
+  ck_free(cal_fn);
+
+  OKF("Exported %llu entries (%llu already present), %llu calibration "
+      "records.", done, skipped, cal_done);
+
+  return 0;
+
+}
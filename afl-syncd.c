@@ -0,0 +1,571 @@
+/*
+   DAFL - sync daemon
+   ------------------
+
+   Relays queue entries between afl-fuzz instances started with
+   AFL_SYNCD=<address> (see syncd.h for the protocol). Every instance
+   pushes the entries it finds, with their calibration records, and
+   receives the entries of all the others.
+
+   Usage: afl-syncd [ -m megs ] address
+
+   address is a UNIX socket path (anything containing a '/') or
+   [host]:port for TCP. The daemon keeps the cases it relays in memory,
+   up to -m megabytes (SYNCD_MAX_MB by default), so that instances that
+   join late or reconnect get the history; past that, the oldest cases are
+   let go. Cases it has seen before are dropped on arrival, even once let
+   go. Each sync ID may be connected only once at a time.
+
+   Send SIGINT or SIGTERM to stop it; it prints its counters on exit.
+*/
+
+#define AFL_MAIN
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "config.h"
+#include "types.h"
+#include "debug.h"
+#include "alloc-inl.h"
+#include "hash.h"
+#include "syncd.h"
+
+/* A case ready to be sent out: the encoded CASE message and the sync ID
+   of the instance it came from (inside the message, not terminated). */
+
+struct relayed_case {
+
+  u8* msg;                            /* Encoded CASE message             */
+  u32 len;                            /* Its length                       */
+  u8* origin;                         /* Origin sync ID                   */
+  u32 origin_len;                     /* Its length                       */
+
+};
+
+struct client {
+
+  s32 fd;                             /* Connection                       */
+  u8* name;                           /* Sync ID, NULL until HELLO        */
+  u32 name_len;                       /* Its length                       */
+
+  u8* in;                             /* Message being received           */
+  u32 in_have;                        /* Bytes of it received so far      */
+
+  u64 out_seq;                        /* Next case to send                */
+  u32 out_off;                        /* Bytes of it sent so far          */
+
+};
+
+static struct relayed_case* cases;    /* Cases held, oldest first         */
+static u32 case_cnt;                  /* Number of cases[]                */
+static u64 case_base;                 /* Sequence number of cases[0]      */
+
+static struct client* clients;        /* Connected instances              */
+static u32 client_cnt;                /* Number of clients[]              */
+
+/* Open-addressing sets of 64-bit keys, grown at half load. 0 marks a free
+   slot, so a key of 0 is stored as 1. */
+
+struct key_set {
+
+  u64* keys;
+  u32  size, used;
+
+};
+
+static struct key_set seen_data,      /* Contents relayed so far          */
+                      seen_paths;     /* DFG path, trace, valuation       */
+
+static u64 clients_total,             /* Connections accepted             */
+           cases_in,                  /* Cases pushed to us               */
+           dup_data,                  /* ...dropped, same contents        */
+           dup_path,                  /* ...dropped, same path            */
+           bad_msgs,                  /* Malformed messages               */
+           cases_out,                 /* Cases sent out                   */
+           bytes_held,                /* Size of cases[]                  */
+           max_held = (u64)SYNCD_MAX_MB << 20; /* Limit on bytes_held     */
+
+static volatile u8 stop_soon;         /* Ctrl-C pressed?                  */
+
+
+static void handle_stop_sig(int sig) {
+
+  stop_soon = 1;
+
+}
+
+
+/* Adds key to set. Returns 1 if it was new. */
+
+static u8 key_set_add(struct key_set* s, u64 key) {
+
+  u32 i;
+
+  if (!key) key = 1;
+
+  if ((s->used + 1) * 2 > s->size) {
+
+    struct key_set n;
+
+    n.size = s->size ? s->size * 2 : 4096;
+    n.used = 0;
+    n.keys = ck_alloc(n.size * sizeof(u64));
+
+    for (i = 0; i < s->size; i++)
+      if (s->keys[i]) key_set_add(&n, s->keys[i]);
+
+    ck_free(s->keys);
+    *s = n;
+
+  }
+
+  for (i = (u32)(key ^ (key >> 32)) & (s->size - 1); s->keys[i];
+       i = (i + 1) & (s->size - 1))
+    if (s->keys[i] == key) return 0;
+
+  s->keys[i] = key;
+  s->used++;
+
+  return 1;
+
+}
+
+
+static void drop_client(u32 i, u8* why) {
+
+  u8* name = clients[i].name ? clients[i].name : (u8*)"?";
+
+  if (why) WARNF("Dropping client '%s': %s", name, why);
+  else if (clients[i].name) OKF("Client '%s' left.", name);
+
+  close(clients[i].fd);
+  ck_free(clients[i].name);
+  ck_free(clients[i].in);
+
+  clients[i] = clients[--client_cnt];
+
+}
+
+
+/* Let the oldest cases go until bytes_held is within max_held. A case
+   that is partly sent to some client stays, and so do the ones after it. */
+
+static void evict_cases(void) {
+
+  u64 keep = case_base + case_cnt;
+  u32 i, n = 0;
+
+  for (i = 0; i < client_cnt; i++)
+    if (clients[i].out_off && clients[i].out_seq < keep)
+      keep = clients[i].out_seq;
+
+  while (bytes_held > max_held && case_base + n < keep) {
+
+    bytes_held -= cases[n].len;
+    ck_free(cases[n].msg);
+    n++;
+
+  }
+
+  if (!n) return;
+
+  memmove(cases, cases + n, (case_cnt - n) * sizeof(struct relayed_case));
+
+  case_cnt  -= n;
+  case_base += n;
+
+}
+
+
+/* Decide whether a pushed case is worth relaying and, if so, add it to
+   cases[]. Returns 0 if the message is malformed. */
+
+static u8 handle_push(struct client* c, u8* p, u32 len) {
+
+  u8 *data, *msg, path_key[12];
+  u32 data_len, msg_len;
+  u64 hash;
+
+  if (!syncd_case_ok(p, len) || syncd_get32(p + SYNCD_CASE_ORIGIN_LEN * 4))
+    return 0;
+
+  data     = p + SYNCD_CASE_LEN;
+  data_len = syncd_get32(p + SYNCD_CASE_DATA_LEN * 4);
+
+  if (!data_len || data_len > MAX_FILE) return 0;
+
+  /* The message carries the low 32 bits of the content hash, as a check;
+     duplicates are told apart by all 64 (hash64() covers the length). */
+
+  hash = hash64(data, data_len, HASH_CONST);
+
+  if ((u32)hash != syncd_get32(p + SYNCD_CASE_HASH * 4)) return 0;
+
+  cases_in++;
+
+  if (!key_set_add(&seen_data, hash)) {
+    dup_data++;
+    return 1;
+  }
+
+  /* Without a trace checksum (e.g. a case that did not calibrate), the
+     path key would lump unrelated cases together. */
+
+  if (syncd_get32(p + SYNCD_CASE_EXEC_CKSUM * 4)) {
+
+    memcpy(path_key, p + SYNCD_CASE_EXEC_CKSUM * 4, sizeof(path_key));
+
+    if (!key_set_add(&seen_paths,
+                     hash64(path_key, sizeof(path_key), HASH_CONST))) {
+      dup_path++;
+      return 1;
+    }
+
+  }
+
+  /* Re-encode as a CASE message with the origin filled in. */
+
+  msg_len = SYNCD_HDR_LEN + len + c->name_len;
+  msg     = ck_alloc_nozero(msg_len);
+
+  syncd_put_hdr(msg, SYNCD_CASE, len + c->name_len);
+  memcpy(msg + SYNCD_HDR_LEN, p, SYNCD_CASE_LEN);
+  syncd_put32(msg + SYNCD_HDR_LEN + SYNCD_CASE_ORIGIN_LEN * 4, c->name_len);
+  memcpy(msg + SYNCD_HDR_LEN + SYNCD_CASE_LEN, c->name, c->name_len);
+  memcpy(msg + SYNCD_HDR_LEN + SYNCD_CASE_LEN + c->name_len,
+         p + SYNCD_CASE_LEN, len - SYNCD_CASE_LEN);
+
+  cases = ck_realloc_block(cases, (case_cnt + 1) * sizeof(struct relayed_case));
+
+  cases[case_cnt].msg        = msg;
+  cases[case_cnt].len        = msg_len;
+  cases[case_cnt].origin     = msg + SYNCD_HDR_LEN + SYNCD_CASE_LEN;
+  cases[case_cnt].origin_len = c->name_len;
+
+  case_cnt++;
+  bytes_held += msg_len;
+
+  if (bytes_held > max_held) evict_cases();
+
+  return 1;
+
+}
+
+
+/* Read what is available from client i and handle complete messages.
+   Returns 0 if the client was dropped. */
+
+static u8 read_client(u32 i) {
+
+  struct client* c = clients + i;
+  u32 j;
+
+  while (1) {
+
+    u32 need = SYNCD_HDR_LEN;
+    ssize_t r;
+    u8* p;
+
+    if (c->in_have >= SYNCD_HDR_LEN) need += syncd_get32(c->in + 8);
+
+    if (c->in_have < need) {
+
+      r = read(c->fd, c->in + c->in_have, need - c->in_have);
+
+      if (r < 0 && (errno == EAGAIN || errno == EINTR)) return 1;
+
+      if (r <= 0) {
+        drop_client(i, r ? (u8*)"read error" : NULL);
+        return 0;
+      }
+
+      c->in_have += r;
+
+      if (c->in_have == SYNCD_HDR_LEN) {
+
+        u32 len = syncd_get32(c->in + 8);
+
+        if (syncd_get32(c->in) != SYNCD_MAGIC || len > SYNCD_MAX_MSG) {
+          bad_msgs++;
+          drop_client(i, "bad message header");
+          return 0;
+        }
+
+        c->in = ck_realloc(c->in, SYNCD_HDR_LEN + len);
+
+      }
+
+      continue;
+
+    }
+
+    /* One complete message. */
+
+    p = c->in + SYNCD_HDR_LEN;
+
+    switch (syncd_get32(c->in + 4)) {
+
+      case SYNCD_HELLO:
+
+        if (c->name || need < SYNCD_HDR_LEN + 5 ||
+            syncd_get32(p) != SYNCD_VERSION) {
+          bad_msgs++;
+          drop_client(i, "bad hello");
+          return 0;
+        }
+
+        /* Two instances under one sync ID would get each other's cases
+           filtered out as their own. */
+
+        for (j = 0; j < client_cnt; j++)
+          if (clients[j].name &&
+              clients[j].name_len == need - SYNCD_HDR_LEN - 4 &&
+              !memcmp(clients[j].name, p + 4, clients[j].name_len)) break;
+
+        c->name_len = need - SYNCD_HDR_LEN - 4;
+        c->name     = ck_alloc(c->name_len + 1);
+        memcpy(c->name, p + 4, c->name_len);
+
+        if (j < client_cnt) {
+          drop_client(i, "sync ID already connected");
+          return 0;
+        }
+
+        /* Start from the oldest case still held. */
+
+        c->out_seq = case_base;
+
+        OKF("Client '%s' joined.", c->name);
+        break;
+
+      case SYNCD_PUSH:
+
+        if (!c->name || !handle_push(c, p, need - SYNCD_HDR_LEN)) {
+          bad_msgs++;
+          drop_client(i, "bad push");
+          return 0;
+        }
+
+        break;
+
+      default:
+
+        bad_msgs++;
+        drop_client(i, "unknown message type");
+        return 0;
+
+    }
+
+    c->in_have = 0;
+
+  }
+
+}
+
+
+/* Skip the cases client i need not get back, i.e. its own. Returns 1 if
+   there is something left to send. */
+
+static u8 client_pending(struct client* c) {
+
+  struct relayed_case* rc;
+
+  if (!c->name) return 0;
+
+  /* Cases let go before they got to this client are lost to it. */
+
+  if (c->out_seq < case_base) c->out_seq = case_base;
+
+  while (c->out_seq < case_base + case_cnt && !c->out_off) {
+
+    rc = cases + (c->out_seq - case_base);
+
+    if (rc->origin_len != c->name_len ||
+        memcmp(rc->origin, c->name, c->name_len)) break;
+
+    c->out_seq++;
+
+  }
+
+  return c->out_seq < case_base + case_cnt;
+
+}
+
+
+/* Send as much as the socket of client i takes. Returns 0 if the client
+   was dropped. */
+
+static u8 write_client(u32 i) {
+
+  struct client* c = clients + i;
+
+  while (client_pending(c)) {
+
+    struct relayed_case* rc = cases + (c->out_seq - case_base);
+    ssize_t r = send(c->fd, rc->msg + c->out_off, rc->len - c->out_off,
+                     MSG_NOSIGNAL);
+
+    if (r < 0 && (errno == EAGAIN || errno == EINTR)) return 1;
+
+    if (r <= 0) {
+      drop_client(i, NULL);
+      return 0;
+    }
+
+    c->out_off += r;
+
+    if (c->out_off == rc->len) {
+      c->out_seq++;
+      c->out_off = 0;
+      cases_out++;
+    }
+
+  }
+
+  return 1;
+
+}
+
+
+int main(int argc, char** argv) {
+
+  struct sigaction sa;
+  struct pollfd* pfd = NULL;
+  s32 listen_fd, opt;
+  u8* addr;
+  u32 i;
+
+  SAYF(cCYA "afl-syncd " cBRI VERSION cRST " (DAFL sync daemon)\n");
+
+  while ((opt = getopt(argc, argv, "+m:")) > 0)
+
+    switch (opt) {
+
+      case 'm': {
+
+          u32 megs;
+
+          if (sscanf(optarg, "%u", &megs) < 1 || !megs)
+            FATAL("Bad syntax used for -m");
+
+          max_held = (u64)megs << 20;
+          break;
+
+        }
+
+      default:
+
+        optind = argc;
+        break;
+
+    }
+
+  if (optind + 1 != argc) {
+
+    SAYF("\n%s [ -m megs ] address\n\n"
+         "Relays queue entries between afl-fuzz instances started with\n"
+         "AFL_SYNCD=address. address is a UNIX socket path (containing a '/')\n"
+         "or [host]:port for TCP.\n\n"
+         "  -m megs - memory for the cases held for late joiners (default: %u)\n\n",
+         argv[0], SYNCD_MAX_MB);
+
+    exit(1);
+
+  }
+
+  addr = (u8*)argv[optind];
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_stop_sig;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  sa.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &sa, NULL);
+
+  listen_fd = syncd_open(addr, 1);
+  if (listen_fd < 0) PFATAL("Unable to listen on '%s'", addr);
+
+  fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+
+  OKF("Listening on '%s' (keeping up to %llu MB of cases).", addr,
+      max_held >> 20);
+
+  while (!stop_soon) {
+
+    pfd = ck_realloc(pfd, (client_cnt + 1) * sizeof(struct pollfd));
+
+    pfd[0].fd     = listen_fd;
+    pfd[0].events = POLLIN;
+
+    for (i = 0; i < client_cnt; i++) {
+      pfd[i + 1].fd     = clients[i].fd;
+      pfd[i + 1].events = POLLIN | (client_pending(clients + i) ? POLLOUT : 0);
+    }
+
+    if (poll(pfd, client_cnt + 1, -1) < 0) {
+      if (errno == EINTR) continue;
+      PFATAL("poll() failed");
+    }
+
+    /* Walk backwards: drop_client() moves the last client into the slot
+       it frees, and pfd[] no longer matches clients[] past that point. */
+
+    for (i = client_cnt; i > 0; i--) {
+
+      short ev = pfd[i].revents;
+
+      if (ev & (POLLIN | POLLHUP | POLLERR)) {
+        if (!read_client(i - 1)) continue;
+      }
+
+      if (ev & POLLOUT) write_client(i - 1);
+
+    }
+
+    if (pfd[0].revents & POLLIN) {
+
+      s32 fd;
+
+      while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+
+        clients = ck_realloc_block(clients, (client_cnt + 1) *
+                                   sizeof(struct client));
+
+        memset(clients + client_cnt, 0, sizeof(struct client));
+        clients[client_cnt].fd = fd;
+        clients[client_cnt].in = ck_alloc_nozero(SYNCD_HDR_LEN);
+        client_cnt++;
+
+        clients_total++;
+
+      }
+
+    }
+
+  }
+
+  if (strchr((char*)addr, '/')) unlink((char*)addr);
+
+  SAYF("\n" cGRA "  Connections : " cRST "%llu\n"
+       cGRA " Cases pushed : " cRST "%llu (%llu duplicate contents, "
+       "%llu duplicate paths)\n"
+       cGRA "Cases relayed : " cRST "%llu (%u held, %llu KB; %llu let go)\n"
+       cGRA "   Cases sent : " cRST "%llu\n"
+       cGRA " Bad messages : " cRST "%llu\n\n",
+       clients_total, cases_in, dup_data, dup_path, case_base + case_cnt,
+       case_cnt, bytes_held >> 10, case_base, cases_out, bad_msgs);
+
+  return 0;
+
+}
@@ -0,0 +1,92 @@
+/*
+   DAFL - mutation log decoder
+   ---------------------------
+
+   Converts the binary mutation log written by afl-fuzz (<out_dir>/vertical.bin)
+   into the CSV format of the old vertical.log, one line per record:
+
+     kind,persistent,interesting,new_valuation,mutator,location
+
+   Usage: afl-vlog-decode [ vertical.bin [ output.csv ] ]
+
+   Reads stdin and writes stdout when the file names are omitted.
+*/
+
+#define AFL_MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "config.h"
+#include "types.h"
+#include "debug.h"
+#include "vlog.h"
+
+/* Records are read in chunks of this many. */
+
+#define DECODE_CHUNK 4096
+
+int main(int argc, char** argv) {
+
+  static struct vlog_record buf[DECODE_CHUNK];
+
+  struct vlog_header hdr;
+  FILE *in = stdin, *out = stdout;
+  u64 total = 0;
+  size_t cnt;
+
+  if (argc > 3 || (argc > 1 && !strcmp(argv[1], "-h"))) {
+
+    SAYF("Usage: %s [ vertical.bin [ output.csv ] ]\n\n"
+         "Decodes a DAFL binary mutation log into CSV. Uses stdin / stdout\n"
+         "when file names are omitted.\n", argv[0]);
+    exit(1);
+
+  }
+
+  if (argc > 1 && strcmp(argv[1], "-")) {
+    in = fopen(argv[1], "rb");
+    if (!in) PFATAL("Unable to open '%s'", argv[1]);
+  }
+
+  if (argc > 2) {
+    out = fopen(argv[2], "w");
+    if (!out) PFATAL("Unable to create '%s'", argv[2]);
+  }
+
+  if (fread(&hdr, sizeof(hdr), 1, in) != 1)
+    FATAL("Input is too short to be a mutation log");
+
+  if (memcmp(hdr.magic, VLOG_MAGIC, sizeof(hdr.magic)))
+    FATAL("Not a mutation log (bad magic)");
+
+  if (hdr.version != VLOG_VERSION ||
+      hdr.record_size != sizeof(struct vlog_record))
+    FATAL("Unsupported mutation log version %u (record size %u)",
+          hdr.version, hdr.record_size);
+
+  while ((cnt = fread(buf, sizeof(struct vlog_record), DECODE_CHUNK, in))) {
+
+    size_t i;
+
+    for (i = 0; i < cnt; i++)
+      fprintf(out, "%c,%u,%u,%u,%u,%.6f\n", buf[i].kind, buf[i].persistent,
+              buf[i].interesting, buf[i].new_valuation, buf[i].mutator,
+              buf[i].location);
+
+    total += cnt;
+
+  }
+
+  if (ferror(in)) PFATAL("Read error");
+
+  if (fclose(out)) PFATAL("Write error");
+
+  if (argc > 2) OKF("Decoded %llu records.", total);
+
+  return 0;
+
+}
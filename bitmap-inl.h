@@ -0,0 +1,220 @@
+/*
+   DAFL - fused trace bitmap scan
+   ------------------------------
+
+   After every exec, the trace bitmap used to be walked three times: once
+   to bucket the hit counts (classify_counts()), once to checksum it
+   (hash32()) and once more to diff it against the virgin map
+   (has_new_bits()). fused_trace_scan() does all three in a single pass.
+
+   There is a portable word-at-a-time implementation and an AVX2 one for
+   x86-64; fused_trace_scan_init() picks one at runtime based on what the
+   CPU supports. Both produce results identical to the three-pass version;
+   see experimental/bitmap_bench/ for a cross-check and a benchmark.
+*/
+
+#ifndef _HAVE_BITMAP_INL_H
+#define _HAVE_BITMAP_INL_H
+
+#include "types.h"
+#include "hash.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#  define HAVE_AVX2_SCAN 1
+#  include <immintrin.h>
+#endif /* __x86_64__ && __GNUC__ */
+
+/* Scans size bytes of trace[] (size must be a multiple of 32). If lookup16
+   is non-NULL, the raw hit counts are bucketed in place through it first.
+   Bits seen in trace[] are cleared from virgin[]; the return value follows
+   has_new_bits(): 1 for new hit counts only, 2 for new tuples. If cksum is
+   non-NULL, it receives hash32(trace, size, seed) of the bucketed trace. */
+
+typedef u8 (*fused_scan_fn)(u8* trace, u8* virgin, u32 size,
+                            const u16* lookup16, u32* cksum, u32 seed);
+
+static u8 fused_trace_scan_scalar(u8* trace, u8* virgin, u32 size,
+                                  const u16* lookup16, u32* cksum, u32 seed) {
+
+  hash_word* current = (hash_word*)trace;
+  hash_word* vir     = (hash_word*)virgin;
+  hash_word  h1      = hash32_begin(size, seed);
+
+  u32 i = size / sizeof(hash_word);
+  u8  ret = 0;
+
+  while (i--) {
+
+    /* Go through a union so that the bucketed word is not read back through
+       a pointer of a different type. */
+
+    union {
+      hash_word w;
+      u16       w16[sizeof(hash_word) / 2];
+      u8        w8[sizeof(hash_word)];
+    } cur;
+
+    cur.w = *current;
+
+    if (unlikely(cur.w)) {
+
+      if (lookup16) {
+
+        u32 j;
+
+        for (j = 0; j < sizeof(hash_word) / 2; j++)
+          cur.w16[j] = lookup16[cur.w16[j]];
+
+        *current = cur.w;
+
+      }
+
+      if (unlikely(cur.w & *vir)) {
+
+        if (likely(ret < 2)) {
+
+          u8* vir8 = (u8*)vir;
+          u32 j;
+
+          ret = 1;
+
+          for (j = 0; j < sizeof(hash_word); j++)
+            if (cur.w8[j] && vir8[j] == 0xff) ret = 2;
+
+        }
+
+        *vir &= ~cur.w;
+
+      }
+
+    }
+
+    if (cksum) h1 = hash32_step(h1, cur.w);
+
+    current++;
+    vir++;
+
+  }
+
+  if (cksum) *cksum = hash32_end(h1);
+
+  return ret;
+
+}
+
+
+#ifdef HAVE_AVX2_SCAN
+
+__attribute__((target("avx2")))
+static u8 fused_trace_scan_avx2(u8* trace, u8* virgin, u32 size,
+                                const u16* lookup16, u32* cksum, u32 seed) {
+
+  /* Bucketing without a table walk: counts below 16 are looked up by their
+     low nibble, everything else by the high one. */
+
+  const __m256i lo_tab = _mm256_setr_epi8(
+    0, 1, 2, 4, 8, 8, 8, 8, 16, 16, 16, 16, 16, 16, 16, 16,
+    0, 1, 2, 4, 8, 8, 8, 8, 16, 16, 16, 16, 16, 16, 16, 16);
+
+  const __m256i hi_tab = _mm256_setr_epi8(
+    0, 32, 64, 64, 64, 64, 64, 64, -128, -128, -128, -128, -128, -128, -128, -128,
+    0, 32, 64, 64, 64, 64, 64, 64, -128, -128, -128, -128, -128, -128, -128, -128);
+
+  const __m256i nib  = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi8(-1);
+
+  u64 h1 = hash32_begin(size, seed);
+  u32 i;
+  u8  ret = 0;
+
+  for (i = 0; i < size; i += 32) {
+
+    __m256i cur = _mm256_loadu_si256((__m256i*)(trace + i));
+
+    if (likely(_mm256_testz_si256(cur, cur))) {
+
+      /* Zero words still have to go through the checksum. */
+
+      if (cksum) {
+        h1 = hash32_step(h1, 0);
+        h1 = hash32_step(h1, 0);
+        h1 = hash32_step(h1, 0);
+        h1 = hash32_step(h1, 0);
+      }
+
+      continue;
+
+    }
+
+    if (lookup16) {
+
+      __m256i lo_idx = _mm256_and_si256(cur, nib);
+      __m256i hi_idx = _mm256_and_si256(_mm256_srli_epi16(cur, 4), nib);
+      __m256i lo_val = _mm256_shuffle_epi8(lo_tab, lo_idx);
+      __m256i hi_val = _mm256_shuffle_epi8(hi_tab, hi_idx);
+
+      cur = _mm256_blendv_epi8(hi_val, lo_val, _mm256_cmpeq_epi8(hi_idx, zero));
+      _mm256_storeu_si256((__m256i*)(trace + i), cur);
+
+    }
+
+    {
+
+      __m256i vir = _mm256_loadu_si256((__m256i*)(virgin + i));
+
+      if (unlikely(!_mm256_testz_si256(cur, vir))) {
+
+        if (likely(ret < 2)) {
+
+          /* New tuple: a nonzero byte whose virgin counterpart is 0xff. */
+
+          __m256i hit    = _mm256_andnot_si256(_mm256_cmpeq_epi8(cur, zero),
+                                               _mm256_cmpeq_epi8(vir, ones));
+
+          ret = _mm256_movemask_epi8(hit) ? 2 : 1;
+
+        }
+
+        _mm256_storeu_si256((__m256i*)(virgin + i),
+                            _mm256_andnot_si256(cur, vir));
+
+      }
+
+    }
+
+    if (cksum) {
+      u64* w = (u64*)(trace + i);
+      h1 = hash32_step(h1, w[0]);
+      h1 = hash32_step(h1, w[1]);
+      h1 = hash32_step(h1, w[2]);
+      h1 = hash32_step(h1, w[3]);
+    }
+
+  }
+
+  if (cksum) *cksum = hash32_end(h1);
+
+  return ret;
+
+}
+
+#endif /* HAVE_AVX2_SCAN */
+
+
+/* Runtime dispatch. Returns the best implementation for this CPU. */
+
+static fused_scan_fn fused_trace_scan_init(void) {
+
+#ifdef HAVE_AVX2_SCAN
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return fused_trace_scan_avx2;
+
+#endif /* HAVE_AVX2_SCAN */
+
+  return fused_trace_scan_scalar;
+
+}
+
+#endif /* !_HAVE_BITMAP_INL_H */
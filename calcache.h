@@ -0,0 +1,56 @@
+/*
+   DAFL - calibration cache format
+   -------------------------------
+
+   Every queue entry that calibrates cleanly gets a record appended to
+   <out_dir>/queue/.state/calibration/records, holding what the dry run
+   would otherwise have to execute the target (up to CAL_CYCLES_LONG times)
+   to learn again: exec time, the classified trace, the DFG coverage map,
+   the last location, the variable-behavior flag and the valuation hash.
+   The file is only ever appended to, one write per record; a later record
+   for the same entry name supersedes the earlier ones.
+
+   The records also travel with the queue: when syncing, an instance reads
+   the record a peer published for each new entry and skips running the
+   entry if the record shows nothing it does not know yet.
+
+   Records are keyed by the target binary and the input contents; one that
+   does not match both is ignored and the entry is calibrated as usual.
+
+   Layout, in native byte order: struct cal_record, then trace_len u32
+   trace indices, trace_len u8 trace values, packed_len bytes of the DFG
+   map in the dfg_packed_map encoding (varint index delta, count) and the
+   name_len bytes of the entry name, without a terminating NUL.
+*/
+
+#ifndef _HAVE_CALCACHE_H
+#define _HAVE_CALCACHE_H
+
+#include "types.h"
+
+#define CAL_MAGIC     "DAFLCALR"
+#define CAL_VERSION   3
+
+struct cal_record {
+
+  u8  magic[8];                       /* CAL_MAGIC, not NUL-terminated    */
+  u32 version;                        /* CAL_VERSION                      */
+  u32 len;                            /* Input length                     */
+  u64 target_size;                    /* Size of the target binary        */
+  u32 target_hash;                    /* hash_file() of the target binary */
+  u32 content_hash;                   /* hash32() of the input            */
+  u64 exec_us;                        /* Average execution time (us)      */
+  u32 exec_cksum,                     /* Checksum of the execution trace  */
+      dfg_cksum,                      /* Checksum of the DFG map          */
+      bitmap_size;                    /* Number of bits set in bitmap     */
+  s32 last_location;                  /* *last_location after the run     */
+  u32 trace_len,                      /* Nonzero bytes in trace_bits      */
+      packed_len;                     /* Bytes of packed DFG map          */
+  u32 val_hash;                       /* Valuation hash, 0 if none        */
+  u32 name_len;                       /* Bytes of entry name at the end   */
+  u8  var_behavior,                   /* Variable behavior?               */
+      pad[7];
+
+};
+
+#endif /* !_HAVE_CALCACHE_H */
@@ -0,0 +1,113 @@
+/*
+   DAFL - scheduler checkpoint format
+   ----------------------------------
+
+   afl-fuzz periodically saves the scheduler state that an in-place resume
+   (-i -) would otherwise have to rebuild from scratch, or could not rebuild
+   at all, to <out_dir>/scheduler.ckpt: the DFG count map and path hashmaps,
+   the pareto buckets, the vertical entries with their valuation maps, the
+   interval tree, the stride scheduler and per-entry calibration results.
+
+   The file is a ckpt_header followed by the sections of enum ckpt_section,
+   in that order, each starting with its u32 tag. Queue entries are referred
+   to by entry_id (CKPT_NONE for NULL). On restore, the entry records are
+   matched to the current queue by length and content hash, not by
+   position; a record with no match is dropped along with every reference
+   to it, and the entry it stood for goes through the regular dry run.
+
+   Everything is in native byte order; the file is only meant to be read
+   back by the same build. It is written to a temporary file and renamed
+   into place, so a crash leaves either the previous checkpoint or the new
+   one, never a torn file.
+*/
+
+#ifndef _HAVE_CKPT_H
+#define _HAVE_CKPT_H
+
+#include "types.h"
+
+#define CKPT_MAGIC    "DAFLCKPT"
+#define CKPT_VERSION  3
+
+#define CKPT_NONE     0xffffffff
+
+enum ckpt_section {
+  CKPT_GLOBALS = 0x434b0001,          /* struct ckpt_globals              */
+  CKPT_MAPS,                          /* dfg_count_map, virgin maps       */
+  CKPT_ENTRIES,                       /* ckpt_entry + packed map + mini   */
+  CKPT_TOP_RATED,                     /* MAP_SIZE entry ids               */
+  CKPT_HASHMAPS,                      /* dfg, valuation, dfg path counts  */
+  CKPT_PARETO,                        /* moo and explore buckets          */
+  CKPT_VERTICAL,                      /* vertical manager, interval tree  */
+  CKPT_STRIDE,                        /* struct stride_scheduler          */
+  CKPT_END
+};
+
+struct ckpt_header {
+
+  u8  magic[8];                       /* CKPT_MAGIC, not NUL-terminated   */
+  u32 version;                        /* CKPT_VERSION                     */
+  u32 entry_count;                    /* Queue entries (ids 0 .. n-1)     */
+  u64 target_size;                    /* Size of the target binary        */
+  u32 target_hash;                    /* hash_file() of the target binary */
+  u32 map_size;                       /* MAP_SIZE                         */
+  u32 dfg_map_size;                   /* DFG_MAP_SIZE                     */
+  u32 interval_size;                  /* INTERVAL_SIZE                    */
+
+};
+
+struct ckpt_prox {
+
+  u64 original;
+  double adjusted;
+  u32 covered, pad;
+
+};
+
+struct ckpt_globals {
+
+  struct ckpt_prox min, max, total, avg;
+  u64 total_prox_original,
+      total_prox_cnt,
+      total_saved_crashes,
+      total_saved_positives;
+  u32 unique_dafl_input,
+      moo_cycle;
+
+};
+
+/* One per entry id. present is 0 for ids with no queue entry; otherwise the
+   record is followed by packed_len bytes of dfg_packed_map and, if
+   has_trace_mini is set, MAP_SIZE >> 3 bytes of trace_mini. */
+
+struct ckpt_entry {
+
+  u32 len,                            /* Input length when saved          */
+      exec_cksum,
+      dfg_cksum,
+      bitmap_size,
+      selection_count,
+      moo_status, moo_index,
+      explore_status, explore_index;
+  s32 last_location,
+      rank_moo,
+      rank_explore;
+  u32 prox_covered,
+      packed_len;
+  u64 content_hash,                   /* hash_queue_entry() of the input  */
+      exec_us,
+      handicap,
+      depth,
+      prox_original;
+  double prox_adjusted;
+  u8  present,
+      was_fuzzed,
+      passed_det,
+      has_new_cov,
+      var_behavior,
+      has_trace_mini,
+      pad[2];
+
+};
+
+#endif /* !_HAVE_CKPT_H */
@@ -216,6 +216,15 @@
 
 #define SYNC_INTERVAL       5
 
+/* Time after which an instance that has stopped refreshing its heartbeat
+   no longer owns DFG paths with AFL_DFG_PARTITION (seconds): */
+
+#define PARTITION_TIMEOUT   (STATS_UPDATE_SEC * 3)
+
+/* Maximum number of targets in one campaign (-p a.txt:b.txt:...): */
+
+#define MULTI_TARGET_MAX    64
+
 /* Output directory reuse grace period (minutes): */
 
 #define OUTPUT_GRACE        25
@@ -306,6 +315,14 @@
 
 #define FORKSRV_FD          198
 
+/* Options in the fork server "hello" message. A zero message means none;
+   with FS_OPT_MAPSIZE, the low bits carry the number of trace_bits bytes
+   the target uses (DAFL_SEQ_IDS). */
+
+#define FS_OPT_ENABLED      0x80000000
+#define FS_OPT_MAPSIZE      0x40000000
+#define FS_OPT_SIZE_MASK    0x00ffffff
+
 /* Fork server init timeout multiplier: we'll wait the user-selected
    timeout plus this much for the fork server to spin up. */
 
@@ -332,6 +349,52 @@
 #define MAP_SIZE            (1 << MAP_SIZE_POW2)
 #define DFG_MAP_SIZE        32568
 
+/* Mutation log (vertical.bin) ring buffer size in records (power of 2), the
+   number of pending records that triggers a flush, and how long the writer
+   thread sleeps between checks (us): */
+
+#define VLOG_RING_SIZE      (1 << 16)
+#define VLOG_FLUSH_RECORDS  4096
+#define VLOG_POLL_USEC      10000
+
+/* Event log (unique_dafl.evlog): events below EVLOG_MIN_LEVEL (see evlog.h;
+   0 = debug ... 4 = none) are compiled out altogether, and records are
+   buffered in EVLOG_BUF_SIZE bytes before hitting the disk: */
+
+#define EVLOG_MIN_LEVEL     0
+#define EVLOG_BUF_SIZE      (64 * 1024)
+
+/* Interval between scheduler checkpoints (scheduler.ckpt), in seconds: */
+
+#define CKPT_INTERVAL       (5 * 60)
+
+/* Address space reserved for mapping the packed queue (AFL_QUEUE_PACK);
+   the pack cannot grow past this: */
+
+#define PACK_MAP_SIZE       (sizeof(void*) == 8 ? (1ULL << 36) : (1ULL << 30))
+
+/* Default memory budget for cached seed contents, in MB (AFL_SEED_CACHE_MB
+   overrides it; 0 disables the cache): */
+
+#define SEED_CACHE_MB       64
+
+/* Maximum number of executors in the pool (AFL_EXEC_POOL): */
+
+#define EXEC_POOL_MAX       256
+
+/* Memory afl-syncd may hold relayed cases in, for instances that join
+   late, in MB (-m overrides it), and the most afl-fuzz queues for sending
+   to it before dropping new entries, in bytes: */
+
+#define SYNCD_MAX_MB        1024
+#define SYNCD_OUT_MAX       (64 * 1024 * 1024)
+
+/* Slots in each of the tables shared between instances with AFL_SHARED_DFG,
+   as a power of two, and the maximum number of instances per sync dir: */
+
+#define DFG_SHM_SET_POW2    20
+#define DFG_SHM_INSTANCES   256
+
 /* Maximum allocator request size (keep well under INT_MAX): */
 
 #define MAX_ALLOC           0x40000000
@@ -0,0 +1,334 @@
+/*
+   DAFL - DFG index format
+   -----------------------
+
+   afl-dfg-index compiles the text inputs of the instrumentation -- the DFG
+   node lists (DAFL_DFG_SCORE, one per target) and the list of functions to
+   instrument (DAFL_SELECTIVE_COV) -- into one file that is mapped and used
+   as is, with no parsing: the pass takes it from DAFL_DFG_INDEX, and
+   afl-fuzz takes it in place of the node lists with -p.
+
+   The index remembers the sources it was built from: path, size, mtime and
+   a hash of the contents. dfgi_stale() checks them; a source whose size
+   and mtime are unchanged is trusted, any other is hashed again. An index
+   whose sources changed is rejected and has to be rebuilt.
+
+   Layout, in native byte order, with all offsets counted from the start of
+   the file: struct dfgi_header, then the sections it points to:
+
+     sources   src_cnt struct dfgi_source
+     targets   target_cnt struct dfgi_target, one per DFG, in order
+     nodes     node_cnt struct dfgi_node, in DFG map index order
+     line_tab  line_slots u32: (file ID, line) -> first node at that line
+     files     file_cnt u32: string offset of each file name, by file ID
+     file_tab  file_slots u32: file name -> file ID
+     funcs     func_cnt struct dfgi_func
+     func_tab  func_slots u32: function name -> first dfgi_func of that name
+     strings   strings_len bytes of NUL-terminated strings
+
+   The tables are open-addressed with linear probing; their sizes are
+   powers of two, at least twice the number of keys, and empty slots hold
+   DFGI_NONE. Nodes at the same line, and functions of the same name, are
+   chained through their next fields in index order.
+*/
+
+#ifndef _HAVE_DFGINDEX_H
+#define _HAVE_DFGINDEX_H
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "types.h"
+
+#define DFGI_MAGIC    "DAFLDFGI"
+#define DFGI_VERSION  1
+
+#define DFGI_NONE     0xffffffffU
+
+/* Source kinds. */
+
+#define DFGI_SRC_DFG  0               /* DFG node list (DAFL_DFG_SCORE)   */
+#define DFGI_SRC_COV  1               /* Function list (DAFL_SELECTIVE_COV) */
+
+struct dfgi_header {
+
+  u8  magic[8];                       /* DFGI_MAGIC, not NUL-terminated   */
+  u32 version;                        /* DFGI_VERSION                     */
+  u32 pad;
+  u64 size;                           /* Size of the whole index          */
+
+  u32 src_cnt, target_cnt, node_cnt, file_cnt, func_cnt;
+  u32 line_slots, file_slots, func_slots;
+  u32 strings_len;
+  u32 pad2;
+
+  u64 src_off, target_off, node_off, line_off, file_off, file_tab_off,
+      func_off, func_tab_off, str_off;
+
+};
+
+struct dfgi_source {
+
+  u32 path;                           /* Absolute path (string offset)    */
+  u32 kind;                           /* DFGI_SRC_*                       */
+  u64 size;                           /* Size when the index was built    */
+  u64 mtime_ns;                       /* Modification time, ns            */
+  u64 hash;                           /* dfgi_hash() of the contents      */
+
+};
+
+struct dfgi_target {
+
+  u32 base;                           /* Index of the first node          */
+  u32 nodes;                          /* Number of nodes                  */
+
+};
+
+struct dfgi_node {
+
+  u32 score;                          /* Proximity score                  */
+  u32 file;                           /* File ID, DFGI_NONE if not file:line */
+  u32 line;                           /* Line number                      */
+  u32 next;                           /* Next node at this line, or DFGI_NONE */
+  u64 max_paths;                      /* Path count                       */
+
+};
+
+struct dfgi_func {
+
+  u32 name;                           /* Function name (string offset)    */
+  u32 file;                           /* File ID                          */
+  u32 entry;                          /* "file:func" as listed            */
+  u32 next;                           /* Next of that name, or DFGI_NONE  */
+
+};
+
+/* 64-bit FNV-1a; continue a running hash by passing it as h. */
+
+static inline u64 dfgi_hash(const void* data, u64 len, u64 h) {
+
+  const u8* p = (const u8*)data;
+
+  while (len--) {
+    h ^= *p++;
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+
+}
+
+#define DFGI_HASH_INIT 0xcbf29ce484222325ULL
+
+static inline u32 dfgi_str_hash(const char* s) {
+
+  return (u32)dfgi_hash(s, strlen(s), DFGI_HASH_INIT);
+
+}
+
+static inline u32 dfgi_line_hash(u32 file, u32 line) {
+
+  u64 k = ((u64)file << 32 | line) * 0x9e3779b97f4a7c15ULL;
+  return (u32)(k >> 32);
+
+}
+
+#define DFGI_AT(h, off, type) ((const type*)((const u8*)(h) + (off)))
+
+static inline const char* dfgi_str(const struct dfgi_header* h, u32 off) {
+
+  if (off >= h->strings_len) return "";
+  return DFGI_AT(h, h->str_off + off, char);
+
+}
+
+/* Checks the header and section bounds of a mapped index of len bytes.
+   Returns the header, or NULL if it is not a usable index. */
+
+static inline const struct dfgi_header* dfgi_check(const u8* map, u64 len) {
+
+  const struct dfgi_header* h = (const struct dfgi_header*)map;
+
+#define DFGI_FITS(off, cnt, sz) \
+  ((off) <= len && (u64)(cnt) * (sz) <= len - (off))
+
+  if (len < sizeof(struct dfgi_header) ||
+      memcmp(h->magic, DFGI_MAGIC, sizeof(h->magic)) ||
+      h->version != DFGI_VERSION || h->size != len) return NULL;
+
+  if (!DFGI_FITS(h->src_off, h->src_cnt, sizeof(struct dfgi_source)) ||
+      !DFGI_FITS(h->target_off, h->target_cnt, sizeof(struct dfgi_target)) ||
+      !DFGI_FITS(h->node_off, h->node_cnt, sizeof(struct dfgi_node)) ||
+      !DFGI_FITS(h->line_off, h->line_slots, 4) ||
+      !DFGI_FITS(h->file_off, h->file_cnt, 4) ||
+      !DFGI_FITS(h->file_tab_off, h->file_slots, 4) ||
+      !DFGI_FITS(h->func_off, h->func_cnt, sizeof(struct dfgi_func)) ||
+      !DFGI_FITS(h->func_tab_off, h->func_slots, 4) ||
+      !DFGI_FITS(h->str_off, h->strings_len, 1)) return NULL;
+
+#undef DFGI_FITS
+
+  /* Tables must be powers of two with room to spare, so that probes end. */
+
+  if (!h->line_slots || (h->line_slots & (h->line_slots - 1)) ||
+      !h->file_slots || (h->file_slots & (h->file_slots - 1)) ||
+      !h->func_slots || (h->func_slots & (h->func_slots - 1)) ||
+      h->node_cnt >= h->line_slots || h->file_cnt >= h->file_slots ||
+      h->func_cnt >= h->func_slots) return NULL;
+
+  if (!h->strings_len || map[h->str_off + h->strings_len - 1]) return NULL;
+
+  return h;
+
+}
+
+/* File ID of a file name, DFGI_NONE if the index does not mention it. */
+
+static inline u32 dfgi_file_id(const struct dfgi_header* h, const char* name) {
+
+  const u32* tab   = DFGI_AT(h, h->file_tab_off, u32);
+  const u32* files = DFGI_AT(h, h->file_off, u32);
+  u32 mask = h->file_slots - 1, i = dfgi_str_hash(name) & mask;
+
+  for (; tab[i] != DFGI_NONE; i = (i + 1) & mask)
+    if (tab[i] < h->file_cnt && !strcmp(dfgi_str(h, files[tab[i]]), name))
+      return tab[i];
+
+  return DFGI_NONE;
+
+}
+
+/* First node at a line of a file, DFGI_NONE if none. */
+
+static inline u32 dfgi_line_first(const struct dfgi_header* h, u32 file,
+                                  u32 line) {
+
+  const u32* tab = DFGI_AT(h, h->line_off, u32);
+  const struct dfgi_node* nodes = DFGI_AT(h, h->node_off, struct dfgi_node);
+  u32 mask = h->line_slots - 1, i = dfgi_line_hash(file, line) & mask;
+
+  for (; tab[i] != DFGI_NONE; i = (i + 1) & mask)
+    if (tab[i] < h->node_cnt && nodes[tab[i]].file == file &&
+        nodes[tab[i]].line == line) return tab[i];
+
+  return DFGI_NONE;
+
+}
+
+/* First function entry with a name, DFGI_NONE if none. */
+
+static inline u32 dfgi_func_first(const struct dfgi_header* h, const char* name) {
+
+  const u32* tab = DFGI_AT(h, h->func_tab_off, u32);
+  const struct dfgi_func* funcs = DFGI_AT(h, h->func_off, struct dfgi_func);
+  u32 mask = h->func_slots - 1, i = dfgi_str_hash(name) & mask;
+
+  for (; tab[i] != DFGI_NONE; i = (i + 1) & mask)
+    if (tab[i] < h->func_cnt && !strcmp(dfgi_str(h, funcs[tab[i]].name), name))
+      return tab[i];
+
+  return DFGI_NONE;
+
+}
+
+/* Hashes the contents of a file. Returns 0 if it cannot be read. */
+
+static inline u8 dfgi_hash_file(const char* path, u64* hash, u64* size) {
+
+  u8 buf[65536];
+  s32 fd = open(path, O_RDONLY), n;
+
+  if (fd < 0) return 0;
+
+  *hash = DFGI_HASH_INIT;
+  *size = 0;
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    *hash = dfgi_hash(buf, n, *hash);
+    *size += n;
+  }
+
+  close(fd);
+  return !n;
+
+}
+
+/* Returns the number of the first source that changed since the index was
+   built, or -1 if none did. */
+
+static inline s32 dfgi_stale(const struct dfgi_header* h) {
+
+  const struct dfgi_source* src = DFGI_AT(h, h->src_off, struct dfgi_source);
+  struct stat st;
+  u64 hash, size;
+  u32 i;
+
+  for (i = 0; i < h->src_cnt; i++) {
+
+    const char* path = dfgi_str(h, src[i].path);
+
+    if (stat(path, &st)) return i;
+
+    if ((u64)st.st_size == src[i].size &&
+        (u64)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec ==
+        src[i].mtime_ns) continue;
+
+    if (!dfgi_hash_file(path, &hash, &size) || size != src[i].size ||
+        hash != src[i].hash) return i;
+
+  }
+
+  return -1;
+
+}
+
+/* Maps an index read-only. Returns NULL if it cannot be mapped; check the
+   result with dfgi_check(). */
+
+static inline const u8* dfgi_map(const char* path, u64* len) {
+
+  struct stat st;
+  void* map;
+  s32 fd = open(path, O_RDONLY);
+
+  if (fd < 0) return NULL;
+
+  if (fstat(fd, &st) || !st.st_size) {
+    close(fd);
+    return NULL;
+  }
+
+  map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) return NULL;
+
+  *len = st.st_size;
+  return (const u8*)map;
+
+}
+
+/* Tells whether a file starts like an index, for callers that accept both
+   an index and the text lists. */
+
+static inline u8 dfgi_is_index(const char* path) {
+
+  u8 magic[8];
+  s32 fd = open(path, O_RDONLY);
+  u8 ret;
+
+  if (fd < 0) return 0;
+
+  ret = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+        !memcmp(magic, DFGI_MAGIC, sizeof(magic));
+
+  close(fd);
+  return ret;
+
+}
+
+#endif /* !_HAVE_DFGINDEX_H */
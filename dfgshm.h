@@ -0,0 +1,169 @@
+/*
+   DAFL - shared DFG state
+   -----------------------
+
+   With AFL_SHARED_DFG set, all -M / -S instances of a sync dir attach one
+   host-local SysV shared memory segment (key: ftok() of the sync dir) and
+   keep in it the scheduling state they would otherwise each rebuild on
+   their own:
+
+     - the DFG node counts (dfg_count_map[]), updated with atomic adds,
+
+     - the set of DFG path checksums seen by any instance, so that a path
+       is only ever counted as unique once,
+
+     - the set of valuation hashes seen by any instance,
+
+     - a memo of input (hash64() of the contents, length) -> valuation
+       hash, so that inputs imported from a sibling are not run through
+       the valuation binary again.
+
+   The sets and the memo are lock-free open-addressing tables of fixed
+   size (DFG_SHM_SET_POW2); 0 marks a free slot, so a key of 0 is stored
+   as 1. Once a table is full, lookups keep working and new keys are
+   simply not shared any more.
+
+   The segment is created and initialized by the first instance, which
+   sets ready last; it is removed by the last instance to detach. The
+   instances of a sync dir are expected to start from the same -i seeds,
+   so only the creator adds those to the counts.
+*/
+
+#ifndef _HAVE_DFGSHM_H
+#define _HAVE_DFGSHM_H
+
+#include "types.h"
+
+#define DFGSHM_MAGIC      "DAFLDSHM"
+#define DFGSHM_VERSION    2
+
+#define DFGSHM_SET_SIZE   (1 << DFG_SHM_SET_POW2)
+
+struct dfgshm_header {
+
+  u8  magic[8];                       /* DFGSHM_MAGIC, not NUL-terminated */
+  u32 version;                        /* DFGSHM_VERSION                   */
+  u32 dfg_map_size;                   /* DFG_MAP_SIZE                     */
+  u32 set_size;                       /* DFGSHM_SET_SIZE                  */
+  u32 target_hash;                    /* hash_file() of the target binary */
+  u64 target_size;                    /* Size of the target binary        */
+  u32 ready;                          /* Set once the creator is done     */
+  u32 pad;
+
+};
+
+/* The segment, as laid out in memory. instances[] holds hash32() of the
+   sync ids that have contributed their queue to counts[]. */
+
+struct dfgshm {
+
+  struct dfgshm_header hdr;
+
+  u32 counts[DFG_MAP_SIZE];
+  u32 instances[DFG_SHM_INSTANCES];
+  u32 paths[DFGSHM_SET_SIZE];
+  u32 valuations[DFGSHM_SET_SIZE];
+  u64 memo_keys[DFGSHM_SET_SIZE];
+  u64 memo_vals[DFGSHM_SET_SIZE];
+
+};
+
+/* Adds key to a set. Returns 1 if it was new, 0 if it was already there,
+   and 1 as well if the set is full (the caller then treats the key as
+   local news, which is what it would be without sharing). */
+
+static inline u8 dfgshm_set_add(u32* set, u32 size, u32 key) {
+
+  u32 i, n;
+
+  if (!key) key = 1;
+
+  for (i = key & (size - 1), n = 0; n < size; i = (i + 1) & (size - 1), n++) {
+
+    u32 cur = __atomic_load_n(set + i, __ATOMIC_ACQUIRE);
+
+    if (!cur &&
+        __atomic_compare_exchange_n(set + i, &cur, key, 0, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) return 1;
+
+    if (cur == key) return 0;
+
+  }
+
+  return 1;
+
+}
+
+/* Memo slots are claimed by setting the key, then filled in with the
+   input length in the upper and the valuation hash in the lower half of
+   the value; a slot whose value is still 0 is not ready yet. Inputs are
+   never empty, so a filled-in value is never 0. */
+
+/* Looks up the valuation hash memoized for an input. */
+
+static inline u8 dfgshm_memo_get(struct dfgshm* shm, u64 key, u32 len,
+                                 u32* val) {
+
+  u32 i, n;
+
+  if (!key) key = 1;
+
+  for (i = key & (DFGSHM_SET_SIZE - 1), n = 0; n < DFGSHM_SET_SIZE;
+       i = (i + 1) & (DFGSHM_SET_SIZE - 1), n++) {
+
+    u64 cur = __atomic_load_n(shm->memo_keys + i, __ATOMIC_ACQUIRE), ent;
+
+    if (!cur) return 0;
+    if (cur != key) continue;
+
+    ent = __atomic_load_n(shm->memo_vals + i, __ATOMIC_ACQUIRE);
+
+    if ((u32)(ent >> 32) == len) {
+      *val = (u32)ent;
+      return 1;
+    }
+
+  }
+
+  return 0;
+
+}
+
+/* Memoizes a valuation hash. The first one stored for an input wins. */
+
+static inline void dfgshm_memo_put(struct dfgshm* shm, u64 key, u32 len,
+                                   u32 val) {
+
+  u32 i, n;
+
+  if (!key) key = 1;
+
+  for (i = key & (DFGSHM_SET_SIZE - 1), n = 0; n < DFGSHM_SET_SIZE;
+       i = (i + 1) & (DFGSHM_SET_SIZE - 1), n++) {
+
+    u64 cur = __atomic_load_n(shm->memo_keys + i, __ATOMIC_ACQUIRE);
+
+    if (!cur &&
+        __atomic_compare_exchange_n(shm->memo_keys + i, &cur, key, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      __atomic_store_n(shm->memo_vals + i, ((u64)len << 32) | val,
+                       __ATOMIC_RELEASE);
+      return;
+    }
+
+    /* Same hash, other length: keep probing, the length is part of the
+       key. */
+
+    if (cur == key) {
+
+      u64 ent = __atomic_load_n(shm->memo_vals + i, __ATOMIC_ACQUIRE);
+
+      if (!ent || (u32)(ent >> 32) == len) return;
+
+    }
+
+  }
+
+}
+
+#endif /* !_HAVE_DFGSHM_H */
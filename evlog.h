@@ -0,0 +1,249 @@
+/*
+   DAFL - structured event log
+   ---------------------------
+
+   afl-fuzz used to fprintf() a line to unique_dafl.log for every scheduler
+   decision, new valuation, saved seed and so on. Those lines are now events:
+   each one has an id and a level, listed in EVLOG_EVENTS below, and a
+   printf-style format, id##_FMT. At runtime only the arguments are stored, as binary
+   records in <out_dir>/unique_dafl.evlog; afl-evlog-decode formats them back
+   into exactly the text the old log had.
+
+   The file is an evlog_header followed by records in native byte order:
+
+     u16 event id, u16 payload length, payload
+
+   The payload holds the arguments in format order. Integers (of any size)
+   and floating point values take 8 bytes each; strings are a u16 length
+   followed by that many bytes, with no terminator.
+*/
+
+#ifndef _HAVE_EVLOG_H
+#define _HAVE_EVLOG_H
+
+#include <string.h>
+#include <strings.h>
+
+#include "types.h"
+
+#define EVLOG_MAGIC    "DAFLEVLG"
+#define EVLOG_VERSION  1
+
+/* Longest string argument kept in a record; longer ones are truncated. */
+
+#define EVLOG_MAX_STR  4096
+
+enum evlog_level {
+  EV_DEBUG,
+  EV_INFO,
+  EV_WARN,
+  EV_ERROR,
+  EV_NONE
+};
+
+/* Format of every event, as id##_FMT. These are macros rather than part of
+   EVLOG_EVENTS so that EVLOG() can hand the literal to a dead printf() and
+   have the compiler check the arguments against it. */
+
+#define EV_ADAPTIVE_FMT \
+  "[adaptive] [cur %d] [new %d] [h %u] [v %u] [h3 %f] [h12 %f] [v3 %f] [v12 %f] [rst %d]\n"
+#define EV_VERT_ENTRY_INSERT_FMT \
+  "[vert-entry] [insert] [entry %u] [vals %u] [entries %u]\n"
+#define EV_ERR_VERT_ENTRY_INSERT_FMT \
+  "[error] [vert-entry] [insert] [error] [entry %u] [vals %u] [entries %u] [cur %u] [cur-vals %u] [cur-entries %u]\n"
+#define EV_SEL_MOO_FMT \
+  "[sel] [moo] [id %d] [dfg-path %u] [dfg-path-count %llu] [time %llu]\n"
+#define EV_ERR_MOO_REMOVE_FMT \
+  "[error] [moo] [remove] [id %d] [status %d] [index %d] [removed %d] [time %llu]\n"
+#define EV_SEL_EXPLORE_FMT \
+  "[sel] [explore] [id %d] [dfg-path %u] [dfg-path-count %llu] [time %llu]\n"
+#define EV_ERR_EXPLORE_REMOVE_FMT \
+  "[error] [explore] [remove] [id %d] [status %d] [index %d] [removed %d] [time %llu]\n"
+#define EV_Q_UNIQ_FMT \
+  "[q] [uniq] [seed %d] [id %u] [orig %llu] [adj %.4f] [cov %u] [cnt %u]\n"
+#define EV_Q_NON_UNIQ_FMT \
+  "[q] [non-uniq] [seed %d] [id %u] [orig %llu] [adj %.4f] [cov %u]\n"
+#define EV_STAT_MOO_ORIG_FMT \
+  "[stat] [moo] [orig] [min %llu] [max %llu] [avg %llu] [total %llu]\n"
+#define EV_STAT_MOO_ADJ_FMT \
+  "[stat] [moo] [adj] [min %f] [max %f] [avg %f] [total %f]\n"
+#define EV_VERT_ENTRY_SEL_FMT \
+  "[vert-entry] [sel] [selected %u] [vals %u] [entries %u]\n"
+#define EV_SEL_DAFL_FMT \
+  "[sel] [dafl] [id %d] [time %llu]\n"
+#define EV_SEL_VERTICAL_FMT \
+  "[sel] [vertical] [id %d] [dfg-path %u] [time %llu]\n"
+#define EV_VERTICAL_ENTRY_ADD_FMT \
+  "[vertical] [entry-add] [id %u] [checksum %u]\n"
+#define EV_COV_FMT \
+  "[cov] [new %u] [old 1]\n"
+#define EV_PACFIX_MEM_FMT \
+  "[pacfix] [mem] [%s] [seed %d] [entry %d] [id %llu] [hash %u] [time %llu] [file %s]\n"
+#define EV_NUV_FMT \
+  "[nuv] [dfg-path %u] [hash %u] [seed %d] [crash %u] [time %llu]\n"
+#define EV_VERTICAL_ENTRY_ADD_LATE_FMT \
+  "[vertical] [entry-add-late] [id %u] [checksum %u]\n"
+#define EV_VERTICAL_VALUATION_FMT \
+  "[vertical] [valuation] [seed %d] [entry %d] [dfg-path %u] [hash %u] [id %u] [persistent %u] [time %llu]\n"
+#define EV_ERR_VALUATION_FMT \
+  "[error] [valuation] [no local hashmap found] [dfg-path %u] [hash %u]\n"
+#define EV_VERTICAL_DRY_RUN_FMT \
+  "[vertical] [dry-run] [id %u] [dfg-path %u] [res %u] [file %s] [last-loc %u]\n"
+#define EV_MOO_UNIQ_PATH_FMT \
+  "[moo] [uniq-path] [seed %d] [moo-id %u]\n"
+#define EV_MOO_UNIQ_FMT \
+  "[moo] [uniq] [seed %d] [id %u] [moo-id %u] [cov %u] [prox %llu] [adj %f] [mut %s] [time %llu]\n"
+#define EV_MOO_NO_UNIQ_FMT \
+  "[moo] [no-uniq] [seed %d] [id %u] [cov %u] [prox %llu] [adj %f] [tgt %u] [mut %s] [time %llu]\n"
+#define EV_VERTICAL_SAVE_FMT \
+  "[vertical] [save] [seed %d] [id %u] [crash %u] [dfg-path %u] [cov %u] [prox %llu] [adj %f] [mut %s] [file %s] [time %llu] [last-loc %u] [val-hash %u] [stf %d] [neg %d] [exec %u]\n"
+#define EV_MOO_SAVE_FMT \
+  "[moo] [save] [seed %d] [moo-id %u] [fault %u] [path %u] [val %u] [file %s] [mut %s] [time %llu]\n"
+#define EV_POW_FMT \
+  "[pow] [orig %u] [factor %f] [perf %u] [id %d]\n"
+#define EV_OPTIONS_FMT \
+  "[options] [hor %d] [ver %d] [ve %d] [k %d] [r %f] [y %d] [v %d]\n"
+#define EV_OPTIONS_CMD_FMT \
+  "[options] [cmd \"%s\"]\n"
+
+/* _(id, level). Ids are stored in the log, so new events go at the end and
+   existing ones are never reordered; bump EVLOG_VERSION otherwise. */
+
+#define EVLOG_EVENTS(_) \
+  _(EV_ADAPTIVE, EV_DEBUG) \
+  _(EV_VERT_ENTRY_INSERT, EV_DEBUG) \
+  _(EV_ERR_VERT_ENTRY_INSERT, EV_ERROR) \
+  _(EV_SEL_MOO, EV_DEBUG) \
+  _(EV_ERR_MOO_REMOVE, EV_ERROR) \
+  _(EV_SEL_EXPLORE, EV_DEBUG) \
+  _(EV_ERR_EXPLORE_REMOVE, EV_ERROR) \
+  _(EV_Q_UNIQ, EV_INFO) \
+  _(EV_Q_NON_UNIQ, EV_DEBUG) \
+  _(EV_STAT_MOO_ORIG, EV_INFO) \
+  _(EV_STAT_MOO_ADJ, EV_INFO) \
+  _(EV_VERT_ENTRY_SEL, EV_DEBUG) \
+  _(EV_SEL_DAFL, EV_DEBUG) \
+  _(EV_SEL_VERTICAL, EV_DEBUG) \
+  _(EV_VERTICAL_ENTRY_ADD, EV_INFO) \
+  _(EV_COV, EV_DEBUG) \
+  _(EV_PACFIX_MEM, EV_INFO) \
+  _(EV_NUV, EV_DEBUG) \
+  _(EV_VERTICAL_ENTRY_ADD_LATE, EV_INFO) \
+  _(EV_VERTICAL_VALUATION, EV_INFO) \
+  _(EV_ERR_VALUATION, EV_ERROR) \
+  _(EV_VERTICAL_DRY_RUN, EV_INFO) \
+  _(EV_MOO_UNIQ_PATH, EV_INFO) \
+  _(EV_MOO_UNIQ, EV_INFO) \
+  _(EV_MOO_NO_UNIQ, EV_DEBUG) \
+  _(EV_VERTICAL_SAVE, EV_INFO) \
+  _(EV_MOO_SAVE, EV_INFO) \
+  _(EV_POW, EV_DEBUG) \
+  _(EV_OPTIONS, EV_INFO) \
+  _(EV_OPTIONS_CMD, EV_INFO) \
+
+#define EVLOG_ENUM(id, lvl) id,
+#define EVLOG_LEVEL(id, lvl) id##_LEVEL = lvl,
+#define EVLOG_DESC(id, lvl) { #id, lvl, id##_FMT },
+
+enum evlog_event { EVLOG_EVENTS(EVLOG_ENUM) EV_COUNT };
+
+/* Compile-time level of every event, as id##_LEVEL. */
+
+enum evlog_event_level { EVLOG_EVENTS(EVLOG_LEVEL) };
+
+struct evlog_desc {
+  const char* name;
+  u8 level;
+  const char* fmt;
+};
+
+static const struct evlog_desc evlog_desc[EV_COUNT] = {
+  EVLOG_EVENTS(EVLOG_DESC)
+};
+
+#undef EVLOG_ENUM
+#undef EVLOG_LEVEL
+#undef EVLOG_DESC
+
+struct evlog_header {
+
+  u8  magic[8];                       /* EVLOG_MAGIC, not NUL-terminated  */
+  u32 version;                        /* EVLOG_VERSION                    */
+  u32 event_count;                    /* EV_COUNT when the log was made   */
+
+};
+
+/* Argument classes, as consumed from a va_list. */
+
+enum evlog_arg {
+  EVA_NONE,                           /* "%%" - no argument               */
+  EVA_INT,                            /* int or unsigned                  */
+  EVA_SINT,                           /* int, printed signed              */
+  EVA_LONG,                           /* long, long long or size_t        */
+  EVA_DOUBLE,                         /* double                           */
+  EVA_STR                             /* const char*                      */
+};
+
+/* Parses the conversion spec starting at fmt (which points at '%'). Stores
+   its length in *len and returns its argument class. Handles flags, width,
+   precision and the h, l, ll and z modifiers; '*' is not supported. */
+
+static u8 evlog_spec(const char* fmt, u32* len) {
+
+  const char* p = fmt + 1;
+  u8 is_long = 0;
+
+  while (*p && strchr("-+ #0", *p)) p++;
+  while (*p >= '0' && *p <= '9') p++;
+
+  if (*p == '.') {
+    p++;
+    while (*p >= '0' && *p <= '9') p++;
+  }
+
+  while (*p && strchr("hlzjqL", *p)) {
+    if (*p != 'h') is_long = 1;
+    p++;
+  }
+
+  *len = p - fmt + (*p ? 1 : 0);
+
+  switch (*p) {
+
+    case 'd': case 'i':
+      return is_long ? EVA_LONG : EVA_SINT;
+
+    case 'u': case 'x': case 'X': case 'o': case 'c':
+      return is_long ? EVA_LONG : EVA_INT;
+
+    case 'f': case 'F': case 'g': case 'G': case 'e': case 'E':
+      return EVA_DOUBLE;
+
+    case 's':
+      return EVA_STR;
+
+    default:
+      return EVA_NONE;
+
+  }
+
+}
+
+/* Maps "debug", "info", "warn", "error" or "none" (or 0-4) to a level.
+   Returns -1 if the name is not recognized. */
+
+static s32 evlog_parse_level(const char* name) {
+
+  static const char* names[] = { "debug", "info", "warn", "error", "none" };
+  u32 i;
+
+  for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    if (!strcasecmp(name, names[i])) return i;
+
+  if (name[0] >= '0' && name[0] <= '4' && !name[1]) return name[0] - '0';
+
+  return -1;
+
+}
+
+#endif /* !_HAVE_EVLOG_H */
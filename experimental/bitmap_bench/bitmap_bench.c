@@ -0,0 +1,255 @@
+/*
+   DAFL - fused trace scan microbenchmark
+   --------------------------------------
+
+   Compares the three passes afl-fuzz used to make over trace_bits[] after
+   every exec (classify_counts(), hash32(), has_new_bits()) with the single
+   fused pass from bitmap-inl.h, both the portable and the AVX2 flavor.
+   Every variant is first cross-checked against the baseline on the same
+   inputs, so this also doubles as a correctness test.
+
+   Build and run from this directory:
+
+     gcc -O3 -I../.. bitmap_bench.c -o bitmap_bench
+     ./bitmap_bench [iterations] [nonzero_tuples]
+*/
+
+#include "config.h"
+#include "types.h"
+#include "hash.h"
+#include "bitmap-inl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const u8 count_class_lookup8[256] = {
+
+  [0]           = 0,
+  [1]           = 1,
+  [2]           = 2,
+  [3]           = 4,
+  [4 ... 7]     = 8,
+  [8 ... 15]    = 16,
+  [16 ... 31]   = 32,
+  [32 ... 127]  = 64,
+  [128 ... 255] = 128
+
+};
+
+static u16 count_class_lookup16[65536];
+
+static u8 raw_trace[MAP_SIZE], trace[MAP_SIZE];
+static u8 virgin_a[MAP_SIZE], virgin_b[MAP_SIZE];
+
+
+static u64 now_us(void) {
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (tv.tv_sec * 1000000ULL) + tv.tv_usec;
+
+}
+
+
+/* Baseline: the original afl-fuzz routines, word by word. */
+
+static void classify_counts(hash_word* mem) {
+
+  u32 i = MAP_SIZE / sizeof(hash_word);
+
+  while (i--) {
+
+    if (unlikely(*mem)) {
+
+      u16* mem16 = (u16*)mem;
+      u32  j;
+
+      for (j = 0; j < sizeof(hash_word) / 2; j++)
+        mem16[j] = count_class_lookup16[mem16[j]];
+
+    }
+
+    mem++;
+
+  }
+
+}
+
+
+static u8 has_new_bits(u8* cur_map, u8* virgin_map) {
+
+  hash_word* current = (hash_word*)cur_map;
+  hash_word* virgin  = (hash_word*)virgin_map;
+
+  u32 i = MAP_SIZE / sizeof(hash_word);
+  u8  ret = 0;
+
+  while (i--) {
+
+    if (unlikely(*current) && unlikely(*current & *virgin)) {
+
+      if (likely(ret < 2)) {
+
+        u8* cur = (u8*)current;
+        u8* vir = (u8*)virgin;
+        u32 j;
+
+        ret = 1;
+
+        for (j = 0; j < sizeof(hash_word); j++)
+          if (cur[j] && vir[j] == 0xff) ret = 2;
+
+      }
+
+      *virgin &= ~*current;
+
+    }
+
+    current++;
+    virgin++;
+
+  }
+
+  return ret;
+
+}
+
+
+static u8 three_pass(u8* virgin, u32* cksum) {
+
+  classify_counts((hash_word*)trace);
+  *cksum = hash32(trace, MAP_SIZE, HASH_CONST);
+  return has_new_bits(trace, virgin);
+
+}
+
+
+/* Fill raw_trace[] with a sparse trace with a spread of hit counts. */
+
+static void make_trace(u32 tuples) {
+
+  u32 i;
+
+  memset(raw_trace, 0, MAP_SIZE);
+
+  for (i = 0; i < tuples; i++)
+    raw_trace[random() % MAP_SIZE] = 1 + (random() % 255);
+
+}
+
+
+static void check_variant(const char* name, fused_scan_fn fn, u32 tuples) {
+
+  u32 round;
+
+  memset(virgin_a, 255, MAP_SIZE);
+  memset(virgin_b, 255, MAP_SIZE);
+
+  for (round = 0; round < 64; round++) {
+
+    u32 ck_a, ck_b;
+    u8  ret_a, ret_b, trace_b[MAP_SIZE];
+
+    make_trace(tuples);
+
+    memcpy(trace, raw_trace, MAP_SIZE);
+    ret_a = three_pass(virgin_a, &ck_a);
+    memcpy(trace_b, trace, MAP_SIZE);
+
+    memcpy(trace, raw_trace, MAP_SIZE);
+    ret_b = fn(trace, virgin_b, MAP_SIZE, count_class_lookup16, &ck_b,
+               HASH_CONST);
+
+    if (ret_a != ret_b || ck_a != ck_b || memcmp(trace, trace_b, MAP_SIZE) ||
+        memcmp(virgin_a, virgin_b, MAP_SIZE)) {
+
+      printf("MISMATCH in %s (round %u: ret %u/%u, cksum %08x/%08x)\n",
+             name, round, ret_a, ret_b, ck_a, ck_b);
+      exit(1);
+
+    }
+
+  }
+
+}
+
+
+static void bench_variant(const char* name, fused_scan_fn fn, u32 iters,
+                          u32 tuples) {
+
+  u64 start, fused_us = 0, base_us = 0;
+  u32 i, ck, sink = 0;
+
+  make_trace(tuples);
+  memset(virgin_a, 255, MAP_SIZE);
+
+  for (i = 0; i < iters; i++) {
+
+    memcpy(trace, raw_trace, MAP_SIZE);
+    start = now_us();
+    sink += three_pass(virgin_a, &ck) + ck;
+    base_us += now_us() - start;
+
+    memcpy(trace, raw_trace, MAP_SIZE);
+    start = now_us();
+    sink += fn(trace, virgin_a, MAP_SIZE, count_class_lookup16, &ck,
+               HASH_CONST) + ck;
+    fused_us += now_us() - start;
+
+  }
+
+  printf("%-8s tuples %6u: three-pass %8.3f us/exec, fused %8.3f us/exec "
+         "(%.2fx) [%u]\n", name, tuples, (double)base_us / iters,
+         (double)fused_us / iters, (double)base_us / (fused_us ? fused_us : 1),
+         sink & 1);
+
+}
+
+
+int main(int argc, char** argv) {
+
+  u32 iters  = argc > 1 ? atoi(argv[1]) : 20000;
+  u32 tuples = argc > 2 ? atoi(argv[2]) : 0;
+  u32 b1, b2, i;
+
+  static const u32 densities[] = { 64, 512, 4096, 16384 };
+
+  for (b1 = 0; b1 < 256; b1++)
+    for (b2 = 0; b2 < 256; b2++)
+      count_class_lookup16[(b1 << 8) + b2] =
+        (count_class_lookup8[b1] << 8) | count_class_lookup8[b2];
+
+  srandom(1234);
+
+  check_variant("scalar", fused_trace_scan_scalar, 512);
+  check_variant("scalar", fused_trace_scan_scalar, 16384);
+
+#ifdef HAVE_AVX2_SCAN
+  if (fused_trace_scan_init() == fused_trace_scan_avx2) {
+    check_variant("avx2", fused_trace_scan_avx2, 512);
+    check_variant("avx2", fused_trace_scan_avx2, 16384);
+  }
+#endif /* HAVE_AVX2_SCAN */
+
+  printf("All variants match the three-pass baseline.\n");
+
+  for (i = 0; i < sizeof(densities) / sizeof(u32); i++) {
+
+    u32 t = tuples ? tuples : densities[i];
+
+    bench_variant("scalar", fused_trace_scan_scalar, iters, t);
+
+#ifdef HAVE_AVX2_SCAN
+    if (fused_trace_scan_init() == fused_trace_scan_avx2)
+      bench_variant("avx2", fused_trace_scan_avx2, iters, t);
+#endif /* HAVE_AVX2_SCAN */
+
+    if (tuples) break;
+
+  }
+
+  return 0;
+
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# DAFL - executor pool scaling benchmark
+# --------------------------------------
+#
+# Runs afl-fuzz on the same target for a fixed time, first without the
+# executor pool and then with AFL_EXEC_POOL set to each of the given sizes,
+# and prints the throughput reported in fuzzer_stats for every run.
+#
+# Only havoc and splice go through the pool, and results are merged on the
+# main thread, so gains show up on targets whose exec time dominates the
+# per-exec bookkeeping - and, of course, only with as many free cores.
+#
+# Run from this directory after building DAFL:
+#
+#   ./exec_pool_bench.sh [ seconds [ pool_sizes ] ]
+#
+# The default target is ../../test-instr.c; set TARGET to the path of an
+# already instrumented binary (and DFG to its DFG file) to use another one.
+#
+
+SECS="${1:-30}"
+SIZES="${2:-1 2 4 8}"
+AFL="../.."
+WORK="/tmp/exec_pool_bench.$$"
+
+mkdir -p "$WORK/in" || exit 1
+echo 0 >"$WORK/in/seed"
+
+if [ "$TARGET" = "" ]; then
+  TARGET="$WORK/test-instr"
+  AFL_QUIET=1 "$AFL/afl-gcc" -O2 "$AFL/test-instr.c" -o "$TARGET" || exit 1
+fi
+
+if [ "$DFG" = "" ]; then
+  DFG="$WORK/dfg.txt"
+  printf '0 10 test-instr.c:1\n1 5 test-instr.c:2\n' >"$DFG"
+fi
+
+run() {
+
+  rm -rf "$WORK/out"
+
+  AFL_SKIP_CPUFREQ=1 AFL_NO_UI=1 timeout -s INT "$SECS" \
+    "$AFL/afl-fuzz" -m none -i "$WORK/in" -o "$WORK/out" -p "$DFG" \
+    -- "$TARGET" >/dev/null 2>&1
+
+  printf '%-8s %12s %14s\n' "$1" \
+    "$(sed -n 's/^execs_done *: //p' "$WORK/out/fuzzer_stats")" \
+    "$(sed -n 's/^execs_per_sec *: //p' "$WORK/out/fuzzer_stats")"
+
+}
+
+printf '%-8s %12s %14s\n' "pool" "execs_done" "execs_per_sec"
+
+unset AFL_EXEC_POOL
+run "off"
+
+for n in $SIZES; do
+  export AFL_EXEC_POOL="$n"
+  run "$n"
+done
+
+rm -rf "$WORK"
@@ -71,6 +71,68 @@ static inline u32 hash32(const void* key, u32 len, u32 seed) {
 
 }
 
+/* Incremental flavor of hash32(), for callers that already walk the buffer
+   one word at a time: hash32_begin(), then hash32_step() for every 64-bit
+   word, then hash32_end(). Yields the same value as hash32(). */
+
+typedef u64 hash_word;
+
+static inline u64 hash32_begin(u32 len, u32 seed) {
+
+  return seed ^ len;
+
+}
+
+static inline u64 hash32_step(u64 h1, u64 k1) {
+
+  k1 *= 0x87c37b91114253d5ULL;
+  k1  = ROL64(k1, 31);
+  k1 *= 0x4cf5ad432745937fULL;
+
+  h1 ^= k1;
+  h1  = ROL64(h1, 27);
+  return h1 * 5 + 0x52dce729;
+
+}
+
+static inline u32 hash32_end(u64 h1) {
+
+  h1 ^= h1 >> 33;
+  h1 *= 0xff51afd7ed558ccdULL;
+  h1 ^= h1 >> 33;
+  h1 *= 0xc4ceb9fe1a85ec53ULL;
+  h1 ^= h1 >> 33;
+
+  return h1;
+
+}
+
+/* 64-bit hash of all len bytes of key, trailing bytes included, for keys
+   where a 32-bit collision would silently conflate two different inputs. */
+
+static inline u64 hash64(const void* key, u32 len, u32 seed) {
+
+  const u8* data = (u8*)key;
+  u64 h1 = seed ^ len, k1 = 0;
+  u32 i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    h1 = hash32_step(h1, *(u64*)(data + i));
+
+  for (; i < len; i++) k1 |= (u64)data[i] << ((i & 7) << 3);
+
+  h1  = hash32_step(h1, k1);
+
+  h1 ^= h1 >> 33;
+  h1 *= 0xff51afd7ed558ccdULL;
+  h1 ^= h1 >> 33;
+  h1 *= 0xc4ceb9fe1a85ec53ULL;
+  h1 ^= h1 >> 33;
+
+  return h1;
+
+}
+
 #else 
 
 #define ROL32(_x, _r)  ((((u32)(_x)) << (_r)) | (((u32)(_x)) >> (32 - (_r))))
@@ -106,6 +168,59 @@ static inline u32 hash32(const void* key, u32 len, u32 seed) {
 
 }
 
+/* Incremental flavor of hash32(); see the 64-bit variant above. */
+
+typedef u32 hash_word;
+
+static inline u32 hash32_begin(u32 len, u32 seed) {
+
+  return seed ^ len;
+
+}
+
+static inline u32 hash32_step(u32 h1, u32 k1) {
+
+  k1 *= 0xcc9e2d51;
+  k1  = ROL32(k1, 15);
+  k1 *= 0x1b873593;
+
+  h1 ^= k1;
+  h1  = ROL32(h1, 13);
+  return h1 * 5 + 0xe6546b64;
+
+}
+
+static inline u32 hash32_end(u32 h1) {
+
+  h1 ^= h1 >> 16;
+  h1 *= 0x85ebca6b;
+  h1 ^= h1 >> 13;
+  h1 *= 0xc2b2ae35;
+  h1 ^= h1 >> 16;
+
+  return h1;
+
+}
+
+/* 64-bit hash of all len bytes of key; see the 64-bit variant above. Two
+   differently seeded hash32() passes, with the tail folded into both. */
+
+static inline u64 hash64(const void* key, u32 len, u32 seed) {
+
+  const u8* data = (u8*)key;
+  u32 tail = 0, lo, hi, i;
+
+  for (i = len & ~3; i < len; i++) tail |= (u32)data[i] << ((i & 3) << 3);
+
+  lo = hash32_end(hash32_step(hash32_begin(len, hash32(key, len, seed)),
+                              tail));
+  hi = hash32_end(hash32_step(hash32_begin(len, hash32(key, len,
+                                                       ~seed)), tail));
+
+  return ((u64)hi << 32) | lo;
+
+}
+
 #endif /* ^__x86_64__ */
 
 #endif /* !_HAVE_HASH_H */
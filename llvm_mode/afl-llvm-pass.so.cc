@@ -33,23 +33,29 @@
 
 #include "../config.h"
 #include "../debug.h"
+#include "../dfgindex.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <set>
+#include <vector>
+#include <unordered_map>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
 #include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 #include "llvm/Support/CommandLine.h"
 
@@ -58,9 +64,96 @@ using namespace llvm;
 bool selective_coverage = false;
 bool dfg_scoring = false;
 bool no_filename_match = false;
-std::set<std::string> instr_targets;
-std::map<std::string,std::pair<unsigned int,unsigned int>> dfg_node_map;
-std::map<std::string,unsigned long long> dfg_path_map;
+bool sparse_last_loc = false;
+bool seq_ids = false;
+
+// File names of the target and DFG lists, interned: file name -> file ID.
+std::unordered_map<std::string,unsigned int> file_ids;
+
+// Instrumentation targets: function name -> (file ID, "file:func") for each
+// file that lists it.
+std::unordered_map<std::string,std::vector<std::pair<unsigned int,std::string>>> instr_targets;
+
+// A line may be a node of several DFGs (one per target): one (index, score)
+// pair for each.
+struct DFGNode {
+  std::vector<std::pair<unsigned int,unsigned int>> nodes;
+  unsigned long long path_cnt;
+};
+
+// DFG nodes, by dfg_key(file ID, line).
+std::unordered_map<unsigned long long,DFGNode> dfg_node_map;
+
+// With DAFL_DFG_INDEX, the lists are looked up in the mapped index instead,
+// and the maps above stay empty.
+const struct dfgi_header *dfg_index = nullptr;
+
+
+unsigned int internFile(const std::string &file) {
+  return file_ids.emplace(file, file_ids.size()).first->second;
+}
+
+
+// File ID of a file name, or -1 if no list mentions it.
+int lookupFile(const std::string &file) {
+  if (dfg_index) {
+    unsigned int id = dfgi_file_id(dfg_index, file.c_str());
+    return id == DFGI_NONE ? -1 : (int) id;
+  }
+  auto it = file_ids.find(file);
+  return it == file_ids.end() ? -1 : (int) it->second;
+}
+
+
+static inline unsigned long long dfg_key(unsigned int file_id, unsigned int line) {
+  return ((unsigned long long) file_id << 32) | line;
+}
+
+
+// Is func of file file_id an instrumentation target? If so, sets entry to
+// the line that lists it.
+bool lookupTarget(const std::string &func, int file_id, std::string &entry) {
+  if (dfg_index) {
+    const struct dfgi_func *funcs = DFGI_AT(dfg_index, dfg_index->func_off, struct dfgi_func);
+    for (unsigned int i = dfgi_func_first(dfg_index, func.c_str());
+         i < dfg_index->func_cnt; i = funcs[i].next) {
+      if (no_filename_match || (int) funcs[i].file == file_id) {
+        entry = dfgi_str(dfg_index, funcs[i].entry);
+        return true;
+      }
+    }
+    return false;
+  }
+  auto it = instr_targets.find(func);
+  if (it == instr_targets.end()) return false;
+  for (auto &targ : it->second) {
+    if (no_filename_match || (int) targ.first == file_id) {
+      entry = targ.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// The DFG nodes at a line of file file_id, or nullptr if there are none.
+// Points into dfg_node_map, or, with an index, to scratch, which the
+// caller owns and which is overwritten by the next lookup.
+const DFGNode *lookupDFGNode(int file_id, unsigned int line, DFGNode &scratch) {
+  if (dfg_index) {
+    const struct dfgi_node *nodes = DFGI_AT(dfg_index, dfg_index->node_off, struct dfgi_node);
+    scratch.nodes.clear();
+    for (unsigned int i = dfgi_line_first(dfg_index, file_id, line);
+         i < dfg_index->node_cnt; i = nodes[i].next) {
+      scratch.nodes.push_back(std::make_pair(i, nodes[i].score));
+      scratch.path_cnt = nodes[i].max_paths;
+    }
+    return scratch.nodes.empty() ? nullptr : &scratch;
+  }
+  auto it = dfg_node_map.find(dfg_key(file_id, line));
+  if (it == dfg_node_map.end()) return nullptr;
+  return &it->second;
+}
 
 
 namespace {
@@ -87,13 +180,19 @@ void initCoverageTarget(char* select_file) {
   std::string line;
   std::ifstream stream(select_file);
 
-  while (std::getline(stream, line))
-    instr_targets.insert(line);
+  while (std::getline(stream, line)) {
+    std::size_t colon = line.find(":");
+    std::string target_file = line.substr(0, colon);
+    std::string target_func = line.substr(colon + 1, std::string::npos);
+    instr_targets[target_func].push_back(
+        std::make_pair(internFile(target_file), line));
+  }
 }
 
 
-void initDFGNodeMap(char* dfg_file) {
-  unsigned int idx = 0;
+// Read the nodes of one DFG, numbering them from idx on. Returns the index
+// of the next free slot.
+unsigned int initDFGNodeMap(const char* dfg_file, unsigned int idx) {
   std::string line;
   std::ifstream stream(dfg_file);
 
@@ -103,39 +202,164 @@ void initDFGNodeMap(char* dfg_file) {
     std::size_t space_idx2 = line.find(" ", space_idx + 1);
     std::string path_cnt_str = line.substr(space_idx + 1, space_idx2);
     std::string targ_line = line.substr(space_idx2 + 1, std::string::npos);
+    std::size_t colon = targ_line.find_last_of(':');
     int score = stoi(score_str);
     unsigned long long path_cnt = stoull(path_cnt_str);
-    dfg_node_map[targ_line] = std::make_pair(idx++, (unsigned int) score);
-    dfg_path_map[targ_line] = path_cnt;
+    char *end;
+    unsigned long line_no = colon == std::string::npos ? 0 :
+                            strtoul(targ_line.c_str() + colon + 1, &end, 10);
+    // Not a file:line node: it keeps its index, but no block maps to it.
+    if (line_no && !*end) {
+      DFGNode &node = dfg_node_map[dfg_key(internFile(targ_line.substr(0, colon)), line_no)];
+      node.nodes.push_back(std::make_pair(idx, (unsigned int) score));
+      node.path_cnt = path_cnt;
+    }
+    idx++;
     if (idx >= DFG_MAP_SIZE - 1) {
       std::cout << "Input DFG is too large (check DFG_MAP_SIZE)" << std::endl;
       exit(1);
     }
   }
+  return idx;
+}
+
+
+// Map the index built by afl-dfg-index, in place of the text lists.
+void initIndex(const char* index_file) {
+  const struct dfgi_source *srcs;
+  const u8 *map;
+  u64 len;
+  s32 stale;
+
+  map = dfgi_map(index_file, &len);
+  dfg_index = map ? dfgi_check(map, len) : nullptr;
+
+  if (!dfg_index) FATAL("'%s' is not a valid DFG index", index_file);
+
+  srcs = DFGI_AT(dfg_index, dfg_index->src_off, struct dfgi_source);
+
+  if ((stale = dfgi_stale(dfg_index)) >= 0)
+    FATAL("DFG index '%s' is out of date ('%s' changed), rebuild it with afl-dfg-index",
+          index_file, dfgi_str(dfg_index, srcs[stale].path));
+
+  for (unsigned int i = 0; i < dfg_index->src_cnt; i++) {
+    if (srcs[i].kind == DFGI_SRC_COV) selective_coverage = true;
+    else dfg_scoring = true;
+  }
 }
 
 
 void initialize(void) {
   char* select_file = getenv("DAFL_SELECTIVE_COV");
   char* dfg_file = getenv("DAFL_DFG_SCORE");
+  char* index_file = getenv("DAFL_DFG_INDEX");
+
+  if (getenv("DAFL_NO_FILENAME_MATCH")) no_filename_match = true;
+  if (getenv("DAFL_SPARSE_LAST_LOC")) sparse_last_loc = true;
+  if (getenv("DAFL_SEQ_IDS")) seq_ids = true;
+
+  if (index_file) {
+    initIndex(index_file);
+    return;
+  }
 
   if (select_file) {
     selective_coverage = true;
     initCoverageTarget(select_file);
   }
 
+  /* Several targets: DAFL_DFG_SCORE=a.txt:b.txt:... Each DFG gets its own
+     slice of the DFG map, in the order given; afl-fuzz -p takes the same
+     list and derives the same slices. */
+
   if (dfg_file) {
+    std::stringstream files(dfg_file);
+    std::string file;
+    unsigned int idx = 0;
     dfg_scoring = true;
-    initDFGNodeMap(dfg_file);
+    while (std::getline(files, file, ':'))
+      if (!file.empty()) idx = initDFGNodeMap(file.c_str(), idx);
   }
-
-  if (getenv("DAFL_NO_FILENAME_MATCH")) no_filename_match = true;
 }
 
 
 char AFLCoverage::ID = 0;
 
 
+/* DAFL_SEQ_IDS: turn an ID local to this module into a program-wide one,
+   by adding the base the runtime gave the module (see runOnModule()). */
+
+static Value *seqID(Module &M, IRBuilder<> &IRB, Constant *SeqBase,
+                   unsigned int id) {
+
+  LoadInst *Base = IRB.CreateLoad(SeqBase);
+  Base->setMetadata(M.getMDKindID("nosanitize"),
+                    MDNode::get(M.getContext(), None));
+
+  return IRB.CreateAdd(Base, ConstantInt::get(IRB.getInt32Ty(), id));
+
+}
+
+
+/* DAFL_SEQ_IDS: bump __afl_area_ptr[id] at the start of a block. */
+
+static void insertEdgeCounter(Module &M, BasicBlock *BB,
+                              GlobalVariable *AFLMapPtr, Constant *SeqBase,
+                              unsigned int id) {
+
+  LLVMContext &C = M.getContext();
+  IRBuilder<> IRB(&(*BB->getFirstInsertionPt()));
+
+  LoadInst *MapPtr = IRB.CreateLoad(AFLMapPtr);
+  MapPtr->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+  Value *MapPtrIdx = IRB.CreateGEP(
+      MapPtr, IRB.CreateZExt(seqID(M, IRB, SeqBase, id % MAP_SIZE),
+                             IRB.getInt64Ty()));
+
+  LoadInst *Counter = IRB.CreateLoad(MapPtrIdx);
+  Counter->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+  Value *Incr = IRB.CreateAdd(Counter, ConstantInt::get(IRB.getInt8Ty(), 1));
+  IRB.CreateStore(Incr, MapPtrIdx)
+      ->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+
+}
+
+
+/* DAFL_SEQ_IDS: give each edge into BB its own counter. A block with at
+   most one predecessor stands for its only edge; otherwise every incoming
+   edge is split and the counter goes into the new block. Edges that cannot
+   be split (EH pads, indirectbr, several edges from one predecessor) are
+   counted in BB itself. Returns the next free ID. */
+
+static unsigned int insertEdgeCounters(Module &M, BasicBlock *BB,
+                                       GlobalVariable *AFLMapPtr,
+                                       Constant *SeqBase, unsigned int id) {
+
+  std::vector<BasicBlock*> preds(pred_begin(BB), pred_end(BB));
+  std::set<BasicBlock*> uniq(preds.begin(), preds.end());
+  bool split = uniq.size() > 1 && uniq.size() == preds.size() &&
+               !BB->isEHPad();
+
+  for (auto *P : uniq) {
+    Instruction *T = P->getTerminator();
+    if (!isa<BranchInst>(T) && !isa<SwitchInst>(T)) split = false;
+  }
+
+  if (!split) {
+    insertEdgeCounter(M, BB, AFLMapPtr, SeqBase, id++);
+    return id;
+  }
+
+  for (auto *P : preds) {
+    BasicBlock *E = SplitEdge(P, BB);
+    insertEdgeCounter(M, E, AFLMapPtr, SeqBase, id++);
+  }
+
+  return id;
+
+}
+
+
 bool AFLCoverage::runOnModule(Module &M) {
 
   LLVMContext &C = M.getContext();
@@ -164,6 +388,45 @@ bool AFLCoverage::runOnModule(Module &M) {
   GlobalVariable *AFLMapDFGLastPtr = new GlobalVariable(M, PointerType::get(Int32Ty, 0), false,
                          GlobalValue::ExternalLinkage, 0, "__afl_area_dfg_last_ptr");
 
+  /* Sparse last location: blocks leave cur_loc in __afl_prev_loc, unshifted,
+     and the runtime stores it to __afl_area_dfg_last_ptr when the run ends.
+     This marker tells the runtime to do so. */
+
+  if (sparse_last_loc)
+    new GlobalVariable(M, Int8Ty, true, GlobalValue::WeakAnyLinkage,
+                       ConstantInt::get(Int8Ty, 1), "__afl_sparse_last_loc");
+
+  /* Sequential IDs: edges are numbered from 0 in the order they are met
+     and counted in trace_bits[] directly, with no prev_loc hashing; blocks
+     use their own number as the last location. Both are relative to a base
+     that the runtime hands out at startup, so that the modules of a program
+     get disjoint ranges: every module leaves a { base, count } record in
+     the __dafl_seq section, and the runtime walks them all (see
+     __afl_setup_seq_ids()). There are never more blocks than edges, so
+     count covers both. */
+
+  unsigned int seq_edge = 0, seq_block = 0;
+
+  GlobalVariable *SeqModule = nullptr;
+  Constant *SeqBase = nullptr;
+
+  if (seq_ids) {
+
+    StructType *SeqTy = StructType::get(Int32Ty, Int32Ty);
+
+    SeqModule = new GlobalVariable(M, SeqTy, false,
+                                   GlobalValue::InternalLinkage,
+                                   ConstantAggregateZero::get(SeqTy),
+                                   "__dafl_seq_module");
+    SeqModule->setSection("__dafl_seq");
+    appendToCompilerUsed(M, SeqModule);
+
+    SeqBase = ConstantExpr::getInBoundsGetElementPtr(
+        SeqTy, SeqModule, ArrayRef<Constant*>{ConstantInt::get(Int32Ty, 0),
+                                              ConstantInt::get(Int32Ty, 0)});
+
+  }
+
   /* Instrument all the things! */
 
   int inst_blocks = 0;
@@ -188,33 +451,28 @@ bool AFLCoverage::runOnModule(Module &M) {
     }
 
     bool is_inst_targ = false;
-    const std::string func_name = F.getName().str();
-    std::set<std::string>::iterator it;
+    int file_id = lookupFile(file_name);
 
     /* Check if this function is our instrumentation target. */
     if (selective_coverage) {
-      for (it = instr_targets.begin(); it != instr_targets.end(); ++it) {
-        std::size_t colon = (*it).find(":");
-        std::string target_file = (*it).substr(0, colon);
-        std::string target_func = (*it).substr(colon + 1, std::string::npos);
-
-        if (no_filename_match || file_name.compare(target_file) == 0) {
-          if (func_name.compare(target_func) == 0) {
-            is_inst_targ = true;
-            covered_targets.insert(*it);
-            break;
-          }
-        }
+      std::string entry;
+      if (lookupTarget(F.getName().str(), file_id, entry)) {
+        is_inst_targ = true;
+        covered_targets.insert(entry);
       }
     } else is_inst_targ = true; // If disabled, instrument all the blocks.
 
-    /* Now iterate through the basic blocks of the function. */
+    /* Now iterate through the basic blocks of the function. Take a copy of
+       the list first, as sequential IDs add blocks while we go. */
 
-    for (auto &BB : F) {
-      bool is_dfg_node = false;
-      unsigned int node_idx = 0;
-      unsigned int node_score = 0;
-      unsigned long long path_cnt = 0;
+    std::vector<BasicBlock*> blocks;
+    for (auto &BB : F) blocks.push_back(&BB);
+
+    DFGNode dfg_scratch;
+
+    for (auto *BBp : blocks) {
+      BasicBlock &BB = *BBp;
+      const DFGNode *dfg_node = nullptr;
 
       if (is_inst_targ) {
         inst_blocks++;
@@ -227,23 +485,14 @@ bool AFLCoverage::runOnModule(Module &M) {
       /* Iterate through the instructions in the basic block to check if this
        * block is a DFG node. If so, retrieve its proximity score. */
 
-      if (dfg_scoring) {
+      if (dfg_scoring && file_id >= 0) {
         for (auto &inst : BB) {
           DebugLoc dbg = inst.getDebugLoc();
           DILocation* DILoc = dbg.get();
           if (DILoc && DILoc->getLine()) {
-            int line_no = DILoc->getLine();
-            std::ostringstream stream;
-            stream << file_name << ":" << line_no;
-            std::string targ_str = stream.str();
-            if (dfg_node_map.count(targ_str) > 0) {
-              is_dfg_node = true;
-              auto node_info = dfg_node_map[targ_str];
-              auto path_info = dfg_path_map[targ_str];
-              node_idx = node_info.first;
-              node_score = node_info.second;
-              path_cnt = path_info;
-              inst_dfg_nodes++;
+            dfg_node = lookupDFGNode(file_id, DILoc->getLine(), dfg_scratch);
+            if (dfg_node) {
+              inst_dfg_nodes += dfg_node->nodes.size();
               break;
             }
           }
@@ -255,59 +504,94 @@ bool AFLCoverage::runOnModule(Module &M) {
 
       /* Make up cur_loc */
 
-      unsigned int cur_loc = AFL_R(MAP_SIZE);
+      unsigned int cur_loc = seq_ids ? seq_block++ % MAP_SIZE : AFL_R(MAP_SIZE);
 
-      ConstantInt *CurLoc = ConstantInt::get(Int32Ty, cur_loc);
+      Value *CurLoc = seq_ids ? seqID(M, IRB, SeqBase, cur_loc)
+                              : ConstantInt::get(Int32Ty, cur_loc);
 
       /* Record current location in AFLMapDFGPtr */
-      LoadInst *DFGMap = IRB.CreateLoad(AFLMapDFGLastPtr);
-      DFGMap->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
-      ConstantInt *DFGMapIdx = ConstantInt::get(Int32Ty, 0);
-      Value *DFGMapPtrIdxCur = IRB.CreateGEP(DFGMap, DFGMapIdx);
-      StoreInst *StoreCur = IRB.CreateStore(CurLoc, DFGMapPtrIdxCur);
-      StoreCur->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+      if (!sparse_last_loc) {
+        LoadInst *DFGMap = IRB.CreateLoad(AFLMapDFGLastPtr);
+        DFGMap->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+        ConstantInt *DFGMapIdx = ConstantInt::get(Int32Ty, 0);
+        Value *DFGMapPtrIdxCur = IRB.CreateGEP(DFGMap, DFGMapIdx);
+        StoreInst *StoreCur = IRB.CreateStore(CurLoc, DFGMapPtrIdxCur);
+        StoreCur->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+      }
 
-      /* Load prev_loc */
+      if (seq_ids) {
 
-      LoadInst *PrevLoc = IRB.CreateLoad(AFLPrevLoc);
-      PrevLoc->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
-      Value *PrevLocCasted = IRB.CreateZExt(PrevLoc, IRB.getInt32Ty());
+        /* No edge hashing; sparse mode still needs cur_loc in prev_loc. */
 
-      /* Load SHM pointer */
+        if (sparse_last_loc)
+          IRB.CreateStore(CurLoc, AFLPrevLoc)
+              ->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
 
-      LoadInst *MapPtr = IRB.CreateLoad(AFLMapPtr);
-      MapPtr->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
-      Value *MapPtrIdx =
-          IRB.CreateGEP(MapPtr, IRB.CreateXor(PrevLocCasted, CurLoc));
+      } else {
 
-      /* Update bitmap */
+        /* Load prev_loc (kept unshifted in sparse mode) */
 
-      LoadInst *Counter = IRB.CreateLoad(MapPtrIdx);
-      Counter->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
-      Value *Incr = IRB.CreateAdd(Counter, ConstantInt::get(Int8Ty, 1));
-      IRB.CreateStore(Incr, MapPtrIdx)
-          ->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+        LoadInst *PrevLoc = IRB.CreateLoad(AFLPrevLoc);
+        PrevLoc->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+        Value *PrevLocCasted = IRB.CreateZExt(PrevLoc, IRB.getInt32Ty());
+        if (sparse_last_loc) PrevLocCasted = IRB.CreateLShr(PrevLocCasted, 1);
 
-      /* Set prev_loc to cur_loc >> 1 */
+        /* Load SHM pointer */
 
-      StoreInst *Store =
-          IRB.CreateStore(ConstantInt::get(Int32Ty, cur_loc >> 1), AFLPrevLoc);
-      Store->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+        LoadInst *MapPtr = IRB.CreateLoad(AFLMapPtr);
+        MapPtr->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+        Value *MapPtrIdx =
+            IRB.CreateGEP(MapPtr, IRB.CreateXor(PrevLocCasted, CurLoc));
+
+        /* Update bitmap */
+
+        LoadInst *Counter = IRB.CreateLoad(MapPtrIdx);
+        Counter->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+        Value *Incr = IRB.CreateAdd(Counter, ConstantInt::get(Int8Ty, 1));
+        IRB.CreateStore(Incr, MapPtrIdx)
+            ->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
 
-      if (is_dfg_node) {
-        /* Update DFG coverage map. */
+        /* Set prev_loc to cur_loc >> 1 (cur_loc in sparse mode) */
+
+        StoreInst *Store = IRB.CreateStore(
+            ConstantInt::get(Int32Ty, sparse_last_loc ? cur_loc : cur_loc >> 1), AFLPrevLoc);
+        Store->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+
+      }
+
+      if (dfg_node) {
+        /* Update DFG coverage map, once for every DFG the block is in. */
         LoadInst *DFGMap = IRB.CreateLoad(AFLMapDFGPtr);
         DFGMap->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
-        ConstantInt * Idx = ConstantInt::get(Int32Ty, node_idx);
-        ConstantInt * Score = ConstantInt::get(Int32Ty, node_score);
-        ConstantInt * PathCnt = ConstantInt::get(Int64Ty, path_cnt);
-        Value *DFGMapPtrIdx = IRB.CreateGEP(DFGMap, Idx);
-        IRB.CreateStore(Score, DFGMapPtrIdx)
-            ->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+        ConstantInt * PathCnt = ConstantInt::get(Int64Ty, dfg_node->path_cnt);
+        for (auto &node : dfg_node->nodes) {
+          ConstantInt * Idx = ConstantInt::get(Int32Ty, node.first);
+          ConstantInt * Score = ConstantInt::get(Int32Ty, node.second);
+          Value *DFGMapPtrIdx = IRB.CreateGEP(DFGMap, Idx);
+          IRB.CreateStore(Score, DFGMapPtrIdx)
+              ->setMetadata(M.getMDKindID("nosanitize"), MDNode::get(C, None));
+        }
       }
+
+      if (seq_ids)
+        seq_edge = insertEdgeCounters(M, &BB, AFLMapPtr, SeqBase, seq_edge);
     }
   }
 
+  if (seq_ids) {
+
+    if (seq_edge > MAP_SIZE) {
+      WARNF("%u edges do not fit in the map, IDs wrap around MAP_SIZE.",
+            seq_edge);
+      seq_edge = MAP_SIZE;
+    }
+
+    SeqModule->setInitializer(ConstantStruct::get(
+        cast<StructType>(SeqModule->getValueType()),
+        {ConstantInt::get(Int32Ty, 0), ConstantInt::get(Int32Ty, seq_edge)}));
+
+  }
+
   /* Say something nice. */
   for (auto it = covered_targets.begin(); it != covered_targets.end(); ++it)
     std::cout << "Covered " << (*it) << std::endl;
@@ -71,6 +71,30 @@ u32 *__afl_area_dfg_last_ptr = &__afl_area_initial_dfg_last;
 
 __thread u32 __afl_prev_loc;
 
+/* Defined by the pass in modules built with DAFL_SPARSE_LAST_LOC. Their
+   blocks keep the current location in __afl_prev_loc, unshifted, instead of
+   storing it to *__afl_area_dfg_last_ptr; we copy it there when the run
+   ends, normally or on a fatal signal. */
+
+extern u8 __afl_sparse_last_loc __attribute__((weak));
+
+/* DAFL_SEQ_IDS: every module built with it leaves a record in the
+   __dafl_seq section, with the number of IDs it uses. We hand out disjoint
+   ranges of trace_bits[] by filling in the bases, and __afl_final_loc ends
+   up one past the highest ID, i.e. the number of trace_bits bytes in use.
+   It is reported to afl-fuzz in the fork server hello. */
+
+struct dafl_seq_module {
+  u32 base, count;
+};
+
+#ifdef __ELF__
+extern struct dafl_seq_module __start___dafl_seq[] __attribute__((weak));
+extern struct dafl_seq_module __stop___dafl_seq[] __attribute__((weak));
+#endif /* __ELF__ */
+
+u32 __afl_final_loc;
+
 /* Running in persistent mode? */
 
 static u8 is_persistent;
@@ -118,19 +142,123 @@ static void __afl_map_shm(void) {
 }
 
 
+/* Sparse last-location mode: flush the location of the last block. */
+
+static void __afl_flush_last_loc(void) {
+
+  *__afl_area_dfg_last_ptr = __afl_prev_loc;
+
+}
+
+
+static const int __afl_fatal_sigs[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+#define FATAL_SIG_CNT (sizeof(__afl_fatal_sigs) / sizeof(__afl_fatal_sigs[0]))
+
+static struct sigaction __afl_old_sa[FATAL_SIG_CNT];
+
+
+/* Flush, then hand the signal to whoever had it before us (ASAN, say), or
+   let it take its default course. */
+
+static void __afl_fatal_sig(int sig, siginfo_t* si, void* ctx) {
+
+  struct sigaction* old = NULL;
+  u32 i;
+
+  __afl_flush_last_loc();
+
+  for (i = 0; i < FATAL_SIG_CNT; i++)
+    if (__afl_fatal_sigs[i] == sig) old = &__afl_old_sa[i];
+
+  if (old && (old->sa_flags & SA_SIGINFO)) {
+    old->sa_sigaction(sig, si, ctx);
+    return;
+  }
+
+  if (old && old->sa_handler == SIG_IGN) return;
+
+  if (old && old->sa_handler != SIG_DFL) {
+    old->sa_handler(sig);
+    return;
+  }
+
+  signal(sig, SIG_DFL);
+  raise(sig);
+
+}
+
+
+static void __afl_setup_last_loc(void) {
+
+  struct sigaction sa;
+  u32 i;
+
+  if (!&__afl_sparse_last_loc) return;
+
+  atexit(__afl_flush_last_loc);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = __afl_fatal_sig;
+  sa.sa_flags     = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&sa.sa_mask);
+
+  for (i = 0; i < FATAL_SIG_CNT; i++)
+    sigaction(__afl_fatal_sigs[i], &sa, &__afl_old_sa[i]);
+
+}
+
+
+/* Give the DAFL_SEQ_IDS modules their bases, counting from 1. One that
+   does not fit in the map any more keeps base 0, overlapping the others,
+   and the whole map is reported as in use. Modules of shared libraries
+   have sections of their own that we don't see, and stay at 0 too. */
+
+static void __afl_setup_seq_ids(void) {
+
+#ifdef __ELF__
+
+  struct dafl_seq_module *m = __start___dafl_seq, *end = __stop___dafl_seq;
+  u32 next = 1;
+  u8  full = 0;
+
+  if (!m || m == end) return;
+
+  for (; m < end; m++) {
+
+    if ((u64)next + m->count > MAP_SIZE) {
+      full = 1;
+      continue;
+    }
+
+    m->base = next;
+    next   += m->count;
+
+  }
+
+  __afl_final_loc = full ? MAP_SIZE : next;
+
+#endif /* __ELF__ */
+
+}
+
+
 /* Fork server logic. */
 
 static void __afl_start_forkserver(void) {
 
-  static u8 tmp[4];
+  u32 hello = 0;
   s32 child_pid;
 
   u8  child_stopped = 0;
 
+  if (__afl_final_loc > 1 && __afl_final_loc <= FS_OPT_SIZE_MASK)
+    hello = FS_OPT_ENABLED | FS_OPT_MAPSIZE | __afl_final_loc;
+
   /* Phone home and tell the parent that we're OK. If parent isn't there,
      assume we're not running in forkserver mode and just execute program. */
 
-  if (write(FORKSRV_FD + 1, tmp, 4) != 4) return;
+  if (write(FORKSRV_FD + 1, &hello, 4) != 4) return;
 
   while (1) {
 
@@ -233,6 +361,8 @@ int __afl_persistent_loop(unsigned int max_cnt) {
 
     if (--cycle_cnt) {
 
+      if (&__afl_sparse_last_loc) __afl_flush_last_loc();
+
       raise(SIGSTOP);
 
       __afl_area_ptr[0] = 1;
@@ -270,6 +400,7 @@ void __afl_manual_init(void) {
   if (!init_done) {
 
     __afl_map_shm();
+    __afl_setup_last_loc();
     __afl_start_forkserver();
     init_done = 1;
 
@@ -284,6 +415,10 @@ __attribute__((constructor(CONST_PRIO))) void __afl_auto_init(void) {
 
   is_persistent = !!getenv(PERSIST_ENV_VAR);
 
+  /* Before any deferred init, so that the IDs are final from here on. */
+
+  __afl_setup_seq_ids();
+
   if (getenv(DEFER_ENV_VAR)) return;
 
   __afl_manual_init();
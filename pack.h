@@ -0,0 +1,81 @@
+/*
+   DAFL - packed queue format
+   --------------------------
+
+   With AFL_QUEUE_PACK set, afl-fuzz keeps the contents of the queue in two
+   files under <queue>/.state/pack/ instead of one file per entry:
+
+     data   - pack_header, then the entries back to back: the entry name
+              (name_len bytes, not NUL-terminated) followed by its contents
+              (len bytes). The calibration records of the entries (see
+              calcache.h) are appended to it too, instead of to a file of
+              their own. Only ever appended to.
+
+     index  - pack_header, then one pack_entry per queue entry id. When an
+              entry is trimmed or recalibrated, its new contents or record
+              are appended to data and its pack_entry is rewritten in place.
+
+   data is always written before index, so a record never points past the
+   end of data after a crash; readers ignore records that do, and the ones
+   that are still all zero. Everything is in native byte order.
+
+   afl-queue-export writes the entries of a pack out as regular files, for
+   afl-cmin and other tools that expect the classic queue/ layout.
+*/
+
+#ifndef _HAVE_PACK_H
+#define _HAVE_PACK_H
+
+#include "types.h"
+
+#define PACK_DATA_MAGIC  "DAFLPACK"
+#define PACK_INDEX_MAGIC "DAFLPIDX"
+#define PACK_VERSION     2
+
+struct pack_header {
+
+  u8  magic[8];                       /* PACK_*_MAGIC, not NUL-terminated */
+  u32 version;                        /* PACK_VERSION                     */
+  u32 record_size;                    /* sizeof(struct pack_entry)        */
+
+};
+
+struct pack_entry {
+
+  u64 offset;                         /* Contents, from start of data     */
+  u32 len;                            /* Input length                     */
+  u32 name_len;                       /* Name, right before the contents  */
+  u64 cal_off;                        /* Calibration record in data       */
+  u32 cal_len,                        /* Its size, 0 if none              */
+      pad;
+
+};
+
+/* Checks a pack_entry against the size of data. Returns the entry name,
+   or NULL if the record is unused or does not fit. */
+
+static inline u8* pack_entry_name(u8* data, u64 data_len,
+                                  struct pack_entry* e) {
+
+  if (!e->name_len || e->offset < sizeof(struct pack_header) + e->name_len ||
+      e->offset > data_len || e->len > data_len - e->offset) return NULL;
+
+  return data + e->offset - e->name_len;
+
+}
+
+/* Same for the calibration record of an entry. Returns NULL if there is
+   none or it does not fit; the record itself is not checked. */
+
+static inline u8* pack_entry_cal(u8* data, u64 data_len,
+                                 struct pack_entry* e) {
+
+  if (!e->cal_len || e->cal_off < sizeof(struct pack_header) ||
+      e->cal_off > data_len || e->cal_len > data_len - e->cal_off)
+    return NULL;
+
+  return data + e->cal_off;
+
+}
+
+#endif /* !_HAVE_PACK_H */
@@ -0,0 +1,216 @@
+/*
+   DAFL - sync daemon protocol
+   ---------------------------
+
+   afl-syncd relays queue entries between afl-fuzz instances that run with
+   AFL_SYNCD=<address>, over a UNIX socket (an address containing a '/')
+   or TCP (host:port). It replaces the filesystem sync of -M / -S for
+   those instances, and works the same for local and remote peers.
+
+   Every message is a SYNCD_HDR_LEN byte header (magic, type, payload
+   length) followed by the payload. All integers on the wire are u32,
+   little-endian; use syncd_put32() and syncd_get32().
+
+     HELLO  client -> daemon, once, right after connecting:
+            u32 SYNCD_VERSION, then the sync ID of the instance (the rest
+            of the payload). The daemon starts sending the cases it holds
+            from other instances. If the sync ID is connected already, the
+            daemon closes the connection instead.
+
+     PUSH   client -> daemon: a new queue entry, as a case record with
+            origin_len = 0.
+
+     CASE   daemon -> client: a case pushed by another instance, as a case
+            record with the origin sync ID filled in.
+
+   A case record is the fields of SYNCD_CASE_* (u32 each), followed by the
+   origin sync ID (origin_len bytes), the input (data_len bytes) and the
+   metadata (meta_len bytes). The metadata is the calibration record of
+   the entry (see calcache.h) if the sender had one; it is opaque to the
+   daemon and checked by the receiver against its own target binary, so a
+   record from a different build or byte order is simply not used.
+
+   The daemon drops cases whose contents it has seen already, and cases
+   that repeat the DFG path, trace and valuation of an earlier one.
+*/
+
+#ifndef _HAVE_SYNCD_H
+#define _HAVE_SYNCD_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "types.h"
+
+#define SYNCD_MAGIC       0x4e595344 /* "DSYN" */
+#define SYNCD_VERSION     1
+
+/* Upper bound on the payload of a message. */
+
+#define SYNCD_MAX_MSG     (4 * 1024 * 1024)
+
+enum syncd_type {
+  SYNCD_HELLO = 1,
+  SYNCD_PUSH,
+  SYNCD_CASE
+};
+
+/* Header: magic, type, payload length. */
+
+#define SYNCD_HDR_LEN     12
+
+/* Case record fields, in wire order. */
+
+enum syncd_case_field {
+  SYNCD_CASE_ID = 0,                  /* Entry ID at the origin           */
+  SYNCD_CASE_HASH,                    /* Content hash                     */
+  SYNCD_CASE_EXEC_CKSUM,              /* Trace checksum, 0 if unknown     */
+  SYNCD_CASE_DFG_CKSUM,               /* DFG path checksum                */
+  SYNCD_CASE_VAL_HASH,                /* Valuation hash, 0 if none        */
+  SYNCD_CASE_ORIGIN_LEN,
+  SYNCD_CASE_DATA_LEN,
+  SYNCD_CASE_META_LEN,
+  SYNCD_CASE_FIELDS
+};
+
+#define SYNCD_CASE_LEN    (SYNCD_CASE_FIELDS * 4)
+
+static inline void syncd_put32(u8* p, u32 v) {
+
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+
+}
+
+static inline u32 syncd_get32(u8* p) {
+
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+
+}
+
+static inline void syncd_put_hdr(u8* p, u32 type, u32 len) {
+
+  syncd_put32(p, SYNCD_MAGIC);
+  syncd_put32(p + 4, type);
+  syncd_put32(p + 8, len);
+
+}
+
+/* Checks a case record of len bytes. Returns 1 if the lengths add up. */
+
+static inline u8 syncd_case_ok(u8* p, u32 len) {
+
+  u64 need;
+
+  if (len < SYNCD_CASE_LEN) return 0;
+
+  need = (u64)SYNCD_CASE_LEN + syncd_get32(p + SYNCD_CASE_ORIGIN_LEN * 4) +
+         syncd_get32(p + SYNCD_CASE_DATA_LEN * 4) +
+         syncd_get32(p + SYNCD_CASE_META_LEN * 4);
+
+  return need == len;
+
+}
+
+/* Opens a socket on addr: a UNIX socket path if it contains a '/',
+   [host]:port otherwise. With listening set, binds and listens on it
+   (an empty host or "*" means all interfaces); otherwise connects to it.
+   Returns the descriptor, or -1 with errno set. */
+
+static inline s32 syncd_open(u8* addr, u8 listening) {
+
+  struct addrinfo hints, *res, *ai;
+  u8 *colon, *host;
+  s32 fd = -1, one = 1;
+
+  if (strchr((char*)addr, '/')) {
+
+    struct sockaddr_un sun;
+
+    if (strlen((char*)addr) >= sizeof(sun.sun_path)) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, (char*)addr);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (listening) unlink((char*)addr); /* ignore errors */
+
+    if (listening ? bind(fd, (struct sockaddr*)&sun, sizeof(sun)) ||
+                    listen(fd, 64)
+                  : connect(fd, (struct sockaddr*)&sun, sizeof(sun))) {
+      close(fd);
+      return -1;
+    }
+
+    return fd;
+
+  }
+
+  colon = (u8*)strrchr((char*)addr, ':');
+
+  if (!colon || !colon[1]) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  host = (u8*)strndup((char*)addr, colon - addr);
+  if (!host) return -1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags    = listening ? AI_PASSIVE : 0;
+
+  if (getaddrinfo((!host[0] || !strcmp((char*)host, "*")) ? NULL : (char*)host,
+                  (char*)colon + 1, &hints, &res)) {
+    free(host);
+    errno = EADDRNOTAVAIL;
+    return -1;
+  }
+
+  free(host);
+
+  for (ai = res; ai; ai = ai->ai_next) {
+
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+
+    if (listening) {
+
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (!bind(fd, ai->ai_addr, ai->ai_addrlen) && !listen(fd, 64)) break;
+
+    } else {
+
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      if (!connect(fd, ai->ai_addr, ai->ai_addrlen)) break;
+
+    }
+
+    close(fd);
+    fd = -1;
+
+  }
+
+  freeaddrinfo(res);
+  return fd;
+
+}
+
+#endif /* !_HAVE_SYNCD_H */
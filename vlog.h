@@ -0,0 +1,40 @@
+/*
+   DAFL - binary mutation log format
+   ---------------------------------
+
+   afl-fuzz records every mutator selection (deterministic stages and each
+   stacked havoc mutation) into <out_dir>/vertical.bin. The file is a
+   vlog_header followed by fixed-size vlog_record entries in native byte
+   order. afl-vlog-decode turns it back into the vertical.log CSV:
+
+     kind,persistent,interesting,new_valuation,mutator,location
+*/
+
+#ifndef _HAVE_VLOG_H
+#define _HAVE_VLOG_H
+
+#include "types.h"
+
+#define VLOG_MAGIC    "DAFLVLOG"
+#define VLOG_VERSION  1
+
+struct vlog_header {
+
+  u8  magic[8];                       /* VLOG_MAGIC, not NUL-terminated   */
+  u32 version;                        /* VLOG_VERSION                     */
+  u32 record_size;                    /* sizeof(struct vlog_record)       */
+
+};
+
+struct vlog_record {
+
+  u8  kind;                           /* 'd' (deterministic) or 'v'       */
+  u8  persistent;                     /* vertical_is_persistent           */
+  u8  interesting;                    /* vertical_is_interesting          */
+  u8  new_valuation;                  /* vertical_is_new_valuation        */
+  u32 mutator;                        /* Mutator (operator) index         */
+  double location;                    /* Relative location, 0.0 - 1.0     */
+
+};
+
+#endif /* !_HAVE_VLOG_H */